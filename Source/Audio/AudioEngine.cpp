@@ -1,170 +1,1560 @@
 #include "AudioEngine.h"
 
+namespace
+{
+    // Segna l'audio thread dentro il callback: waitForAudioThread attende che l'epoca cambi
+    struct ScopedCallbackEpoch
+    {
+        explicit ScopedCallbackEpoch(std::atomic<juce::uint32>& e) : epoch(e) { epoch.fetch_add(1); }
+        ~ScopedCallbackEpoch() { epoch.fetch_add(1); }
+
+        std::atomic<juce::uint32>& epoch;
+    };
+}
+
 AudioEngine::AudioEngine()
 {
-    formatManager.registerBasicFormats();
-    thread.startThread(juce::Thread::Priority::normal);
-    setAudioChannels(0, 2);
+    formatManager.registerBasicFormats();
+    // Nessun ingresso all'avvio: si aprono quando servono (openInputChannels)
+    setAudioChannels(0, maxOutputChannels);
+
+    // La timeline usa la frequenza del dispositivo: nel caso comune i clip non vanno ricampionati
+    if (auto* device = deviceManager.getCurrentAudioDevice())
+        if (device->getCurrentSampleRate() > 0.0)
+            timelineSampleRate = device->getCurrentSampleRate();
+
+    musicalClock.setTempo(currentBPM);
+
+    // Appena un file compresso è decodificato, i clip che lo usano passano alla lettura mappata
+    decodedFiles.onFileDecoded = [safeThis = juce::Component::SafePointer<AudioEngine>(this)](const juce::File& file)
+    {
+        if (safeThis == nullptr)
+            return;
+
+        for (auto& [id, source] : safeThis->trackSources)
+            source->clipSource->reopenFile(file);
+    };
+}
+
+AudioEngine::~AudioEngine()
+{
+    recorder.stop();
+    shutdownAudio();
+
+    // Senza piano i nodi appartengono solo alle mappe: si staccano dai worker mentre vengono distrutti
+    activePlan.store(nullptr);
+    processingPlan.reset();
+    midiTracks.clear();
+    trackSources.clear();
+
+    for (auto& [id, convolution] : busConvolutions)
+        convolutionWorkers.removeReverb(convolution.reverb.get());
+
+    if (RealtimeChecker::enabled)
+        juce::Logger::writeToLog("AudioEngine: " + juce::String(RealtimeChecker::getNumViolations()) + " real-time violations on the audio thread");
+}
+
+void AudioEngine::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    const juce::ScopedLock lock(sourceLock);
+
+    currentSampleRate = sampleRate;
+    preparedBlockSize = samplesPerBlockExpected;
+    mixBlockSize = juce::jmax(samplesPerBlockExpected, 1024);
+
+    for (auto const& busId : routingGraph.getBusIds())
+        routingGraph.getBusChannel(busId)->meter.prepare(sampleRate);
+
+    // La latenza del bus master dipende dalla frequenza: le compensazioni vanno ricalcolate.
+    // Il piano in uso resta valido: finché arriva il nuovo, il callback divide i blocchi sui suoi slot.
+    juce::MessageManager::callAsync([safeThis = juce::Component::SafePointer<AudioEngine>(this)]
+    {
+        if (safeThis != nullptr)
+        {
+            safeThis->rebuildProcessingPlan();
+
+            // Anche gli strumenti dei worker vanno preparati alla nuova frequenza
+            for (auto const& [id, track] : safeThis->midiTracks)
+                safeThis->updatePrerendering(id);
+
+            // E le risposte all'impulso ricampionate
+            std::vector<int> staleReverbs;
+            for (auto const& [id, convolution] : safeThis->busConvolutions)
+                if (convolution.sampleRate != safeThis->currentSampleRate.load())
+                    staleReverbs.push_back(id);
+
+            for (int busId : staleReverbs)
+            {
+                const auto& convolution = safeThis->busConvolutions.at(busId);
+                safeThis->setBusConvolution(busId, juce::File(convolution.file), convolution.wetLevel, convolution.dryLevel);
+            }
+        }
+    });
+
+    for (auto& [id, source] : trackSources)
+    {
+        source->prepare(sampleRate, mixBlockSize);
+        source->channel->meter.prepare(sampleRate);
+    }
+
+    for (auto& [id, track] : midiTracks)
+        if (track->instrument)
+            track->instrument->prepare(sampleRate, samplesPerBlockExpected);
+
+    // Spazio per qualche migliaio di eventi per blocco senza riallocare sull'audio thread
+    midiBlock.ensureSize(32768);
+
+    masterBus.prepare(sampleRate, samplesPerBlockExpected);
+    musicalClock.prepare(sampleRate);
+    masterMeter.prepare(sampleRate);
+    masterLoudness.prepare(sampleRate);
+    spectrumAnalyzer.setSampleRate(sampleRate);
+}
+
+void AudioEngine::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    const RealtimeChecker::ScopedRealtimeSection realtimeSection;
+    const ScopedCallbackEpoch callbackScope(callbackEpoch);
+    AW_TRACE_SCOPE("Audio callback");
+
+    // Gli ingressi sono nel buffer solo prima che il mixer lo sovrascriva: vanno catturati subito
+    recorder.captureInputs(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
+
+    // Nessun lock: tracce, curve e riverberi arrivano tutti dal piano pubblicato
+    auto& output = *bufferToFill.buffer;
+    bufferToFill.clearActiveBufferRegion();
+
+    // CORREZIONE DEFINITIVA: Rimosso il check sul numero di sorgenti.
+    // Se l'engine non sta suonando, esci (la coda del lookahead si svuota e il meter master scende a zero).
+    // Un solo caricamento del piano per callback: non può cambiare a metà del blocco.
+    auto* plan = activePlan.load();
+    const int blockSize = plan != nullptr ? juce::jmin(mixBlockSize.load(), plan->maxBlockSize) : mixBlockSize.load();
+
+    if (!engineIsPlaying || blockSize == 0)
+    {
+        // Transport appena fermato: le tracce rilasciano le note qui, dove vivono i loro strumenti
+        if (wasPlaying && plan != nullptr)
+            for (auto& step : plan->steps)
+                if (step.track != nullptr)
+                    step.track->stopped();
+        wasPlaying = false;
+
+        masterBus.process(output, bufferToFill.startSample, bufferToFill.numSamples);
+        masterMeter.process(output, bufferToFill.startSample, bufferToFill.numSamples);
+        if (analyzerSource.load(std::memory_order_relaxed) == 0)
+            analyzerTap.push(output, bufferToFill.startSample, bufferToFill.numSamples);
+        return;
+    }
+
+    wasPlaying = true;
+    if (clockResetRequested.exchange(false))
+        musicalClock.reset();
+
+    juce::int64 meteringTicks = 0;
+    const double timelinePerSample = timelineSampleRate / juce::jmax(1.0, currentSampleRate.load());
+
+    // Gli slot del piano e i buffer dell'automazione hanno una dimensione fissa: blocchi più lunghi vengono divisi
+    for (int offset = 0; offset < bufferToFill.numSamples;)
+    {
+        const int chunk = juce::jmin(bufferToFill.numSamples - offset, blockSize);
+
+        // Il mix arriva al bus master in ritardo della compensazione: l'automazione lo segue
+        const int mixLatency = plan != nullptr ? plan->mixLatency : 0;
+        const double masterPosition = timelinePosition - mixLatency * timelinePerSample;
+        const auto masterAutomation = plan != nullptr ? plan->renderMasterAutomation(masterPosition, timelinePerSample, chunk)
+                                                      : MasterBus::ParameterBuffers();
+
+        meteringTicks += mixTracks(plan, output, bufferToFill.startSample + offset, chunk);
+
+        // Guadagno master, limiter true-peak e dither: il meter misura ciò che esce davvero
+        masterBus.process(output, bufferToFill.startSample + offset, chunk, masterAutomation);
+        offset += chunk;
+    }
+
+    const auto masterStart = juce::Time::getHighResolutionTicks();
+    masterMeter.process(output, bufferToFill.startSample, bufferToFill.numSamples);
+    masterLoudness.process(output, bufferToFill.startSample, bufferToFill.numSamples);
+    meteringTicks += juce::Time::getHighResolutionTicks() - masterStart;
+
+    // L'analizzatore riceve solo una copia: la FFT gira sul suo thread
+    if (analyzerSource.load(std::memory_order_relaxed) == 0)
+        analyzerTap.push(output, bufferToFill.startSample, bufferToFill.numSamples);
+
+    // Costo del metering rispetto alla durata del blocco
+    const double budgetSeconds = bufferToFill.numSamples / juce::jmax(1.0, currentSampleRate.load());
+    const auto load = (float) (juce::Time::highResolutionTicksToSeconds(meteringTicks) / budgetSeconds);
+    meteringLoad.store(0.95f * meteringLoad.load(std::memory_order_relaxed) + 0.05f * load, std::memory_order_relaxed);
+}
+
+juce::int64 AudioEngine::mixTracks(ProcessingPlan* plan, juce::AudioBuffer<float>& output, int startSample, int numSamples)
+{
+    const double timelinePerSample = timelineSampleRate / juce::jmax(1.0, currentSampleRate.load());
+    musicalClock.beginBlock();
+
+    // Le tracce si rendono dai loro nodi; instradamento, fader, mandate e bus sono del piano
+    const juce::int64 meteringTicks = plan != nullptr ? plan->process(output, startSample, numSamples, timelinePosition, timelinePerSample)
+                                                      : 0;
+
+    musicalClock.advance(numSamples);
+    devicePosition += numSamples;
+
+    // La timeline avanza in campioni propri, che possono differire da quelli del dispositivo
+    timelinePosition += numSamples * timelinePerSample;
+    publishedTimelinePosition.store((juce::int64) timelinePosition, std::memory_order_relaxed);
+
+    return meteringTicks;
+}
+
+void AudioEngine::tapTrack(int trackId, const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    // L'analizzatore riceve solo una copia: la FFT gira sul suo thread
+    if (trackId == analyzerSource.load(std::memory_order_relaxed))
+        analyzerTap.push(buffer, 0, numSamples);
+}
+
+//==============================================================================
+AudioEngine::TrackAudioSource::TrackAudioSource(AudioEngine& owner, int id, std::unique_ptr<ClipTrackSource> clips)
+    : engine(owner), trackId(id), clipSource(std::move(clips))
+{
+    // Il read-ahead è gestito dal DiskStreamer: la traccia non usa un proprio buffer
+    streamingSource = std::make_unique<StreamingAudioSource>(clipSource.get(), false, engine.timelineSampleRate);
+    engine.diskStreamer.addSource(streamingSource.get());
+}
+
+AudioEngine::TrackAudioSource::~TrackAudioSource()
+{
+    // Mai sull'audio thread: removeSource può attendere che un worker finisca di leggere
+    engine.diskStreamer.removeSource(streamingSource.get());
+}
+
+void AudioEngine::TrackAudioSource::prepare(double deviceSampleRate, int maxBlockSize)
+{
+    resampling = deviceSampleRate > 0.0 && deviceSampleRate != engine.timelineSampleRate;
+    if (!resampling)
+        return;
+
+    if (resampler == nullptr)
+        resampler = std::make_unique<juce::ResamplingAudioSource>(streamingSource.get(), false, 2);
+
+    // Preparato per il passo più lungo del piano: getNextAudioBlock non rialloca mai
+    resampler->setResamplingRatio(engine.timelineSampleRate / deviceSampleRate);
+    resampler->prepareToPlay(maxBlockSize, deviceSampleRate);
+}
+
+void AudioEngine::TrackAudioSource::release()
+{
+    if (resampler != nullptr)
+        resampler->releaseResources();
+}
+
+AudioEngine::MidiTrackSource::~MidiTrackSource()
+{
+    if (prerendered != nullptr)
+        engine.prerenderer.removeTrack(prerendered.get());
+}
+
+void AudioEngine::MidiTrackSource::stopped()
+{
+    if (instrument != nullptr)
+        instrument->allNotesOff();
+}
+
+bool AudioEngine::renderAudioTrack(TrackAudioSource& source, juce::AudioBuffer<float>& buffer,
+                                   int numSamples, juce::int64& meteringTicks)
+{
+    if (!source.channel)
+        return false;
+
+    adoptLaunchRequest(source);
+
+    if (!isAudible(*source.channel))
+    {
+        // Traccia silenziata: lancio e stop valgono dall'inizio del blocco, nessun campione da dividere
+        if (isLaunchActionDue(source, numSamples))
+            applyLaunchAction(source);
+
+        if (source.launchStopped)
+            source.channel->meter.processSilence(numSamples);
+        else
+            meteringTicks += skipTrack(source, numSamples);
+        return false;
+    }
+
+    if (source.launchStopped && !isLaunchActionDue(source, numSamples))
+    {
+        // Ferma in attesa di un lancio: la posizione resta dov'è
+        source.channel->meter.processSilence(numSamples);
+        return false;
+    }
+
+    if (!source.wasAudible)
+    {
+        // Torna attiva. Di norma il message thread l'ha già svegliata con un prefill poco più avanti
+        // (prefillTracksBecomingAudible); altrimenti lo streaming riparte dalla posizione raggiunta "a vuoto"
+        source.wasAudible = true;
+        if (source.streamingSource->isDormant())
+            source.streamingSource->setDormant(false);
+    }
+
+    renderLaunchableTrack(source, buffer, numSamples);
+    tapTrack(source.trackId, buffer, numSamples);
+
+    const auto meterStart = juce::Time::getHighResolutionTicks();
+    source.channel->meter.process(buffer, 0, numSamples);
+    meteringTicks += juce::Time::getHighResolutionTicks() - meterStart;
+    return true;
+}
+
+void AudioEngine::adoptLaunchRequest(TrackAudioSource& source)
+{
+    const int request = source.channel->launchRequest.exchange(0, std::memory_order_acquire);
+    if (request == 0)
+        return;
+
+    // Il confine si fissa in battiti: se il tempo cambia prima di arrivarci, il lancio lo segue
+    source.pendingLaunchAction = request & 0xf;
+    source.pendingLaunchBeat = musicalClock.getNextBoundary((Quantization) (request >> 4));
+}
+
+bool AudioEngine::isLaunchActionDue(const TrackAudioSource& source, int numSamples) const
+{
+    return source.pendingLaunchAction != launchActionNone
+           && musicalClock.getSampleOffsetOf(source.pendingLaunchBeat) < numSamples;
+}
+
+void AudioEngine::applyLaunchAction(TrackAudioSource& source)
+{
+    if (source.pendingLaunchAction == launchActionStart)
+    {
+        source.launchStopped = false;
+        source.skipRemainder = 0.0;
+        // Niente wakeUp: il WaitableEvent prende un mutex. I worker ricontrollano le sorgenti
+        // almeno ogni 10 ms, e la testa in memoria copre ben più di quell'attesa.
+        source.streamingSource->launchFromStart();
+    }
+    else if (source.pendingLaunchAction == launchActionStop)
+    {
+        source.launchStopped = true;
+    }
+
+    source.channel->launched.store(!source.launchStopped, std::memory_order_relaxed);
+    source.pendingLaunchAction = launchActionNone;
+}
+
+void AudioEngine::renderLaunchableTrack(TrackAudioSource& source, juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    for (int done = 0; done < numSamples;)
+    {
+        // Il segmento finisce sul campione dell'azione in attesa, anche a metà blocco
+        int segmentEnd = numSamples;
+        if (source.pendingLaunchAction != launchActionNone)
+        {
+            const auto offset = musicalClock.getSampleOffsetOf(source.pendingLaunchBeat);
+            if (offset <= done)
+            {
+                applyLaunchAction(source);
+                continue;
+            }
+            segmentEnd = (int) juce::jmin<juce::int64>(numSamples, offset);
+        }
+
+        if (source.launchStopped)
+        {
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                buffer.clear(ch, done, segmentEnd - done);
+        }
+        else
+        {
+            juce::AudioSourceChannelInfo segment(&buffer, done, segmentEnd - done);
+            if (source.resampling)
+                source.resampler->getNextAudioBlock(segment);
+            else
+                source.streamingSource->getNextAudioBlock(segment);
+        }
+
+        done = segmentEnd;
+    }
+}
+
+bool AudioEngine::renderMidiTrack(MidiTrackSource& track, juce::AudioBuffer<float>& buffer,
+                                  int numSamples, juce::int64& meteringTicks)
+{
+    if (!track.instrument || !track.channel)
+        return false;
+
+    const double ratio = timelineSampleRate / juce::jmax(1.0, currentSampleRate.load());
+
+    if (track.prerendered != nullptr)
+    {
+        auto& lane = *track.prerendered;
+        lane.begin(devicePosition, timelinePosition, ratio);
+
+        if (isAudible(*track.channel) && lane.read(buffer, devicePosition, numSamples))
+        {
+            // Da qui il worker è avanti al callback: lo strumento dal vivo tace
+            if (!track.playingPrerendered)
+                track.instrument->allNotesOff();
+            track.playingPrerendered = true;
+            tapTrack(track.trackId, buffer, numSamples);
+
+            const auto meterStart = juce::Time::getHighResolutionTicks();
+            track.channel->meter.process(buffer, 0, numSamples);
+            meteringTicks += juce::Time::getHighResolutionTicks() - meterStart;
+            return true;
+        }
+
+        lane.skip(devicePosition, numSamples);
+
+        if (track.playingPrerendered)
+        {
+            // Lo stato dello strumento è nel worker: in ritardo si suona silenzio, come un underrun del disco
+            if (isAudible(*track.channel))
+                lane.reportUnderrun();
+            track.channel->meter.processSilence(numSamples);
+            return false;
+        }
+
+        // Il ring non copre ancora il blocco: si rende dal vivo fino al passaggio
+    }
+
+    if (!isAudible(*track.channel))
+    {
+        // Traccia silenziata: nessun rendering, e nessuna nota appesa al ritorno
+        if (track.wasAudible)
+            track.instrument->allNotesOff();
+        track.wasAudible = false;
+        track.channel->meter.processSilence(numSamples);
+        return false;
+    }
+
+    track.wasAudible = true;
+
+    midiBlock.clear();
+    if (track.events != nullptr)
+        SamplerInstrument::collectEvents(*track.events, midiBlock, timelinePosition, ratio, numSamples);
+
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        buffer.clear(ch, 0, numSamples);
+
+    track.instrument->render(buffer, midiBlock, 0, numSamples);
+    tapTrack(track.trackId, buffer, numSamples);
+
+    const auto meterStart = juce::Time::getHighResolutionTicks();
+    track.channel->meter.process(buffer, 0, numSamples);
+    meteringTicks += juce::Time::getHighResolutionTicks() - meterStart;
+    return true;
+}
+
+bool AudioEngine::isAudible(const TrackChannel& channel) const
+{
+    const bool anySoloed = numSoloedTracks.load(std::memory_order_relaxed) > 0;
+    return !channel.muted.load(std::memory_order_relaxed)
+           && (!anySoloed || channel.soloed.load(std::memory_order_relaxed));
+}
+
+juce::int64 AudioEngine::skipTrack(TrackAudioSource& source, int numSamples)
+{
+    if (source.wasAudible)
+    {
+        source.wasAudible = false;
+        source.skipRemainder = 0.0;
+        source.streamingSource->setDormant(true);
+    }
+
+    // Niente decodifica, resampling o mix: la posizione avanza in aritmetica
+    // (in campioni della timeline, che può avere una frequenza diversa dal dispositivo)
+    const double ratio = source.streamingSource->getSourceSampleRate() / juce::jmax(1.0, currentSampleRate.load());
+    const double frames = numSamples * ratio + source.skipRemainder;
+    const auto wholeFrames = (juce::int64) frames;
+    source.skipRemainder = frames - (double) wholeFrames;
+    source.streamingSource->skipFrames(wholeFrames);
+
+    const auto meterStart = juce::Time::getHighResolutionTicks();
+    source.channel->meter.processSilence(numSamples);
+    return juce::Time::getHighResolutionTicks() - meterStart;
+}
+
+void AudioEngine::releaseResources()
+{
+    const juce::ScopedLock lock(sourceLock);
+    preparedBlockSize = 0;
+
+    for (auto& [id, source] : trackSources)
+        source->release();
+}
+
+bool AudioEngine::loadFile(const juce::File& file, int trackId)
+{
+    juce::Logger::writeToLog("AudioEngine: Loading file: " + file.getFullPathName() + " for track " + juce::String(trackId));
+
+    if (!file.existsAsFile())
+    {
+        juce::Logger::writeToLog("AudioEngine Error: File does not exist: " + file.getFullPathName());
+        return false;
+    }
+
+    // Il file diventa un unico clip all'inizio della timeline, ripetuto in loop come prima
+    auto clipSource = std::make_unique<ClipTrackSource>(formatManager, timelineSampleRate, &decodedFiles);
+    Clip clip;
+    clip.file = file;
+
+    if (clipSource->addClip(clip) < 0)
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot create reader for: " + file.getFullPathName());
+        return false;
+    }
+
+    clipSource->setLooping(true);
+    installTrackAudio(trackId, std::move(clipSource));
+
+    juce::Logger::writeToLog("AudioEngine: File loaded successfully for track " + juce::String(trackId));
+
+    juce::MessageManager::callAsync([this, file, trackId]() {
+        listeners.call(&Listener::fileLoaded, file, trackId);
+    });
+
+    return true;
+}
+
+void AudioEngine::installTrackAudio(int trackId, std::unique_ptr<ClipTrackSource> clipSource)
+{
+    auto newSource = std::make_shared<TrackAudioSource>(*this, trackId, std::move(clipSource));
+    newSource->channel = getOrCreateTrackChannel(trackId);
+
+    std::shared_ptr<TrackAudioSource> oldSource;
+    {
+        const juce::ScopedLock lock(sourceLock);
+        if (preparedBlockSize > 0)
+            newSource->prepare(currentSampleRate, mixBlockSize);
+
+        oldSource = std::exchange(trackSources[trackId], newSource);
+    }
+
+    // Dopo la pubblicazione nessun callback raggiunge più la catena precedente: viene distrutta qui
+    rebuildProcessingPlan();
+    oldSource.reset();
+    memoryBudget.remove(getLaunchHeadKey(trackId)); // Apparteneva alla catena sostituita
+}
+
+void AudioEngine::ClipEdit::include(const ClipTrackSource& source, int clipId)
+{
+    ResolvedClip resolved;
+    if (!source.getResolvedClip(clipId, resolved))
+        return;
+
+    start = juce::jmin(start, resolved.clip.timelineStart);
+    end = juce::jmax(end, resolved.clip.getTimelineEnd());
+}
+
+void AudioEngine::refreshTrackAudio(int trackId, const ClipEdit* edit)
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return;
+
+    auto* streaming = it->second->streamingSource.get();
+    const auto length = streaming->getTotalLength();
+
+    // Con il loop una durata diversa sposta il punto di ritorno: tutto ciò che è oltre va riletto
+    const bool loopMoved = edit == nullptr || (streaming->isLooping() && edit->lengthBefore != length);
+
+    // La testa per i lanci non corrisponde più all'arrangiamento: verrà ricostruita al prossimo lancio.
+    // Il callback in corso può ancora leggerla: la si libera solo quando è terminato.
+    if (loopMoved || edit->start < launchHeadFrames)
+    {
+        streaming->setLaunchHead(nullptr);
+        waitForAudioThread();
+        memoryBudget.remove(getLaunchHeadKey(trackId));
+    }
+
+    // Una traccia ferma oltre la fine riprende a leggere solo se la nuova fine la raggiunge
+    const bool pastEnd = edit != nullptr && !streaming->isLooping()
+                         && streaming->getNextReadPosition() >= juce::jmin(edit->lengthBefore, length);
+
+    if (loopMoved || pastEnd || streaming->mayHaveReadAhead(edit->start, edit->end))
+    {
+        streaming->setNextReadPosition(streaming->getNextReadPosition());
+        diskStreamer.wakeUp();
+    }
+}
+
+ClipTrackSource& AudioEngine::getOrCreateClipSource(int trackId)
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+    {
+        installTrackAudio(trackId, std::make_unique<ClipTrackSource>(formatManager, timelineSampleRate, &decodedFiles));
+        it = trackSources.find(trackId);
+    }
+    return *it->second->clipSource;
+}
+
+int AudioEngine::addClip(int trackId, const Clip& clip)
+{
+    auto& clipSource = getOrCreateClipSource(trackId);
+    ClipEdit edit;
+    edit.lengthBefore = clipSource.getTotalLength();
+
+    const int clipId = clipSource.addClip(clip);
+    if (clipId < 0)
+        return -1;
+
+    edit.include(clipSource, clipId);
+    refreshTrackAudio(trackId, &edit);
+    juce::Logger::writeToLog("AudioEngine: Clip " + juce::String(clipId) + " added to track " + juce::String(trackId));
+    return clipId;
+}
+
+bool AudioEngine::updateClip(int trackId, const Clip& clip)
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return false;
+
+    auto& clipSource = *it->second->clipSource;
+    ClipEdit edit;
+    edit.lengthBefore = clipSource.getTotalLength();
+    edit.include(clipSource, clip.id);
+
+    if (!clipSource.updateClip(clip))
+        return false;
+
+    edit.include(clipSource, clip.id);
+    refreshTrackAudio(trackId, &edit);
+    return true;
+}
+
+bool AudioEngine::removeClip(int trackId, int clipId)
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return false;
+
+    auto& clipSource = *it->second->clipSource;
+    ClipEdit edit;
+    edit.lengthBefore = clipSource.getTotalLength();
+    edit.include(clipSource, clipId);
+
+    if (!clipSource.removeClip(clipId))
+        return false;
+
+    refreshTrackAudio(trackId, &edit);
+    return true;
+}
+
+void AudioEngine::setTrackLooping(int trackId, bool shouldLoop)
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return;
+
+    it->second->clipSource->setLooping(shouldLoop);
+    refreshTrackAudio(trackId);
+}
+
+bool AudioEngine::setMidiTrackInstrument(int trackId, const std::vector<SamplerInstrument::Zone>& zones)
+{
+    // Voci e campioni si preparano qui: l'audio thread riceve uno strumento già pronto
+    auto instrument = std::make_shared<SamplerInstrument>();
+    const bool allLoaded = instrument->setZones(zones, sampleCache);
+
+    {
+        const juce::ScopedLock lock(sourceLock);
+        if (preparedBlockSize > 0)
+            instrument->prepare(currentSampleRate, preparedBlockSize);
+    }
+
+    auto track = copyMidiTrack(trackId);
+    track->instrument = std::move(instrument);
+    track->wasAudible = true; // Strumento nuovo: nessuna nota da rilasciare
+    track->zones = zones;
+    installMidiTrack(trackId, std::move(track));
+
+    juce::Logger::writeToLog("AudioEngine: Sampler with " + juce::String((int) zones.size()) + " zones set on track " + juce::String(trackId));
+    return allLoaded;
+}
+
+bool AudioEngine::setMidiTrackSequence(int trackId, const juce::MidiMessageSequence& sequence)
+{
+    auto events = std::make_shared<std::vector<TimedMidiEvent>>();
+    events->reserve((size_t) sequence.getNumEvents());
+
+    for (auto* holder : sequence)
+    {
+        const auto& message = holder->message;
+        if (message.isNoteOnOrOff() || message.isController() || message.isPitchWheel() || message.isAllNotesOff())
+            events->push_back({ (juce::int64) std::llround(message.getTimeStamp() * timelineSampleRate), message });
+    }
+
+    std::stable_sort(events->begin(), events->end(),
+                     [](const TimedMidiEvent& a, const TimedMidiEvent& b) { return a.time < b.time; });
+
+    auto track = copyMidiTrack(trackId);
+    track->events = std::move(events);
+    installMidiTrack(trackId, std::move(track));
+
+    return true;
+}
+
+bool AudioEngine::loadMidiFile(const juce::File& file, int trackId)
+{
+    juce::FileInputStream stream(file);
+    juce::MidiFile midiFile;
+
+    if (!stream.openedOk() || !midiFile.readFrom(stream))
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot read MIDI file: " + file.getFullPathName());
+        return false;
+    }
+
+    midiFile.convertTimestampTicksToSeconds();
+
+    juce::MidiMessageSequence merged;
+    for (int i = 0; i < midiFile.getNumTracks(); ++i)
+        merged.addSequence(*midiFile.getTrack(i), 0.0);
+    merged.updateMatchedPairs();
+
+    juce::Logger::writeToLog("AudioEngine: MIDI file loaded for track " + juce::String(trackId));
+    return setMidiTrackSequence(trackId, merged);
+}
+
+void AudioEngine::setAnticipativeRendering(bool shouldPrerender)
+{
+    if (anticipativeRendering == shouldPrerender)
+        return;
+
+    anticipativeRendering = shouldPrerender;
+    for (auto const& [id, track] : midiTracks)
+        updatePrerendering(id);
+
+    juce::Logger::writeToLog(juce::String("AudioEngine: Anticipative rendering ") + (shouldPrerender ? "enabled" : "disabled"));
+}
+
+void AudioEngine::setTrackLive(int trackId, bool isLive)
+{
+    const bool wasLive = liveTracks.count(trackId) > 0;
+    if (wasLive == isLive)
+        return;
+
+    if (isLive)
+        liveTracks.insert(trackId);
+    else
+        liveTracks.erase(trackId);
+
+    updatePrerendering(trackId);
+}
+
+void AudioEngine::updatePrerendering(int trackId)
+{
+    // Anche con una traccia già anticipata si ricomincia da capo: strumento e sequenza sono fotografati qui
+    if (midiTracks.count(trackId) > 0)
+        installMidiTrack(trackId, copyMidiTrack(trackId));
+}
+
+std::shared_ptr<AudioEngine::MidiTrackSource> AudioEngine::copyMidiTrack(int trackId)
+{
+    auto track = std::make_shared<MidiTrackSource>(*this, trackId);
+
+    auto it = midiTracks.find(trackId);
+    if (it != midiTracks.end())
+    {
+        const auto& current = *it->second;
+        track->instrument = current.instrument;
+        track->events = current.events;
+        track->channel = current.channel;
+        track->wasAudible = current.wasAudible;
+        track->zones = current.zones;
+    }
+    else
+    {
+        track->channel = getOrCreateTrackChannel(trackId);
+    }
+
+    return track;
+}
+
+void AudioEngine::installMidiTrack(int trackId, std::shared_ptr<MidiTrackSource> track)
+{
+    const double sampleRate = currentSampleRate.load();
+    const bool shouldPrerender = anticipativeRendering && sampleRate > 0.0
+                                 && track->events != nullptr && !track->zones.empty()
+                                 && liveTracks.count(trackId) == 0 && !recorder.isTrackArmed(trackId);
+
+    if (shouldPrerender)
+    {
+        // Strumento proprio del worker: i campioni sono condivisi attraverso la SampleCache
+        auto instrument = std::make_shared<SamplerInstrument>();
+        instrument->setZones(track->zones, sampleCache);
+        instrument->prepare(sampleRate, PrerenderedTrack::renderBlockFrames);
+
+        auto midi = std::make_shared<juce::MidiBuffer>();
+        midi->ensureSize(32768);
+
+        const double ratio = timelineSampleRate / sampleRate;
+        track->prerendered = std::make_unique<PrerenderedTrack>(
+            [instrument, midi, events = track->events, ratio](juce::AudioBuffer<float>& buffer, double blockStart, int numSamples)
+            {
+                SamplerInstrument::collectEvents(*events, *midi, blockStart, ratio, numSamples);
+                instrument->render(buffer, *midi, 0, numSamples);
+            },
+            sampleRate);
+
+        prerenderer.addTrack(track->prerendered.get());
+    }
+
+    // Lo strumento dal vivo riprende subito; il passaggio al nuovo ring avviene quando lo copre
+    std::shared_ptr<MidiTrackSource> previous;
+    {
+        const juce::ScopedLock lock(sourceLock);
+        previous = std::exchange(midiTracks[trackId], std::move(track));
+    }
+
+    // La versione precedente (e il suo rendering anticipato) sparisce quando nessun callback la usa più
+    rebuildProcessingPlan();
+}
+
+std::shared_ptr<TrackNode> AudioEngine::findTrackNode(int trackId) const
+{
+    auto audio = trackSources.find(trackId);
+    if (audio != trackSources.end())
+        return audio->second;
+
+    auto midi = midiTracks.find(trackId);
+    return midi != midiTracks.end() ? midi->second : nullptr;
+}
+
+void AudioEngine::applySessionChange(const SessionState& before, const SessionState& after)
+{
+    // Il diff salta i sottoalberi condivisi: si toccano solo le tracce cambiate
+    struct TrackVisitor
+    {
+        AudioEngine& engine;
+        void added(int trackId, const TrackState& track)   { engine.applyTrackChange(trackId, nullptr, track); }
+        void removed(int trackId, const TrackState&)       { engine.removeTrackAudio(trackId); }
+        void changed(int trackId, const TrackState& previous, const TrackState& track) { engine.applyTrackChange(trackId, &previous, track); }
+    } visitor { *this };
+
+    PersistentMap<int, TrackState>::diff(before.tracks, after.tracks, visitor);
+
+    setBPM(after.bpm);
+    setKey(after.key);
+}
+
+void AudioEngine::applyTrackChange(int trackId, const TrackState* before, const TrackState& after)
+{
+    const PersistentMap<int, Clip> noClips;
+    const auto& previousClips = before != nullptr ? before->clips : noClips;
+
+    if (!after.clips.isSameAs(previousClips))
+    {
+        auto& clipSource = getOrCreateClipSource(trackId);
+
+        // Ogni clip toccato allarga la regione da confrontare con l'audio già letto
+        struct ClipVisitor
+        {
+            ClipTrackSource& source;
+            ClipEdit& edit;
+            void added(int, const Clip& clip)                  { edit.include(source, source.addClip(clip)); }
+            void removed(int clipId, const Clip&)              { edit.include(source, clipId); source.removeClip(clipId); }
+            void changed(int, const Clip&, const Clip& clip)
+            {
+                edit.include(source, clip.id);
+                source.updateClip(clip);
+                edit.include(source, clip.id);
+            }
+        };
+
+        ClipEdit edit;
+        edit.lengthBefore = clipSource.getTotalLength();
+        ClipVisitor visitor { clipSource, edit };
+
+        clipSource.setDeferIndexUpdates(true);
+        PersistentMap<int, Clip>::diff(previousClips, after.clips, visitor);
+        clipSource.setDeferIndexUpdates(false);
+        refreshTrackAudio(trackId, &edit);
+    }
+
+    if (before == nullptr || before->looping != after.looping)
+        setTrackLooping(trackId, after.looping);
+    if (before == nullptr || before->gain != after.gain)
+        setTrackGain(trackId, after.gain);
+    if (before == nullptr || before->muted != after.muted)
+        setTrackMuted(trackId, after.muted);
+    if (before == nullptr || before->soloed != after.soloed)
+        setTrackSoloed(trackId, after.soloed);
+}
+
+std::vector<Clip> AudioEngine::getClips(int trackId) const
+{
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return {};
+
+    return it->second->clipSource->getClips();
+}
+
+bool AudioEngine::getResolvedClip(int trackId, int clipId, ResolvedClip& result) const
+{
+    auto it = trackSources.find(trackId);
+    return it != trackSources.end() && it->second->clipSource->getResolvedClip(clipId, result);
+}
+
+bool AudioEngine::bakeClip(const ResolvedClip& source, const ClipBaker::Options& options, Clip& result)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(source.clip.file));
+    if (reader == nullptr)
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot create reader for clip: " + source.clip.file.getFullPathName());
+        return false;
+    }
+
+    const auto directory = ClipBaker::getDefaultDirectory();
+    if (!directory.createDirectory())
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot create directory " + directory.getFullPathName());
+        return false;
+    }
+
+    const auto destination = directory.getNonexistentChildFile(source.clip.file.getFileNameWithoutExtension() + " (rendered)", ".wav");
+    return ClipBaker::bake(*reader, source, options, destination, result);
+}
+
+void AudioEngine::removeTrackAudio(int trackId)
+{
+    recorder.removeTrack(trackId);
+    trackChannels.erase(trackId);
+    updateSoloCount();
+
+    {
+        const juce::ScopedLock sl(automationLock);
+        automation.erase({ AutomatedParameter::trackVolume, trackId });
+        automation.erase({ AutomatedParameter::trackPan, trackId });
+        trackPans.erase(trackId);
+    }
+
+    if (analyzerSource.load() == trackId)
+        setAnalyzerSource(0);
+
+    std::shared_ptr<TrackAudioSource> removed;
+    std::shared_ptr<MidiTrackSource> removedMidi;
+    {
+        const juce::ScopedLock lock(sourceLock);
+
+        auto audio = trackSources.find(trackId);
+        if (audio != trackSources.end())
+        {
+            removed = std::move(audio->second);
+            trackSources.erase(audio);
+        }
+
+        auto midi = midiTracks.find(trackId);
+        if (midi != midiTracks.end())
+        {
+            removedMidi = std::move(midi->second);
+            midiTracks.erase(midi);
+        }
+    }
+
+    routingGraph.removeTrack(trackId);
+    rebuildProcessingPlan();
+
+    // Nessun piano li raggiunge più: la distruzione stacca lo streaming e il rendering anticipato
+    removed.reset();
+    removedMidi.reset();
+    memoryBudget.remove(getLaunchHeadKey(trackId));
+    liveTracks.erase(trackId);
+    juce::Logger::writeToLog("AudioEngine: Removed audio for track " + juce::String(trackId));
+}
+
+void AudioEngine::launchTrack(int trackId, Quantization quantization)
+{
+    requestLaunchAction(trackId, launchActionStart, quantization);
 }
 
-AudioEngine::~AudioEngine()
+void AudioEngine::stopTrack(int trackId, Quantization quantization)
 {
-    shutdownAudio();
-    mixerSource.removeAllInputs();
-    trackSources.clear();
-    thread.stopThread(1000);
+    requestLaunchAction(trackId, launchActionStop, quantization);
 }
 
-void AudioEngine::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+bool AudioEngine::isTrackLaunched(int trackId) const
 {
-    mixerSource.prepareToPlay(samplesPerBlockExpected, sampleRate);
+    auto it = trackChannels.find(trackId);
+    return it != trackChannels.end() && it->second->launched.load(std::memory_order_relaxed);
 }
 
-void AudioEngine::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+void AudioEngine::requestLaunchAction(int trackId, LaunchAction action, Quantization quantization)
 {
-    const juce::ScopedLock lock(sourceLock);
+    auto it = trackSources.find(trackId);
+    if (it == trackSources.end())
+        return;
 
-    // CORREZIONE DEFINITIVA: Rimosso il check sul numero di sorgenti.
-    // Se l'engine non sta suonando, esci. Il mixer gestirà correttamente 0 sorgenti.
-    if (!engineIsPlaying)
+    if (action == launchActionStart
+        && memoryBudget.find<juce::AudioBuffer<float>>(getLaunchHeadKey(trackId)) == nullptr
+        && !buildLaunchHead(trackId, it->second))
+        juce::Logger::writeToLog("AudioEngine: Track " + juce::String(trackId) + " will launch from disk (no head in memory)");
+
+    // Una richiesta non ancora adottata viene sostituita dall'ultima
+    it->second->channel->launchRequest.store(action | ((int) quantization << 4), std::memory_order_release);
+}
+
+bool AudioEngine::buildLaunchHead(int trackId, const std::shared_ptr<TrackAudioSource>& source)
+{
+    AW_TRACE_SCOPE("Launch head build");
+
+    // Copia dell'arrangiamento con reader propri: la sorgente della traccia è letta dai worker
+    ClipTrackSource headSource(formatManager, timelineSampleRate, &decodedFiles);
+    headSource.setDeferIndexUpdates(true);
+    for (auto const& clip : source->clipSource->getClips())
+        headSource.addClip(clip);
+    headSource.setDeferIndexUpdates(false);
+    headSource.setLooping(source->clipSource->isLooping());
+
+    const int frames = (int) juce::jmin<juce::int64>(launchHeadFrames, headSource.getTotalLength());
+    if (frames <= 0)
+        return false;
+
+    auto head = std::make_shared<juce::AudioBuffer<float>>(2, frames);
+    headSource.prepareToPlay(frames, timelineSampleRate);
+    headSource.getNextAudioBlock({ head.get(), 0, frames });
+    headSource.releaseResources();
+
+    // Sfratto: la traccia torna a leggere solo dal disco, ma mai mentre suona dalla testa.
+    // Può arrivare da qualsiasi thread: la catena si raggiunge senza passare dalla mappa.
+    auto evictHead = [this, weakSource = std::weak_ptr<TrackAudioSource>(source)]
     {
-        bufferToFill.clearActiveBufferRegion();
-        return;
+        auto owner = weakSource.lock();
+        if (owner == nullptr)
+            return true;
+
+        if (owner->streamingSource->isPlayingLaunchHead())
+            return false;
+
+        // Un lancio adottato nel frattempo trova la testa già tolta e legge dal ring
+        owner->streamingSource->setLaunchHead(nullptr);
+        waitForAudioThread();
+        return true;
+    };
+
+    // Dato facoltativo: se non c'è spazio il lancio attende il disco come senza testa
+    const auto bytes = (size_t) head->getNumChannels() * (size_t) frames * sizeof(float);
+    if (!memoryBudget.insert(getLaunchHeadKey(trackId), MemoryBudget::Category::launchHead, head, bytes, true, evictHead))
+        return false;
+
+    // Finché head è vivo qui la testa non può essere sfrattata
+    source->streamingSource->setLaunchHead(head.get());
+    return true;
+}
+
+void AudioEngine::play()
+{
+    if (!engineIsPlaying || mixBlockSize.load() == 0)
+    {
+        // Il clock appartiene all'audio thread: lo azzera il callback all'inizio del prossimo blocco
+        clockResetRequested.store(true);
+        engineIsPlaying = true;
+        juce::Logger::writeToLog("AudioEngine: Playback started.");
     }
+}
+
+void AudioEngine::stop()
+{
+    if (recorder.isRecording())
+        stopRecording();
 
-    // Chiedi al mixer di riempire il buffer.
-    mixerSource.getNextAudioBlock(bufferToFill);
+    if (engineIsPlaying)
+    {
+        // Le note appese vengono rilasciate dal callback, che vede il transport fermarsi
+        engineIsPlaying = false;
+        juce::Logger::writeToLog("AudioEngine: Playback stopped.");
+    }
 }
 
-void AudioEngine::releaseResources()
+float AudioEngine::getPositionRelative(int trackId) const
+{
+    auto it = trackSources.find(trackId);
+    if (it != trackSources.end())
+    {
+        const auto& streaming = *it->second->streamingSource;
+        const auto totalLength = streaming.getTotalLength();
+        if (totalLength > 0)
+            return (float) (streaming.getNextReadPosition() % totalLength) / (float) totalLength;
+    }
+    return 0.0f;
+}
+
+std::shared_ptr<AudioEngine::TrackChannel> AudioEngine::getOrCreateTrackChannel(int trackId)
 {
-    mixerSource.releaseResources();
+    auto& channel = trackChannels[trackId];
+    if (channel == nullptr)
+    {
+        channel = std::make_shared<TrackChannel>();
+        channel->meter.prepare(currentSampleRate);
+
+        // Una traccia nuova esce sul master finché non viene instradata altrove
+        routingGraph.addTrack(trackId);
+        rebuildProcessingPlan();
+    }
+    return channel;
 }
 
-bool AudioEngine::loadFile(const juce::File& file, int trackId)
+void AudioEngine::rebuildProcessingPlan()
 {
-    juce::Logger::writeToLog("AudioEngine: Loading file: " + file.getFullPathName() + " for track " + juce::String(trackId));
+    // Compilazione e allocazioni qui, senza lock: l'audio thread vede il nuovo piano dal callback successivo.
+    // Se il dispositivo cambia blocco nel frattempo, prepareToPlay chiede un'altra compilazione.
+    auto plan = routingGraph.compile(juce::jmax(mixBlockSize.load(), 1024), masterBus.getLatencySamples());
 
-    if (!file.existsAsFile())
+    const int latency = plan->mixLatency + masterBus.getLatencySamples();
+    if (latency != outputLatency.exchange(latency))
+        juce::Logger::writeToLog("AudioEngine: Output latency " + juce::String(latency) + " samples ("
+                                 + juce::String(plan->mixLatency) + " from delay compensation)");
+
+    // Scritte solo da questo thread: niente automationLock per leggerle
+    auto curveFor = [this](AutomatedParameter parameter, int id) -> std::shared_ptr<const AutomationCurve>
     {
-        juce::Logger::writeToLog("AudioEngine Error: File does not exist: " + file.getFullPathName());
-        return false;
+        auto it = automation.find({ parameter, id });
+        return it != automation.end() ? it->second : nullptr;
+    };
+
+    for (auto& step : plan->steps)
+    {
+        if (step.isBus)
+        {
+            auto convolution = busConvolutions.find(step.id);
+            step.reverb = convolution != busConvolutions.end() ? convolution->second.reverb.get() : nullptr;
+            step.busAutomation.setCurve(curveFor(AutomatedParameter::busGain, step.id));
+        }
+        else
+        {
+            step.track = findTrackNode(step.id);
+            step.trackAutomation.volume.setCurve(curveFor(AutomatedParameter::trackVolume, step.id));
+            step.trackAutomation.pan.setCurve(curveFor(AutomatedParameter::trackPan, step.id));
+        }
     }
 
-    auto* reader = formatManager.createReaderFor(file);
-    if (reader == nullptr)
+    plan->masterGainAutomation.setCurve(curveFor(AutomatedParameter::masterGain, 0));
+    plan->masterCeilingAutomation.setCurve(curveFor(AutomatedParameter::masterCeiling, 0));
+
+    publishPlan(std::move(plan));
+}
+
+void AudioEngine::publishPlan(std::unique_ptr<ProcessingPlan> plan)
+{
+    activePlan.store(plan.get());
+
+    // Un callback già iniziato può ancora percorrere il piano precedente: lo si distrugge dopo
+    waitForAudioThread();
+    processingPlan = std::move(plan);
+}
+
+void AudioEngine::waitForAudioThread() const
+{
+    // Epoca pari: nessun callback in corso, e il prossimo leggerà ciò che è stato pubblicato prima
+    const auto epoch = callbackEpoch.load();
+    if ((epoch & 1) == 0)
+        return;
+
+    while (callbackEpoch.load() == epoch)
+        juce::Thread::yield();
+}
+
+int AudioEngine::addBus(const juce::String& name)
+{
+    const int busId = routingGraph.addBus(name);
+    routingGraph.getBusChannel(busId)->meter.prepare(currentSampleRate);
+    rebuildProcessingPlan();
+    juce::Logger::writeToLog("AudioEngine: Bus " + juce::String(busId) + " (" + name + ") added");
+    return busId;
+}
+
+void AudioEngine::removeBus(int busId)
+{
     {
-        juce::Logger::writeToLog("AudioEngine Error: Cannot create reader for: " + file.getFullPathName());
-        return false;
+        const juce::ScopedLock sl(automationLock);
+        automation.erase({ AutomatedParameter::busGain, busId });
     }
 
-    TrackAudioSource newSource;
-    newSource.reader = std::unique_ptr<juce::AudioFormatReader>(reader);
-    newSource.readerSource = std::make_unique<juce::AudioFormatReaderSource>(newSource.reader.get(), false);
-    newSource.transportSource = std::make_unique<juce::AudioTransportSource>();
+    if (busConvolutions.count(busId) > 0)
+        setBusConvolution(busId, {});
+
+    routingGraph.removeBus(busId);
+    rebuildProcessingPlan();
+}
+
+bool AudioEngine::setDestination(RoutingGraph::NodeRef node, int busId)
+{
+    if (!routingGraph.setDestination(node, busId))
+        return false;
+
+    rebuildProcessingPlan();
+    return true;
+}
+
+bool AudioEngine::setSend(RoutingGraph::NodeRef node, int busId, float level, bool preFader)
+{
+    if (!routingGraph.setSend(node, busId, juce::jmax(0.0f, level), preFader))
+        return false;
+
+    rebuildProcessingPlan();
+    return true;
+}
+
+void AudioEngine::removeSend(RoutingGraph::NodeRef node, int busId)
+{
+    routingGraph.removeSend(node, busId);
+    rebuildProcessingPlan();
+}
+
+bool AudioEngine::setProcessingLatency(RoutingGraph::NodeRef node, int latencySamples)
+{
+    if (routingGraph.getLatency(node) == latencySamples)
+        return true;
+
+    if (!routingGraph.setLatency(node, latencySamples))
+        return false;
+
+    rebuildProcessingPlan();
+    return true;
+}
+
+bool AudioEngine::setBusOutputChannel(int busId, int firstOutputChannel)
+{
+    if (!routingGraph.setBusOutputChannel(busId, firstOutputChannel))
+        return false;
+
+    rebuildProcessingPlan();
+    return true;
+}
+
+bool AudioEngine::setBusConvolution(int busId, const juce::File& impulseResponse, float wetLevel, float dryLevel)
+{
+    auto channel = routingGraph.getBusChannel(busId);
+    if (channel == nullptr)
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot add a reverb to missing bus " + juce::String(busId));
+        return false;
+    }
 
-    newSource.readerSource->setLooping(true);
-    newSource.transportSource->setSource(newSource.readerSource.get(),
-                                         32768,
-                                         &thread,
-                                         reader->sampleRate);
+    const double sampleRate = currentSampleRate.load() > 0.0 ? currentSampleRate.load() : timelineSampleRate;
+    std::unique_ptr<ConvolutionReverb> reverb;
 
+    if (impulseResponse != juce::File())
     {
-        const juce::ScopedLock lock(sourceLock);
-        removeTrackAudio_internal(trackId);
-        mixerSource.addInputSource(newSource.transportSource.get(), false);
-        trackSources[trackId] = std::move(newSource);
+        // Ricampionamento e spettri delle partizioni qui, sul message thread: il callback riceve un riverbero pronto
+        juce::AudioBuffer<float> impulse;
+        if (!ConvolutionReverb::loadImpulseResponse(formatManager, impulseResponse, sampleRate, impulse))
+            return false;
 
-         if (engineIsPlaying)
-         {
-             if (auto* transport = trackSources[trackId].transportSource.get())
-             {
-                 transport->start();
-             }
-         }
+        reverb = std::make_unique<ConvolutionReverb>(impulse);
+        reverb->setLevels(wetLevel, dryLevel);
+        convolutionWorkers.addReverb(reverb.get());
     }
 
-    juce::Logger::writeToLog("AudioEngine: File loaded successfully for track " + juce::String(trackId));
+    std::unique_ptr<ConvolutionReverb> previous;
+    auto existing = busConvolutions.find(busId);
+    if (existing != busConvolutions.end())
+    {
+        previous = std::move(existing->second.reverb);
+        busConvolutions.erase(existing);
+    }
 
-    juce::MessageManager::callAsync([this, file, trackId]() {
-        listeners.call(&Listener::fileLoaded, file, trackId);
-    });
+    if (reverb != nullptr)
+    {
+        juce::Logger::writeToLog("AudioEngine: Bus " + juce::String(busId) + " convolution reverb " + impulseResponse.getFileName()
+                                 + " (" + juce::String(reverb->getImpulseLength() / sampleRate, 2) + " s, "
+                                 + juce::String(reverb->getNumTailPartitions()) + " tail partitions)");
+
+        auto& convolution = busConvolutions[busId];
+        convolution.file = impulseResponse;
+        convolution.wetLevel = wetLevel;
+        convolution.dryLevel = dryLevel;
+        convolution.sampleRate = sampleRate;
+        convolution.reverb = std::move(reverb);
+    }
+    else
+    {
+        juce::Logger::writeToLog("AudioEngine: Bus " + juce::String(busId) + " reverb removed");
+    }
+
+    rebuildProcessingPlan();
 
+    // Il riverbero precedente non è più raggiungibile dall'audio thread: via dai worker, poi distrutto
+    if (previous != nullptr)
+        convolutionWorkers.removeReverb(previous.get());
     return true;
 }
 
-void AudioEngine::removeTrackAudio_internal(int trackId)
+void AudioEngine::setBusGain(int busId, float linearGain)
 {
-     auto it = trackSources.find(trackId);
-     if (it != trackSources.end())
-     {
-         juce::Logger::writeToLog("AudioEngine: Removing audio source for track " + juce::String(trackId) + " (internal)");
-         auto* transport = it->second.transportSource.get();
-         if (transport)
-         {
-             mixerSource.removeInputSource(transport);
-             transport->stop();
-             transport->setSource(nullptr);
-         }
-          trackSources.erase(it);
-          juce::Logger::writeToLog("AudioEngine: Track " + juce::String(trackId) + " removed from map.");
-     }
+    if (auto channel = routingGraph.getBusChannel(busId))
+        channel->gain.store(juce::jmax(0.0f, linearGain));
 }
 
-void AudioEngine::removeTrackAudio(int trackId)
+void AudioEngine::setBusMuted(int busId, bool muted)
 {
-    const juce::ScopedLock lock(sourceLock);
-    juce::Logger::writeToLog("AudioEngine: Request to remove audio for track " + juce::String(trackId));
-    removeTrackAudio_internal(trackId);
+    if (auto channel = routingGraph.getBusChannel(busId))
+        channel->muted.store(muted);
 }
 
+std::shared_ptr<const LevelMeter> AudioEngine::getBusMeter(int busId) const
+{
+    auto channel = routingGraph.getBusChannel(busId);
+    return channel != nullptr ? std::shared_ptr<const LevelMeter>(channel, &channel->meter) : nullptr;
+}
 
-void AudioEngine::play()
+std::shared_ptr<const LevelMeter> AudioEngine::getTrackMeter(int trackId) const
+{
+    auto it = trackChannels.find(trackId);
+    return it != trackChannels.end() ? std::shared_ptr<const LevelMeter>(it->second, &it->second->meter) : nullptr;
+}
+
+void AudioEngine::setTrackMuted(int trackId, bool muted)
+{
+    auto channel = getOrCreateTrackChannel(trackId);
+    prefillTracksBecomingAudible(trackId, muted, channel->soloed.load());
+    channel->muted.store(muted);
+    juce::Logger::writeToLog("AudioEngine: Track " + juce::String(trackId) + (muted ? " muted" : " unmuted"));
+}
+
+void AudioEngine::setTrackSoloed(int trackId, bool soloed)
+{
+    auto channel = getOrCreateTrackChannel(trackId);
+    prefillTracksBecomingAudible(trackId, channel->muted.load(), soloed);
+    channel->soloed.store(soloed);
+    updateSoloCount();
+    juce::Logger::writeToLog("AudioEngine: Track " + juce::String(trackId) + (soloed ? " soloed" : " unsoloed"));
+}
+
+void AudioEngine::setTrackGain(int trackId, float linearGain)
+{
+    getOrCreateTrackChannel(trackId)->gain.store(juce::jmax(0.0f, linearGain));
+}
+
+void AudioEngine::setTrackPan(int trackId, float pan)
+{
+    pan = juce::jlimit(-1.0f, 1.0f, pan);
+    getOrCreateTrackChannel(trackId)->pan.store(pan);
+
+    const juce::ScopedLock sl(automationLock);
+    trackPans[trackId] = pan;
+}
+
+void AudioEngine::setAutomation(AutomatedParameter parameter, int id, std::shared_ptr<const AutomationCurve> curve)
 {
-    if (!engineIsPlaying)
+    switch (parameter)
     {
-        const juce::ScopedLock lock(sourceLock);
-        engineIsPlaying = true;
-        for (auto const& [id, source] : trackSources)
-        {
-            if (source.transportSource)
+        case AutomatedParameter::trackVolume:
+        case AutomatedParameter::trackPan:
+            getOrCreateTrackChannel(id);
+            break;
+
+        case AutomatedParameter::busGain:
+            if (routingGraph.getBusChannel(id) == nullptr)
             {
-                 source.transportSource->start();
+                juce::Logger::writeToLog("AudioEngine Error: Cannot automate missing bus " + juce::String(id));
+                return;
             }
-        }
-        juce::Logger::writeToLog("AudioEngine: Playback started.");
+            break;
+
+        case AutomatedParameter::masterGain:
+        case AutomatedParameter::masterCeiling:
+            id = 0;
+            break;
+    }
+
+    {
+        const juce::ScopedLock sl(automationLock);
+        if (curve != nullptr && !curve->isEmpty())
+            automation[{ parameter, id }] = std::move(curve);
+        else
+            automation.erase({ parameter, id });
     }
+
+    // Le corsie vivono nel piano: il callback vede la nuova curva dal blocco successivo
+    rebuildProcessingPlan();
 }
 
-void AudioEngine::stop()
+std::shared_ptr<const AutomationCurve> AudioEngine::getAutomation(AutomatedParameter parameter, int id) const
 {
-    if (engineIsPlaying)
+    if (parameter == AutomatedParameter::masterGain || parameter == AutomatedParameter::masterCeiling)
+        id = 0;
+
+    const juce::ScopedLock sl(automationLock);
+    auto it = automation.find({ parameter, id });
+    return it != automation.end() ? it->second : nullptr;
+}
+
+OfflineRenderer::Settings AudioEngine::getExportSettings()
+{
+    OfflineRenderer::Settings settings;
+    settings.masterGain = masterBus.getGain();
+    settings.limiterEnabled = masterBus.isLimiterEnabled();
+    settings.ceilingDb = masterBus.getCeilingDb();
     {
-        const juce::ScopedLock lock(sourceLock);
-        engineIsPlaying = false;
-        for (auto const& [id, source] : trackSources)
-        {
-            if (source.transportSource)
-                source.transportSource->stop();
-        }
-        juce::Logger::writeToLog("AudioEngine: Playback stopped.");
+        const juce::ScopedLock sl(automationLock);
+        settings.automation = automation;
+        settings.trackPan = trackPans;
+    }
+
+    // Il renderer compila il suo piano da una copia staccata: l'export non tocca meter e mandate dell'engine
+    settings.routing = std::make_shared<const RoutingGraph>(routingGraph.detachedCopy());
+    for (auto const& [busId, convolution] : busConvolutions)
+        settings.busReverbs[busId] = { convolution.file, convolution.wetLevel, convolution.dryLevel };
+
+    for (auto const& [trackId, track] : midiTracks)
+    {
+        auto& midi = settings.midiTracks[trackId];
+        midi.zones = track->zones;
+        midi.events = track->events;
+        midi.gain = track->channel->gain.load();
+        midi.muted = track->channel->muted.load();
+        midi.soloed = track->channel->soloed.load();
     }
+
+    settings.sampleCache = &sampleCache;
+    return settings;
 }
 
-float AudioEngine::getPositionRelative(int trackId) const
+bool AudioEngine::exportMix(const SessionState& session, const OfflineRenderer::Settings& settings,
+                            const std::vector<ExportPipeline::Target>& targets, ExportPipeline::ProgressCallback progress)
 {
-    auto it = trackSources.find(trackId);
-    if (it != trackSources.end() && it->second.transportSource)
+    OfflineRenderer renderer(formatManager, session, timelineSampleRate, settings);
+    if (renderer.getLengthInSamples() == 0)
     {
-        auto* transport = it->second.transportSource.get();
-        auto totalLength = transport->getLengthInSeconds();
-        if (totalLength > 0.0)
-        {
-            auto currentPosition = transport->getCurrentPosition();
-            return static_cast<float>(std::fmod(currentPosition, totalLength) / totalLength);
-        }
+        juce::Logger::writeToLog("AudioEngine: Nothing to export");
+        return false;
     }
-    return 0.0f;
+
+    ExportPipeline pipeline(formatManager);
+    return pipeline.run(renderer, targets, std::move(progress));
+}
+
+bool AudioEngine::exportStems(const SessionState& session, const StemExporter::Options& options,
+                              StemExporter::ProgressCallback progress)
+{
+    StemExporter exporter(formatManager);
+    return exporter.run(session, timelineSampleRate, options, std::move(progress));
+}
+
+void AudioEngine::setAnalyzerSource(int trackId)
+{
+    if (analyzerSource.exchange(juce::jmax(0, trackId)) != juce::jmax(0, trackId))
+        spectrumAnalyzer.reset(); // Niente coda del segnale precedente nello spettrogramma
+}
+
+void AudioEngine::updateSoloCount()
+{
+    int count = 0;
+    for (auto const& [id, channel] : trackChannels)
+        if (channel->soloed.load())
+            ++count;
+
+    numSoloedTracks.store(count);
+}
+
+void AudioEngine::prefillTracksBecomingAudible(int trackId, bool mutedAfter, bool soloedAfter)
+{
+    int soloedAfterChange = 0;
+    for (auto const& [id, channel] : trackChannels)
+        if (id == trackId ? soloedAfter : channel->soloed.load())
+            ++soloedAfterChange;
+
+    bool anyWoken = false;
+    for (auto const& [id, source] : trackSources)
+    {
+        // Solo le tracce che l'audio thread sta facendo scorrere a vuoto
+        if (!source->channel || isAudible(*source->channel))
+            continue;
+
+        const bool muted = id == trackId ? mutedAfter : source->channel->muted.load();
+        const bool soloed = id == trackId ? soloedAfter : source->channel->soloed.load();
+        if (muted || (soloedAfterChange > 0 && !soloed))
+            continue;
+
+        auto& streaming = *source->streamingSource;
+        streaming.wakeAhead((juce::int64) (unmuteLeadSeconds * streaming.getSourceSampleRate()));
+        anyWoken = true;
+    }
+
+    if (anyWoken)
+        diskStreamer.wakeUp();
+}
+
+int AudioEngine::openInputChannels()
+{
+    auto* device = deviceManager.getCurrentAudioDevice();
+    if (device == nullptr)
+        return 0;
+
+    const int numInputs = device->getActiveInputChannels().countNumberOfSetBits();
+    if (numInputs > 0 || device->getInputChannelNames().isEmpty())
+        return numInputs;
+
+    // Stesso dispositivo, frequenza e buffer: cambiano solo gli ingressi
+    auto setup = deviceManager.getAudioDeviceSetup();
+    setup.inputChannels.clear();
+    setup.inputChannels.setRange(0, juce::jmin(maxInputChannels, device->getInputChannelNames().size()), true);
+    setup.useDefaultInputChannels = false;
+
+    const auto error = deviceManager.setAudioDeviceSetup(setup, true);
+    if (error.isNotEmpty())
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot open the audio inputs: " + error);
+        return 0;
+    }
+
+    device = deviceManager.getCurrentAudioDevice();
+    const int opened = device != nullptr ? device->getActiveInputChannels().countNumberOfSetBits() : 0;
+    juce::Logger::writeToLog("AudioEngine: Opened " + juce::String(opened) + " audio inputs");
+    return opened;
+}
+
+void AudioEngine::setTrackRecordArmed(int trackId, bool armed, int inputChannel)
+{
+    // Disarmare non apre nulla; al primo arm gli ingressi servono già per l'ingresso predefinito
+    int numInputs = 0;
+    if (armed)
+        numInputs = openInputChannels();
+    else if (auto* device = deviceManager.getCurrentAudioDevice())
+        numInputs = device->getActiveInputChannels().countNumberOfSetBits();
+
+    // Per default la traccia N registra dall'ingresso N (mono)
+    if (inputChannel < 0)
+        inputChannel = numInputs > 0 ? (trackId - 1) % numInputs : 0;
+
+    recorder.setTrackArmed(trackId, armed, inputChannel);
+    updatePrerendering(trackId);
+    juce::Logger::writeToLog("AudioEngine: Track " + juce::String(trackId) + (armed ? " armed on input " + juce::String(inputChannel + 1)
+                                                                                    : " disarmed"));
+}
+
+bool AudioEngine::isTrackRecordArmed(int trackId) const
+{
+    return recorder.isTrackArmed(trackId);
+}
+
+bool AudioEngine::startRecording()
+{
+    return startRecording(openInputChannels());
+}
+
+bool AudioEngine::startRecording(int numInputsAvailable)
+{
+    if (!recorder.start(currentSampleRate, numInputsAvailable))
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot start recording (no armed tracks or inputs)");
+        return false;
+    }
+
+    play();
+    return true;
+}
+
+void AudioEngine::stopRecording()
+{
+    // Chi gestisce la sessione inserisce la take nella traccia (così l'operazione è annullabile)
+    for (auto const& take : recorder.stop())
+        if (take.file.existsAsFile())
+            listeners.call(&Listener::takeRecorded, take.file, take.trackId);
 }
 
 bool AudioEngine::isPlaying() const
@@ -177,6 +1567,7 @@ void AudioEngine::setBPM(int bpm)
     if (bpm > 0 && bpm != currentBPM)
     {
         currentBPM = bpm;
+        musicalClock.setTempo(bpm);
         juce::Logger::writeToLog("AudioEngine: BPM set to " + juce::String(currentBPM));
         listeners.call(&Listener::bpmChanged, currentBPM);
     }
@@ -201,6 +1592,3 @@ void AudioEngine::removeListener(Listener* listener)
 {
     listeners.remove(listener);
 }
-
-// --- Dichiarazione della funzione helper interna nel file .h ---
-// void AudioEngine::removeTrackAudio_internal(int trackId); // Già dichiarata in .h
\ No newline at end of file
@@ -2,6 +2,29 @@
 
 #include <JuceHeader.h>
 #include <map> // Per std::map
+#include <set>
+#include <limits>
+#include "DiskStreamer.h"
+#include "ClipTrackSource.h"
+#include "ClipBaker.h"
+#include "MultitrackRecorder.h"
+#include "LevelMeter.h"
+#include "MasterBus.h"
+#include "MemoryBudget.h"
+#include "SampleCache.h"
+#include "SamplerInstrument.h"
+#include "AudioTap.h"
+#include "Automation.h"
+#include "ConvolutionReverb.h"
+#include "SpectrumAnalyzer.h"
+#include "ExportPipeline.h"
+#include "StemExporter.h"
+#include "MusicalClock.h"
+#include "RealtimeChecker.h"
+#include "RoutingGraph.h"
+#include "Tracer.h"
+#include "TrackPrerenderer.h"
+#include "../Session/SessionState.h"
 
 // Assicurati che NON erediti più da juce::ChangeListener
 class AudioEngine : public juce::AudioAppComponent
@@ -19,6 +42,77 @@ public:
     // Metodo per rimuovere l'audio associato a un ID di traccia
     void removeTrackAudio(int trackId);
 
+    // --- Arrangiamento: clip sulla timeline condivisa ---
+    // Le posizioni dei clip sono in campioni a questa frequenza (fissata all'apertura del dispositivo)
+    double getTimelineSampleRate() const { return timelineSampleRate; }
+    // Aggiunge un clip (creando la traccia se serve); restituisce l'ID del clip o -1
+    int addClip(int trackId, const Clip& clip);
+    bool updateClip(int trackId, const Clip& clip);
+    bool removeClip(int trackId, int clipId);
+    std::vector<Clip> getClips(int trackId) const;
+    // Clip come lo suona il motore (durata risolta, misure del file): serve agli edit di ClipEdits
+    bool getResolvedClip(int trackId, int clipId, ResolvedClip& result) const;
+    // Edit distruttivo esplicito (normalizzazione, verso già applicato): scrive un nuovo file in
+    // ClipBaker::getDefaultDirectory() e restituisce il clip che lo usa, da inserire nella sessione
+    // come passo annullabile. Blocca: va chiamato da un thread in background.
+    bool bakeClip(const ResolvedClip& source, const ClipBaker::Options& options, Clip& result);
+    void setTrackLooping(int trackId, bool shouldLoop);
+
+    // --- Lancio quantizzato (sincronizzato alla griglia del progetto) ---
+    using Quantization = MusicalClock::Quantization;
+    // Fa partire la traccia dall'inizio esattamente sul prossimo confine; se sta già suonando
+    // è un restart del loop. I primi secondi sono tenuti in memoria: nessuna attesa del disco.
+    void launchTrack(int trackId, Quantization quantization = Quantization::bar);
+    void stopTrack(int trackId, Quantization quantization = Quantization::bar);
+    bool isTrackLaunched(int trackId) const;
+    // Posizione musicale del transport (in battiti dall'inizio, aggiornata dall'audio thread)
+    double getBeatPosition() const { return musicalClock.getPublishedBeatPosition(); }
+    int getBeatsPerBar() const { return musicalClock.getBeatsPerBar(); }
+
+    // --- Tracce MIDI con campionatore ---
+    // Le zone vengono caricate attraverso la SampleCache, condivisa tra tutti gli strumenti
+    bool setMidiTrackInstrument(int trackId, const std::vector<SamplerInstrument::Zone>& zones);
+    // Campioni tenuti compressi senza perdite in RAM (per i prossimi caricamenti)
+    void setCompressedSampleStorage(bool shouldCompress)
+    {
+        sampleCache.setStorageFormat(shouldCompress ? SampleCache::StorageFormat::compressed : SampleCache::StorageFormat::float32);
+    }
+    // Timestamp della sequenza in secondi dall'inizio della timeline
+    bool setMidiTrackSequence(int trackId, const juce::MidiMessageSequence& sequence);
+    bool loadMidiFile(const juce::File& file, int trackId);
+    // Posizione della timeline condivisa (in campioni della timeline), avanza durante la riproduzione
+    juce::int64 getTimelinePosition() const { return publishedTimelinePosition.load(std::memory_order_relaxed); }
+
+    // --- Rendering anticipato ---
+    // Le tracce MIDI non armate e non marcate come live vengono rese in anticipo dai worker, a
+    // blocchi grandi: il callback si limita a mixarle. Così il buffer del dispositivo può restare
+    // piccolo per il monitoraggio anche su sessioni troppo pesanti da rendere dal vivo.
+    void setAnticipativeRendering(bool shouldPrerender);
+    bool isAnticipativeRenderingEnabled() const { return anticipativeRendering; }
+    // Traccia che l'utente sta suonando o modificando: resa nel callback, ogni modifica si sente subito
+    void setTrackLive(int trackId, bool isLive);
+    void setPrerenderWorkerOptions(const TrackPrerenderer::WorkerOptions& options) { prerenderer.setWorkerOptions(options); }
+    TrackPrerenderer::WorkerOptions getPrerenderWorkerOptions() const { return prerenderer.getWorkerOptions(); }
+    int getPrerenderUnderruns() const { return prerenderer.getTotalUnderruns(); }
+
+    // --- Export ---
+    // Message thread: ciò che l'export deve riprodurre oltre alla sessione (bus master,
+    // instradamento e bus con i loro riverberi, automazione, pan, tracce MIDI). Va fotografato
+    // prima di passare l'export al thread in background.
+    OfflineRenderer::Settings getExportSettings();
+    // Rende la sessione offline una sola volta, con un piano di esecuzione proprio compilato
+    // come quello della riproduzione, e la codifica in tutti i formati richiesti.
+    // Blocca: va chiamato da un thread in background.
+    bool exportMix(const SessionState& session, const OfflineRenderer::Settings& settings,
+                   const std::vector<ExportPipeline::Target>& targets, ExportPipeline::ProgressCallback progress = nullptr);
+    // Uno stem per traccia (audio o MIDI), resi in parallelo su tutti i core; options.render
+    // viene da getExportSettings
+    bool exportStems(const SessionState& session, const StemExporter::Options& options,
+                     StemExporter::ProgressCallback progress = nullptr);
+
+    // Porta il motore da una istantanea della sessione all'altra applicando solo le differenze
+    void applySessionChange(const SessionState& before, const SessionState& after);
+
     void play();
     void stop();
 
@@ -26,6 +120,26 @@ public:
     float getPositionRelative(int trackId) const;
     bool isPlaying() const; // Controlla se l'engine sta suonando
 
+    // --- Registrazione ---
+    // Arma la traccia sull'ingresso indicato (-1 = ingresso predefinito in base all'ID)
+    void setTrackRecordArmed(int trackId, bool armed, int inputChannel = -1);
+    bool isTrackRecordArmed(int trackId) const;
+    // Avvia la registrazione sulle tracce armate (e la riproduzione, se ferma)
+    bool startRecording();
+    // Come sopra, con il numero di ingressi già noto: serve a chi chiama il callback senza
+    // un dispositivo aperto (RealtimeSelfTest), dove non c'è nulla da aprire
+    bool startRecording(int numInputsAvailable);
+    void setRecordingDirectory(const juce::File& directory) { recorder.setOutputDirectory(directory); }
+    // Ferma la registrazione e notifica le nuove take ai listener (takeRecorded)
+    void stopRecording();
+    bool isRecording() const { return recorder.isRecording(); }
+    juce::int64 getDroppedRecordingSamples() const { return recorder.getDroppedSamples(); }
+
+    // Numero massimo di ingressi e uscite aperti sul dispositivo (le uscite 0-1 sono il mix principale).
+    // Gli ingressi si aprono solo al primo arm o all'avvio della registrazione.
+    static constexpr int maxInputChannels = 64;
+    static constexpr int maxOutputChannels = 16;
+
     // --- Gestione BPM e Chiave (Implementazione base) ---
     int getCurrentBPM() const { return currentBPM; }
     juce::String getCurrentKey() const { return currentKey; }
@@ -43,42 +157,318 @@ public:
         virtual void bpmChanged(int newBpm) {}
         // Notifica cambio Chiave
         virtual void keyChanged(const juce::String& newKey) {}
+        // Notifica una take appena registrata, da inserire nella traccia
+        virtual void takeRecorded(const juce::File& file, int trackId) {}
         // Potresti aggiungere altri callback se necessario
     };
 
     void addListener(Listener* listener);
     void removeListener(Listener* listener);
 
+    // --- Mute / Solo ---
+    // Le tracce silenziate non vengono decodificate né mixate, ma la loro posizione continua ad avanzare
+    void setTrackMuted(int trackId, bool muted);
+    void setTrackSoloed(int trackId, bool soloed);
+    void setTrackGain(int trackId, float linearGain);
+    // Bilanciamento della traccia: -1 = solo sinistra, 0 = centro (guadagno unitario), 1 = solo destra
+    void setTrackPan(int trackId, float pan);
+
+    // --- Routing: bus di gruppo/aux, mandate pre/post fader, uscite del dispositivo ---
+    // Ogni modifica ricompila il piano di esecuzione e lo sostituisce tra un blocco e l'altro.
+    // Le modifiche che creerebbero un ciclo vengono rifiutate (false).
+    int addBus(const juce::String& name);
+    void removeBus(int busId);
+    std::vector<int> getBusIds() const { return routingGraph.getBusIds(); }
+    juce::String getBusName(int busId) const { return routingGraph.getBusName(busId); }
+    // Uscita principale di una traccia o di un bus (RoutingGraph::master = bus master)
+    bool setDestination(RoutingGraph::NodeRef node, int busId);
+    bool setSend(RoutingGraph::NodeRef node, int busId, float level, bool preFader);
+    void removeSend(RoutingGraph::NodeRef node, int busId);
+    // Coppia di uscite del dispositivo per un bus (-1 = segue la destinazione); salta il bus master
+    bool setBusOutputChannel(int busId, int firstOutputChannel);
+    // Latenza dichiarata dall'elaborazione di una traccia o di un bus: i percorsi più rapidi
+    // vengono ritardati perché tutto arrivi allineato al master
+    bool setProcessingLatency(RoutingGraph::NodeRef node, int latencySamples);
+    // Latenza totale dall'ingresso del grafo all'uscita (compensazioni + bus master), in campioni
+    int getOutputLatency() const { return outputLatency.load(std::memory_order_relaxed); }
+    void setBusGain(int busId, float linearGain);
+    void setBusMuted(int busId, bool muted);
+    // Riverbero a convoluzione come insert del bus, prima del meter e del fader (su un bus aux
+    // si usa tutto wet). La coda della risposta è calcolata dai worker; un file vuoto lo toglie.
+    bool setBusConvolution(int busId, const juce::File& impulseResponse, float wetLevel = 1.0f, float dryLevel = 0.0f);
+    int getConvolutionUnderruns() const { return convolutionWorkers.getTotalUnderruns(); }
+    std::shared_ptr<const LevelMeter> getBusMeter(int busId) const;
+
+    // --- Bus master ---
+    void setMasterGain(float linearGain) { masterBus.setGain(linearGain); }
+    void setMasterLimiterEnabled(bool enabled) { masterBus.setLimiterEnabled(enabled); }
+    void setMasterCeilingDb(float ceilingDb) { masterBus.setCeilingDb(ceilingDb); }
+    // Dither per l'export a virgola fissa (bitDepth = 0 lo disattiva)
+    void setOutputDither(int bitDepth, bool noiseShaping) { masterBus.setDither(bitDepth, noiseShaping); }
+    int getMasterLatencySamples() const { return masterBus.getLatencySamples(); }
+    float getMasterGainReductionDb() const { return masterBus.getGainReductionDb(); }
+
+    // --- Automazione ---
+    // Curve in campioni della timeline, applicate campione per campione nel mix e nel bus master
+    // (allineate alla compensazione della latenza) e riprodotte anche dall'export. id = traccia
+    // o bus, ignorato per i parametri del master. nullptr toglie l'automazione: il parametro
+    // torna al valore statico del suo controllo.
+    void setAutomation(AutomatedParameter parameter, int id, std::shared_ptr<const AutomationCurve> curve);
+    std::shared_ptr<const AutomationCurve> getAutomation(AutomatedParameter parameter, int id) const;
+
+    // --- Metering ---
+    // Meter della traccia, nullptr se la traccia non ha (ancora) audio, MIDI o parametri del mixer.
+    // Solo una ricerca, senza creare canali: la UI può chiederlo a ogni refresh e leggerlo senza lock.
+    std::shared_ptr<const LevelMeter> getTrackMeter(int trackId) const;
+    const LevelMeter& getMasterMeter() const { return masterMeter; }
+    const LoudnessMeter& getMasterLoudness() const { return masterLoudness; }
+    void resetIntegratedLoudness() { masterLoudness.requestReset(); }
+    // Frazione del budget del callback spesa nel metering (0..1, media mobile)
+    float getMeteringLoad() const { return meteringLoad.load(std::memory_order_relaxed); }
+
+    // --- Analizzatore di spettro ---
+    // Segnale analizzato: 0 = uscita master, altrimenti la traccia indicata (prima del fader)
+    void setAnalyzerSource(int trackId);
+    int getAnalyzerSource() const { return analyzerSource.load(std::memory_order_relaxed); }
+    const SpectrumAnalyzer& getSpectrumAnalyzer() const { return spectrumAnalyzer; }
+
+    // --- Budget di memoria ---
+    // Limite per i dati audio tenuti in RAM (campioni decodificati, teste per i lanci): oltre
+    // il limite si liberano i dati usati meno di recente e non in riproduzione
+    void setMemoryBudgetMegabytes(int megabytes) { memoryBudget.setBudgetMegabytes(megabytes); }
+    // Occupazione per categoria e hit/miss delle cache (per il monitoraggio)
+    MemoryBudget::Stats getMemoryStats() const { return memoryBudget.getStats(); }
+
+    // --- Cache dei file compressi decodificati (persistente, nella cartella dati dell'applicazione) ---
+    void setDecodedCacheSizeMegabytes(int megabytes) { decodedFiles.setMaxSizeMegabytes(megabytes); }
+    juce::int64 getDecodedCacheSizeInBytes() const { return decodedFiles.getSizeInBytes(); }
+
+    // Underrun totali delle tracce in streaming (per diagnostica)
+    int getStreamingUnderruns() const { return diskStreamer.getTotalUnderruns(); }
+
 private:
-    // Dichiarazione della funzione helper interna
-    void removeTrackAudio_internal(int trackId);
+    // Stato di canale di una traccia: sopravvive al cambio di file e viene condiviso con l'audio thread
+    struct TrackChannel
+    {
+        LevelMeter meter;
+        std::atomic<bool> muted { false };
+        std::atomic<bool> soloed { false };
+        std::atomic<float> gain { 1.0f };
+        std::atomic<float> pan { 0.0f };
+
+        // Richiesta di lancio/stop dal message thread (azione | quantizzazione << 4), stato pubblicato
+        std::atomic<int> launchRequest { 0 };
+        std::atomic<bool> launched { true };
+    };
+
+    // Struttura interna per tenere insieme le risorse audio di una traccia. È un nodo dei piani
+    // pubblicati: la distrugge il message thread quando nessun piano la usa più.
+    struct TrackAudioSource : public TrackNode
+    {
+        TrackAudioSource(AudioEngine& owner, int id, std::unique_ptr<ClipTrackSource> clips);
+        ~TrackAudioSource() override;
+
+        bool render(juce::AudioBuffer<float>& buffer, int numSamples, juce::int64& meteringTicks) override
+        {
+            return engine.renderAudioTrack(*this, buffer, numSamples, meteringTicks);
+        }
+
+        float getGain() const override { return channel->gain.load(std::memory_order_relaxed); }
+        float getPan() const override { return channel->pan.load(std::memory_order_relaxed); }
+
+        // Con i callback fermi (prepareToPlay) o prima della pubblicazione, sotto sourceLock
+        void prepare(double deviceSampleRate, int maxBlockSize);
+        void release();
 
-    // Struttura interna per tenere insieme le risorse audio di una traccia
-    struct TrackAudioSource
+        AudioEngine& engine;
+        const int trackId;
+
+        // In ordine di dipendenza: la distruzione procede al contrario
+        std::unique_ptr<ClipTrackSource> clipSource; // Arrangiamento della traccia, letto dai worker
+        std::unique_ptr<StreamingAudioSource> streamingSource; // Read-ahead servito dal DiskStreamer
+        // Solo se il dispositivo non gira alla frequenza della timeline. Il suo SpinLock protegge il
+        // rapporto, che cambia solo in prepare: sull'audio thread non è mai conteso.
+        std::unique_ptr<juce::ResamplingAudioSource> resampler;
+        bool resampling = false;
+        std::shared_ptr<TrackChannel> channel; // Meter e mute/solo, condivisi con la UI
+
+        // Stato usato solo dall'audio thread per le tracce silenziate
+        bool wasAudible = true;
+        double skipRemainder = 0.0;
+
+        // Stato del lancio (solo audio thread): azione in attesa del suo battito
+        bool launchStopped = false;
+        int pendingLaunchAction = 0;
+        double pendingLaunchBeat = 0.0;
+
+        JUCE_DECLARE_NON_COPYABLE(TrackAudioSource)
+    };
+
+    // Traccia MIDI: lo strumento gira sull'audio thread. Immutabile per il message thread: ogni
+    // modifica costruisce una nuova versione del nodo e la pubblica con un nuovo piano.
+    struct MidiTrackSource : public TrackNode
     {
-        std::unique_ptr<juce::AudioFormatReader> reader; // Teniamo il reader per info
-        std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-        std::unique_ptr<juce::AudioTransportSource> transportSource;
+        MidiTrackSource(AudioEngine& owner, int id) : engine(owner), trackId(id) {}
+        ~MidiTrackSource() override;
+
+        bool render(juce::AudioBuffer<float>& buffer, int numSamples, juce::int64& meteringTicks) override
+        {
+            return engine.renderMidiTrack(*this, buffer, numSamples, meteringTicks);
+        }
 
-        // Costruttore di default per permettere l'inserimento nella mappa prima dell'inizializzazione completa
-         TrackAudioSource() = default;
+        float getGain() const override { return channel->gain.load(std::memory_order_relaxed); }
+        float getPan() const override { return channel->pan.load(std::memory_order_relaxed); }
+        void stopped() override;
 
-         // Costruttore di spostamento per std::move
-         TrackAudioSource(TrackAudioSource&&) = default;
-         TrackAudioSource& operator=(TrackAudioSource&&) = default;
+        AudioEngine& engine;
+        const int trackId;
+
+        // Condiviso con la versione precedente del nodo: le note in corso continuano a suonare
+        std::shared_ptr<SamplerInstrument> instrument;
+        std::shared_ptr<const std::vector<TimedMidiEvent>> events; // Condivisa con il rendering anticipato
+        std::shared_ptr<TrackChannel> channel;
+        bool wasAudible = true;
+
+        // Rendering anticipato: il worker ha un suo strumento costruito dalle stesse zone
+        std::vector<SamplerInstrument::Zone> zones;
+        std::unique_ptr<PrerenderedTrack> prerendered;
+        bool playingPrerendered = false;              // Solo audio thread
+
+        JUCE_DECLARE_NON_COPYABLE(MidiTrackSource)
+    };
+
+    // Costruisce la catena clip -> streaming -> ricampionamento e la sostituisce a quella esistente
+    void installTrackAudio(int trackId, std::unique_ptr<ClipTrackSource> clipSource);
+    // Regione della timeline toccata da una serie di modifiche ai clip (clip prima e dopo)
+    struct ClipEdit
+    {
+        juce::int64 start = std::numeric_limits<juce::int64>::max();
+        juce::int64 end = std::numeric_limits<juce::int64>::min();
+        juce::int64 lengthBefore = 0; // Durata della traccia prima delle modifiche
 
-         // Impedisci copia
-         TrackAudioSource(const TrackAudioSource&) = delete;
-         TrackAudioSource& operator=(const TrackAudioSource&) = delete;
+        void include(const ClipTrackSource& source, int clipId);
     };
+    // Dopo una modifica ai clip, già pubblicata nell'indice: se tocca l'audio letto in anticipo lo
+    // scarta e rilegge dalla posizione corrente, altrimenti basta il nuovo indice e la traccia
+    // continua a suonare dal ring. Senza edit (es. cambio del loop) rilegge sempre.
+    void refreshTrackAudio(int trackId, const ClipEdit* edit = nullptr);
+    // Restituisce l'arrangiamento della traccia, creando la catena audio se manca
+    ClipTrackSource& getOrCreateClipSource(int trackId);
+    void applyTrackChange(int trackId, const TrackState* before, const TrackState& after);
+    std::shared_ptr<TrackChannel> getOrCreateTrackChannel(int trackId);
+    void updateSoloCount();
+    // Message thread, prima di applicare mute/solo di trackId: le tracce silenziate che diventeranno
+    // udibili riempiono il ring da un punto poco più avanti, così al cambio l'audio è già pronto
+    void prefillTracksBecomingAudible(int trackId, bool mutedAfter, bool soloedAfter);
+    static constexpr double unmuteLeadSeconds = 0.03; // Margine per la prima lettura dei worker
+    // Apre gli ingressi del dispositivo (con le impostazioni correnti) se sono ancora chiusi;
+    // restituisce il numero di ingressi attivi
+    int openInputChannels();
+    // Avanza una traccia silenziata senza decodificarla; restituisce i tick spesi nel metering
+    juce::int64 skipTrack(TrackAudioSource& source, int numSamples);
+
+    // Lancio quantizzato (audio thread)
+    enum LaunchAction { launchActionNone = 0, launchActionStart = 1, launchActionStop = 2 };
+    void requestLaunchAction(int trackId, LaunchAction action, Quantization quantization);
+    // La testa appartiene al budget di memoria: se viene sfrattata il lancio parte dal disco
+    bool buildLaunchHead(int trackId, const std::shared_ptr<TrackAudioSource>& source);
+    static juce::String getLaunchHeadKey(int trackId) { return "launch-head/" + juce::String(trackId); }
+    void adoptLaunchRequest(TrackAudioSource& source);
+    void applyLaunchAction(TrackAudioSource& source);
+    bool isLaunchActionDue(const TrackAudioSource& source, int numSamples) const;
+    // Rende la traccia nel buffer dividendo il blocco sul campione esatto di un lancio/stop
+    void renderLaunchableTrack(TrackAudioSource& source, juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // Esegue il piano di routing sull'uscita; restituisce i tick spesi nel metering
+    juce::int64 mixTracks(ProcessingPlan* plan, juce::AudioBuffer<float>& output, int startSample, int numSamples);
+    bool renderAudioTrack(TrackAudioSource& source, juce::AudioBuffer<float>& buffer, int numSamples, juce::int64& meteringTicks);
+    bool renderMidiTrack(MidiTrackSource& track, juce::AudioBuffer<float>& buffer, int numSamples, juce::int64& meteringTicks);
+    // Copia del segnale della traccia per l'analizzatore, se è la sorgente scelta
+    void tapTrack(int trackId, const juce::AudioBuffer<float>& buffer, int numSamples);
+    // Message thread: nuova versione del nodo MIDI con lo stesso stato, da modificare e installare
+    std::shared_ptr<MidiTrackSource> copyMidiTrack(int trackId);
+    // Crea il rendering anticipato (se serve) e pubblica il nodo al posto del precedente
+    void installMidiTrack(int trackId, std::shared_ptr<MidiTrackSource> track);
+    // Message thread: crea, sostituisce o rimuove il rendering anticipato della traccia MIDI
+    void updatePrerendering(int trackId);
+    // Nodo della traccia (audio o MIDI) da mettere nel piano
+    std::shared_ptr<TrackNode> findTrackNode(int trackId) const;
+    // Message thread: compila il grafo (senza lock), vi collega nodi, curve e riverberi e pubblica il nuovo piano
+    void rebuildProcessingPlan();
+    // Rende il piano visibile dal callback successivo e distrugge il precedente quando
+    // l'audio thread non può più usarlo
+    void publishPlan(std::unique_ptr<ProcessingPlan> plan);
+    // Message thread: attende che il callback in corso (se c'è) sia terminato
+    void waitForAudioThread() const;
+    bool isAudible(const TrackChannel& channel) const;
 
     juce::AudioFormatManager formatManager;
-    juce::TimeSliceThread thread { "Audio Load Thread" }; // Thread per lettura file
-    juce::MixerAudioSource mixerSource;                  // Mixer per combinare le tracce
+    DecodedFileCache decodedFiles { formatManager };     // MP3/Ogg/FLAC decodificati una volta sola
+    DiskStreamer diskStreamer;                           // Scheduler di lettura da disco per tutte le tracce
+
+    MemoryBudget memoryBudget;
+    SampleCache sampleCache { formatManager, memoryBudget };
 
     // Mappa che associa l'ID della traccia (int) alle sue risorse audio
-    std::map<int, TrackAudioSource> trackSources;
-    juce::CriticalSection sourceLock; // Lock per proteggere l'accesso a trackSources e mixerSource
+    TrackPrerenderer prerenderer;                       // Deve sopravvivere alle tracce che rende
+    bool anticipativeRendering = false;
+    std::set<int> liveTracks;                           // Solo message thread
+
+    // Scritte solo dal message thread; l'audio thread raggiunge i nodi attraverso il piano
+    std::map<int, std::shared_ptr<TrackAudioSource>> trackSources;
+    std::map<int, std::shared_ptr<MidiTrackSource>> midiTracks;
+    // Esclude prepareToPlay/releaseResources (che preparano i nodi) dalle modifiche alle mappe.
+    // Mai preso dall'audio thread.
+    juce::CriticalSection sourceLock;
+
+    RoutingGraph routingGraph;                          // Solo message thread
+
+    // Riverberi dei bus: l'audio thread li raggiunge dal passo del piano
+    struct BusConvolution
+    {
+        juce::File file;
+        float wetLevel = 1.0f, dryLevel = 0.0f;
+        double sampleRate = 0.0;                        // Frequenza a cui è stata ricampionata la risposta
+        std::unique_ptr<ConvolutionReverb> reverb;
+    };
+    ConvolutionTailScheduler convolutionWorkers;        // Deve sopravvivere ai riverberi
+    std::map<int, BusConvolution> busConvolutions;      // Solo message thread
+    std::unique_ptr<ProcessingPlan> processingPlan;     // Solo message thread: possiede il piano pubblicato
+    std::atomic<ProcessingPlan*> activePlan { nullptr }; // Letto una sola volta per callback
+    std::atomic<juce::uint32> callbackEpoch { 0 };      // Dispari mentre l'audio thread è nel callback
+    std::atomic<int> mixBlockSize { 0 };   // Campioni per passo del piano, fissati in prepareToPlay
+    std::atomic<int> outputLatency { 0 };
+    // Curve attive e pan statici, scritti dal message thread e letti anche da altri thread
+    mutable juce::CriticalSection automationLock;
+    AutomationMap automation;
+    std::map<int, float> trackPans;
+    juce::MidiBuffer midiBlock;            // Eventi del blocco corrente, preallocato in prepareToPlay
+    int preparedBlockSize = 0;
+    bool wasPlaying = false;               // Solo audio thread: rileva lo stop del transport
+    std::atomic<bool> clockResetRequested { false }; // Da play(): il clock appartiene all'audio thread
+    double timelinePosition = 0.0;         // Solo audio thread
+    juce::int64 devicePosition = 0;        // Campioni del dispositivo suonati (solo audio thread)
+    std::atomic<juce::int64> publishedTimelinePosition { 0 };
+
+    MasterBus masterBus;
+    MusicalClock musicalClock;
+
+    std::map<int, std::shared_ptr<TrackChannel>> trackChannels; // Solo message thread
+    std::atomic<int> numSoloedTracks { 0 };
+    LevelMeter masterMeter;
+    LoudnessMeter masterLoudness;
+    std::atomic<float> meteringLoad { 0.0f };
+
+    AudioTap analyzerTap;                      // Scritta dall'audio thread, letta dall'analizzatore
+    SpectrumAnalyzer spectrumAnalyzer { analyzerTap };
+    std::atomic<int> analyzerSource { 0 };
+
+    // Frame dell'arrangiamento tenuti in memoria per un lancio immediato
+    static constexpr int launchHeadFrames = 65536;
+
+    MultitrackRecorder recorder;
+    std::atomic<double> currentSampleRate { 0.0 };
+    double timelineSampleRate = 44100.0;
 
     int currentBPM = 120;
     juce::String currentKey = "C Minor"; // Chiave iniziale
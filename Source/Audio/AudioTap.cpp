@@ -0,0 +1,56 @@
+#include "AudioTap.h"
+
+AudioTap::AudioTap(int capacitySamples)
+    : fifo(capacitySamples)
+{
+    ring.allocate((size_t) capacitySamples, true);
+}
+
+void AudioTap::push(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    const int channels = juce::jmin(2, buffer.getNumChannels());
+    if (channels == 0)
+        return;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    auto writeMono = [&](int ringStart, int size, int offset)
+    {
+        if (size <= 0)
+            return;
+
+        const float* left = buffer.getReadPointer(0, startSample + offset);
+        if (channels == 1)
+        {
+            juce::FloatVectorOperations::copy(ring + ringStart, left, size);
+            return;
+        }
+
+        juce::FloatVectorOperations::copyWithMultiply(ring + ringStart, left, 0.5f, size);
+        juce::FloatVectorOperations::addWithMultiply(ring + ringStart, buffer.getReadPointer(1, startSample + offset), 0.5f, size);
+    };
+
+    writeMono(start1, size1, 0);
+    writeMono(start2, size2, size1);
+    fifo.finishedWrite(size1 + size2);
+}
+
+int AudioTap::pull(float* destination, int maxSamples)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(maxSamples, start1, size1, start2, size2);
+
+    if (size1 > 0)
+        juce::FloatVectorOperations::copy(destination, ring + start1, size1);
+    if (size2 > 0)
+        juce::FloatVectorOperations::copy(destination + size1, ring + start2, size2);
+
+    fifo.finishedRead(size1 + size2);
+    return size1 + size2;
+}
+
+void AudioTap::discardAll()
+{
+    fifo.finishedRead(fifo.getNumReady());
+}
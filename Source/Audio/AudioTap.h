@@ -0,0 +1,26 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Presa audio lock-free: l'audio thread copia il segnale (ridotto a mono) in un ring buffer,
+// un thread in background lo legge. Singolo produttore, singolo consumatore; se il consumatore
+// resta indietro i campioni in eccesso vengono scartati, mai attesi.
+class AudioTap
+{
+public:
+    explicit AudioTap(int capacitySamples = 32768);
+
+    // --- Audio thread ---
+    void push(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    // --- Thread consumatore ---
+    int pull(float* destination, int maxSamples);
+    int getNumReady() const { return fifo.getNumReady(); }
+    void discardAll();
+
+private:
+    juce::AbstractFifo fifo;
+    juce::HeapBlock<float> ring;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioTap)
+};
@@ -0,0 +1,228 @@
+#include "Automation.h"
+
+namespace
+{
+    using Register = juce::dsp::SIMDRegister<float>;
+    constexpr int registerSize = (int) Register::size();
+
+    // Scrive evaluate(x) con x = x0 + i * dx. Testa e coda scalari, corpo su registri allineati:
+    // evaluate è generica, riceve sia float sia Register con le stesse operazioni.
+    template <typename Evaluate>
+    void renderRamp(float* destination, int numSamples, float x0, float dx, Evaluate evaluate)
+    {
+        int i = 0;
+        for (; i < numSamples && !Register::isSIMDAligned(destination + i); ++i)
+            destination[i] = evaluate(x0 + (float) i * dx);
+
+        auto laneOffsets = Register::expand(0.0f);
+        for (size_t lane = 0; lane < Register::size(); ++lane)
+            laneOffsets.set(lane, (float) lane * dx);
+
+        // x ricalcolato a ogni registro (niente accumulo di errore lungo il tratto)
+        for (; i + registerSize <= numSamples; i += registerSize)
+            evaluate(laneOffsets + (x0 + (float) i * dx)).copyToRawArray(destination + i);
+
+        for (; i < numSamples; ++i)
+            destination[i] = evaluate(x0 + (float) i * dx);
+    }
+
+    // start * ratio^x: ogni corsia del registro è una catena moltiplicativa indipendente, quindi
+    // il corpo costa una moltiplicazione per registro invece di una pow per campione
+    void renderExponential(float* destination, int numSamples, float start, float ratio, float x0, float dx)
+    {
+        auto valueAt = [=](int i) { return start * std::pow(ratio, x0 + (float) i * dx); };
+
+        int i = 0;
+        for (; i < numSamples && !Register::isSIMDAligned(destination + i); ++i)
+            destination[i] = valueAt(i);
+
+        if (i + registerSize <= numSamples)
+        {
+            auto values = Register::expand(0.0f);
+            for (size_t lane = 0; lane < Register::size(); ++lane)
+                values.set(lane, valueAt(i + (int) lane));
+
+            const auto step = Register::expand(std::pow(ratio, (float) registerSize * dx));
+            for (; i + registerSize <= numSamples; i += registerSize)
+            {
+                values.copyToRawArray(destination + i);
+                values *= step;
+            }
+        }
+
+        for (; i < numSamples; ++i)
+            destination[i] = valueAt(i);
+    }
+
+    void renderSegment(const AutomationCurve::Breakpoint& from, const AutomationCurve::Breakpoint& to,
+                       float* destination, int numSamples, float x0, float dx)
+    {
+        const float start = from.value;
+        const float range = to.value - from.value;
+
+        if (range == 0.0f)
+        {
+            juce::FloatVectorOperations::fill(destination, start, numSamples);
+            return;
+        }
+
+        switch (from.shape)
+        {
+            case AutomationCurve::Shape::exponential:
+                // Definita solo tra valori positivi: altrimenti il tratto resta lineare
+                if (start > 0.0f && to.value > 0.0f)
+                {
+                    renderExponential(destination, numSamples, start, to.value / start, x0, dx);
+                    return;
+                }
+                break;
+
+            case AutomationCurve::Shape::sCurve:
+                renderRamp(destination, numSamples, x0, dx, [=](auto x) { return x * x * (x * -2.0f + 3.0f) * range + start; });
+                return;
+
+            case AutomationCurve::Shape::linear:
+                break;
+        }
+
+        renderRamp(destination, numSamples, x0, dx, [=](auto x) { return x * range + start; });
+    }
+}
+
+//==============================================================================
+AutomationCurve::AutomationCurve(std::vector<Breakpoint> breakpoints)
+    : points(std::move(breakpoints))
+{
+    std::stable_sort(points.begin(), points.end(), [](const Breakpoint& a, const Breakpoint& b) { return a.time < b.time; });
+}
+
+int AutomationCurve::findSegment(double time) const
+{
+    auto it = std::upper_bound(points.begin(), points.end(), time,
+                               [](double t, const Breakpoint& point) { return t < (double) point.time; });
+    return (int) (it - points.begin()) - 1;
+}
+
+float AutomationCurve::getValueAt(double time) const
+{
+    if (points.empty())
+        return 0.0f;
+
+    const int segment = findSegment(time);
+    if (segment < 0)
+        return points.front().value;
+    if (segment + 1 >= (int) points.size())
+        return points.back().value;
+
+    const auto& from = points[(size_t) segment];
+    const auto& to = points[(size_t) segment + 1];
+    return interpolate(from, to, (float) ((time - (double) from.time) / (double) (to.time - from.time)));
+}
+
+float AutomationCurve::interpolate(const Breakpoint& from, const Breakpoint& to, float x)
+{
+    const float range = to.value - from.value;
+
+    switch (from.shape)
+    {
+        case Shape::exponential:
+            if (from.value > 0.0f && to.value > 0.0f)
+                return from.value * std::pow(to.value / from.value, x);
+            break;
+
+        case Shape::sCurve:
+            return from.value + range * x * x * (3.0f - 2.0f * x);
+
+        case Shape::linear:
+            break;
+    }
+
+    return from.value + range * x;
+}
+
+//==============================================================================
+std::shared_ptr<const AutomationCurve> AutomationLane::setCurve(std::shared_ptr<const AutomationCurve> newCurve)
+{
+    if (newCurve != nullptr && newCurve->isEmpty())
+        newCurve = nullptr;
+
+    std::swap(curve, newCurve);
+    needsSeek = true;
+    return newCurve;
+}
+
+void AutomationLane::render(float* destination, double blockStart, double timelinePerSample, int numSamples)
+{
+    jassert(curve != nullptr && timelinePerSample > 0.0);
+    if (curve == nullptr || numSamples <= 0)
+        return;
+
+    const auto& points = curve->getBreakpoints();
+    const int last = (int) points.size() - 1;
+
+    // Curva nuova o salto indietro (loop, riposizionamento): ricerca binaria, poi di nuovo incrementale
+    if (needsSeek || (cursor >= 0 && (double) points[(size_t) cursor].time > blockStart))
+    {
+        cursor = curve->findSegment(blockStart);
+        needsSeek = false;
+    }
+
+    for (int i = 0; i < numSamples;)
+    {
+        const double position = blockStart + i * timelinePerSample;
+        while (cursor < last && (double) points[(size_t) cursor + 1].time <= position)
+            ++cursor;
+
+        if (cursor == last)
+        {
+            juce::FloatVectorOperations::fill(destination + i, points.back().value, numSamples - i);
+            return;
+        }
+
+        const auto& next = points[(size_t) cursor + 1];
+
+        // Primo campione che arriva al punto successivo (almeno un campione per giro)
+        const double boundary = std::ceil(((double) next.time - blockStart) / timelinePerSample);
+        const int end = boundary >= numSamples ? numSamples : juce::jmax(i + 1, (int) boundary);
+
+        if (cursor < 0)
+        {
+            // Prima del primo punto la curva vale quanto il primo punto
+            juce::FloatVectorOperations::fill(destination + i, next.value, end - i);
+        }
+        else
+        {
+            const auto& from = points[(size_t) cursor];
+            const double length = (double) (next.time - from.time);
+            renderSegment(from, next, destination + i, end - i,
+                          (float) ((position - (double) from.time) / length), (float) (timelinePerSample / length));
+        }
+
+        i = end;
+    }
+}
+
+//==============================================================================
+void AutomatedFader::renderGains(float staticVolume, float staticPan, double blockStart, double timelinePerSample,
+                                 float* left, float* right, float* scratch, int numSamples)
+{
+    if (volume.isActive())
+        volume.render(left, blockStart, timelinePerSample, numSamples);
+    else
+        juce::FloatVectorOperations::fill(left, staticVolume, numSamples);
+
+    if (pan.isActive())
+        pan.render(scratch, blockStart, timelinePerSample, numSamples);
+    else
+        juce::FloatVectorOperations::fill(scratch, staticPan, numSamples);
+
+    // Destra: volume * (1 + pan), sinistra: volume * (1 - pan), ognuna limitata a [0, 1]
+    juce::FloatVectorOperations::add(right, scratch, 1.0f, numSamples);
+    juce::FloatVectorOperations::clip(right, right, 0.0f, 1.0f, numSamples);
+    juce::FloatVectorOperations::multiply(right, left, numSamples);
+
+    juce::FloatVectorOperations::negate(scratch, scratch, numSamples);
+    juce::FloatVectorOperations::add(scratch, 1.0f, numSamples);
+    juce::FloatVectorOperations::clip(scratch, scratch, 0.0f, 1.0f, numSamples);
+    juce::FloatVectorOperations::multiply(left, scratch, numSamples);
+}
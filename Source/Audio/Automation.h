@@ -0,0 +1,96 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Curva di automazione: punti sulla timeline (in campioni della timeline) uniti da tratti
+// lineari, esponenziali o a S. Immutabile: si sostituisce in blocco, e l'audio thread la
+// legge senza lock mentre il message thread ne prepara una nuova.
+class AutomationCurve
+{
+public:
+    enum class Shape
+    {
+        linear,
+        exponential, // Rapporto costante: su un guadagno lineare è una retta in dB
+        sCurve       // Partenza e arrivo morbidi (smoothstep)
+    };
+
+    struct Breakpoint
+    {
+        juce::int64 time = 0;        // Campioni della timeline
+        float value = 0.0f;
+        Shape shape = Shape::linear; // Forma del tratto verso il punto successivo
+    };
+
+    // I punti vengono ordinati per tempo; due punti con lo stesso tempo danno un salto
+    explicit AutomationCurve(std::vector<Breakpoint> breakpoints);
+
+    const std::vector<Breakpoint>& getBreakpoints() const { return points; }
+    bool isEmpty() const { return points.empty(); }
+
+    // Indice dell'ultimo punto con tempo <= time (-1 se time precede il primo punto)
+    int findSegment(double time) const;
+    // Valore in un istante qualsiasi (ricerca binaria: per la UI, non per il callback)
+    float getValueAt(double time) const;
+
+    // Valore del tratto from -> to alla frazione x (0..1)
+    static float interpolate(const Breakpoint& from, const Breakpoint& to, float x);
+
+private:
+    std::vector<Breakpoint> points;
+};
+
+// Parametri automatizzabili. Guadagni e soffitto del limiter sono lineari; il pan va da -1 a 1.
+enum class AutomatedParameter
+{
+    trackVolume,
+    trackPan,
+    busGain,
+    masterGain,
+    masterCeiling
+};
+
+// Curve per parametro e ID (traccia o bus; 0 per i parametri del bus master)
+using AutomationMap = std::map<std::pair<AutomatedParameter, int>, std::shared_ptr<const AutomationCurve>>;
+
+// Lettura di una curva sull'audio thread, un blocco alla volta. Il cursore ricorda il tratto
+// corrente: in riproduzione lineare avanza di pochi punti per blocco (O(1)), solo un salto
+// indietro sulla timeline costa una ricerca binaria. I valori per campione sono calcolati a
+// tratti su registri SIMD, quindi anche centinaia di parametri automatizzati costano poco.
+class AutomationLane
+{
+public:
+    // Da chiamare prima che l'audio thread veda la corsia (o sotto un lock che lo esclude).
+    // Restituisce la curva precedente. nullptr (o una curva vuota) toglie l'automazione.
+    std::shared_ptr<const AutomationCurve> setCurve(std::shared_ptr<const AutomationCurve> newCurve);
+
+    bool isActive() const { return curve != nullptr; }
+
+    // Audio thread: valore di ogni campione del blocco, che inizia a blockStart (campioni della
+    // timeline) e avanza di timelinePerSample per campione
+    void render(float* destination, double blockStart, double timelinePerSample, int numSamples);
+
+private:
+    std::shared_ptr<const AutomationCurve> curve;
+    int cursor = -1; // Ultimo punto con tempo <= posizione letta (-1 = prima del primo punto)
+    bool needsSeek = true;
+};
+
+// Fader di una traccia con volume e bilanciamento automatizzabili. Produce i guadagni per
+// campione dei due canali: il lato opposto al pan si attenua linearmente, il centro resta a
+// guadagno unitario (le sessioni senza pan suonano come prima).
+struct AutomatedFader
+{
+    AutomationLane volume, pan;
+
+    // Vero se il fader va applicato campione per campione invece che con un guadagno unico
+    bool isPerSample(float staticPan) const { return volume.isActive() || pan.isActive() || staticPan != 0.0f; }
+
+    // Audio thread: scratch deve avere numSamples campioni come left e right
+    void renderGains(float staticVolume, float staticPan, double blockStart, double timelinePerSample,
+                     float* left, float* right, float* scratch, int numSamples);
+};
@@ -0,0 +1,91 @@
+#include "ClipBaker.h"
+#include "Tracer.h"
+
+bool ClipBaker::bake(juce::AudioFormatReader& reader, const ResolvedClip& source, const Options& options,
+                     const juce::File& destination, Clip& result)
+{
+    AW_TRACE_SCOPE("Bake clip");
+
+    const auto& clip = source.clip;
+    const auto first = clip.sourceOffset;
+    const auto frames = juce::jmin(reader.lengthInSamples - first,
+                                   (juce::int64) std::ceil((double) clip.length * source.sourceRatio));
+    const int numChannels = (int) reader.numChannels;
+
+    if (frames <= 0 || first < 0 || numChannels <= 0)
+    {
+        juce::Logger::writeToLog("ClipBaker Error: Clip " + juce::String(clip.id) + " has no samples to render");
+        return false;
+    }
+
+    float gain = 1.0f;
+    if (options.normalise)
+    {
+        juce::HeapBlock<juce::Range<float>> levels((size_t) numChannels);
+        reader.readMaxLevels(first, frames, levels.get(), numChannels);
+
+        float peak = 0.0f;
+        for (int ch = 0; ch < numChannels; ++ch)
+            peak = juce::jmax(peak, -levels[ch].getStart(), levels[ch].getEnd());
+
+        // Un tratto silenzioso resta com'è
+        if (peak > 0.0f)
+            gain = juce::Decibels::decibelsToGain(options.peakDb) / peak;
+    }
+
+    juce::TemporaryFile output(destination);
+    {
+        auto stream = std::make_unique<juce::FileOutputStream>(output.getFile());
+        if (!stream->openedOk())
+        {
+            juce::Logger::writeToLog("ClipBaker Error: Cannot write " + destination.getFullPathName());
+            return false;
+        }
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), reader.sampleRate,
+                                                                            (unsigned int) numChannels, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Ora appartiene al writer
+
+        juce::AudioBuffer<float> chunk(numChannels, 65536);
+        for (juce::int64 done = 0; done < frames;)
+        {
+            const int count = (int) juce::jmin<juce::int64>(chunk.getNumSamples(), frames - done);
+
+            // Al contrario i blocchi vengono letti dalla fine del tratto e rovesciati
+            const auto position = clip.reversed ? first + frames - done - count : first + done;
+            reader.read(&chunk, 0, count, position, true, true);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                if (clip.reversed)
+                    chunk.reverse(ch, 0, count);
+                chunk.applyGain(ch, 0, count, gain);
+            }
+
+            if (!writer->writeFromAudioSampleBuffer(chunk, 0, count))
+                return false;
+            done += count;
+        }
+    }
+
+    if (!output.overwriteTargetFileWithTemporary())
+        return false;
+
+    result = clip;
+    result.file = destination;
+    result.sourceOffset = 0;
+    result.reversed = false;
+
+    juce::Logger::writeToLog("ClipBaker: Clip " + juce::String(clip.id) + " rendered to " + destination.getFullPathName());
+    return true;
+}
+
+juce::File ClipBaker::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+               .getChildFile("AudioWorkstation").getChildFile("Rendered");
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "ClipTrackSource.h"
+
+// Edit distruttivi, eseguiti solo su richiesta esplicita: il tratto del file che un clip suona
+// viene scritto in un file nuovo (normalizzato e/o già rovesciato) e il clip passa a usare
+// quello. È l'unico punto in cui un edit alloca campioni: il file originale non cambia, quindi
+// gli altri clip che lo usano e l'undo continuano a funzionare.
+class ClipBaker
+{
+public:
+    struct Options
+    {
+        bool normalise = false;
+        float peakDb = 0.0f; // Picco del tratto dopo la normalizzazione
+    };
+
+    // Scrive in destination (WAV float a 32 bit, alla frequenza del file) i campioni nel verso
+    // in cui il clip li suona. result è il clip sul nuovo file; fade e guadagno restano non distruttivi.
+    static bool bake(juce::AudioFormatReader& reader, const ResolvedClip& source, const Options& options,
+                     const juce::File& destination, Clip& result);
+
+    // Cartella dei file prodotti dagli edit distruttivi
+    static juce::File getDefaultDirectory();
+};
@@ -0,0 +1,380 @@
+#include "ClipTrackSource.h"
+#include <algorithm>
+#include <limits>
+#include <set>
+
+namespace
+{
+    // Interpolazione cubica di Hermite (Catmull-Rom) tra y1 e y2
+    inline float hermite(float y0, float y1, float y2, float y3, float t) noexcept
+    {
+        const float c1 = 0.5f * (y2 - y0);
+        const float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+        const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+        return ((c3 * t + c2) * t + c1) * t + y1;
+    }
+}
+
+//==============================================================================
+ClipIndex::ClipIndex(std::vector<Entry> clipEntries)
+    : entries(std::move(clipEntries))
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+    {
+        return a.clip.timelineStart < b.clip.timelineStart;
+    });
+
+    subtreeMaxEnd.resize(entries.size());
+    endOfLastClip = juce::jmax<juce::int64>(0, buildMaxEnd(0, (int) entries.size()));
+}
+
+juce::int64 ClipIndex::buildMaxEnd(int lo, int hi)
+{
+    if (lo >= hi)
+        return std::numeric_limits<juce::int64>::min();
+
+    const int mid = (lo + hi) / 2;
+    const auto maxEnd = juce::jmax(entries[(size_t) mid].clip.getTimelineEnd(),
+                                   buildMaxEnd(lo, mid),
+                                   buildMaxEnd(mid + 1, hi));
+    subtreeMaxEnd[(size_t) mid] = maxEnd;
+    return maxEnd;
+}
+
+void ClipIndex::findOverlapping(juce::int64 start, juce::int64 end, std::vector<int>& result) const
+{
+    query(0, (int) entries.size(), start, end, result);
+}
+
+void ClipIndex::query(int lo, int hi, juce::int64 start, juce::int64 end, std::vector<int>& result) const
+{
+    if (lo >= hi)
+        return;
+
+    const int mid = (lo + hi) / 2;
+
+    // Nessun clip di questo sottoalbero arriva fino a start
+    if (subtreeMaxEnd[(size_t) mid] <= start)
+        return;
+
+    query(lo, mid, start, end, result);
+
+    const auto& clip = entries[(size_t) mid].clip;
+    if (clip.timelineStart >= end)
+        return; // Anche tutto il sottoalbero destro inizia dopo la fine della query
+
+    if (clip.getTimelineEnd() > start)
+        result.push_back(mid);
+
+    query(mid + 1, hi, start, end, result);
+}
+
+//==============================================================================
+ClipTrackSource::ClipTrackSource(juce::AudioFormatManager& formatManager, double timelineSampleRate,
+                                 DecodedFileCache* decodedCache)
+    : formats(formatManager),
+      decodedFiles(decodedCache),
+      timelineRate(timelineSampleRate > 0.0 ? timelineSampleRate : 44100.0),
+      currentIndex(std::make_shared<const ClipIndex>(std::vector<ClipIndex::Entry>()))
+{
+}
+
+ClipTrackSource::~ClipTrackSource() = default;
+
+bool ClipTrackSource::resolveClip(Clip& clip, std::shared_ptr<juce::AudioFormatReader>& reader)
+{
+    auto& cached = readers[clip.file.getFullPathName()];
+    if (cached == nullptr)
+        cached.reset(decodedFiles != nullptr ? decodedFiles->createReaderFor(clip.file) : formats.createReaderFor(clip.file));
+
+    if (cached == nullptr || cached->sampleRate <= 0.0)
+    {
+        readers.erase(clip.file.getFullPathName());
+        juce::Logger::writeToLog("AudioEngine Error: Cannot create reader for clip: " + clip.file.getFullPathName());
+        return false;
+    }
+
+    const double ratio = cached->sampleRate / timelineRate;
+    clip.timelineStart = juce::jmax<juce::int64>(0, clip.timelineStart);
+    clip.sourceOffset = juce::jlimit<juce::int64>(0, cached->lengthInSamples, clip.sourceOffset);
+
+    if (clip.length < 0)
+        clip.length = (juce::int64) ((cached->lengthInSamples - clip.sourceOffset) / ratio);
+
+    if (clip.length <= 0)
+        return false;
+
+    clip.fadeInLength = juce::jlimit<juce::int64>(0, clip.length, clip.fadeInLength);
+    clip.fadeOutLength = juce::jlimit<juce::int64>(0, clip.length, clip.fadeOutLength);
+    clip.gain = juce::jmax(0.0f, clip.gain);
+
+    reader = cached;
+    return true;
+}
+
+int ClipTrackSource::addClip(const Clip& clip)
+{
+    ClipIndex::Entry entry { clip, nullptr };
+    if (!resolveClip(entry.clip, entry.reader))
+        return -1;
+
+    const int id = clip.id > 0 ? clip.id : nextClipId;
+    if (clips.count(id) > 0)
+        return -1;
+
+    entry.clip.id = id;
+    nextClipId = juce::jmax(nextClipId, id + 1);
+    clips[id] = std::move(entry);
+    publishIndex();
+    return id;
+}
+
+bool ClipTrackSource::updateClip(const Clip& clip)
+{
+    auto it = clips.find(clip.id);
+    if (it == clips.end())
+        return false;
+
+    ClipIndex::Entry entry { clip, nullptr };
+    if (!resolveClip(entry.clip, entry.reader))
+        return false;
+
+    it->second = std::move(entry);
+    publishIndex();
+    return true;
+}
+
+bool ClipTrackSource::removeClip(int clipId)
+{
+    if (clips.erase(clipId) == 0)
+        return false;
+
+    publishIndex();
+    return true;
+}
+
+std::vector<Clip> ClipTrackSource::getClips() const
+{
+    std::vector<Clip> result;
+    result.reserve(clips.size());
+    for (auto const& [id, entry] : clips)
+        result.push_back(entry.clip);
+    return result;
+}
+
+bool ClipTrackSource::getResolvedClip(int clipId, ResolvedClip& result) const
+{
+    auto it = clips.find(clipId);
+    if (it == clips.end())
+        return false;
+
+    const auto& reader = *it->second.reader;
+    result.clip = it->second.clip;
+    result.sourceRatio = reader.sampleRate / timelineRate;
+    result.sourceLength = reader.lengthInSamples;
+    return true;
+}
+
+void ClipTrackSource::setDeferIndexUpdates(bool shouldDefer)
+{
+    deferIndexUpdates = shouldDefer;
+    if (!shouldDefer && indexIsStale)
+        publishIndex();
+}
+
+bool ClipTrackSource::reopenFile(const juce::File& file)
+{
+    const auto path = file.getFullPathName();
+    if (readers.count(path) == 0)
+        return false;
+
+    readers.erase(path);
+
+    // Solo il reader cambia: posizioni e durate dei clip restano quelle già risolte
+    for (auto& [id, entry] : clips)
+    {
+        if (entry.clip.file != file)
+            continue;
+
+        auto clip = entry.clip;
+        std::shared_ptr<juce::AudioFormatReader> reader;
+        if (resolveClip(clip, reader))
+            entry.reader = std::move(reader);
+    }
+
+    publishIndex();
+    return true;
+}
+
+void ClipTrackSource::publishIndex()
+{
+    if (deferIndexUpdates)
+    {
+        indexIsStale = true;
+        return;
+    }
+
+    indexIsStale = false;
+    std::vector<ClipIndex::Entry> entries;
+    entries.reserve(clips.size());
+
+    std::set<juce::String> usedFiles;
+    for (auto const& [id, entry] : clips)
+    {
+        entries.push_back(entry);
+        usedFiles.insert(entry.clip.file.getFullPathName());
+    }
+
+    // I reader non più usati restano vivi finché il worker tiene il vecchio indice
+    for (auto it = readers.begin(); it != readers.end();)
+        it = usedFiles.count(it->first) > 0 ? std::next(it) : readers.erase(it);
+
+    std::shared_ptr<const ClipIndex> index = std::make_shared<const ClipIndex>(std::move(entries));
+    totalLength.store(index->getEndOfLastClip());
+
+    {
+        const juce::SpinLock::ScopedLockType lock(indexLock);
+        std::swap(currentIndex, index);
+    }
+    // Il vecchio indice viene distrutto qui, fuori dal lock
+}
+
+std::shared_ptr<const ClipIndex> ClipTrackSource::getCurrentIndex() const
+{
+    const juce::SpinLock::ScopedLockType lock(indexLock);
+    return currentIndex;
+}
+
+void ClipTrackSource::prepareToPlay(int, double)
+{
+    clipBuffer.setSize(2, renderChunkFrames);
+    sourceBuffer.setSize(2, renderChunkFrames * 2 + 4);
+    activeClips.reserve(64);
+}
+
+void ClipTrackSource::releaseResources()
+{
+}
+
+void ClipTrackSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    bufferToFill.clearActiveBufferRegion();
+
+    const auto index = getCurrentIndex();
+    const auto length = getTotalLength();
+    const bool loop = isLooping() && length > 0;
+
+    for (int done = 0; done < bufferToFill.numSamples;)
+    {
+        auto position = nextReadPosition;
+        if (loop)
+            position %= length;
+
+        int segment = juce::jmin(bufferToFill.numSamples - done, renderChunkFrames);
+        if (loop)
+            segment = (int) juce::jmin<juce::int64>(segment, length - position);
+
+        renderRange(*index, *bufferToFill.buffer, bufferToFill.startSample + done, position, segment);
+
+        nextReadPosition = position + segment;
+        done += segment;
+    }
+}
+
+void ClipTrackSource::renderRange(const ClipIndex& index, juce::AudioBuffer<float>& buffer, int startSample,
+                                  juce::int64 timelinePosition, int numSamples)
+{
+    activeClips.clear();
+    index.findOverlapping(timelinePosition, timelinePosition + numSamples, activeClips);
+
+    for (int clipIndex : activeClips)
+        renderClip(index.getEntry(clipIndex), buffer, startSample, timelinePosition, numSamples);
+}
+
+void ClipTrackSource::renderClip(const ClipIndex::Entry& entry, juce::AudioBuffer<float>& buffer, int startSample,
+                                 juce::int64 timelinePosition, int numSamples)
+{
+    const auto& clip = entry.clip;
+    auto& reader = *entry.reader;
+
+    const auto from = juce::jmax(timelinePosition, clip.timelineStart);
+    const auto to = juce::jmin(timelinePosition + numSamples, clip.getTimelineEnd());
+    const int count = (int) (to - from);
+    if (count <= 0)
+        return;
+
+    const double ratio = reader.sampleRate / timelineRate;
+
+    // Al contrario il tratto viene letto in avanti dalla posizione simmetrica e poi rovesciato
+    const auto offsetInClip = clip.reversed ? clip.length - (from - clip.timelineStart) - count
+                                            : from - clip.timelineStart;
+
+    if (ratio == 1.0)
+    {
+        reader.read(&clipBuffer, 0, count, clip.sourceOffset + offsetInClip, true, true);
+    }
+    else
+    {
+        // Lettura senza stato: ogni blocco legge i campioni che gli servono più un margine per la cubica
+        const double start = clip.sourceOffset + offsetInClip * ratio;
+        const auto first = (juce::int64) std::floor(start) - 1;
+        const int needed = (int) ((juce::int64) std::floor(start + (count - 1) * ratio) - first) + 3;
+
+        sourceBuffer.setSize(2, needed, false, false, true);
+        reader.read(&sourceBuffer, 0, needed, first, true, true);
+
+        const double phase = start - (double) first;
+        for (int ch = 0; ch < clipBuffer.getNumChannels(); ++ch)
+        {
+            const float* in = sourceBuffer.getReadPointer(ch);
+            float* out = clipBuffer.getWritePointer(ch);
+
+            for (int i = 0; i < count; ++i)
+            {
+                const double position = phase + i * ratio;
+                const int n = (int) position;
+                out[i] = hermite(in[n - 1], in[n], in[n + 1], in[n + 2], (float) (position - n));
+            }
+        }
+    }
+
+    if (clip.reversed)
+        for (int ch = 0; ch < clipBuffer.getNumChannels(); ++ch)
+            clipBuffer.reverse(ch, 0, count);
+
+    applyFades(clip, clipBuffer, 0, from, count);
+
+    const int offsetInBlock = (int) (from - timelinePosition);
+    for (int ch = 0; ch < juce::jmin(buffer.getNumChannels(), clipBuffer.getNumChannels()); ++ch)
+        buffer.addFrom(ch, startSample + offsetInBlock, clipBuffer, ch, 0, count, clip.gain);
+}
+
+void ClipTrackSource::applyFades(const Clip& clip, juce::AudioBuffer<float>& buffer, int startSample,
+                                 juce::int64 timelinePosition, int numSamples) const
+{
+    const auto blockEnd = timelinePosition + numSamples;
+
+    // Rampe lineari: ogni segmento riparte esattamente dal guadagno in cui era finito il precedente
+    auto applyRamp = [&](juce::int64 rampStart, juce::int64 rampEnd, auto gainAt)
+    {
+        const auto a = juce::jmax(timelinePosition, rampStart);
+        const auto b = juce::jmin(blockEnd, rampEnd);
+        if (b <= a)
+            return;
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            buffer.applyGainRamp(ch, startSample + (int) (a - timelinePosition), (int) (b - a), gainAt(a), gainAt(b));
+    };
+
+    if (clip.fadeInLength > 0)
+        applyRamp(clip.timelineStart, clip.timelineStart + clip.fadeInLength, [&](juce::int64 t)
+        {
+            return (float) (t - clip.timelineStart) / (float) clip.fadeInLength;
+        });
+
+    if (clip.fadeOutLength > 0)
+        applyRamp(clip.getTimelineEnd() - clip.fadeOutLength, clip.getTimelineEnd(), [&](juce::int64 t)
+        {
+            return (float) (clip.getTimelineEnd() - t) / (float) clip.fadeOutLength;
+        });
+}
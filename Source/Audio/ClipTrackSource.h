@@ -0,0 +1,151 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include "DecodedFileCache.h"
+
+// Un clip posizionato sulla timeline condivisa. Posizioni, durate e fade sono in campioni
+// della timeline; sourceOffset è in campioni del file (che può avere un'altra frequenza).
+// Il clip è solo un riferimento: i campioni del file non vengono mai modificati né copiati.
+struct Clip
+{
+    int id = 0;                      // 0 = assegnato da ClipTrackSource::addClip
+    juce::File file;
+    juce::int64 timelineStart = 0;
+    juce::int64 sourceOffset = 0;
+    juce::int64 length = -1;         // -1 = fino alla fine del file
+    juce::int64 fadeInLength = 0;
+    juce::int64 fadeOutLength = 0;
+    float gain = 1.0f;
+    bool reversed = false;           // La regione [sourceOffset, fine) suona dall'ultimo campione
+
+    juce::int64 getTimelineEnd() const { return timelineStart + length; }
+
+    bool operator==(const Clip& other) const
+    {
+        return id == other.id && file == other.file && timelineStart == other.timelineStart
+            && sourceOffset == other.sourceOffset && length == other.length
+            && fadeInLength == other.fadeInLength && fadeOutLength == other.fadeOutLength && gain == other.gain
+            && reversed == other.reversed;
+    }
+};
+
+// Clip con durata e limiti risolti sul suo file, e le misure del file che servono agli edit
+struct ResolvedClip
+{
+    Clip clip;
+    double sourceRatio = 1.0;      // Campioni del file per campione della timeline
+    juce::int64 sourceLength = 0;  // Campioni del file
+};
+
+// Indice a intervalli statico e immutabile: i clip sono ordinati per inizio e ogni nodo
+// dell'albero implicito (il punto medio di un intervallo dell'array) conosce la fine massima
+// del proprio sottoalbero. Una query costa O(log n + k), dove k sono i clip che suonano.
+class ClipIndex
+{
+public:
+    struct Entry
+    {
+        Clip clip;
+        std::shared_ptr<juce::AudioFormatReader> reader;
+    };
+
+    explicit ClipIndex(std::vector<Entry> entries);
+
+    // Aggiunge a result gli indici dei clip che intersecano [start, end)
+    void findOverlapping(juce::int64 start, juce::int64 end, std::vector<int>& result) const;
+
+    const Entry& getEntry(int index) const { return entries[(size_t) index]; }
+    int size() const { return (int) entries.size(); }
+    juce::int64 getEndOfLastClip() const { return endOfLastClip; }
+
+private:
+    juce::int64 buildMaxEnd(int lo, int hi);
+    void query(int lo, int hi, juce::int64 start, juce::int64 end, std::vector<int>& result) const;
+
+    std::vector<Entry> entries;
+    std::vector<juce::int64> subtreeMaxEnd;
+    juce::int64 endOfLastClip = 0;
+};
+
+// Sorgente che rende l'arrangiamento di una traccia: a ogni blocco interroga l'indice e
+// legge solo i clip attivi, applicando offset, fade e guadagno. Viene letta dai worker del
+// DiskStreamer (mai dall'audio thread); le modifiche dal message thread pubblicano un nuovo
+// indice immutabile, che il worker adotta alla lettura successiva.
+class ClipTrackSource : public juce::PositionableAudioSource
+{
+public:
+    // Con decodedCache i file compressi vengono letti dalla loro decodifica su disco, appena pronta
+    ClipTrackSource(juce::AudioFormatManager& formatManager, double timelineSampleRate,
+                    DecodedFileCache* decodedCache = nullptr);
+    ~ClipTrackSource() override;
+
+    // --- Modifiche all'arrangiamento (message thread) ---
+    // Restituisce l'ID del nuovo clip (quello di clip.id, se già assegnato), -1 se il file non si
+    // può aprire o l'ID è già in uso
+    int addClip(const Clip& clip);
+    bool updateClip(const Clip& clip);
+    bool removeClip(int clipId);
+    std::vector<Clip> getClips() const;
+    bool getResolvedClip(int clipId, ResolvedClip& result) const;
+    // Durante una serie di modifiche l'indice viene ricostruito una sola volta, alla fine
+    void setDeferIndexUpdates(bool shouldDefer);
+    // Riapre il file (es. appena decodificato nella cache); false se nessun clip lo usa
+    bool reopenFile(const juce::File& file);
+
+    double getTimelineSampleRate() const { return timelineRate; }
+
+    // --- AudioSource ---
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    // --- PositionableAudioSource ---
+    void setNextReadPosition(juce::int64 newPosition) override { nextReadPosition = newPosition; }
+    juce::int64 getNextReadPosition() const override { return nextReadPosition; }
+    juce::int64 getTotalLength() const override { return totalLength.load(std::memory_order_relaxed); }
+    bool isLooping() const override { return looping.load(std::memory_order_relaxed); }
+    void setLooping(bool shouldLoop) override { looping.store(shouldLoop); }
+
+private:
+    // Rende [timelinePosition, timelinePosition + numSamples) nel buffer (già azzerato)
+    void renderRange(const ClipIndex& index, juce::AudioBuffer<float>& buffer, int startSample,
+                     juce::int64 timelinePosition, int numSamples);
+    void renderClip(const ClipIndex::Entry& entry, juce::AudioBuffer<float>& buffer, int startSample,
+                    juce::int64 timelinePosition, int numSamples);
+    void applyFades(const Clip& clip, juce::AudioBuffer<float>& buffer, int startSample,
+                    juce::int64 timelinePosition, int numSamples) const;
+
+    bool resolveClip(Clip& clip, std::shared_ptr<juce::AudioFormatReader>& reader);
+    void publishIndex();
+    std::shared_ptr<const ClipIndex> getCurrentIndex() const;
+
+    juce::AudioFormatManager& formats;
+    DecodedFileCache* const decodedFiles;
+    const double timelineRate;
+
+    // Stato del message thread
+    std::map<int, ClipIndex::Entry> clips;
+    std::map<juce::String, std::shared_ptr<juce::AudioFormatReader>> readers;
+    int nextClipId = 1;
+    bool deferIndexUpdates = false;
+    bool indexIsStale = false;
+
+    // Indice pubblicato per i worker (lo SpinLock protegge solo lo scambio del puntatore)
+    std::shared_ptr<const ClipIndex> currentIndex;
+    mutable juce::SpinLock indexLock;
+
+    std::atomic<juce::int64> totalLength { 0 };
+    std::atomic<bool> looping { false };
+
+    // Stato del worker
+    static constexpr int renderChunkFrames = 4096;
+    juce::int64 nextReadPosition = 0;
+    std::vector<int> activeClips;
+    juce::AudioBuffer<float> clipBuffer;    // Un clip alla volta, prima di fade e somma
+    juce::AudioBuffer<float> sourceBuffer;  // Campioni del file per l'interpolazione
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ClipTrackSource)
+};
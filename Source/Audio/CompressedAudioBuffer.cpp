@@ -0,0 +1,253 @@
+#include "CompressedAudioBuffer.h"
+
+namespace
+{
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<juce::uint8>& destination) : out(destination) {}
+
+        void write(juce::uint32 value, int numBits)
+        {
+            if (numBits == 0)
+                return;
+
+            accumulator = (accumulator << numBits) | (value & (juce::uint32) ((1ull << numBits) - 1));
+            pendingBits += numBits;
+
+            while (pendingBits >= 8)
+            {
+                pendingBits -= 8;
+                out.push_back((juce::uint8) (accumulator >> pendingBits));
+            }
+        }
+
+        // Quoziente di Rice: q zeri seguiti da un uno
+        void writeUnary(juce::uint32 q)
+        {
+            for (; q >= 32; q -= 32)
+                write(0, 32);
+            write(1, (int) q + 1);
+        }
+
+        // Ogni blocco inizia a un byte intero: si può decodificare senza i precedenti
+        void flush()
+        {
+            if (pendingBits > 0)
+                out.push_back((juce::uint8) (accumulator << (8 - pendingBits)));
+            pendingBits = 0;
+            accumulator = 0;
+        }
+
+    private:
+        std::vector<juce::uint8>& out;
+        juce::uint64 accumulator = 0;
+        int pendingBits = 0;
+    };
+
+    class BitReader
+    {
+    public:
+        explicit BitReader(const juce::uint8* source) : data(source) {}
+
+        juce::uint32 read(int numBits)
+        {
+            if (numBits == 0)
+                return 0;
+
+            while (availableBits < numBits)
+            {
+                accumulator = (accumulator << 8) | *data++;
+                availableBits += 8;
+            }
+
+            availableBits -= numBits;
+            return (juce::uint32) ((accumulator >> availableBits) & ((1ull << numBits) - 1));
+        }
+
+        juce::uint32 readUnary()
+        {
+            juce::uint32 q = 0;
+            while (read(1) == 0)
+                ++q;
+            return q;
+        }
+
+    private:
+        const juce::uint8* data;
+        juce::uint64 accumulator = 0;
+        int availableBits = 0;
+    };
+
+    inline int predict(int order, const int* x, int i)
+    {
+        switch (order)
+        {
+            case 1:  return x[i - 1];
+            case 2:  return 2 * x[i - 1] - x[i - 2];
+            case 3:  return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+            default: return 0;
+        }
+    }
+
+    inline juce::uint32 zigZag(int value) { return ((juce::uint32) value << 1) ^ (juce::uint32) (value >> 31); }
+    inline int unZigZag(juce::uint32 value) { return (int) (value >> 1) ^ -(int) (value & 1); }
+
+    // Riservato a fine stream: il BitReader può leggere qualche byte oltre l'ultimo blocco
+    constexpr int streamPadding = 8;
+}
+
+//==============================================================================
+CompressedAudioBuffer::CompressedAudioBuffer(int channels, int frames, int bits)
+    : numChannels(channels), numFrames(frames), bitDepth(bits)
+{
+    offsets.reserve((size_t) getNumBlocks() * (size_t) channels);
+    stream.reserve((size_t) frames * (size_t) channels * (size_t) bits / 16); // Stima: metà del PCM
+}
+
+std::unique_ptr<CompressedAudioBuffer> CompressedAudioBuffer::fromReader(juce::AudioFormatReader& reader, int maxChannels)
+{
+    const int bits = (int) reader.bitsPerSample;
+    if (reader.usesFloatingPointData || bits < 8 || bits > 24
+        || reader.lengthInSamples <= 0 || reader.lengthInSamples > std::numeric_limits<int>::max())
+        return nullptr;
+
+    const int channels = juce::jmin(maxChannels, (int) reader.numChannels);
+    std::unique_ptr<CompressedAudioBuffer> buffer(new CompressedAudioBuffer(channels, (int) reader.lengthInSamples, bits));
+
+    juce::HeapBlock<int> chunk((size_t) channels * blockFrames);
+    std::vector<int*> channelPointers;
+    for (int ch = 0; ch < channels; ++ch)
+        channelPointers.push_back(chunk.get() + ch * blockFrames);
+
+    for (int block = 0; block < buffer->getNumBlocks(); ++block)
+    {
+        const int start = block * blockFrames;
+        const int count = juce::jmin(blockFrames, buffer->numFrames - start);
+
+        // I reader JUCE restituiscono interi allineati a sinistra: si torna al valore del file
+        if (!reader.read(channelPointers.data(), channels, start, count, false))
+            return nullptr;
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            for (int i = 0; i < count; ++i)
+                channelPointers[(size_t) ch][i] >>= 32 - bits;
+
+            buffer->encodeBlock(channelPointers[(size_t) ch], count);
+        }
+    }
+
+    buffer->stream.resize(buffer->stream.size() + streamPadding, 0);
+    buffer->stream.shrink_to_fit();
+    return buffer;
+}
+
+void CompressedAudioBuffer::encodeBlock(const int* samples, int count)
+{
+    offsets.push_back((juce::uint32) stream.size());
+
+    // Modo più compatto tra i predittori fissi (con il parametro di Rice migliore) e il PCM
+    int bestMode = verbatim;
+    int bestK = 0;
+    juce::int64 bestBits = (juce::int64) count * bitDepth;
+
+    std::vector<juce::uint32> residuals((size_t) count);
+    for (int order = 0; order <= 3 && order < count; ++order)
+    {
+        juce::uint64 sum = 0;
+        for (int i = order; i < count; ++i)
+        {
+            residuals[(size_t) i] = zigZag(samples[i] - predict(order, samples, i));
+            sum += residuals[(size_t) i];
+        }
+
+        const juce::uint64 numResiduals = (juce::uint64) (count - order);
+        int estimate = 0;
+        while (estimate < 30 && (numResiduals << (estimate + 1)) < sum)
+            ++estimate;
+
+        for (int k = juce::jmax(0, estimate - 1); k <= juce::jmin(30, estimate + 1); ++k)
+        {
+            juce::int64 bits = (juce::int64) order * bitDepth + (juce::int64) numResiduals * (k + 1);
+            for (int i = order; i < count; ++i)
+                bits += residuals[(size_t) i] >> k;
+
+            if (bits < bestBits)
+            {
+                bestBits = bits;
+                bestMode = order;
+                bestK = k;
+            }
+        }
+    }
+
+    stream.push_back((juce::uint8) bestMode);
+    stream.push_back((juce::uint8) bestK);
+
+    BitWriter writer(stream);
+    const int warmUp = bestMode == verbatim ? count : juce::jmin(bestMode, count);
+
+    for (int i = 0; i < warmUp; ++i)
+        writer.write((juce::uint32) samples[i], bitDepth);
+
+    for (int i = warmUp; i < count; ++i)
+    {
+        const auto residual = zigZag(samples[i] - predict(bestMode, samples, i));
+        writer.writeUnary(residual >> bestK);
+        writer.write(residual, bestK);
+    }
+
+    writer.flush();
+}
+
+int CompressedAudioBuffer::decodeBlock(int block, int channel, float* dest, int* scratch) const
+{
+    const int count = juce::jmin(blockFrames, numFrames - block * blockFrames);
+    const auto* header = stream.data() + offsets[(size_t) (block * numChannels + channel)];
+    const int mode = header[0];
+    const int k = header[1];
+
+    BitReader reader(header + 2);
+    const int warmUp = mode == verbatim ? count : juce::jmin(mode, count);
+    const int signShift = 32 - bitDepth;
+
+    for (int i = 0; i < warmUp; ++i)
+        scratch[i] = (int) (reader.read(bitDepth) << signShift) >> signShift;
+
+    for (int i = warmUp; i < count; ++i)
+    {
+        const juce::uint32 q = reader.readUnary();
+        scratch[i] = predict(mode, scratch, i) + unZigZag((q << k) | reader.read(k));
+    }
+
+    // Di nuovo allineati a sinistra e convertiti come fa il reader: gli stessi float del file
+    for (int i = 0; i < count; ++i)
+        scratch[i] = (int) ((juce::uint32) scratch[i] << signShift);
+
+    juce::FloatVectorOperations::convertFixedToFloat(dest, scratch, 1.0f / (float) 0x7fffffff, count);
+    return count;
+}
+
+//==============================================================================
+void CompressedAudioBuffer::Reader::prepare(int maxChannels)
+{
+    maxSlotChannels = maxChannels;
+    slots.setSize(2 * maxChannels, blockFrames);
+    scratch.allocate((size_t) blockFrames, false);
+}
+
+void CompressedAudioBuffer::Reader::setSource(const CompressedAudioBuffer* newSource)
+{
+    jassert(newSource == nullptr || newSource->getNumChannels() <= maxSlotChannels);
+    source = newSource;
+    slotBlocks[0] = slotBlocks[1] = -1;
+}
+
+void CompressedAudioBuffer::Reader::decodeIntoSlot(int slot, int block)
+{
+    for (int ch = 0; ch < source->getNumChannels(); ++ch)
+        source->decodeBlock(block, ch, slots.getWritePointer(slot * maxSlotChannels + ch), scratch.get());
+
+    slotBlocks[slot] = block;
+}
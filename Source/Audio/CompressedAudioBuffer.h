@@ -0,0 +1,72 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+// Audio tenuto in memoria compresso senza perdite, in blocchi indipendenti di blockFrames
+// frame: predittore fisso (ordine 0-3, come in FLAC) e codifica di Rice dei residui, oppure
+// i campioni impacchettati alla loro profondità quando la predizione non conviene.
+// Vale solo per sorgenti intere fino a 24 bit; i file in virgola mobile restano in float.
+class CompressedAudioBuffer
+{
+public:
+    static constexpr int blockFrames = 1024;
+
+    // Legge e comprime tutto il file; nullptr se il formato non è comprimibile senza perdite
+    static std::unique_ptr<CompressedAudioBuffer> fromReader(juce::AudioFormatReader& reader, int maxChannels);
+
+    int getNumChannels() const { return numChannels; }
+    int getNumFrames() const { return numFrames; }
+    int getNumBlocks() const { return (numFrames + blockFrames - 1) / blockFrames; }
+    size_t getSizeInBytes() const { return stream.size() + offsets.size() * sizeof(juce::uint32); }
+
+    // Decodifica un blocco di un canale in dest (almeno blockFrames float); restituisce i frame.
+    // Non alloca: può girare sull'audio thread. scratch deve contenere blockFrames interi.
+    int decodeBlock(int block, int channel, float* dest, int* scratch) const;
+
+    // Lettura per campione con i blocchi decodificati su richiesta: due slot, così
+    // l'interpolazione a cavallo di due blocchi non li decodifica a ogni campione
+    class Reader
+    {
+    public:
+        // Fuori dall'audio thread: alloca gli slot
+        void prepare(int maxChannels);
+        // Audio thread: cambia sorgente e invalida i blocchi decodificati
+        void setSource(const CompressedAudioBuffer* newSource);
+
+        float getSample(int channel, int frame)
+        {
+            const int block = frame / blockFrames;
+            const int slot = block & 1;
+            if (slotBlocks[slot] != block)
+                decodeIntoSlot(slot, block);
+
+            return slots.getSample(slot * maxSlotChannels + channel, frame - block * blockFrames);
+        }
+
+    private:
+        void decodeIntoSlot(int slot, int block);
+
+        const CompressedAudioBuffer* source = nullptr;
+        juce::AudioBuffer<float> slots;
+        juce::HeapBlock<int> scratch;
+        int maxSlotChannels = 0;
+        int slotBlocks[2] { -1, -1 };
+    };
+
+private:
+    enum BlockMode : juce::uint8 { verbatim = 4 }; // 0-3 = ordine del predittore
+
+    CompressedAudioBuffer(int channels, int frames, int bits);
+    void encodeBlock(const int* samples, int count);
+
+    const int numChannels;
+    const int numFrames;
+    const int bitDepth;
+
+    std::vector<juce::uint8> stream;      // Blocchi codificati, allineati al byte
+    std::vector<juce::uint32> offsets;    // Inizio di ogni (blocco, canale) in stream
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CompressedAudioBuffer)
+};
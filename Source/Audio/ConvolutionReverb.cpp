@@ -0,0 +1,493 @@
+#include "ConvolutionReverb.h"
+#include "Tracer.h"
+
+namespace
+{
+    int log2Of(int powerOfTwo)
+    {
+        jassert(juce::isPowerOfTwo(powerOfTwo));
+        int order = 0;
+        while ((1 << order) < powerOfTwo)
+            ++order;
+        return order;
+    }
+}
+
+//==============================================================================
+UniformConvolver::UniformConvolver(const float* impulse, int length, int size)
+    : blockSize(size),
+      numBins(size + 1),
+      numPartitions(juce::jmax(1, (length + size - 1) / size)),
+      fft(log2Of(2 * size))
+{
+    const size_t spectrumSize = (size_t) (numPartitions * numBins);
+    impulseReal.resize(spectrumSize);
+    impulseImag.resize(spectrumSize);
+    inputReal.assign(spectrumSize, 0.0f);
+    inputImag.assign(spectrumSize, 0.0f);
+    sumReal.resize((size_t) numBins);
+    sumImag.resize((size_t) numBins);
+    fftBuffer.resize((size_t) (4 * blockSize)); // 2 * dimensione della FFT, come richiede juce::dsp::FFT
+
+    // Ogni partizione occupa la prima metà della finestra: nella seconda metà overlap-save dà la convoluzione lineare
+    for (int partition = 0; partition < numPartitions; ++partition)
+    {
+        std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+        const int start = partition * blockSize;
+        const int count = juce::jlimit(0, blockSize, length - start);
+        std::copy(impulse + start, impulse + start + count, fftBuffer.begin());
+
+        forwardTransform(impulseReal.data() + partition * numBins, impulseImag.data() + partition * numBins);
+    }
+}
+
+void UniformConvolver::forwardTransform(float* real, float* imag)
+{
+    fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        real[bin] = fftBuffer[(size_t) (2 * bin)];
+        imag[bin] = fftBuffer[(size_t) (2 * bin + 1)];
+    }
+}
+
+void UniformConvolver::reset()
+{
+    std::fill(inputReal.begin(), inputReal.end(), 0.0f);
+    std::fill(inputImag.begin(), inputImag.end(), 0.0f);
+}
+
+void UniformConvolver::process(const float* window, float* output)
+{
+    std::copy(window, window + 2 * blockSize, fftBuffer.begin());
+
+    // La linea di ritardo è un ring: lo spettro più recente sostituisce il più vecchio
+    newestPartition = (newestPartition + numPartitions - 1) % numPartitions;
+    forwardTransform(inputReal.data() + newestPartition * numBins, inputImag.data() + newestPartition * numBins);
+
+    std::fill(sumReal.begin(), sumReal.end(), 0.0f);
+    std::fill(sumImag.begin(), sumImag.end(), 0.0f);
+
+    // Somma dei prodotti: l'ingresso di k blocchi fa per la partizione k della risposta
+    for (int partition = 0; partition < numPartitions; ++partition)
+    {
+        const int slot = (newestPartition + partition) % numPartitions;
+        const float* xr = inputReal.data() + slot * numBins;
+        const float* xi = inputImag.data() + slot * numBins;
+        const float* hr = impulseReal.data() + partition * numBins;
+        const float* hi = impulseImag.data() + partition * numBins;
+        float* yr = sumReal.data();
+        float* yi = sumImag.data();
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            yr[bin] += xr[bin] * hr[bin] - xi[bin] * hi[bin];
+            yi[bin] += xr[bin] * hi[bin] + xi[bin] * hr[bin];
+        }
+    }
+
+    // Spettro completo (simmetria hermitiana) per la FFT inversa, che è già normalizzata
+    const int fftSize = 2 * blockSize;
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        fftBuffer[(size_t) (2 * bin)] = sumReal[(size_t) bin];
+        fftBuffer[(size_t) (2 * bin + 1)] = sumImag[(size_t) bin];
+    }
+    for (int bin = 1; bin < blockSize; ++bin)
+    {
+        fftBuffer[(size_t) (2 * (fftSize - bin))] = sumReal[(size_t) bin];
+        fftBuffer[(size_t) (2 * (fftSize - bin) + 1)] = -sumImag[(size_t) bin];
+    }
+
+    fft.performRealOnlyInverseTransform(fftBuffer.data());
+    std::copy(fftBuffer.begin() + blockSize, fftBuffer.begin() + 2 * blockSize, output);
+}
+
+//==============================================================================
+ConvolutionReverb::ConvolutionReverb(const juce::AudioBuffer<float>& impulseResponse)
+    : impulseLength(impulseResponse.getNumSamples()),
+      hasTail(impulseResponse.getNumSamples() > tailStart),
+      channels((size_t) maxChannels),
+      wetChunk((size_t) headPartitionSize)
+{
+    jassert(impulseResponse.getNumChannels() > 0);
+
+    for (int ch = 0; ch < maxChannels; ++ch)
+    {
+        auto& channel = channels[(size_t) ch];
+        const float* impulse = impulseResponse.getReadPointer(juce::jmin(ch, impulseResponse.getNumChannels() - 1));
+
+        channel.direct.assign(impulse, impulse + juce::jmin(impulseLength, headPartitionSize));
+        channel.headWindow.assign((size_t) (2 * headPartitionSize), 0.0f);
+        channel.headOutput.assign((size_t) headPartitionSize, 0.0f);
+
+        if (impulseLength > headPartitionSize)
+            channel.head = std::make_unique<UniformConvolver>(impulse + headPartitionSize,
+                                                              juce::jmin(impulseLength, tailStart) - headPartitionSize,
+                                                              headPartitionSize);
+
+        if (hasTail)
+        {
+            channel.tail = std::make_unique<UniformConvolver>(impulse + tailStart, impulseLength - tailStart, tailPartitionSize);
+            channel.tailInput.assign((size_t) (tailRingBlocks * tailPartitionSize), 0.0f);
+            channel.tailOutput.assign((size_t) (tailRingBlocks * tailPartitionSize), 0.0f);
+            channel.tailWindow.assign((size_t) (2 * tailPartitionSize), 0.0f);
+        }
+    }
+}
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+    // Va rimosso dal ConvolutionTailScheduler prima della distruzione
+    jassert(!registered.load());
+}
+
+bool ConvolutionReverb::loadImpulseResponse(juce::AudioFormatManager& formats, const juce::File& file,
+                                            double sampleRate, juce::AudioBuffer<float>& result)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+    {
+        juce::Logger::writeToLog("ConvolutionReverb Error: Cannot read impulse response " + file.getFullPathName());
+        return false;
+    }
+
+    const int numChannels = juce::jmin(maxChannels, (int) reader->numChannels);
+    const int length = (int) juce::jmin<juce::int64>(reader->lengthInSamples, (juce::int64) (maxImpulseSeconds * reader->sampleRate));
+
+    juce::AudioBuffer<float> original(numChannels, length);
+    reader->read(&original, 0, length, 0, true, numChannels > 1);
+
+    if (std::abs(reader->sampleRate - sampleRate) < 1.0e-6)
+    {
+        result = std::move(original);
+        return true;
+    }
+
+    // Qualche campione di silenzio in fondo: l'interpolatore può leggere oltre l'ultimo
+    original.setSize(numChannels, length + 8, true, true);
+
+    const double speedRatio = reader->sampleRate / sampleRate;
+    const int resampledLength = juce::jmax(1, (int) (length / speedRatio));
+    result.setSize(numChannels, resampledLength);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        juce::LagrangeInterpolator interpolator;
+        interpolator.process(speedRatio, original.getReadPointer(ch), result.getWritePointer(ch), resampledLength);
+    }
+
+    return true;
+}
+
+int ConvolutionReverb::getNumHeadPartitions() const
+{
+    return channels.front().head != nullptr ? channels.front().head->getNumPartitions() : 0;
+}
+
+int ConvolutionReverb::getNumTailPartitions() const
+{
+    return channels.front().tail != nullptr ? channels.front().tail->getNumPartitions() : 0;
+}
+
+void ConvolutionReverb::setLevels(float wetLevel, float dryLevel)
+{
+    wet.store(juce::jmax(0.0f, wetLevel));
+    dry.store(juce::jmax(0.0f, dryLevel));
+}
+
+void ConvolutionReverb::process(juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    const float wetLevel = wet.load(std::memory_order_relaxed);
+    const float dryLevel = dry.load(std::memory_order_relaxed);
+    const int numChannels = juce::jmin(buffer.getNumChannels(), maxChannels);
+    const int tailRingSize = tailRingBlocks * tailPartitionSize;
+
+    // A tratti che non superano mai il confine di una partizione piccola (e quindi di una di coda)
+    for (int offset = 0; offset < numSamples;)
+    {
+        const int partitionOffset = (int) (position % headPartitionSize);
+        const int count = juce::jmin(numSamples - offset, headPartitionSize - partitionOffset);
+
+        // Coda corrispondente a questo tratto, se il worker l'ha già consegnata
+        bool tailReady = false;
+        if (hasTail && position >= tailStart)
+        {
+            const auto block = (position - tailStart) / tailPartitionSize;
+            tailReady = block < tailBlocksDone.load(std::memory_order_acquire)
+                        && block >= tailValidFrom.load(std::memory_order_acquire);
+
+            if (!tailReady && block != lastUnderrunBlock)
+            {
+                lastUnderrunBlock = block;
+                underruns.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        const int tailOffset = tailReady ? (int) ((position - tailStart) % tailRingSize) : 0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto& channel = channels[(size_t) ch];
+            float* data = buffer.getWritePointer(ch, offset);
+            float* window = channel.headWindow.data() + headPartitionSize + partitionOffset;
+
+            std::copy(data, data + count, window);
+            if (hasTail)
+                std::copy(data, data + count, channel.tailInput.data() + position % tailRingSize);
+
+            // FIR diretta sul primo tratto: ogni coefficiente è una somma vettoriale sull'intero tratto
+            float* wetData = wetChunk.data();
+            juce::FloatVectorOperations::copy(wetData, channel.headOutput.data() + partitionOffset, count);
+            for (int tap = 0; tap < (int) channel.direct.size(); ++tap)
+                juce::FloatVectorOperations::addWithMultiply(wetData, window - tap, channel.direct[(size_t) tap], count);
+
+            if (tailReady)
+                juce::FloatVectorOperations::add(wetData, channel.tailOutput.data() + tailOffset, count);
+
+            juce::FloatVectorOperations::multiply(data, dryLevel, count);
+            juce::FloatVectorOperations::addWithMultiply(data, wetData, wetLevel, count);
+        }
+
+        position += count;
+        offset += count;
+
+        if (position % headPartitionSize != 0)
+            continue;
+
+        // Partizione completa: il suo contributo FFT serve alla partizione successiva
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto& channel = channels[(size_t) ch];
+            if (channel.head != nullptr)
+                channel.head->process(channel.headWindow.data(), channel.headOutput.data());
+
+            std::copy(channel.headWindow.begin() + headPartitionSize, channel.headWindow.end(), channel.headWindow.begin());
+        }
+
+        if (hasTail && position % tailPartitionSize == 0)
+            tailInputBlocks.store(position / tailPartitionSize, std::memory_order_release);
+    }
+}
+
+void ConvolutionReverb::processOffline(juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    jassert(!registered.load());
+
+    // Tratti di al più un blocco di coda: la coda che serve al tratto è già stata calcolata
+    // dopo il precedente, perché inizia due blocchi dopo il suo ingresso
+    for (int offset = 0; offset < numSamples;)
+    {
+        const int count = juce::jmin(numSamples - offset, tailPartitionSize);
+        juce::AudioBuffer<float> section(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), offset, count);
+        process(section, count);
+
+        while (wantsService())
+            serviceTail();
+
+        offset += count;
+    }
+}
+
+bool ConvolutionReverb::wantsService() const
+{
+    return hasTail && nextTailBlock < tailInputBlocks.load(std::memory_order_acquire);
+}
+
+void ConvolutionReverb::serviceTail()
+{
+    const auto available = tailInputBlocks.load(std::memory_order_acquire);
+    if (!hasTail || nextTailBlock >= available)
+        return;
+
+    AW_TRACE_SCOPE("Convolution tail");
+
+    // Troppo indietro: l'ingresso dei blocchi mancanti è già stato sovrascritto. Si riparte
+    // dall'ultimo blocco con la linea di ritardo vuota (la coda si ricostruisce in pochi blocchi).
+    if (available - nextTailBlock > tailRingBlocks - 2)
+    {
+        nextTailBlock = available - 1;
+        for (auto& channel : channels)
+            channel.tail->reset();
+        tailValidFrom.store(nextTailBlock, std::memory_order_release);
+    }
+
+    for (; nextTailBlock < available; ++nextTailBlock)
+    {
+        for (auto& channel : channels)
+        {
+            // Finestra overlap-save: blocco precedente e blocco appena completato
+            for (int half = 0; half < 2; ++half)
+            {
+                const auto block = nextTailBlock - 1 + half;
+                float* destination = channel.tailWindow.data() + half * tailPartitionSize;
+
+                if (block < 0)
+                    std::fill(destination, destination + tailPartitionSize, 0.0f);
+                else
+                    std::copy_n(channel.tailInput.data() + (block % tailRingBlocks) * tailPartitionSize, tailPartitionSize, destination);
+            }
+
+            channel.tail->process(channel.tailWindow.data(),
+                                  channel.tailOutput.data() + (nextTailBlock % tailRingBlocks) * tailPartitionSize);
+        }
+
+        tailBlocksDone.store(nextTailBlock + 1, std::memory_order_release);
+    }
+}
+
+juce::String ConvolutionReverb::runBenchmark(double sampleRate, int blockSize)
+{
+    constexpr double secondsPerRun = 10.0;
+    juce::Random random(1234);
+
+    juce::String report;
+    report << "Convolution reverb benchmark: " << juce::String(sampleRate, 0) << " Hz, stereo, blocks of "
+           << blockSize << " samples, " << juce::String(secondsPerRun, 0) << " s of noise per length\n"
+           << "IR (s)  head/tail partitions  audio thread (us/block, % of block)  tail worker (% of a core)\n";
+
+    for (double impulseSeconds : { 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0 })
+    {
+        // Rumore con decadimento esponenziale fino a -60 dB: la forma tipica di un riverbero
+        const int length = (int) (impulseSeconds * sampleRate);
+        juce::AudioBuffer<float> impulse(2, length);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < length; ++i)
+                impulse.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * std::exp(-6.9f * (float) i / (float) length));
+
+        ConvolutionReverb reverb(impulse);
+        juce::AudioBuffer<float> block(2, blockSize);
+        const int numBlocks = (int) (secondsPerRun * sampleRate / blockSize);
+        juce::int64 audioTicks = 0, tailTicks = 0;
+
+        // La coda viene calcolata dopo ogni blocco sullo stesso thread, ma misurata a parte
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < blockSize; ++i)
+                    block.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+            const auto audioStart = juce::Time::getHighResolutionTicks();
+            reverb.process(block, blockSize);
+            const auto tailStartTicks = juce::Time::getHighResolutionTicks();
+            reverb.serviceTail();
+            tailTicks += juce::Time::getHighResolutionTicks() - tailStartTicks;
+            audioTicks += tailStartTicks - audioStart;
+        }
+
+        const double duration = numBlocks * blockSize / sampleRate;
+        const double audioSeconds = juce::Time::highResolutionTicksToSeconds(audioTicks);
+        const double tailSeconds = juce::Time::highResolutionTicksToSeconds(tailTicks);
+
+        report << juce::String(impulseSeconds, 2).paddedLeft(' ', 6)
+               << (juce::String(reverb.getNumHeadPartitions()) + "/" + juce::String(reverb.getNumTailPartitions())).paddedLeft(' ', 22)
+               << juce::String(audioSeconds * 1.0e6 / numBlocks, 1).paddedLeft(' ', 24)
+               << juce::String(100.0 * audioSeconds / duration, 2).paddedLeft(' ', 12) << "%"
+               << juce::String(100.0 * tailSeconds / duration, 2).paddedLeft(' ', 27) << "%\n";
+    }
+
+    return report;
+}
+
+//==============================================================================
+class ConvolutionTailScheduler::Worker : public juce::Thread
+{
+public:
+    Worker(ConvolutionTailScheduler& scheduler, int index)
+        : juce::Thread("Convolution tail " + juce::String(index + 1)), owner(scheduler)
+    {
+    }
+
+    void run() override { owner.runWorker(*this); }
+
+private:
+    ConvolutionTailScheduler& owner;
+};
+
+ConvolutionTailScheduler::ConvolutionTailScheduler(int numThreads)
+{
+    for (int i = 0; i < juce::jmax(1, numThreads); ++i)
+        workers.add(new Worker(*this, i))->startThread(juce::Thread::Priority::high);
+}
+
+ConvolutionTailScheduler::~ConvolutionTailScheduler()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+    reverbsAvailable.signal();
+    for (auto* worker : workers)
+        worker->stopThread(2000);
+
+    jassert(reverbs.isEmpty());
+}
+
+void ConvolutionTailScheduler::addReverb(ConvolutionReverb* reverb)
+{
+    jassert(reverb != nullptr);
+    const juce::ScopedLock sl(lock);
+    reverbs.addIfNotAlreadyThere(reverb);
+    reverb->registered = true;
+    reverbsAvailable.signal();
+}
+
+void ConvolutionTailScheduler::removeReverb(ConvolutionReverb* reverb)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        reverbs.removeFirstMatchingValue(reverb);
+        reverb->registered = false;
+        if (reverbs.isEmpty())
+            reverbsAvailable.reset();
+    }
+
+    // Un worker potrebbe starne calcolando la coda: aspettiamo che finisca il blocco
+    while (reverb->serviceInProgress.load(std::memory_order_acquire))
+        juce::Thread::sleep(1);
+}
+
+int ConvolutionTailScheduler::getTotalUnderruns() const
+{
+    const juce::ScopedLock sl(lock);
+    int total = 0;
+    for (auto* reverb : reverbs)
+        total += reverb->getUnderrunCount();
+    return total;
+}
+
+ConvolutionReverb* ConvolutionTailScheduler::claimReverb()
+{
+    const juce::ScopedLock sl(lock);
+
+    // A rotazione: nessun riverbero resta indietro perché un altro ha sempre lavoro
+    for (int i = 0; i < reverbs.size(); ++i)
+    {
+        auto* reverb = reverbs[(nextReverb + i) % reverbs.size()];
+        if (reverb->serviceInProgress.load(std::memory_order_acquire) || !reverb->wantsService())
+            continue;
+
+        nextReverb = (nextReverb + i + 1) % reverbs.size();
+        reverb->serviceInProgress.store(true, std::memory_order_release);
+        return reverb;
+    }
+
+    return nullptr;
+}
+
+void ConvolutionTailScheduler::runWorker(juce::Thread& thread)
+{
+    while (!thread.threadShouldExit())
+    {
+        if (auto* reverb = claimReverb())
+        {
+            reverb->serviceTail();
+            reverb->serviceInProgress.store(false, std::memory_order_release);
+            continue;
+        }
+
+        // Nessun riverbero: niente polling finché addReverb (o la chiusura) non segnala l'evento
+        reverbsAvailable.wait(-1);
+
+        // Un blocco di coda dura decine di millisecondi: un controllo al millisecondo basta
+        thread.wait(1);
+    }
+}
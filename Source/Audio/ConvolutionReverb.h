@@ -0,0 +1,161 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class ConvolutionTailScheduler;
+
+// Convoluzione a partizioni uniformi (overlap-save) di un tratto di risposta all'impulso, con
+// una linea di ritardo in frequenza degli spettri d'ingresso. Un blocco in ingresso costa una
+// FFT, una somma di prodotti complessi per partizione e una FFT inversa.
+class UniformConvolver
+{
+public:
+    // blockSize deve essere una potenza di due
+    UniformConvolver(const float* impulse, int impulseLength, int blockSize);
+
+    int getBlockSize() const { return blockSize; }
+    int getNumPartitions() const { return numPartitions; }
+
+    // window: 2 * blockSize campioni (blocco precedente e blocco appena completato). Scrive in
+    // output i blockSize campioni della convoluzione che corrispondono al blocco completato.
+    void process(const float* window, float* output);
+    void reset();
+
+private:
+    // FFT reale di fftBuffer; i bin 0..blockSize finiscono in real/imag
+    void forwardTransform(float* real, float* imag);
+
+    const int blockSize, numBins, numPartitions;
+    juce::dsp::FFT fft;
+
+    // Spettri in forma separata (reale, immaginaria): i prodotti complessi diventano cicli vettorizzabili
+    std::vector<float> impulseReal, impulseImag; // numPartitions * numBins
+    std::vector<float> inputReal, inputImag;     // Linea di ritardo in frequenza, stessa forma
+    std::vector<float> sumReal, sumImag;
+    std::vector<float> fftBuffer;
+    int newestPartition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UniformConvolver)
+};
+
+// Riverbero a convoluzione con partizioni non uniformi, a latenza zero. Il primo tratto della
+// risposta è una FIR diretta (vettorizzata), fino a tailStart lavorano partizioni FFT piccole
+// sull'audio thread, il resto (la coda, che per un riverbero è quasi tutta la risposta) usa
+// partizioni grandi calcolate dai worker del ConvolutionTailScheduler. La coda inizia due
+// blocchi di coda dopo l'impulso: i worker hanno un intero blocco di tempo per consegnarla.
+class ConvolutionReverb
+{
+public:
+    static constexpr int headPartitionSize = 128;
+    static constexpr int tailPartitionSize = 2048;
+    static constexpr int tailStart = 2 * tailPartitionSize;
+    static constexpr int maxChannels = 2;
+    static constexpr double maxImpulseSeconds = 20.0;
+
+    // Risposta già alla frequenza di lavoro: un canale viene usato per entrambi, due per canale
+    explicit ConvolutionReverb(const juce::AudioBuffer<float>& impulseResponse);
+    ~ConvolutionReverb();
+
+    // Legge la risposta e la ricampiona a sampleRate (al massimo maxImpulseSeconds)
+    static bool loadImpulseResponse(juce::AudioFormatManager& formats, const juce::File& file,
+                                    double sampleRate, juce::AudioBuffer<float>& result);
+
+    int getImpulseLength() const { return impulseLength; }
+    int getNumHeadPartitions() const;
+    int getNumTailPartitions() const;
+
+    // Qualsiasi thread: livelli lineari del segnale riverberato e di quello diretto
+    void setLevels(float wetLevel, float dryLevel);
+
+    // --- Audio thread ---
+    // Sostituisce il segnale con dry * ingresso + wet * convoluzione, senza latenza
+    void process(juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // Rendering offline, con il riverbero non registrato presso i worker: la coda viene calcolata
+    // qui appena il suo ingresso è completo. Stesso risultato di process() senza mai un underrun.
+    void processOffline(juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // Blocchi di coda arrivati tardi (il tratto corrispondente resta senza coda)
+    int getUnderrunCount() const { return underruns.load(std::memory_order_relaxed); }
+
+    // Costo CPU (audio thread e worker) al variare della lunghezza della risposta
+    static juce::String runBenchmark(double sampleRate = 48000.0, int blockSize = 256);
+
+private:
+    friend class ConvolutionTailScheduler;
+
+    struct Channel
+    {
+        std::vector<float> direct;                    // Risposta [0, headPartitionSize)
+        std::unique_ptr<UniformConvolver> head, tail; // [headPartitionSize, tailStart) e [tailStart, fine)
+
+        // Audio thread: partizione precedente + corrente e contributo FFT della partizione corrente
+        std::vector<float> headWindow, headOutput;
+
+        // Ring dell'ingresso (scritto dall'audio thread) e della coda (scritta dai worker)
+        std::vector<float> tailInput, tailOutput;
+        std::vector<float> tailWindow;                // Solo worker
+    };
+
+    // --- Chiamati solo dal ConvolutionTailScheduler, un worker alla volta ---
+    bool wantsService() const;
+    void serviceTail();
+
+    // Blocchi nei ring della coda: il worker può restare indietro di tailRingBlocks - 2 blocchi
+    static constexpr int tailRingBlocks = 8;
+
+    const int impulseLength;
+    const bool hasTail;
+    std::vector<Channel> channels;
+    std::vector<float> wetChunk;
+
+    std::atomic<float> wet { 1.0f }, dry { 0.0f };
+
+    // Audio thread
+    juce::int64 position = 0;
+    juce::int64 lastUnderrunBlock = -1;
+
+    // Blocchi d'ingresso completati (audio thread) e blocchi di coda pronti (worker). I blocchi
+    // prima di tailValidFrom sono stati saltati da un worker rimasto troppo indietro.
+    std::atomic<juce::int64> tailInputBlocks { 0 }, tailBlocksDone { 0 }, tailValidFrom { 0 };
+    juce::int64 nextTailBlock = 0; // Solo worker
+
+    std::atomic<int> underruns { 0 };
+    std::atomic<bool> serviceInProgress { false };
+    std::atomic<bool> registered { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConvolutionReverb)
+};
+
+// Worker che calcolano le code dei riverberi registrati. I thread controllano i riverberi
+// a intervalli di un millisecondo: l'audio thread non deve mai svegliarli (né prendere lock).
+// Senza riverberi registrati i worker dormono finché addReverb non li sveglia.
+class ConvolutionTailScheduler
+{
+public:
+    explicit ConvolutionTailScheduler(int numThreads = 2);
+    ~ConvolutionTailScheduler();
+
+    void addReverb(ConvolutionReverb* reverb);
+    // Rimuove il riverbero e attende che nessun worker ne stia calcolando la coda
+    void removeReverb(ConvolutionReverb* reverb);
+
+    int getTotalUnderruns() const;
+
+private:
+    class Worker;
+
+    ConvolutionReverb* claimReverb();
+    void runWorker(juce::Thread& thread);
+
+    mutable juce::CriticalSection lock; // Protegge solo la lista, mai preso dall'audio thread
+    juce::Array<ConvolutionReverb*> reverbs;
+    juce::WaitableEvent reverbsAvailable { true }; // Segnalato finché la lista non è vuota
+    juce::OwnedArray<juce::Thread> workers;
+    int nextReverb = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConvolutionTailScheduler)
+};
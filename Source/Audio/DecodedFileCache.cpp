@@ -0,0 +1,348 @@
+#include "DecodedFileCache.h"
+#include "Tracer.h"
+
+namespace
+{
+    // FNV-1a a 64 bit: stabile tra versioni e piattaforme, quindi adatto a una cache su disco
+    struct ContentHash
+    {
+        juce::uint64 value = 14695981039346656037ull;
+
+        void add(const void* data, size_t numBytes)
+        {
+            auto* bytes = static_cast<const juce::uint8*>(data);
+            for (size_t i = 0; i < numBytes; ++i)
+                value = (value ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+}
+
+//==============================================================================
+// Hash del contenuto e, se la cache non ha già lo stesso audio, decodifica completa del file su
+// un temporaneo nella cartella della cache, che prende il posto definitivo solo a decodifica
+// finita: un file incompleto non viene mai mappato. Il pool ha un solo thread, quindi due job
+// con lo stesso contenuto non si sovrappongono mai.
+class DecodedFileCache::DecodeJob : public juce::ThreadPoolJob
+{
+public:
+    DecodeJob(DecodedFileCache& cache, const juce::File& source)
+        : juce::ThreadPoolJob("Decode " + source.getFileName()), owner(cache), file(source)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        key = owner.computeContentKey(file);
+        if (key.isEmpty())
+        {
+            owner.decodeFinished(file, key, false);
+            return jobHasFinished;
+        }
+
+        // Stesso audio con un altro nome o in un'altra cartella: la decodifica c'è già
+        if (owner.getCacheFile(key).existsAsFile())
+        {
+            owner.decodeFinished(file, key, true);
+            return jobHasFinished;
+        }
+
+        {
+            const juce::ScopedLock sl(owner.lock);
+            owner.pendingKeys.insert(key);
+        }
+
+        owner.decodeFinished(file, key, decode());
+        return jobHasFinished;
+    }
+
+private:
+    bool decode()
+    {
+        AW_TRACE_SCOPE("Decode to cache");
+
+        std::unique_ptr<juce::AudioFormatReader> reader(owner.formats.createReaderFor(file));
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+            return false;
+
+        juce::TemporaryFile output(owner.getCacheFile(key));
+        {
+            auto stream = std::make_unique<juce::FileOutputStream>(output.getFile());
+            if (!stream->openedOk())
+                return false;
+
+            juce::WavAudioFormat wav;
+            std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), reader->sampleRate,
+                                                                                reader->numChannels, 32, {}, 0));
+            if (writer == nullptr)
+                return false;
+
+            stream.release(); // Ora appartiene al writer
+
+            juce::AudioBuffer<float> chunk((int) reader->numChannels, 65536);
+            for (juce::int64 position = 0; position < reader->lengthInSamples;)
+            {
+                if (shouldExit())
+                    return false;
+
+                const int count = (int) juce::jmin<juce::int64>(chunk.getNumSamples(), reader->lengthInSamples - position);
+                reader->read(&chunk, 0, count, position, true, true);
+                if (!writer->writeFromAudioSampleBuffer(chunk, 0, count))
+                    return false;
+                position += count;
+            }
+        }
+
+        return output.overwriteTargetFileWithTemporary();
+    }
+
+    DecodedFileCache& owner;
+    const juce::File file;
+    juce::String key;
+};
+
+//==============================================================================
+DecodedFileCache::DecodedFileCache(juce::AudioFormatManager& formatManager, const juce::File& cacheDirectory)
+    : formats(formatManager), directory(cacheDirectory)
+{
+    if (!directory.createDirectory())
+        juce::Logger::writeToLog("DecodedFileCache Error: Cannot create " + directory.getFullPathName());
+
+    loadIndex();
+}
+
+DecodedFileCache::~DecodedFileCache()
+{
+    // I job in corso si fermano al blocco successivo e rimuovono il proprio temporaneo
+    pool.removeAllJobs(true, 10000);
+}
+
+juce::File DecodedFileCache::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+               .getChildFile("AudioWorkstation").getChildFile("DecodedCache");
+}
+
+bool DecodedFileCache::isCompressedFormat(const juce::File& file)
+{
+    return file.hasFileExtension("mp3;ogg;flac");
+}
+
+juce::AudioFormatReader* DecodedFileCache::createReaderFor(const juce::File& file)
+{
+    if (!isCompressedFormat(file) || !file.existsAsFile())
+        return formats.createReaderFor(file);
+
+    // Solo la firma del file: l'hash del contenuto non si calcola mai qui
+    const auto key = findKnownKey(file);
+    const auto cached = key.isNotEmpty() ? getCacheFile(key) : juce::File();
+
+    if (cached.existsAsFile())
+    {
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader(wav.createMemoryMappedReader(cached));
+        if (reader != nullptr && reader->mapEntireFile())
+        {
+            Tracer::instant("Decoded cache hit");
+            cached.setLastAccessTime(juce::Time::getCurrentTime()); // Per l'ordine di eliminazione
+            return reader.release();
+        }
+
+        juce::Logger::writeToLog("DecodedFileCache: Discarding unreadable " + cached.getFileName());
+        cached.deleteFile();
+    }
+
+    Tracer::instant("Decoded cache miss");
+    scheduleDecode(file);
+    return formats.createReaderFor(file);
+}
+
+juce::String DecodedFileCache::getSignature(const juce::File& file)
+{
+    return juce::String(file.getSize()) + "/" + juce::String(file.getLastModificationTime().toMilliseconds());
+}
+
+juce::String DecodedFileCache::findKnownKey(const juce::File& file) const
+{
+    const auto signature = getSignature(file);
+
+    const juce::ScopedLock sl(lock);
+    auto it = keysByPath.find(file.getFullPathName());
+    if (it != keysByPath.end() && it->second.first == signature)
+        return it->second.second;
+
+    return {};
+}
+
+juce::String DecodedFileCache::computeContentKey(const juce::File& file)
+{
+    AW_TRACE_SCOPE("Content hash");
+
+    const auto signature = getSignature(file);
+    juce::FileInputStream stream(file);
+    if (!stream.openedOk())
+        return {};
+
+    // I file compressi sono piccoli: l'hash dell'intero contenuto costa poco rispetto a una decodifica
+    ContentHash hash;
+    juce::HeapBlock<char> buffer(65536);
+    while (!stream.isExhausted())
+    {
+        const int read = stream.read(buffer.get(), 65536);
+        if (read <= 0)
+            break;
+        hash.add(buffer.get(), (size_t) read);
+    }
+
+    const auto key = juce::String::toHexString((juce::int64) hash.value).paddedLeft('0', 16)
+                     + "-" + juce::String::toHexString(file.getSize());
+
+    {
+        const juce::ScopedLock sl(lock);
+        keysByPath[file.getFullPathName()] = { signature, key };
+    }
+
+    saveIndex();
+    return key;
+}
+
+void DecodedFileCache::loadIndex()
+{
+    const auto indexFile = getIndexFile();
+    if (!indexFile.existsAsFile())
+        return;
+
+    const auto index = juce::JSON::parse(indexFile);
+    if (!index.isArray())
+    {
+        juce::Logger::writeToLog("DecodedFileCache: Discarding unreadable " + indexFile.getFileName());
+        return;
+    }
+
+    const juce::ScopedLock sl(lock);
+    for (auto const& entry : *index.getArray())
+    {
+        // Le voci di file spariti dal disco non servono più: al prossimo salvataggio scompaiono
+        const juce::String path = entry["path"];
+        if (juce::File::isAbsolutePath(path) && juce::File(path).existsAsFile())
+            keysByPath[path] = { entry["signature"].toString(), entry["key"].toString() };
+    }
+}
+
+void DecodedFileCache::saveIndex()
+{
+    juce::Array<juce::var> entries;
+    {
+        const juce::ScopedLock sl(lock);
+        for (auto const& [path, signatureAndKey] : keysByPath)
+        {
+            auto* entry = new juce::DynamicObject();
+            entry->setProperty("path", path);
+            entry->setProperty("signature", signatureAndKey.first);
+            entry->setProperty("key", signatureAndKey.second);
+            entries.add(juce::var(entry));
+        }
+    }
+
+    // Sostituito con un rename: un crash lascia l'indice precedente, mai metà
+    juce::TemporaryFile temporary(getIndexFile());
+    {
+        juce::FileOutputStream stream(temporary.getFile());
+        if (!stream.openedOk() || !stream.writeText(juce::JSON::toString(juce::var(entries)), false, false, nullptr))
+        {
+            juce::Logger::writeToLog("DecodedFileCache Error: Cannot write " + getIndexFile().getFullPathName());
+            return;
+        }
+        stream.flush();
+    }
+
+    temporary.overwriteTargetFileWithTemporary();
+}
+
+void DecodedFileCache::scheduleDecode(const juce::File& file)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        if (!pendingPaths.insert(file.getFullPathName()).second)
+            return; // Già in coda
+    }
+
+    pool.addJob(new DecodeJob(*this, file), true);
+}
+
+void DecodedFileCache::decodeFinished(const juce::File& file, const juce::String& key, bool succeeded)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        pendingPaths.erase(file.getFullPathName());
+        pendingKeys.erase(key);
+    }
+
+    if (!succeeded)
+    {
+        juce::Logger::writeToLog("DecodedFileCache Error: Cannot decode " + file.getFullPathName());
+        return;
+    }
+
+    evictToFit();
+    juce::Logger::writeToLog("DecodedFileCache: " + file.getFileName() + " decoded ("
+                             + juce::String(getCacheFile(key).getSize() / (1024 * 1024)) + " MB)");
+
+    if (onFileDecoded != nullptr)
+        juce::MessageManager::callAsync([callback = onFileDecoded, file] { callback(file); });
+}
+
+void DecodedFileCache::evictToFit()
+{
+    auto files = directory.findChildFiles(juce::File::findFiles, false, "*.wav");
+
+    // Dal meno recente: l'accesso viene aggiornato a ogni lettura dalla cache
+    std::sort(files.begin(), files.end(), [](const juce::File& a, const juce::File& b)
+    {
+        return a.getLastAccessTime() < b.getLastAccessTime();
+    });
+
+    juce::int64 total = 0;
+    for (auto const& file : files)
+        total += file.getSize();
+
+    std::set<juce::String> pending;
+    {
+        const juce::ScopedLock sl(lock);
+        pending = pendingKeys;
+    }
+
+    for (auto const& file : files)
+    {
+        if (total <= maxSizeBytes.load())
+            break;
+
+        // Il temporaneo di una decodifica in corso inizia con la sua chiave
+        if (pending.count(file.getFileName().upToFirstOccurrenceOf("_", false, false)) > 0)
+            continue;
+
+        // Su alcuni sistemi un file ancora mappato non si può eliminare: resta fino alla prossima volta
+        const auto size = file.getSize();
+        if (file.deleteFile())
+            total -= size;
+    }
+}
+
+void DecodedFileCache::setMaxSizeMegabytes(int megabytes)
+{
+    maxSizeBytes.store((juce::int64) juce::jmax(1, megabytes) * 1024 * 1024);
+    evictToFit();
+}
+
+juce::int64 DecodedFileCache::getSizeInBytes() const
+{
+    juce::int64 total = 0;
+    for (auto const& file : directory.findChildFiles(juce::File::findFiles, false, "*.wav"))
+        total += file.getSize();
+    return total;
+}
+
+int DecodedFileCache::getNumPendingDecodes() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int) pendingPaths.size();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <map>
+#include <set>
+
+// Cache persistente dei file compressi (MP3, Ogg Vorbis, FLAC) decodificati una sola volta in
+// WAV float a 32 bit. La chiave è un hash del contenuto: lo stesso audio rinominato o spostato
+// riusa la stessa decodifica. L'hash si calcola sul thread di decodifica, mai sul chiamante, e
+// l'indice percorso + dimensione + data -> chiave è salvato accanto alla cache: alla sessione
+// successiva un file già visto si apre dalla cache senza rileggerlo. Le letture successive
+// (anche tra una sessione e l'altra) passano da un reader mappato in memoria: nessuna
+// decodifica nei giri di loop, seek immediati anche negli MP3. Oltre la dimensione massima si
+// eliminano i file usati meno di recente.
+class DecodedFileCache
+{
+public:
+    explicit DecodedFileCache(juce::AudioFormatManager& formatManager, const juce::File& cacheDirectory = getDefaultDirectory());
+    ~DecodedFileCache();
+
+    static juce::File getDefaultDirectory();
+    static bool isCompressedFormat(const juce::File& file);
+
+    // Reader mappato dalla cache se la decodifica è pronta; altrimenti il decoder del formato,
+    // e la decodifica viene accodata in background. nullptr se il file non si può aprire.
+    juce::AudioFormatReader* createReaderFor(const juce::File& file);
+
+    void setMaxSizeMegabytes(int megabytes);
+    juce::int64 getSizeInBytes() const;
+    int getNumPendingDecodes() const;
+
+    // Message thread: un file appena decodificato (i reader aperti prima possono passare alla cache)
+    std::function<void(const juce::File&)> onFileDecoded;
+
+private:
+    class DecodeJob;
+
+    // Chiave già nota per percorso, dimensione e data di modifica; vuota se il file va riletto
+    juce::String findKnownKey(const juce::File& file) const;
+    // Thread di decodifica: hash dell'intero contenuto, registrato nell'indice
+    juce::String computeContentKey(const juce::File& file);
+    static juce::String getSignature(const juce::File& file);
+    juce::File getCacheFile(const juce::String& key) const { return directory.getChildFile(key + ".wav"); }
+    juce::File getIndexFile() const { return directory.getChildFile("index.json"); }
+    void loadIndex();
+    void saveIndex();
+    void scheduleDecode(const juce::File& file);
+    void decodeFinished(const juce::File& file, const juce::String& key, bool succeeded);
+    void evictToFit();
+
+    juce::AudioFormatManager& formats;
+    const juce::File directory;
+    std::atomic<juce::int64> maxSizeBytes { (juce::int64) 2048 * 1024 * 1024 };
+
+    mutable juce::CriticalSection lock;
+    std::map<juce::String, std::pair<juce::String, juce::String>> keysByPath; // Percorso -> (firma, chiave)
+    std::set<juce::String> pendingPaths; // In coda o in decodifica
+    std::set<juce::String> pendingKeys;  // In decodifica: i loro temporanei non si eliminano
+
+    juce::ThreadPool pool { 1 }; // Un decoder alla volta: non deve contendere la CPU ai worker del disco
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DecodedFileCache)
+};
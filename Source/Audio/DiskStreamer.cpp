@@ -0,0 +1,510 @@
+#include "DiskStreamer.h"
+#include "Tracer.h"
+
+//==============================================================================
+StreamingAudioSource::StreamingAudioSource(juce::PositionableAudioSource* sourceToStream,
+                                           bool deleteSourceWhenDeleted,
+                                           double sourceSampleRate,
+                                           int numChannels,
+                                           int initialBufferFrames,
+                                           int maxBufferFrames)
+    : source(sourceToStream, deleteSourceWhenDeleted),
+      sampleRate(sourceSampleRate > 0.0 ? sourceSampleRate : 44100.0),
+      capacity(juce::jmax(initialBufferFrames, maxBufferFrames)),
+      minTargetFrames(juce::jmin(initialBufferFrames, DiskStreamer::minChunkFrames * 2)),
+      ring(juce::jmax(1, numChannels), juce::jmax(initialBufferFrames, maxBufferFrames)),
+      targetFrames(initialBufferFrames)
+{
+    jassert(source.get() != nullptr);
+    ring.clear();
+
+    // La sorgente viene letta solo dai worker: la prepariamo qui, sul message thread
+    source->prepareToPlay(DiskStreamer::minChunkFrames, sampleRate);
+}
+
+StreamingAudioSource::~StreamingAudioSource()
+{
+    // Va rimossa dal DiskStreamer prima della distruzione
+    jassert(!registered.load());
+    source->releaseResources();
+}
+
+void StreamingAudioSource::prepareToPlay(int, double)
+{
+    // Niente da fare: il ring è già allocato e la sorgente è servita dai worker
+}
+
+void StreamingAudioSource::releaseResources()
+{
+}
+
+void StreamingAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    // Testa tolta durante il lancio (sfratto, clip modificati): si prosegue dal ring
+    const auto* head = headActive.load(std::memory_order_relaxed) ? launchHead.load() : nullptr;
+    if (head == nullptr)
+    {
+        headActive.store(false, std::memory_order_relaxed);
+        readFromRing(bufferToFill);
+        return;
+    }
+
+    // Subito dopo un lancio: i frame vengono dalla testa, il resto dal ring già riposizionato
+    auto position = streamPosition.load(std::memory_order_relaxed);
+    const int headLength = head->getNumSamples();
+    const int fromHead = (int) juce::jlimit<juce::int64>(0, bufferToFill.numSamples, headLength - position);
+    auto& out = *bufferToFill.buffer;
+
+    for (int ch = 0; ch < out.getNumChannels(); ++ch)
+    {
+        if (ch < head->getNumChannels())
+            out.copyFrom(ch, bufferToFill.startSample, *head, ch, (int) position, fromHead);
+        else
+            out.clear(ch, bufferToFill.startSample, fromHead);
+    }
+
+    position += fromHead;
+    streamPosition.store(position, std::memory_order_relaxed);
+
+    if (position >= headLength)
+        headActive.store(false, std::memory_order_relaxed);
+
+    if (fromHead < bufferToFill.numSamples)
+        readFromRing({ bufferToFill.buffer, bufferToFill.startSample + fromHead, bufferToFill.numSamples - fromHead });
+}
+
+void StreamingAudioSource::launchFromStart()
+{
+    const auto* head = launchHead.load();
+    const int headLength = head != nullptr ? head->getNumSamples() : 0;
+
+    // I worker rileggono dalla fine della testa: hanno la durata della testa per farlo
+    streamPosition.store(0, std::memory_order_relaxed);
+    requestSeek(headLength);
+    headActive.store(headLength > 0, std::memory_order_relaxed);
+}
+
+juce::uint64 StreamingAudioSource::packSeek(int generation, juce::int64 target, bool prefill)
+{
+    constexpr auto targetMask = (juce::uint64 { 1 } << seekTargetBits) - 1;
+    return ((juce::uint64) generation << (seekTargetBits + 1))
+           | ((juce::uint64) (prefill ? 1 : 0) << seekTargetBits)
+           | ((juce::uint64) target & targetMask);
+}
+
+void StreamingAudioSource::requestSeek(juce::int64 target, bool prefill)
+{
+    // Senza lock: può chiamarla anche l'audio thread, in concorrenza con il message thread
+    constexpr int generationMask = (1 << (64 - seekTargetBits - 1)) - 1;
+    auto current = seekRequest.load();
+    while (!seekRequest.compare_exchange_weak(current, packSeek((getSeekGeneration(current) + 1) & generationMask, target, prefill)))
+    {
+    }
+}
+
+void StreamingAudioSource::readFromRing(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    const int numSamples = bufferToFill.numSamples;
+    auto position = streamPosition.load(std::memory_order_relaxed);
+
+    // Adotta un eventuale seek; un prefill non sposta la traccia, che continua dal punto raggiunto
+    const auto request = seekRequest.load();
+    if (getSeekGeneration(request) != consumerGeneration)
+    {
+        consumerGeneration = getSeekGeneration(request);
+        if (!isPrefillSeek(request))
+            position = getSeekTarget(request);
+    }
+
+    int silent = 0; // Frame prima dell'inizio dei dati di un prefill: silenzio voluto, non un underrun
+    int copied = 0;
+
+    // Lettura "seqlock" dei dati del flush: validi solo se la generazione non cambia durante la lettura
+    const int generation = flushGeneration.load();
+    const auto writeIndexAtFlush = flushWriteIndex.load();
+    const auto streamStart = flushStreamPosition.load();
+
+    if (generation == consumerGeneration && flushGeneration.load() == generation)
+    {
+        silent = (int) juce::jlimit<juce::int64>(0, numSamples, streamStart - position);
+
+        auto readIndex = framesRead.load(std::memory_order_relaxed);
+        const auto written = framesWritten.load(std::memory_order_acquire);
+        const auto wantedIndex = writeIndexAtFlush + (position + silent - streamStart);
+
+        // Scarta i dati precedenti al seek (o già superati) senza copiarli
+        if (wantedIndex > readIndex)
+            readIndex = juce::jmin(wantedIndex, written);
+
+        if (readIndex == wantedIndex)
+        {
+            copied = (int) juce::jmin<juce::int64>(numSamples - silent, written - readIndex);
+
+            const int ringStart = (int) (readIndex % capacity);
+            const int firstPart = juce::jmin(copied, capacity - ringStart);
+            const int outStart = bufferToFill.startSample + silent;
+            auto& out = *bufferToFill.buffer;
+
+            for (int ch = 0; ch < out.getNumChannels(); ++ch)
+            {
+                if (ch >= ring.getNumChannels())
+                {
+                    out.clear(ch, outStart, copied);
+                    continue;
+                }
+
+                out.copyFrom(ch, outStart, ring, ch, ringStart, firstPart);
+                if (copied > firstPart)
+                    out.copyFrom(ch, outStart + firstPart, ring, ch, 0, copied - firstPart);
+            }
+
+            readIndex += copied;
+        }
+
+        framesRead.store(readIndex, std::memory_order_release);
+    }
+    else if (isPrefillSeek(request))
+    {
+        // Il worker non ha ancora servito il prefill: i dati partiranno dalla sua destinazione
+        silent = (int) juce::jlimit<juce::int64>(0, numSamples, getSeekTarget(request) - position);
+    }
+
+    if (silent > 0)
+        bufferToFill.buffer->clear(bufferToFill.startSample, silent);
+
+    if (silent + copied < numSamples)
+    {
+        bufferToFill.buffer->clear(bufferToFill.startSample + silent + copied, numSamples - silent - copied);
+
+        const bool pastEnd = !isLooping() && position + silent + copied >= getTotalLength();
+        if (!pastEnd)
+            underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    streamPosition.store(position + numSamples, std::memory_order_relaxed);
+}
+
+void StreamingAudioSource::setNextReadPosition(juce::int64 newPosition)
+{
+    streamPosition.store(newPosition, std::memory_order_relaxed); // Solo per getNextReadPosition()
+    requestSeek(newPosition);
+}
+
+void StreamingAudioSource::setDormant(bool shouldBeDormant)
+{
+    if (dormant.exchange(shouldBeDormant) && !shouldBeDormant)
+    {
+        // Il ring contiene dati ormai superati: si riprende a leggere dal punto in cui si trova la traccia
+        requestSeek(streamPosition.load(std::memory_order_relaxed));
+    }
+}
+
+void StreamingAudioSource::wakeAhead(juce::int64 leadFrames)
+{
+    // Anche se non è più dormiente (un prefill precedente ormai superato) l'audio thread non sta
+    // leggendo dal ring: un nuovo prefill è sempre sicuro
+    requestSeek(streamPosition.load(std::memory_order_relaxed) + leadFrames, true);
+    dormant.store(false);
+}
+
+bool StreamingAudioSource::mayHaveReadAhead(juce::int64 start, juce::int64 end) const
+{
+    if (end <= start)
+        return false;
+
+    // Dati nel ring e letture in corso arrivano al più al target oltre la posizione (o oltre
+    // l'inizio di un prefill): le letture che partono dopo la modifica usano già il nuovo indice
+    const auto request = seekRequest.load();
+    auto windowStart = streamPosition.load(std::memory_order_relaxed);
+    if (isPrefillSeek(request))
+        windowStart = juce::jmax(windowStart, getSeekTarget(request));
+    const auto windowLength = (juce::int64) juce::jmax(getBufferedFrames(), targetFrames.load(std::memory_order_relaxed));
+
+    const auto length = getTotalLength();
+    if (!isLooping() || length <= 0)
+        return start < windowStart + windowLength && end > windowStart;
+
+    if (windowLength >= length)
+        return true;
+
+    // Sul loop la finestra può attraversare la fine e riprendere dall'inizio
+    const auto loopStart = windowStart % length;
+    const auto loopEnd = loopStart + windowLength;
+    return (start < loopEnd && end > loopStart) || (start < loopEnd - length && end > 0);
+}
+
+juce::int64 StreamingAudioSource::getNextReadPosition() const
+{
+    const auto position = streamPosition.load(std::memory_order_relaxed);
+    const auto length = getTotalLength();
+
+    if (isLooping() && length > 0)
+        return position % length;
+
+    return position;
+}
+
+juce::int64 StreamingAudioSource::getTotalLength() const
+{
+    return source->getTotalLength();
+}
+
+bool StreamingAudioSource::isLooping() const
+{
+    return source->isLooping();
+}
+
+void StreamingAudioSource::setLooping(bool shouldLoop)
+{
+    source->setLooping(shouldLoop);
+}
+
+int StreamingAudioSource::getBufferedFrames() const
+{
+    // I frame scritti prima dell'ultimo seek verranno scartati: non contano come buffer utile
+    const auto firstValid = juce::jmax(framesRead.load(std::memory_order_acquire), flushWriteIndex.load());
+    return (int) juce::jmax<juce::int64>(0, framesWritten.load(std::memory_order_acquire) - firstValid);
+}
+
+double StreamingAudioSource::getSecondsUntilDry() const
+{
+    if (getSeekGeneration(seekRequest.load()) != producerGeneration)
+        return 0.0;
+
+    return getBufferedFrames() / sampleRate;
+}
+
+int StreamingAudioSource::getFramesWanted(int minChunkFrames) const
+{
+    if (dormant.load(std::memory_order_relaxed))
+        return 0; // Traccia silenziata: niente decodifica finché non torna attiva
+
+    const int target = targetFrames.load(std::memory_order_relaxed);
+
+    if (getSeekGeneration(seekRequest.load()) != producerGeneration)
+        return target;
+
+    if (!isLooping() && source->getNextReadPosition() >= getTotalLength())
+        return 0; // Fine del file, niente da leggere
+
+    const int buffered = getBufferedFrames();
+    const int missing = target - buffered;
+
+    // Accorpa le letture: si legge solo quando manca almeno un blocco, salvo buffer quasi vuoto
+    if (missing >= minChunkFrames || (missing > 0 && buffered < target / 4))
+        return missing;
+
+    return 0;
+}
+
+void StreamingAudioSource::service()
+{
+    bool afterSeek = false;
+
+    const auto request = seekRequest.load();
+    const int requestedGeneration = getSeekGeneration(request);
+    if (requestedGeneration != producerGeneration)
+    {
+        producerGeneration = requestedGeneration;
+        const auto target = getSeekTarget(request);
+        source->setNextReadPosition(target);
+
+        // I nuovi dati iniziano dal punto di scrittura attuale: l'audio thread scarterà il resto
+        flushGeneration.store(-1);
+        flushWriteIndex.store(framesWritten.load(std::memory_order_relaxed));
+        flushStreamPosition.store(target);
+        flushGeneration.store(requestedGeneration);
+        afterSeek = true;
+    }
+
+    const int buffered = getBufferedFrames();
+    const auto occupied = framesWritten.load(std::memory_order_relaxed) - framesRead.load(std::memory_order_acquire);
+    int toRead = juce::jmin(targetFrames.load(std::memory_order_relaxed) - buffered, capacity - (int) occupied);
+
+    if (!isLooping())
+        toRead = (int) juce::jmin<juce::int64>(toRead, getTotalLength() - source->getNextReadPosition());
+
+    // Dopo un seek i primi dati si pubblicano con una lettura breve, il resto al giro successivo
+    if (afterSeek)
+        toRead = juce::jmin(toRead, DiskStreamer::minChunkFrames);
+
+    if (toRead <= 0)
+        return;
+
+    AW_TRACE_SCOPE("Disk read");
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    const auto writeIndex = framesWritten.load(std::memory_order_relaxed);
+    const int ringStart = (int) (writeIndex % capacity);
+    const int firstPart = juce::jmin(toRead, capacity - ringStart);
+
+    // Un'unica lettura accorpata (al massimo spezzata in due dal giro del ring)
+    source->getNextAudioBlock(juce::AudioSourceChannelInfo(&ring, ringStart, firstPart));
+    if (toRead > firstPart)
+        source->getNextAudioBlock(juce::AudioSourceChannelInfo(&ring, 0, toRead - firstPart));
+
+    framesWritten.store(writeIndex + toRead, std::memory_order_release);
+
+    const auto elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) * 0.001;
+    adaptBufferSize(buffered, toRead, elapsedSeconds, afterSeek);
+}
+
+void StreamingAudioSource::adaptBufferSize(int bufferedBeforeRead, int framesReadNow, double readSeconds, bool afterSeek)
+{
+    if (framesReadNow > 0 && readSeconds > 0.0)
+    {
+        const double rate = framesReadNow / readSeconds;
+        readRateEstimate = readRateEstimate <= 0.0 ? rate : 0.8 * readRateEstimate + 0.2 * rate;
+    }
+
+    if (afterSeek)
+        return; // Dopo un seek il buffer è vuoto per definizione, non è un segnale utile
+
+    int target = targetFrames.load(std::memory_order_relaxed);
+    const double realtimeFactor = readRateEstimate / sampleRate;
+
+    // Buffer quasi vuoto o disco lento (dischi meccanici, volumi di rete): più margine
+    if (bufferedBeforeRead < target / 4 || (readRateEstimate > 0.0 && realtimeFactor < 8.0))
+    {
+        target = juce::jmin(capacity, target + target / 2);
+        comfortableServices = 0;
+    }
+    else if (bufferedBeforeRead > target / 2 && realtimeFactor > 32.0)
+    {
+        // Disco veloce e buffer sempre pieno: restringiamo lentamente per ridurre la latenza dei seek
+        if (++comfortableServices >= 32)
+        {
+            target = juce::jmax(minTargetFrames, target - target / 8);
+            comfortableServices = 0;
+        }
+    }
+
+    targetFrames.store(target, std::memory_order_relaxed);
+}
+
+//==============================================================================
+class DiskStreamer::Worker : public juce::Thread
+{
+public:
+    Worker(DiskStreamer& streamer, int index)
+        : juce::Thread("Disk Streamer " + juce::String(index + 1)), owner(streamer)
+    {
+    }
+
+    void run() override { owner.runWorker(*this); }
+
+private:
+    DiskStreamer& owner;
+};
+
+DiskStreamer::DiskStreamer(int numWorkerThreads)
+{
+    for (int i = 0; i < juce::jmax(1, numWorkerThreads); ++i)
+        workers.add(new Worker(*this, i))->startThread(juce::Thread::Priority::high);
+}
+
+DiskStreamer::~DiskStreamer()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto* worker : workers)
+    {
+        workAvailable.signal();
+        worker->stopThread(2000);
+    }
+
+    jassert(sources.isEmpty());
+}
+
+void DiskStreamer::addSource(StreamingAudioSource* source)
+{
+    jassert(source != nullptr);
+    {
+        const juce::ScopedLock sl(lock);
+        sources.addIfNotAlreadyThere(source);
+        source->registered = true;
+    }
+    wakeUp();
+}
+
+void DiskStreamer::removeSource(StreamingAudioSource* source)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        sources.removeFirstMatchingValue(source);
+        source->registered = false;
+    }
+
+    // Un worker potrebbe averla già presa in carico: aspettiamo che finisca la lettura
+    while (source->serviceInProgress.load(std::memory_order_acquire))
+        juce::Thread::sleep(1);
+}
+
+int DiskStreamer::getNumSources() const
+{
+    const juce::ScopedLock sl(lock);
+    return sources.size();
+}
+
+int DiskStreamer::getTotalUnderruns() const
+{
+    const juce::ScopedLock sl(lock);
+    int total = 0;
+    for (auto* source : sources)
+        total += source->getUnderrunCount();
+    return total;
+}
+
+StreamingAudioSource* DiskStreamer::claimMostUrgentSource(int& waitMs)
+{
+    const juce::ScopedLock sl(lock);
+
+    StreamingAudioSource* mostUrgent = nullptr;
+    double mostUrgentDeadline = std::numeric_limits<double>::max();
+    double nearestDeadline = 0.04;
+
+    for (auto* source : sources)
+    {
+        if (source->serviceInProgress.load(std::memory_order_acquire))
+            continue;
+
+        // Sorgenti dormienti, a fine file o già piene non hanno una scadenza: contarle farebbe
+        // girare i worker a vuoto ogni millisecondo
+        if (source->getFramesWanted(minChunkFrames) == 0)
+            continue;
+
+        const double deadline = source->getSecondsUntilDry();
+        nearestDeadline = juce::jmin(nearestDeadline, deadline);
+
+        if (deadline < mostUrgentDeadline)
+        {
+            mostUrgent = source;
+            mostUrgentDeadline = deadline;
+        }
+    }
+
+    if (mostUrgent != nullptr)
+        mostUrgent->serviceInProgress.store(true, std::memory_order_release);
+
+    // Se non c'è niente da leggere ricontrolliamo ben prima che il buffer più basso si svuoti
+    waitMs = juce::jlimit(1, 10, (int) (nearestDeadline * 1000.0 / 4.0));
+    return mostUrgent;
+}
+
+void DiskStreamer::runWorker(juce::Thread& thread)
+{
+    while (!thread.threadShouldExit())
+    {
+        int waitMs = 10;
+
+        if (auto* source = claimMostUrgentSource(waitMs))
+        {
+            source->service();
+            source->serviceInProgress.store(false, std::memory_order_release);
+            continue;
+        }
+
+        workAvailable.wait(waitMs);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+class DiskStreamer;
+
+// Sorgente che legge in anticipo da un'altra PositionableAudioSource (tipicamente un
+// AudioFormatReaderSource) su un ring buffer lock-free. Il ring viene riempito dai worker
+// del DiskStreamer, mentre l'audio thread legge senza lock (singolo produttore, singolo consumatore).
+class StreamingAudioSource : public juce::PositionableAudioSource
+{
+public:
+    StreamingAudioSource(juce::PositionableAudioSource* sourceToStream,
+                         bool deleteSourceWhenDeleted,
+                         double sourceSampleRate,
+                         int numChannels = 2,
+                         int initialBufferFrames = 32768,
+                         int maxBufferFrames = 131072);
+    ~StreamingAudioSource() override;
+
+    // --- AudioSource ---
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    // --- PositionableAudioSource ---
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override;
+    juce::int64 getTotalLength() const override;
+    bool isLooping() const override;
+    void setLooping(bool shouldLoop) override;
+
+    // --- Tracce silenziate (audio thread) ---
+    // Avanza la posizione senza leggere né decodificare: la traccia resta allineata
+    void skipFrames(juce::int64 numFrames) { streamPosition.fetch_add(numFrames, std::memory_order_relaxed); }
+    // Una sorgente dormiente non viene servita dai worker; al risveglio riparte dalla posizione corrente
+    void setDormant(bool shouldBeDormant);
+    bool isDormant() const { return dormant.load(std::memory_order_relaxed); }
+    // Message thread, prima che una traccia dormiente torni udibile: i worker riempiono il ring da
+    // leadFrames più avanti della posizione raggiunta, mentre la traccia continua a scorrere a vuoto.
+    // L'audio thread suona silenzio fino a quel punto e da lì trova i dati già pronti.
+    void wakeAhead(juce::int64 leadFrames);
+
+    // Message thread, dopo aver pubblicato una modifica alla sorgente: vero se i frame [start, end)
+    // della sorgente possono essere già nel ring o in una lettura in corso, e vanno quindi riletti
+    bool mayHaveReadAhead(juce::int64 start, juce::int64 end) const;
+
+    // --- Lancio dei clip ---
+    // Primi frame della sorgente già in memoria: un lancio parte da qui mentre i worker rileggono
+    // dal punto in cui la testa finisce. Il buffer appartiene al chiamante: dopo averlo tolto
+    // (nullptr) va liberato solo quando il callback in corso è terminato.
+    void setLaunchHead(const juce::AudioBuffer<float>* head) { launchHead.store(head); }
+    // Audio thread: riparte dal frame 0 senza attendere il disco (se c'è una testa)
+    void launchFromStart();
+    // Vero mentre l'audio thread sta suonando dalla testa
+    bool isPlayingLaunchHead() const { return headActive.load(std::memory_order_relaxed); }
+
+    // --- Statistiche (lettura da qualsiasi thread) ---
+    int getBufferedFrames() const;
+    int getTargetBufferFrames() const { return targetFrames.load(std::memory_order_relaxed); }
+    int getUnderrunCount() const { return underruns.load(std::memory_order_relaxed); }
+    double getSourceSampleRate() const { return sampleRate; }
+
+private:
+    friend class DiskStreamer;
+
+    // --- Chiamati solo dal DiskStreamer, un worker alla volta ---
+    // Secondi prima che il buffer si svuoti (0 se c'è un seek da servire)
+    double getSecondsUntilDry() const;
+    // Frame che il worker dovrebbe leggere ora (0 = niente da fare)
+    int getFramesWanted(int minChunkFrames) const;
+    // Legge in un'unica operazione tutto lo spazio mancante fino al target
+    void service();
+    void adaptBufferSize(int bufferedBeforeRead, int framesRead, double readSeconds, bool afterSeek);
+    void readFromRing(const juce::AudioSourceChannelInfo& bufferToFill);
+
+    juce::OptionalScopedPointer<juce::PositionableAudioSource> source;
+    const double sampleRate;
+    const int capacity;
+    const int minTargetFrames;
+    juce::AudioBuffer<float> ring;
+
+    // Contatori monotoni del ring (frame scritti dal worker / consumati dall'audio thread)
+    std::atomic<juce::int64> framesWritten { 0 };
+    std::atomic<juce::int64> framesRead { 0 };
+
+    // Protocollo di seek: chi chiede un seek (message thread, o l'audio thread per un lancio)
+    // pubblica destinazione e generazione in un'unica parola atomica, così nessun lettore può
+    // abbinare la generazione di un seek alla destinazione di un altro; il worker riposiziona la
+    // sorgente e pubblica dove iniziano i nuovi dati nel ring (flushGeneration).
+    // Un seek di prefill (wakeAhead) riempie il ring in anticipo senza spostare la posizione della traccia.
+    static constexpr int seekTargetBits = 47; // Sopra: il bit di prefill e 16 bit di generazione
+    static juce::uint64 packSeek(int generation, juce::int64 target, bool prefill);
+    static int getSeekGeneration(juce::uint64 request) { return (int) (request >> (seekTargetBits + 1)); }
+    static bool isPrefillSeek(juce::uint64 request) { return ((request >> seekTargetBits) & 1) != 0; }
+    static juce::int64 getSeekTarget(juce::uint64 request) { return (juce::int64) (request << (64 - seekTargetBits)) >> (64 - seekTargetBits); }
+    void requestSeek(juce::int64 target, bool prefill = false);
+
+    std::atomic<juce::uint64> seekRequest { 0 };
+    std::atomic<int> flushGeneration { 0 };
+    std::atomic<juce::int64> flushWriteIndex { 0 };
+    std::atomic<juce::int64> flushStreamPosition { 0 };
+
+    // Posizione di lettura corrente (non avvolta sul loop), scritta solo dall'audio thread
+    std::atomic<juce::int64> streamPosition { 0 };
+    int consumerGeneration = 0;
+    int producerGeneration = 0;
+
+    // Testa in memoria per i lanci: pubblicata dal message thread, letta una volta per blocco
+    std::atomic<const juce::AudioBuffer<float>*> launchHead { nullptr };
+    std::atomic<bool> headActive { false }; // Scritto solo dall'audio thread
+
+    std::atomic<int> targetFrames;
+    std::atomic<int> underruns { 0 };
+    std::atomic<bool> serviceInProgress { false };
+    std::atomic<bool> dormant { false };
+    std::atomic<bool> registered { false };
+
+    // Stato dell'adattamento del buffer (solo worker)
+    double readRateEstimate = 0.0; // Frame al secondo misurati sul disco
+    int comfortableServices = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamingAudioSource)
+};
+
+// Scheduler di I/O unico per tutte le tracce in streaming. I worker servono sempre la traccia
+// più vicina a svuotarsi (deadline = tempo rimanente nel suo buffer) e leggono in blocchi
+// accorpati, invece del giro round-robin del TimeSliceThread.
+class DiskStreamer
+{
+public:
+    explicit DiskStreamer(int numWorkerThreads = 2);
+    ~DiskStreamer();
+
+    void addSource(StreamingAudioSource* source);
+    // Rimuove la sorgente e attende che nessun worker la stia leggendo
+    void removeSource(StreamingAudioSource* source);
+
+    // Sveglia i worker (es. dopo un seek o l'aggiunta di una traccia)
+    void wakeUp() { workAvailable.signal(); }
+
+    int getNumSources() const;
+    int getTotalUnderruns() const;
+
+    // Soglia minima di lettura: sotto questa quantità i worker aspettano per accorpare
+    static constexpr int minChunkFrames = 8192;
+
+private:
+    class Worker;
+
+    StreamingAudioSource* claimMostUrgentSource(int& waitMs);
+    void runWorker(juce::Thread& thread);
+
+    mutable juce::CriticalSection lock; // Protegge solo la lista, mai preso dall'audio thread
+    juce::Array<StreamingAudioSource*> sources;
+    juce::WaitableEvent workAvailable;
+    juce::OwnedArray<juce::Thread> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DiskStreamer)
+};
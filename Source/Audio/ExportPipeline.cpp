@@ -0,0 +1,341 @@
+#include "ExportPipeline.h"
+#include <deque>
+#include "LevelMeter.h"
+#include "Tracer.h"
+
+//==============================================================================
+// Uno stadio di codifica: consuma i blocchi dalla sua coda e li scrive su un file temporaneo,
+// che sostituisce la destinazione solo a export riuscito. Con la normalizzazione il primo
+// passaggio scrive il mix in float e ne misura la loudness; il secondo rilegge il file
+// temporaneo applicando il guadagno (il mix non viene reso una seconda volta).
+class ExportPipeline::EncoderStage : public juce::Thread
+{
+public:
+    EncoderStage(const Target& targetToWrite, juce::AudioFormat& outputFormat,
+                 juce::AudioFormatManager& formatManager, double rate)
+        : juce::Thread("Export Encoder " + targetToWrite.file.getFileName()),
+          target(targetToWrite), format(outputFormat), formats(formatManager), sampleRate(rate),
+          output(target.file)
+    {
+    }
+
+    ~EncoderStage() override
+    {
+        stopThread(5000);
+    }
+
+    bool open()
+    {
+        if (target.normaliseLoudness)
+        {
+            // Primo passaggio in float: nessuna perdita prima del guadagno finale
+            rawMix = std::make_unique<juce::TemporaryFile>(".wav");
+            if (auto* wav = formats.findFormatForFileExtension("wav"))
+                writer = createWriter(*wav, rawMix->getFile(), 32, 0);
+            loudness.prepare(sampleRate);
+        }
+        else
+        {
+            writer = createWriter(format, output.getFile(), getOutputBitDepth(), target.oggQuality);
+        }
+
+        return writer != nullptr;
+    }
+
+    // Thread del rendering: attende se la coda è piena. nullptr segnala la fine del mix.
+    bool push(Block block)
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock lock(queueLock);
+                if (failed.load())
+                    return false;
+
+                if ((int) queue.size() < queueCapacity)
+                {
+                    queue.push_back(std::move(block));
+                    break;
+                }
+            }
+
+            spaceAvailable.wait(100);
+        }
+
+        dataAvailable.signal();
+        return true;
+    }
+
+    bool hasFailed() const { return failed.load(); }
+    bool hasSucceeded() const { return succeeded.load(); }
+
+    // Dopo il successo di tutti gli stadi: il file temporaneo prende il posto della destinazione
+    bool commit()
+    {
+        if (!output.overwriteTargetFileWithTemporary())
+        {
+            juce::Logger::writeToLog("ExportPipeline Error: Cannot write " + target.file.getFullPathName());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            Block block;
+            bool received = false;
+            {
+                const juce::ScopedLock lock(queueLock);
+                if (!queue.empty())
+                {
+                    block = std::move(queue.front());
+                    queue.pop_front();
+                    received = true;
+                }
+            }
+
+            if (!received)
+            {
+                dataAvailable.wait(100);
+                continue;
+            }
+
+            spaceAvailable.signal();
+
+            if (block == nullptr)
+            {
+                const bool ok = finish();
+                (ok ? succeeded : failed).store(true);
+                return;
+            }
+
+            if (!write(*block))
+            {
+                failed.store(true);
+                return;
+            }
+        }
+    }
+
+    bool write(const juce::AudioBuffer<float>& block)
+    {
+        AW_TRACE_SCOPE("Export encode");
+        const int numSamples = block.getNumSamples();
+
+        if (target.normaliseLoudness)
+        {
+            loudness.process(block, 0, numSamples);
+            peak = juce::jmax(peak, block.getMagnitude(0, numSamples));
+            return writer->writeFromAudioSampleBuffer(block, 0, numSamples);
+        }
+
+        return writeConverted(block, numSamples, 1.0f);
+    }
+
+    // Guadagno e dither sulla copia locale: il blocco è condiviso con gli altri stadi
+    bool writeConverted(const juce::AudioBuffer<float>& block, int numSamples, float gain)
+    {
+        if (gain == 1.0f && !needsDither())
+            return writer->writeFromAudioSampleBuffer(block, 0, numSamples);
+
+        scratch.setSize(block.getNumChannels(), numSamples, false, false, true);
+        for (int ch = 0; ch < block.getNumChannels(); ++ch)
+            scratch.copyFrom(ch, 0, block.getReadPointer(ch), numSamples, gain);
+
+        if (needsDither())
+            dither.process(scratch, 0, numSamples, target.bitDepth, false);
+
+        return writer->writeFromAudioSampleBuffer(scratch, 0, numSamples);
+    }
+
+    bool finish()
+    {
+        if (!target.normaliseLoudness)
+        {
+            writer.reset(); // Chiude il file e completa l'header
+            return true;
+        }
+
+        writer.reset();
+
+        // Guadagno verso la loudness richiesta, limitato perché il picco resti sotto il ceiling
+        const float integrated = loudness.getIntegratedLufs();
+        float gain = integrated > -70.0f ? juce::Decibels::decibelsToGain(target.targetLufs - integrated) : 1.0f;
+        if (peak > 0.0f)
+            gain = juce::jmin(gain, juce::Decibels::decibelsToGain(target.ceilingDb) / peak);
+
+        juce::Logger::writeToLog("ExportPipeline: " + target.file.getFileName() + " measured "
+                                 + juce::String(integrated, 1) + " LUFS, gain " + juce::String(juce::Decibels::gainToDecibels(gain), 2) + " dB");
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(rawMix->getFile()));
+        writer = createWriter(format, output.getFile(), getOutputBitDepth(), target.oggQuality);
+        if (reader == nullptr || writer == nullptr)
+            return false;
+
+        juce::AudioBuffer<float> chunk((int) reader->numChannels, 8192);
+        for (juce::int64 position = 0; position < reader->lengthInSamples && !threadShouldExit();)
+        {
+            const int count = (int) juce::jmin<juce::int64>(chunk.getNumSamples(), reader->lengthInSamples - position);
+            reader->read(&chunk, 0, count, position, true, true);
+            if (!writeConverted(chunk, count, gain))
+                return false;
+            position += count;
+        }
+
+        writer.reset();
+        return !threadShouldExit();
+    }
+
+    // Ogg Vorbis codifica dai campioni float, la profondità vale solo per WAV e FLAC
+    int getOutputBitDepth() const { return target.format == Format::oggVorbis ? 32 : target.bitDepth; }
+
+    bool needsDither() const
+    {
+        return target.format != Format::oggVorbis && target.bitDepth < 32;
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter(juce::AudioFormat& writerFormat, const juce::File& file,
+                                                          int bitDepth, int quality)
+    {
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        if (!stream->openedOk())
+        {
+            juce::Logger::writeToLog("ExportPipeline Error: Cannot open " + file.getFullPathName());
+            return {};
+        }
+
+        stream->setPosition(0);
+        stream->truncate();
+
+        std::unique_ptr<juce::AudioFormatWriter> newWriter(
+            writerFormat.createWriterFor(stream.get(), sampleRate, 2, bitDepth, {}, quality));
+
+        if (newWriter == nullptr)
+        {
+            juce::Logger::writeToLog("ExportPipeline Error: " + writerFormat.getFormatName()
+                                     + " cannot write " + juce::String(bitDepth) + " bit at " + juce::String(sampleRate) + " Hz");
+            return {};
+        }
+
+        stream.release(); // Ora appartiene al writer
+        return newWriter;
+    }
+
+    const Target target;
+    juce::AudioFormat& format;
+    juce::AudioFormatManager& formats;
+    const double sampleRate;
+
+    juce::TemporaryFile output;
+    std::unique_ptr<juce::TemporaryFile> rawMix;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    juce::CriticalSection queueLock;
+    std::deque<Block> queue;
+    juce::WaitableEvent dataAvailable, spaceAvailable;
+    std::atomic<bool> failed { false }, succeeded { false };
+
+    juce::AudioBuffer<float> scratch;
+    TpdfDither dither;
+    LoudnessMeter loudness;
+    float peak = 0.0f;
+};
+
+//==============================================================================
+juce::String ExportPipeline::getFileExtension(Format format)
+{
+    switch (format)
+    {
+        case Format::wav:       return ".wav";
+        case Format::flac:      return ".flac";
+        case Format::oggVorbis: return ".ogg";
+    }
+    return {};
+}
+
+juce::AudioFormat* ExportPipeline::findFormat(juce::AudioFormatManager& formatManager, Format format)
+{
+    return formatManager.findFormatForFileExtension(getFileExtension(format));
+}
+
+bool ExportPipeline::run(OfflineRenderer& renderer, const std::vector<Target>& targets, ProgressCallback progress)
+{
+    std::vector<std::unique_ptr<EncoderStage>> stages;
+
+    for (auto const& target : targets)
+    {
+        auto* format = findFormat(formats, target.format);
+        if (format == nullptr)
+        {
+            juce::Logger::writeToLog("ExportPipeline Error: No encoder available for " + target.file.getFileName());
+            return false;
+        }
+
+        auto stage = std::make_unique<EncoderStage>(target, *format, formats, renderer.getSampleRate());
+        if (!stage->open())
+            return false;
+
+        stages.push_back(std::move(stage));
+    }
+
+    for (auto& stage : stages)
+        stage->startThread();
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    const double length = (double) juce::jmax<juce::int64>(1, renderer.getLengthInSamples());
+    const int blockSize = 4096;
+    bool ok = true;
+
+    // Un solo rendering: ogni blocco è nuovo e immutabile, gli stadi ne condividono la proprietà
+    while (ok && !renderer.isFinished())
+    {
+        auto block = std::make_shared<juce::AudioBuffer<float>>(2, blockSize);
+        const int rendered = renderer.renderNextBlock(*block, blockSize);
+        block->setSize(2, rendered, true, false, true);
+
+        Block shared = std::move(block);
+        for (auto& stage : stages)
+            ok = stage->push(shared) && ok;
+
+        if (progress != nullptr && !progress(renderer.getPosition() / length))
+            ok = false;
+    }
+
+    if (ok)
+        for (auto& stage : stages)
+            ok = stage->push(nullptr) && ok;
+
+    // Attende gli encoder (la normalizzazione fa ancora il suo secondo passaggio)
+    while (ok)
+    {
+        bool allDone = true;
+        for (auto& stage : stages)
+        {
+            ok = ok && !stage->hasFailed();
+            allDone = allDone && stage->hasSucceeded();
+        }
+
+        if (allDone || !ok)
+            break;
+
+        if (progress != nullptr && !progress(1.0))
+            ok = false;
+
+        juce::Thread::sleep(20);
+    }
+
+    if (ok)
+        for (auto& stage : stages)
+            ok = stage->commit() && ok;
+
+    // In caso di errore o annullamento i distruttori fermano gli stadi e rimuovono i temporanei
+    stages.clear();
+
+    juce::Logger::writeToLog("ExportPipeline: Export of " + juce::String((int) targets.size()) + " files "
+                             + (ok ? "completed in " + juce::String((juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 2) + " s"
+                                   : juce::String("failed")));
+    return ok;
+}
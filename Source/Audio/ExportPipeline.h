@@ -0,0 +1,51 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "OfflineRenderer.h"
+
+// Export del mix in più formati con un solo rendering: il thread chiamante rende i blocchi
+// e li distribuisce (condivisi, immutabili) agli stadi di codifica, ognuno sul proprio thread
+// e con una coda limitata. Il tempo totale tende a max(rendering, codifica più lenta).
+class ExportPipeline
+{
+public:
+    enum class Format { wav, flac, oggVorbis };
+
+    struct Target
+    {
+        juce::File file;
+        Format format = Format::wav;
+        int bitDepth = 24;              // WAV/FLAC; 32 = WAV in virgola mobile
+        int oggQuality = 6;             // Indice delle qualità del formato Ogg Vorbis
+        bool normaliseLoudness = false; // Porta il file a targetLufs (integrated)
+        float targetLufs = -14.0f;
+        float ceilingDb = -1.0f;        // Limite di picco dopo la normalizzazione
+    };
+
+    // Avanzamento 0..1; restituire false annulla l'export
+    using ProgressCallback = std::function<bool(double)>;
+
+    explicit ExportPipeline(juce::AudioFormatManager& formatManager) : formats(formatManager) {}
+
+    // Blocca fino alla fine dell'export; restituisce false se un formato non è disponibile,
+    // un file non si può scrivere o l'export è stato annullato (i file incompleti vengono rimossi)
+    bool run(OfflineRenderer& renderer, const std::vector<Target>& targets, ProgressCallback progress = nullptr);
+
+    // Formato registrato nel manager per un tipo di export (nullptr se manca l'encoder)
+    static juce::AudioFormat* findFormat(juce::AudioFormatManager& formatManager, Format format);
+    static juce::String getFileExtension(Format format);
+
+    // Blocchi in coda per ogni stadio: limita la memoria se un encoder resta indietro
+    static constexpr int queueCapacity = 16;
+
+private:
+    using Block = std::shared_ptr<const juce::AudioBuffer<float>>;
+    class EncoderStage;
+
+    juce::AudioFormatManager& formats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ExportPipeline)
+};
@@ -0,0 +1,389 @@
+#include "GoldenRender.h"
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+namespace
+{
+    // Impronta FNV-1a a 64 bit dei campioni, per riconoscere a colpo d'occhio due rendering nei log
+    juce::uint64 fingerprint(const void* data, size_t numBytes, juce::uint64 value)
+    {
+        auto* bytes = static_cast<const juce::uint8*>(data);
+        for (size_t i = 0; i < numBytes; ++i)
+            value = (value ^ bytes[i]) * 1099511628211ull;
+        return value;
+    }
+
+    Clip makeClip(const juce::File& file, juce::int64 timelineStart)
+    {
+        Clip clip;
+        clip.file = file;
+        clip.timelineStart = timelineStart;
+        return clip;
+    }
+
+    std::shared_ptr<const AutomationCurve> makeCurve(std::vector<AutomationCurve::Breakpoint> points)
+    {
+        return std::make_shared<const AutomationCurve>(std::move(points));
+    }
+}
+
+//==============================================================================
+bool GoldenRender::writeSources(const juce::File& directory)
+{
+    if (!directory.createDirectory())
+        return false;
+
+    // Solo interi divisi per potenze di due: i campioni sono esatti in float su ogni piattaforma
+    auto writeFile = [&directory](const juce::String& name, double rate, int numChannels, int numFrames, auto sampleAt)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numFrames);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numFrames; ++i)
+                buffer.setSample(ch, i, sampleAt(ch, i));
+
+        const auto file = directory.getChildFile(name);
+        file.deleteFile();
+
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        if (!stream->openedOk())
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), rate, (unsigned int) numChannels, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Ora appartiene al writer
+        return writer->writeFromAudioSampleBuffer(buffer, 0, numFrames);
+    };
+
+    // Dente di sega a 44.1 kHz (ricampionato sulla timeline), periodi diversi per canale
+    const bool saw = writeFile("saw.wav", 44100.0, 2, 132300, [](int ch, int i)
+    {
+        const int period = ch == 0 ? 100 : 147;
+        return (float) (2 * (i % period) - period) / (ch == 0 ? 128.0f : 256.0f);
+    });
+
+    // Rumore mono da un generatore congruenziale scritto qui: gli stessi campioni con ogni versione di JUCE
+    juce::uint32 state = 2024;
+    const bool noise = writeFile("noise.wav", sampleRate, 1, 96000, [&state](int, int)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (float) ((int) (state >> 16) - 32768) / 131072.0f;
+    });
+
+    // Onda quadra che sale di livello ogni 100 ms, fino a saturare il limiter
+    const bool pulse = writeFile("pulse.wav", sampleRate, 2, 48000, [](int ch, int i)
+    {
+        const float level = (float) (i / 4800 + 1) / 16.0f;
+        return ((i / 32 + ch) % 2 == 0 ? level : -level);
+    });
+
+    // Campione del sampler: onda a gradini che decade, suonata sulla radice e trasposta
+    const bool note = writeFile("note.wav", sampleRate, 1, 12000, [](int, int i)
+    {
+        return (float) (((i % 48) - 24) * (16 - i / 750)) / 1024.0f;
+    });
+
+    // Risposta del riverbero: pochi impulsi, nel tratto diretto, nelle partizioni piccole e nella coda
+    const bool impulse = writeFile("impulse.wav", sampleRate, 2, 5001, [](int ch, int i)
+    {
+        if (i == 0)
+            return 0.5f;
+        if (i == (ch == 0 ? 200 : 333))
+            return ch == 0 ? -0.25f : 0.25f;
+        if (i == (ch == 0 ? 5000 : 4500))
+            return ch == 0 ? 0.125f : -0.125f;
+        return 0.0f;
+    });
+
+    return saw && noise && pulse && note && impulse;
+}
+
+std::vector<GoldenRender::ReferenceSession> GoldenRender::createReferenceSessions(const juce::File& sourceDirectory, SampleCache& samples)
+{
+    const auto saw = sourceDirectory.getChildFile("saw.wav");
+    const auto noise = sourceDirectory.getChildFile("noise.wav");
+    const auto pulse = sourceDirectory.getChildFile("pulse.wav");
+    const auto note = sourceDirectory.getChildFile("note.wav");
+    const auto impulse = sourceDirectory.getChildFile("impulse.wav");
+    using Shape = AutomationCurve::Shape;
+    using NodeRef = RoutingGraph::NodeRef;
+
+    std::vector<ReferenceSession> sessions;
+
+    // Clip: fade, guadagno, offset, verso, ricampionamento; la traccia silenziata non suona
+    {
+        SessionState session;
+        TrackState first;
+        first.gain = 0.8f;
+        session = session.withTrack(1, first);
+
+        Clip intro = makeClip(saw, 0);
+        intro.length = 96000;
+        intro.fadeInLength = 4800;
+        intro.fadeOutLength = 9600;
+        intro.gain = 0.7f;
+
+        Clip reversed = makeClip(saw, 96000);
+        reversed.sourceOffset = 22050;
+        reversed.length = 48000;
+        reversed.fadeOutLength = 2400;
+        reversed.reversed = true;
+        session = session.withNewClip(1, intro).withNewClip(1, reversed);
+
+        TrackState second;
+        second.gain = 0.5f;
+        Clip noiseClip = makeClip(noise, 24000);
+        noiseClip.fadeInLength = 12000;
+        session = session.withTrack(2, second).withNewClip(2, noiseClip);
+
+        TrackState muted;
+        muted.muted = true;
+        session = session.withTrack(3, muted).withNewClip(3, makeClip(pulse, 0));
+
+        OfflineRenderer::Settings settings;
+        settings.deterministic = true;
+        sessions.push_back({ "clips", session, settings });
+
+        // Stem pre-fader della prima traccia, senza bus master
+        settings.onlyTrackId = 1;
+        settings.applyTrackGain = false;
+        sessions.push_back({ "stem", session, settings });
+    }
+
+    // Automazione, pan, loop e solo; il limiter lavora pesantemente sul finale
+    {
+        SessionState session;
+        TrackState looped;
+        looped.looping = true;
+        looped.soloed = true;
+        Clip loop = makeClip(saw, 0);
+        loop.length = 24000;
+        session = session.withTrack(1, looped).withNewClip(1, loop);
+
+        TrackState loud;
+        loud.soloed = true;
+        session = session.withTrack(2, loud).withNewClip(2, makeClip(pulse, 48000));
+
+        TrackState excluded; // Non in solo: esclusa dal mix
+        session = session.withTrack(3, excluded).withNewClip(3, makeClip(noise, 0));
+
+        OfflineRenderer::Settings settings;
+        settings.deterministic = true;
+        settings.masterGain = 2.0f;
+        settings.ceilingDb = -3.0f;
+        settings.trackPan[2] = 0.25f;
+        settings.automation[{ AutomatedParameter::trackVolume, 1 }] = makeCurve({ { 0, 0.2f, Shape::exponential },
+                                                                                  { 24000, 1.0f, Shape::sCurve },
+                                                                                  { 60000, 0.3f, Shape::linear },
+                                                                                  { 90000, 0.6f } });
+        settings.automation[{ AutomatedParameter::trackPan, 1 }] = makeCurve({ { 0, -1.0f }, { 72000, 1.0f } });
+        settings.automation[{ AutomatedParameter::masterGain, 0 }] = makeCurve({ { 48000, 1.5f, Shape::exponential },
+                                                                                 { 84000, 3.0f } });
+        settings.automation[{ AutomatedParameter::masterCeiling, 0 }] = makeCurve({ { 0, 0.5f }, { 96000, 0.9f } });
+        sessions.push_back({ "automation", session, settings });
+    }
+
+    // Il piano dell'engine: gruppo con latenza dichiarata (compensata sugli altri percorsi) e
+    // automazione, aux con riverbero, mandate pre e post fader, traccia MIDI, bus silenziato.
+    // Lo stesso mix poi con la traccia MIDI resa in anticipo: deve coincidere.
+    {
+        SessionState session;
+        TrackState grouped;
+        grouped.gain = 0.5f;
+        Clip pulseClip = makeClip(pulse, 4800);
+        pulseClip.length = 36000;
+        pulseClip.fadeOutLength = 4800;
+        session = session.withTrack(1, grouped).withNewClip(1, pulseClip);
+        session = session.withTrack(3, TrackState()).withNewClip(3, makeClip(noise, 0));
+
+        RoutingGraph routing;
+        for (int trackId : { 1, 2, 3 })
+            routing.addTrack(trackId);
+
+        const int group = routing.addBus("Group");
+        const int aux = routing.addBus("Reverb");
+        const int silenced = routing.addBus("Muted");
+        routing.setDestination(NodeRef::track(1), group);
+        routing.setSend(NodeRef::track(1), aux, 0.5f, false);
+        routing.setSend(NodeRef::track(2), aux, 0.25f, true);
+        routing.setDestination(NodeRef::track(3), silenced);
+        routing.setLatency(NodeRef::bus(group), 96);
+        routing.getBusChannel(aux)->gain.store(0.75f);
+        routing.getBusChannel(silenced)->muted.store(true);
+
+        // Radice, ottava sopra e sotto e una quinta (ricampionata), in parte sovrapposte
+        auto events = std::make_shared<std::vector<TimedMidiEvent>>();
+        for (auto [start, end, pitch] : { std::tuple<int, int, int> { 0, 9000, 60 }, { 6000, 12000, 72 },
+                                          { 12000, 24000, 48 }, { 20000, 30000, 67 }, { 30000, 36000, 60 } })
+        {
+            events->push_back({ start, juce::MidiMessage::noteOn(1, pitch, (juce::uint8) 100) });
+            events->push_back({ end, juce::MidiMessage::noteOff(1, pitch) });
+        }
+        std::stable_sort(events->begin(), events->end(), [](const TimedMidiEvent& a, const TimedMidiEvent& b) { return a.time < b.time; });
+
+        OfflineRenderer::MidiTrack midi;
+        midi.zones = { { note, 60, 0, 127 } };
+        midi.events = events;
+        midi.gain = 0.75f;
+
+        OfflineRenderer::Settings settings;
+        settings.deterministic = true;
+        settings.routing = std::make_shared<const RoutingGraph>(routing);
+        settings.busReverbs[aux] = { impulse, 1.0f, 0.5f };
+        settings.midiTracks[2] = midi;
+        settings.sampleCache = &samples;
+        settings.trackPan[2] = 0.5f;
+        settings.automation[{ AutomatedParameter::busGain, group }] = makeCurve({ { 0, 1.0f }, { 40000, 0.25f } });
+        sessions.push_back({ "routing", session, settings });
+
+        settings.anticipativeRendering = true;
+        sessions.push_back({ "prerender", session, settings });
+    }
+
+    return sessions;
+}
+
+juce::AudioBuffer<float> GoldenRender::render(juce::AudioFormatManager& formats, const ReferenceSession& reference)
+{
+    OfflineRenderer renderer(formats, reference.session, sampleRate, reference.settings);
+
+    juce::AudioBuffer<float> result(2, (int) renderer.getLengthInSamples());
+    juce::AudioBuffer<float> block(2, OfflineRenderer::deterministicBlockSize);
+
+    for (int position = 0; !renderer.isFinished();)
+    {
+        const int count = renderer.renderNextBlock(block, block.getNumSamples());
+        for (int ch = 0; ch < 2; ++ch)
+            result.copyFrom(ch, position, block, ch, 0, count);
+        position += count;
+    }
+
+    return result;
+}
+
+juce::String GoldenRender::getHash(const juce::AudioBuffer<float>& buffer)
+{
+    juce::uint64 value = 14695981039346656037ull;
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        value = fingerprint(buffer.getReadPointer(ch), sizeof(float) * (size_t) buffer.getNumSamples(), value);
+    return juce::String::toHexString((juce::int64) value).paddedLeft('0', 16);
+}
+
+template <typename Check>
+bool GoldenRender::forEachRender(juce::String& report, Check&& check)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    // Campioni degli strumenti: devono sopravvivere ai renderer
+    MemoryBudget budget;
+    SampleCache samples(formats, budget);
+
+    const auto sources = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioWorkstation Golden Sources");
+    if (!writeSources(sources))
+    {
+        report << "Cannot write the source files in " << sources.getFullPathName() << "\n";
+        return false;
+    }
+
+    bool allPassed = true;
+    for (auto const& reference : createReferenceSessions(sources, samples))
+    {
+        const auto rendered = render(formats, reference);
+        report << reference.name.paddedRight(' ', 12) << getHash(rendered) << "  ";
+        allPassed = check(formats, reference.name, rendered) && allPassed;
+        report << "\n";
+    }
+
+    sources.deleteRecursively();
+    return allPassed;
+}
+
+bool GoldenRender::record(const juce::File& directory, juce::String& report)
+{
+    if (!directory.createDirectory())
+    {
+        report << "Cannot create " << directory.getFullPathName() << "\n";
+        return false;
+    }
+
+    report << "Recording golden renders in " << directory.getFullPathName() << "\n";
+    return forEachRender(report, [&](juce::AudioFormatManager&, const juce::String& name, const juce::AudioBuffer<float>& rendered)
+    {
+        const auto file = directory.getChildFile(name + ".wav");
+        file.deleteFile();
+
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream->openedOk())
+            writer.reset(wav.createWriterFor(stream.get(), sampleRate, 2, 32, {}, 0));
+
+        if (writer == nullptr)
+        {
+            report << "cannot write " << file.getFullPathName();
+            return false;
+        }
+
+        stream.release(); // Ora appartiene al writer
+        const bool written = writer->writeFromAudioSampleBuffer(rendered, 0, rendered.getNumSamples());
+        report << (written ? "recorded" : "write failed");
+        return written;
+    });
+}
+
+bool GoldenRender::verify(const juce::File& directory, juce::String& report)
+{
+    report << "Verifying renders against " << directory.getFullPathName() << " (tolerance "
+           << juce::String(tolerance, 8) << ")\n";
+
+    const bool passed = forEachRender(report, [&](juce::AudioFormatManager& formats, const juce::String& name,
+                                                  const juce::AudioBuffer<float>& rendered)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(directory.getChildFile(name + ".wav")));
+        if (reader == nullptr)
+        {
+            report << "FAIL (no golden file: record it with --record-golden on a known-good build)";
+            return false;
+        }
+
+        if ((int) reader->numChannels != rendered.getNumChannels() || reader->lengthInSamples != rendered.getNumSamples())
+        {
+            report << "FAIL (golden has " << (int) reader->numChannels << " channels and " << reader->lengthInSamples
+                   << " samples, render has " << rendered.getNumSamples() << ")";
+            return false;
+        }
+
+        juce::AudioBuffer<float> golden(rendered.getNumChannels(), rendered.getNumSamples());
+        reader->read(&golden, 0, golden.getNumSamples(), 0, true, true);
+
+        // Un NaN non supera mai il confronto: conta come differenza infinita
+        float maxDifference = 0.0f;
+        for (int ch = 0; ch < rendered.getNumChannels(); ++ch)
+        {
+            const float* a = rendered.getReadPointer(ch);
+            const float* b = golden.getReadPointer(ch);
+            for (int i = 0; i < rendered.getNumSamples(); ++i)
+            {
+                const float difference = std::abs(a[i] - b[i]);
+                maxDifference = difference <= maxDifference ? maxDifference
+                                                            : (std::isnan(difference) ? std::numeric_limits<float>::infinity() : difference);
+            }
+        }
+
+        if (getHash(golden) == getHash(rendered))
+            report << "exact";
+        else if (maxDifference <= tolerance)
+            report << "within tolerance (max difference " << juce::String(maxDifference, 9) << ")";
+        else
+            report << "FAIL (max difference " << juce::String(maxDifference, 9) << ")";
+
+        return maxDifference <= tolerance;
+    });
+
+    report << (passed ? "All renders match\n" : "Render regression detected\n");
+    return passed;
+}
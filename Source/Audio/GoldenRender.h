@@ -0,0 +1,44 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "OfflineRenderer.h"
+
+// Regressione dell'audio: alcune sessioni di riferimento vengono rese in modalità
+// deterministica e confrontate con i file golden salvati, bit per bit o entro tolerance.
+// I file sorgente sono generati con aritmetica esatta (interi e potenze di due), quindi sono
+// identici su ogni piattaforma: una differenza può venire solo dal percorso di rendering.
+// Le sessioni coprono clip (offset, fade, guadagno, verso, ricampionamento), loop, mute e
+// solo, pan e automazione, bus master con limiter, stem pre-fader, e il piano dell'engine:
+// bus e mandate, compensazione della latenza, riverbero su bus, traccia MIDI dal vivo e
+// resa in anticipo. I golden sono nella cartella Golden del repository.
+class GoldenRender
+{
+public:
+    static constexpr double sampleRate = 48000.0;
+    // Massima differenza accettata quando i bit non coincidono (circa -120 dBFS): copre libm e
+    // compilatori diversi, non un cambiamento udibile
+    static constexpr float tolerance = 1.0e-6f;
+
+    // Riscrive i file golden (<sessione>.wav, float a 32 bit) in directory
+    static bool record(const juce::File& directory, juce::String& report);
+    // false se una sessione differisce oltre la tolleranza o non ha il suo file golden
+    static bool verify(const juce::File& directory, juce::String& report);
+
+private:
+    struct ReferenceSession
+    {
+        juce::String name;
+        SessionState session;
+        OfflineRenderer::Settings settings;
+    };
+
+    static bool writeSources(const juce::File& directory);
+    static std::vector<ReferenceSession> createReferenceSessions(const juce::File& sourceDirectory, SampleCache& samples);
+    static juce::AudioBuffer<float> render(juce::AudioFormatManager& formats, const ReferenceSession& reference);
+    static juce::String getHash(const juce::AudioBuffer<float>& buffer);
+
+    // Prepara i file sorgente e rende ogni sessione; check riceve nome e risultato
+    template <typename Check>
+    static bool forEachRender(juce::String& report, Check&& check);
+};
@@ -0,0 +1,299 @@
+#include "LevelMeter.h"
+
+namespace
+{
+    constexpr float silenceLufs = -std::numeric_limits<float>::infinity();
+    constexpr double peakReleaseDbPerSecond = 12.0;
+    constexpr double rmsWindowSeconds = 0.3;
+}
+
+//==============================================================================
+LevelMeter::LevelMeter()
+{
+    reset();
+}
+
+void LevelMeter::prepare(double sampleRate)
+{
+    currentSampleRate = sampleRate > 0.0 ? sampleRate : 44100.0;
+    cachedBlockSize = 0;
+    reset();
+}
+
+void LevelMeter::reset()
+{
+    peakState.fill(0.0f);
+    meanSquareState.fill(0.0f);
+    for (auto& level : peakLevels) level.store(0.0f);
+    for (auto& level : rmsLevels) level.store(0.0f);
+}
+
+void LevelMeter::updateBallistics(int numSamples)
+{
+    // I coefficienti dipendono solo dalla dimensione del blocco: li ricalcoliamo solo se cambia
+    if (numSamples == cachedBlockSize)
+        return;
+
+    cachedBlockSize = numSamples;
+    const double blockSeconds = numSamples / currentSampleRate;
+    peakDecay = (float) juce::Decibels::decibelsToGain(-peakReleaseDbPerSecond * blockSeconds);
+    rmsSmoothing = (float) std::exp(-blockSeconds / rmsWindowSeconds);
+}
+
+void LevelMeter::process(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    if (numSamples <= 0)
+        return;
+
+    updateBallistics(numSamples);
+
+    const int numChannels = juce::jmin(maxChannels, buffer.getNumChannels());
+    for (int ch = 0; ch < maxChannels; ++ch)
+    {
+        float blockPeak = 0.0f;
+        float blockMeanSquare = 0.0f;
+
+        // Una traccia mono viene mostrata uguale su entrambi i canali
+        const int sourceChannel = juce::jmin(ch, numChannels - 1);
+        if (sourceChannel >= 0)
+        {
+            const float* data = buffer.getReadPointer(sourceChannel, startSample);
+            blockPeak = absolutePeak(data, numSamples);
+            blockMeanSquare = sumOfSquares(data, numSamples) / (float) numSamples;
+        }
+
+        auto& peak = peakState[(size_t) ch];
+        peak = juce::jmax(blockPeak, peak * peakDecay);
+
+        auto& meanSquare = meanSquareState[(size_t) ch];
+        meanSquare = rmsSmoothing * meanSquare + (1.0f - rmsSmoothing) * blockMeanSquare;
+
+        peakLevels[(size_t) ch].store(peak, std::memory_order_relaxed);
+        rmsLevels[(size_t) ch].store(std::sqrt(meanSquare), std::memory_order_relaxed);
+    }
+}
+
+void LevelMeter::processSilence(int numSamples)
+{
+    if (numSamples <= 0)
+        return;
+
+    updateBallistics(numSamples);
+
+    for (int ch = 0; ch < maxChannels; ++ch)
+    {
+        peakState[(size_t) ch] *= peakDecay;
+        meanSquareState[(size_t) ch] *= rmsSmoothing;
+        peakLevels[(size_t) ch].store(peakState[(size_t) ch], std::memory_order_relaxed);
+        rmsLevels[(size_t) ch].store(std::sqrt(meanSquareState[(size_t) ch]), std::memory_order_relaxed);
+    }
+}
+
+float LevelMeter::sumOfSquares(const float* data, int numSamples)
+{
+    using Register = juce::dsp::SIMDRegister<float>;
+
+    float scalarSum = 0.0f;
+    int i = 0;
+
+    // Testa non allineata
+    while (i < numSamples && !Register::isSIMDAligned(data + i))
+    {
+        scalarSum += data[i] * data[i];
+        ++i;
+    }
+
+    auto accumulator = Register::expand(0.0f);
+    for (; i + (int) Register::size() <= numSamples; i += (int) Register::size())
+    {
+        const auto values = Register::fromRawArray(data + i);
+        accumulator += values * values;
+    }
+
+    scalarSum += accumulator.sum();
+
+    // Coda
+    for (; i < numSamples; ++i)
+        scalarSum += data[i] * data[i];
+
+    return scalarSum;
+}
+
+float LevelMeter::absolutePeak(const float* data, int numSamples)
+{
+    const auto range = juce::FloatVectorOperations::findMinAndMax(data, numSamples);
+    return juce::jmax(std::abs(range.getStart()), std::abs(range.getEnd()));
+}
+
+//==============================================================================
+LoudnessMeter::LoudnessMeter()
+    : momentaryLufs(silenceLufs), shortTermLufs(silenceLufs), integratedLufs(silenceLufs)
+{
+    prepare(44100.0);
+}
+
+void LoudnessMeter::prepare(double sampleRate)
+{
+    const double fs = sampleRate > 0.0 ? sampleRate : 44100.0;
+
+    // Coefficienti della pesatura K indipendenti dalla frequenza di campionamento (BS.1770-4)
+    {
+        const double f0 = 1681.974450955533;
+        const double gainDb = 3.999843853973347;
+        const double q = 0.7071752369554196;
+        const double k = std::tan(juce::MathConstants<double>::pi * f0 / fs);
+        const double vh = std::pow(10.0, gainDb / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+
+        shelfFilter.b0 = (float) ((vh + vb * k / q + k * k) / a0);
+        shelfFilter.b1 = (float) (2.0 * (k * k - vh) / a0);
+        shelfFilter.b2 = (float) ((vh - vb * k / q + k * k) / a0);
+        shelfFilter.a1 = (float) (2.0 * (k * k - 1.0) / a0);
+        shelfFilter.a2 = (float) ((1.0 - k / q + k * k) / a0);
+    }
+
+    {
+        const double f0 = 38.13547087602444;
+        const double q = 0.5003270373238773;
+        const double k = std::tan(juce::MathConstants<double>::pi * f0 / fs);
+        const double a0 = 1.0 + k / q + k * k;
+
+        highPassFilter.b0 = 1.0f;
+        highPassFilter.b1 = -2.0f;
+        highPassFilter.b2 = 1.0f;
+        highPassFilter.a1 = (float) (2.0 * (k * k - 1.0) / a0);
+        highPassFilter.a2 = (float) ((1.0 - k / q + k * k) / a0);
+    }
+
+    subBlockLength = juce::jmax(1, juce::roundToInt(fs * 0.1));
+    resetState();
+}
+
+void LoudnessMeter::resetState()
+{
+    shelfFilter.z1.fill(0.0f);
+    shelfFilter.z2.fill(0.0f);
+    highPassFilter.z1.fill(0.0f);
+    highPassFilter.z2.fill(0.0f);
+
+    subBlockPosition = 0;
+    subBlockEnergy = 0.0;
+    subBlockHistory.fill(0.0);
+    subBlockIndex = 0;
+    subBlocksFilled = 0;
+    histogramCounts.fill(0);
+    histogramEnergy.fill(0.0);
+
+    momentaryLufs.store(silenceLufs);
+    shortTermLufs.store(silenceLufs);
+    integratedLufs.store(silenceLufs);
+}
+
+float LoudnessMeter::energyToLufs(double meanSquare)
+{
+    if (meanSquare <= 0.0)
+        return silenceLufs;
+
+    return (float) (-0.691 + 10.0 * std::log10(meanSquare));
+}
+
+void LoudnessMeter::process(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    if (resetRequested.exchange(false))
+        resetState();
+
+    const int numChannels = juce::jmin(LevelMeter::maxChannels, buffer.getNumChannels());
+    int processed = 0;
+
+    while (processed < numSamples)
+    {
+        const int segment = juce::jmin(numSamples - processed, subBlockLength - subBlockPosition);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const float* data = buffer.getReadPointer(ch, startSample + processed);
+            float channelEnergy = 0.0f;
+
+            // I filtri IIR sono ricorsivi: il loop resta scalare, ma senza diramazioni
+            for (int i = 0; i < segment; ++i)
+            {
+                const float weighted = highPassFilter.process(shelfFilter.process(data[i], ch), ch);
+                channelEnergy += weighted * weighted;
+            }
+
+            subBlockEnergy += channelEnergy;
+        }
+
+        processed += segment;
+        subBlockPosition += segment;
+
+        if (subBlockPosition >= subBlockLength)
+            finishSubBlock();
+    }
+}
+
+void LoudnessMeter::finishSubBlock()
+{
+    subBlockHistory[(size_t) subBlockIndex] = subBlockEnergy / subBlockLength;
+    subBlockIndex = (subBlockIndex + 1) % subBlocksPerShortTerm;
+    subBlocksFilled = juce::jmin(subBlocksFilled + 1, subBlocksPerShortTerm);
+    subBlockPosition = 0;
+    subBlockEnergy = 0.0;
+
+    auto meanOfLast = [this](int count)
+    {
+        double sum = 0.0;
+        for (int i = 1; i <= count; ++i)
+            sum += subBlockHistory[(size_t) ((subBlockIndex - i + subBlocksPerShortTerm) % subBlocksPerShortTerm)];
+        return sum / count;
+    };
+
+    if (subBlocksFilled >= subBlocksPerMomentary)
+    {
+        // Ogni 100 ms nasce un nuovo blocco di gating da 400 ms (sovrapposizione del 75%)
+        const double momentaryEnergy = meanOfLast(subBlocksPerMomentary);
+        const float momentary = energyToLufs(momentaryEnergy);
+        momentaryLufs.store(momentary, std::memory_order_relaxed);
+
+        if (momentary > -70.0f)
+        {
+            const int bin = juce::jlimit(0, histogramBins - 1, (int) ((momentary + 70.0f) * 10.0f));
+            ++histogramCounts[(size_t) bin];
+            histogramEnergy[(size_t) bin] += momentaryEnergy;
+            updateIntegrated();
+        }
+    }
+
+    shortTermLufs.store(energyToLufs(meanOfLast(subBlocksFilled)), std::memory_order_relaxed);
+}
+
+void LoudnessMeter::updateIntegrated()
+{
+    // Primo passaggio: media dei blocchi sopra il gate assoluto (-70 LUFS)
+    double totalEnergy = 0.0;
+    juce::uint64 totalCount = 0;
+    for (int bin = 0; bin < histogramBins; ++bin)
+    {
+        totalEnergy += histogramEnergy[(size_t) bin];
+        totalCount += histogramCounts[(size_t) bin];
+    }
+
+    if (totalCount == 0)
+        return;
+
+    // Secondo passaggio: gate relativo a -10 LU dalla media precedente
+    const float relativeGate = energyToLufs(totalEnergy / (double) totalCount) - 10.0f;
+    const int firstBin = juce::jlimit(0, histogramBins, (int) std::ceil((relativeGate + 70.0f) * 10.0f));
+
+    double gatedEnergy = 0.0;
+    juce::uint64 gatedCount = 0;
+    for (int bin = firstBin; bin < histogramBins; ++bin)
+    {
+        gatedEnergy += histogramEnergy[(size_t) bin];
+        gatedCount += histogramCounts[(size_t) bin];
+    }
+
+    if (gatedCount > 0)
+        integratedLufs.store(energyToLufs(gatedEnergy / (double) gatedCount), std::memory_order_relaxed);
+}
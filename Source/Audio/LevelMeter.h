@@ -0,0 +1,109 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Meter di picco/RMS stereo. process() gira sull'audio thread con kernel vettoriali,
+// i valori sono pubblicati tramite atomici e possono essere letti dalla UI senza attese.
+class LevelMeter
+{
+public:
+    static constexpr int maxChannels = 2;
+
+    LevelMeter();
+
+    // Può essere chiamato in prepareToPlay (nessuna allocazione)
+    void prepare(double sampleRate);
+    void reset();
+
+    // --- Audio thread ---
+    void process(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+    // Equivale a process() su un blocco di silenzio, senza toccare i dati
+    void processSilence(int numSamples);
+
+    // --- Qualsiasi thread (valori lineari) ---
+    float getPeak(int channel) const { return peakLevels[(size_t) juce::jlimit(0, maxChannels - 1, channel)].load(std::memory_order_relaxed); }
+    float getRms(int channel) const { return rmsLevels[(size_t) juce::jlimit(0, maxChannels - 1, channel)].load(std::memory_order_relaxed); }
+
+    // Kernel vettoriali condivisi con gli altri meter
+    static float sumOfSquares(const float* data, int numSamples);
+    static float absolutePeak(const float* data, int numSamples);
+
+private:
+    void updateBallistics(int numSamples);
+
+    double currentSampleRate = 44100.0;
+    int cachedBlockSize = 0;
+    float peakDecay = 1.0f;     // Fattore di rilascio del picco per blocco
+    float rmsSmoothing = 0.0f;  // Coefficiente della media esponenziale del quadrato
+
+    std::array<float, maxChannels> peakState {};
+    std::array<float, maxChannels> meanSquareState {};
+    std::array<std::atomic<float>, maxChannels> peakLevels;
+    std::array<std::atomic<float>, maxChannels> rmsLevels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeter)
+};
+
+// Loudness EBU R128 (ITU-R BS.1770): momentary (400 ms), short-term (3 s) e integrated con gating.
+// Il gating usa un istogramma a 0.1 LU, quindi la memoria resta costante anche su sessioni lunghe.
+class LoudnessMeter
+{
+public:
+    LoudnessMeter();
+
+    void prepare(double sampleRate);
+    // Azzera l'integrated: la richiesta viene eseguita dall'audio thread al blocco successivo
+    void requestReset() { resetRequested.store(true); }
+
+    // --- Audio thread ---
+    void process(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    // --- Qualsiasi thread (LUFS, -inf se silenzio) ---
+    float getMomentaryLufs() const { return momentaryLufs.load(std::memory_order_relaxed); }
+    float getShortTermLufs() const { return shortTermLufs.load(std::memory_order_relaxed); }
+    float getIntegratedLufs() const { return integratedLufs.load(std::memory_order_relaxed); }
+
+    static float energyToLufs(double meanSquare);
+
+private:
+    struct Biquad
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+        std::array<float, LevelMeter::maxChannels> z1 {}, z2 {};
+
+        float process(float input, int channel) noexcept
+        {
+            const float output = b0 * input + z1[(size_t) channel];
+            z1[(size_t) channel] = b1 * input - a1 * output + z2[(size_t) channel];
+            z2[(size_t) channel] = b2 * input - a2 * output;
+            return output;
+        }
+    };
+
+    void resetState();
+    void finishSubBlock();
+    void updateIntegrated();
+
+    static constexpr int subBlocksPerMomentary = 4;   // 4 x 100 ms
+    static constexpr int subBlocksPerShortTerm = 30;  // 30 x 100 ms
+    static constexpr int histogramBins = 800;         // Da -70 a +10 LUFS a passi di 0.1 LU
+
+    Biquad shelfFilter, highPassFilter; // Pesatura K
+    int subBlockLength = 4410;
+    int subBlockPosition = 0;
+    double subBlockEnergy = 0.0;
+
+    std::array<double, subBlocksPerShortTerm> subBlockHistory {};
+    int subBlockIndex = 0;
+    int subBlocksFilled = 0;
+
+    std::array<juce::uint32, histogramBins> histogramCounts {};
+    std::array<double, histogramBins> histogramEnergy {};
+
+    std::atomic<bool> resetRequested { false };
+    std::atomic<float> momentaryLufs, shortTermLufs, integratedLufs;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoudnessMeter)
+};
@@ -0,0 +1,259 @@
+#include "MasterBus.h"
+
+namespace
+{
+    constexpr double releaseSeconds = 0.08;
+    constexpr double gainSmoothingSeconds = 0.05;
+}
+
+MasterBus::MasterBus()
+    : ceilingGain(juce::Decibels::decibelsToGain(-1.0f))
+{
+    // Sinc finestrata (Hann) per le fasi 1/4, 2/4 e 3/4 tra window[D - 1] e window[D]
+    for (int phase = 0; phase < interpolationPhases; ++phase)
+    {
+        const double fraction = (phase + 1) / (double) (interpolationPhases + 1);
+        auto& coefficients = interpolationCoefficients[(size_t) phase];
+        double sum = 0.0;
+
+        for (int tap = 0; tap < interpolationTaps; ++tap)
+        {
+            const double t = tap - (detectorDelay - 1) - fraction;
+            const double sinc = std::abs(t) < 1.0e-9 ? 1.0 : std::sin(juce::MathConstants<double>::pi * t) / (juce::MathConstants<double>::pi * t);
+            const double window = 0.5 * (1.0 + std::cos(juce::MathConstants<double>::pi * t / (interpolationTaps / 2)));
+            coefficients[(size_t) tap] = (float) (sinc * window);
+            sum += sinc * window;
+        }
+
+        for (auto& c : coefficients)
+            c = (float) (c / sum);
+    }
+}
+
+void MasterBus::prepare(double sampleRate, int maximumBlockSize)
+{
+    currentSampleRate = sampleRate > 0.0 ? sampleRate : 44100.0;
+    maxBlockSize = juce::jmax(1, maximumBlockSize);
+
+    lookaheadSamples = juce::jmax(1, juce::roundToInt(lookaheadSeconds * currentSampleRate));
+    totalDelay = lookaheadSamples + detectorDelay;
+
+    delayLine.setSize(numChannels, totalDelay + maxBlockSize);
+    minQueueCapacity = lookaheadSamples + 2;
+    minQueueValues.allocate((size_t) minQueueCapacity, true);
+    minQueueIndices.allocate((size_t) minQueueCapacity, true);
+    averageWindow.allocate((size_t) lookaheadSamples, true);
+    gainBuffer.allocate((size_t) maxBlockSize, true);
+
+    smoothedGain.reset(currentSampleRate, gainSmoothingSeconds);
+    releaseCoefficient = (float) std::exp(-1.0 / (releaseSeconds * currentSampleRate));
+
+    latencySamples.store(totalDelay);
+    reset();
+}
+
+void MasterBus::reset()
+{
+    delayLine.clear();
+    delayWritePosition = 0;
+
+    for (auto& history : detectorHistory)
+        history.fill(0.0f);
+    detectorPosition = 0;
+
+    minQueueHead = 0;
+    minQueueSize = 0;
+    sampleCounter = 0;
+
+    for (int i = 0; i < lookaheadSamples; ++i)
+        averageWindow[i] = 1.0f;
+    averagePosition = 0;
+    averageSum = lookaheadSamples;
+
+    releaseEnvelope = 1.0f;
+    smoothedGain.setCurrentAndTargetValue(targetGain.load());
+    dither.reset();
+}
+
+void MasterBus::setDither(int bitDepth, bool useNoiseShaping)
+{
+    ditherBitDepth.store(bitDepth <= 0 ? 0 : juce::jlimit(8, 24, bitDepth));
+    ditherNoiseShaping.store(useNoiseShaping);
+}
+
+void MasterBus::process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, ParameterBuffers automation)
+{
+    if (maxBlockSize == 0)
+        return;
+
+    // I buffer sono dimensionati su maxBlockSize: blocchi più lunghi vengono divisi
+    for (int offset = 0; offset < numSamples; offset += maxBlockSize)
+    {
+        ParameterBuffers chunkAutomation;
+        chunkAutomation.gain = automation.gain != nullptr ? automation.gain + offset : nullptr;
+        chunkAutomation.ceilingGain = automation.ceilingGain != nullptr ? automation.ceilingGain + offset : nullptr;
+        processChunk(buffer, startSample + offset, juce::jmin(maxBlockSize, numSamples - offset), chunkAutomation);
+    }
+}
+
+float MasterBus::detectTruePeak(int channel, float input) noexcept
+{
+    // Ogni campione è scritto due volte, così la finestra cronologica è sempre contigua
+    auto& history = detectorHistory[(size_t) channel];
+    history[(size_t) detectorPosition] = input;
+    history[(size_t) (detectorPosition + interpolationTaps)] = input;
+
+    const float* window = history.data() + detectorPosition + 1;
+    float peak = juce::jmax(std::abs(window[detectorDelay - 1]), std::abs(window[detectorDelay]));
+
+    for (auto& coefficients : interpolationCoefficients)
+    {
+        float interpolated = 0.0f;
+        for (int tap = 0; tap < interpolationTaps; ++tap)
+            interpolated += window[tap] * coefficients[(size_t) tap];
+
+        peak = juce::jmax(peak, std::abs(interpolated));
+    }
+
+    return peak;
+}
+
+float MasterBus::computeLimiterGain(float requiredGain) noexcept
+{
+    // Minimo del guadagno richiesto sugli ultimi lookahead + 1 campioni (coda monotona)
+    while (minQueueSize > 0)
+    {
+        const int back = (minQueueHead + minQueueSize - 1) % minQueueCapacity;
+        if (minQueueValues[back] < requiredGain)
+            break;
+        --minQueueSize;
+    }
+
+    const int newBack = (minQueueHead + minQueueSize) % minQueueCapacity;
+    minQueueValues[newBack] = requiredGain;
+    minQueueIndices[newBack] = sampleCounter;
+    ++minQueueSize;
+
+    while (minQueueIndices[minQueueHead] <= sampleCounter - (lookaheadSamples + 1))
+    {
+        minQueueHead = (minQueueHead + 1) % minQueueCapacity;
+        --minQueueSize;
+    }
+
+    const float held = minQueueValues[minQueueHead];
+    ++sampleCounter;
+
+    // Attacco immediato, rilascio esponenziale
+    releaseEnvelope = held < releaseEnvelope ? held : held + (releaseEnvelope - held) * releaseCoefficient;
+
+    // La media mobile su lookahead campioni porta il guadagno al valore richiesto proprio sul picco
+    averageSum += releaseEnvelope - averageWindow[averagePosition];
+    averageWindow[averagePosition] = releaseEnvelope;
+    averagePosition = (averagePosition + 1) % lookaheadSamples;
+
+    return (float) juce::jmin(1.0, averageSum / lookaheadSamples);
+}
+
+void MasterBus::processChunk(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, ParameterBuffers automation)
+{
+    const int channels = juce::jmin(numChannels, buffer.getNumChannels());
+
+    // --- 1. Guadagno master: automazione campione per campione, altrimenti il valore smussato ---
+    smoothedGain.setTargetValue(targetGain.load(std::memory_order_relaxed));
+    if (automation.gain != nullptr)
+    {
+        for (int ch = 0; ch < channels; ++ch)
+            juce::FloatVectorOperations::multiply(buffer.getWritePointer(ch, startSample), automation.gain, numSamples);
+
+        // Quando l'automazione finisce, il fader riparte da dove è arrivata la curva
+        smoothedGain.setCurrentAndTargetValue(automation.gain[numSamples - 1]);
+        smoothedGain.setTargetValue(targetGain.load(std::memory_order_relaxed));
+    }
+    else if (smoothedGain.isSmoothing())
+    {
+        for (int i = 0; i < numSamples; ++i)
+            gainBuffer[i] = smoothedGain.getNextValue();
+
+        for (int ch = 0; ch < channels; ++ch)
+            juce::FloatVectorOperations::multiply(buffer.getWritePointer(ch, startSample), gainBuffer.get(), numSamples);
+    }
+    else if (smoothedGain.getCurrentValue() != 1.0f)
+    {
+        for (int ch = 0; ch < channels; ++ch)
+            juce::FloatVectorOperations::multiply(buffer.getWritePointer(ch, startSample), smoothedGain.getCurrentValue(), numSamples);
+    }
+
+    // --- 2. Guadagno del limiter, con i canali collegati ---
+    const bool enabled = limiterEnabled.load(std::memory_order_relaxed);
+    const float ceiling = ceilingGain.load(std::memory_order_relaxed);
+    float minimumGain = 1.0f;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        float peak = 0.0f;
+        for (int ch = 0; ch < channels; ++ch)
+            peak = juce::jmax(peak, detectTruePeak(ch, buffer.getSample(ch, startSample + i)));
+        detectorPosition = (detectorPosition + 1) % interpolationTaps;
+
+        const float limit = automation.ceilingGain != nullptr ? automation.ceilingGain[i] : ceiling;
+        const float required = (enabled && peak > limit) ? limit / peak : 1.0f;
+        gainBuffer[i] = computeLimiterGain(required);
+        minimumGain = juce::jmin(minimumGain, gainBuffer[i]);
+    }
+
+    // --- 3. Linea di ritardo: si scrive il blocco, si legge in ritardo di totalDelay e si applica il guadagno ---
+    const int capacity = delayLine.getNumSamples();
+    const int readPosition = (delayWritePosition - totalDelay + capacity) % capacity;
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        auto* data = buffer.getWritePointer(ch, startSample);
+
+        const int firstWrite = juce::jmin(numSamples, capacity - delayWritePosition);
+        juce::FloatVectorOperations::copy(delayLine.getWritePointer(ch, delayWritePosition), data, firstWrite);
+        if (numSamples > firstWrite)
+            juce::FloatVectorOperations::copy(delayLine.getWritePointer(ch, 0), data + firstWrite, numSamples - firstWrite);
+
+        const int firstRead = juce::jmin(numSamples, capacity - readPosition);
+        juce::FloatVectorOperations::multiply(data, delayLine.getReadPointer(ch, readPosition), gainBuffer.get(), firstRead);
+        if (numSamples > firstRead)
+            juce::FloatVectorOperations::multiply(data + firstRead, delayLine.getReadPointer(ch, 0), gainBuffer.get() + firstRead, numSamples - firstRead);
+    }
+
+    delayWritePosition = (delayWritePosition + numSamples) % capacity;
+    gainReductionDb.store(juce::Decibels::gainToDecibels(minimumGain, -60.0f), std::memory_order_relaxed);
+
+    // --- 4. Dither per l'export a virgola fissa ---
+    if (const int bitDepth = ditherBitDepth.load(std::memory_order_relaxed); bitDepth > 0)
+        dither.process(buffer, startSample, numSamples, bitDepth, ditherNoiseShaping.load(std::memory_order_relaxed));
+}
+
+void TpdfDither::process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, int bitDepth, bool noiseShaping)
+{
+    const float scale = (float) (1 << (bitDepth - 1));
+    const float inverseScale = 1.0f / scale;
+
+    auto nextRandom = [this]
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (float) (seed >> 8) * (1.0f / 16777216.0f);
+    };
+
+    for (int ch = 0; ch < juce::jmin(maxChannels, buffer.getNumChannels()); ++ch)
+    {
+        auto* data = buffer.getWritePointer(ch, startSample);
+        float error = errors[(size_t) ch];
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            // Retroazione dell'errore di quantizzazione: sposta il rumore verso le alte frequenze
+            const float value = noiseShaping ? data[i] - error : data[i];
+            const float tpdf = nextRandom() - nextRandom();
+            const float quantised = std::round(value * scale + tpdf) * inverseScale;
+            error = quantised - value;
+            data[i] = quantised;
+        }
+
+        errors[(size_t) ch] = error;
+    }
+}
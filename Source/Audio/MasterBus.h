@@ -0,0 +1,118 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Dither TPDF con noise shaping opzionale del primo ordine, per la conversione a virgola fissa.
+// Usato dal bus master e dagli stadi di export (ognuno con il proprio stato).
+class TpdfDither
+{
+public:
+    static constexpr int maxChannels = 2;
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, int bitDepth, bool noiseShaping);
+    void reset() { errors.fill(0.0f); }
+
+private:
+    std::array<float, maxChannels> errors {};
+    juce::uint32 seed = 22222;
+};
+
+// Catena del bus master, dopo la somma delle tracce:
+// guadagno master smussato (o automatizzato) -> limiter true-peak con lookahead -> dither opzionale.
+// Tutti i buffer sono allocati in prepare(): process() non alloca e aggiunge una latenza fissa.
+class MasterBus
+{
+public:
+    static constexpr int numChannels = 2;
+    static constexpr double lookaheadSeconds = 0.0015;
+
+    MasterBus();
+
+    // Alloca le linee di ritardo e i buffer di lavoro (fuori dal callback o in prepareToPlay)
+    void prepare(double sampleRate, int maximumBlockSize);
+    void reset();
+
+    // Valori per campione (automazione) al posto dei parametri statici; nullptr = valore statico
+    struct ParameterBuffers
+    {
+        const float* gain = nullptr;        // Guadagno master lineare
+        const float* ceilingGain = nullptr; // Soffitto del limiter, lineare
+    };
+
+    // --- Audio thread ---
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, ParameterBuffers automation);
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) { process(buffer, startSample, numSamples, ParameterBuffers()); }
+
+    // --- Parametri (qualsiasi thread) ---
+    void setGain(float newLinearGain) { targetGain.store(juce::jmax(0.0f, newLinearGain)); }
+    void setLimiterEnabled(bool shouldBeEnabled) { limiterEnabled.store(shouldBeEnabled); }
+    void setCeilingDb(float newCeilingDb) { ceilingGain.store(juce::Decibels::decibelsToGain(juce::jmin(0.0f, newCeilingDb))); }
+    // bitDepth = 0 disattiva il dither (uscita float verso il dispositivo)
+    void setDither(int bitDepth, bool useNoiseShaping);
+
+    float getGain() const { return targetGain.load(); }
+    bool isLimiterEnabled() const { return limiterEnabled.load(); }
+    float getCeilingDb() const { return juce::Decibels::gainToDecibels(ceilingGain.load()); }
+
+    // Latenza fissa introdotta dal lookahead (e dal rilevatore true-peak), in campioni
+    int getLatencySamples() const { return latencySamples.load(); }
+    // Riduzione di guadagno massima dell'ultimo blocco (dB, <= 0)
+    float getGainReductionDb() const { return gainReductionDb.load(std::memory_order_relaxed); }
+
+private:
+    // Filtro di interpolazione 4x per stimare i picchi tra un campione e l'altro
+    static constexpr int interpolationTaps = 8;
+    static constexpr int interpolationPhases = 3;
+    static constexpr int detectorDelay = interpolationTaps / 2;
+
+    void processChunk(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, ParameterBuffers automation);
+    float detectTruePeak(int channel, float input) noexcept;
+    float computeLimiterGain(float requiredGain) noexcept;
+
+    double currentSampleRate = 44100.0;
+    int maxBlockSize = 0;
+    int lookaheadSamples = 0;
+    int totalDelay = 0;
+
+    // Guadagno master
+    std::atomic<float> targetGain { 1.0f };
+    juce::SmoothedValue<float> smoothedGain;
+
+    // Linea di ritardo del segnale (una per canale), scritta e letta a blocchi
+    juce::AudioBuffer<float> delayLine;
+    int delayWritePosition = 0;
+
+    // Rilevatore true-peak
+    std::array<std::array<float, interpolationTaps>, interpolationPhases> interpolationCoefficients {};
+    std::array<std::array<float, interpolationTaps * 2>, numChannels> detectorHistory {};
+    int detectorPosition = 0;
+
+    // Minimo scorrevole (coda monotona) sulla finestra di lookahead
+    juce::HeapBlock<float> minQueueValues;
+    juce::HeapBlock<juce::int64> minQueueIndices;
+    int minQueueCapacity = 0, minQueueHead = 0, minQueueSize = 0;
+    juce::int64 sampleCounter = 0;
+
+    // Media mobile del guadagno, per arrivare alla riduzione richiesta esattamente sul picco
+    juce::HeapBlock<float> averageWindow;
+    int averagePosition = 0;
+    double averageSum = 0.0;
+
+    float releaseEnvelope = 1.0f;
+    float releaseCoefficient = 0.0f;
+    juce::HeapBlock<float> gainBuffer;
+
+    std::atomic<bool> limiterEnabled { true };
+    std::atomic<float> ceilingGain;
+    std::atomic<int> latencySamples { 0 };
+    std::atomic<float> gainReductionDb { 0.0f };
+
+    // Dither per l'export a virgola fissa
+    std::atomic<int> ditherBitDepth { 0 };
+    std::atomic<bool> ditherNoiseShaping { false };
+    TpdfDither dither;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MasterBus)
+};
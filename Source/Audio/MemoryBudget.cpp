@@ -0,0 +1,120 @@
+#include "MemoryBudget.h"
+#include "Tracer.h"
+
+MemoryBudget::MemoryBudget(int budgetMegabytes)
+{
+    setBudgetMegabytes(budgetMegabytes);
+}
+
+void MemoryBudget::setBudgetMegabytes(int megabytes)
+{
+    const juce::ScopedLock sl(lock);
+    budgetBytes = (juce::int64) juce::jmax(1, megabytes) * 1024 * 1024;
+    evictUntilFits(0);
+}
+
+bool MemoryBudget::insert(const juce::String& key, Category category, std::shared_ptr<const void> data, size_t bytes,
+                          bool optional, std::function<bool()> tryEvict)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto existing = index.find(key);
+    if (existing != index.end())
+        erase(existing->second);
+
+    evictUntilFits(bytes);
+
+    if (usedBytes + (juce::int64) bytes > budgetBytes)
+    {
+        if (optional)
+            return false;
+
+        juce::Logger::writeToLog("MemoryBudget: Over budget by " + juce::String((usedBytes + (juce::int64) bytes - budgetBytes) / (1024 * 1024))
+                                 + " MB, everything cached is in use");
+    }
+
+    entries.push_front({ key, category, std::move(data), bytes, std::move(tryEvict) });
+    index[key] = entries.begin();
+    usedBytes += (juce::int64) bytes;
+    Tracer::counter("Memory budget used (MB)", usedBytes / (1024 * 1024));
+    return true;
+}
+
+std::shared_ptr<const void> MemoryBudget::findEntry(const juce::String& key)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = index.find(key);
+    if (it == index.end())
+    {
+        ++misses;
+        return nullptr;
+    }
+
+    ++hits;
+    entries.splice(entries.begin(), entries, it->second); // In testa alla lista LRU
+    return it->second->data;
+}
+
+void MemoryBudget::remove(const juce::String& key)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = index.find(key);
+    if (it != index.end())
+        erase(it->second);
+}
+
+void MemoryBudget::evictUntilFits(size_t incomingBytes)
+{
+    // Dal meno recente verso il più recente, saltando i dati in uso
+    for (auto it = entries.end(); it != entries.begin() && usedBytes + (juce::int64) incomingBytes > budgetBytes;)
+    {
+        --it;
+
+        const bool inUse = it->data.use_count() > 1;
+        if (inUse || (it->tryEvict != nullptr && !it->tryEvict()))
+            continue;
+
+        ++evictions;
+        Tracer::instant("Memory budget eviction");
+        auto victim = it++;
+        erase(victim);
+    }
+}
+
+void MemoryBudget::erase(std::list<Entry>::iterator entry)
+{
+    usedBytes -= (juce::int64) entry->bytes;
+    index.erase(entry->key);
+    entries.erase(entry);
+}
+
+int MemoryBudget::getNumEntries(Category category) const
+{
+    const juce::ScopedLock sl(lock);
+
+    int count = 0;
+    for (auto const& entry : entries)
+        if (entry.category == category)
+            ++count;
+    return count;
+}
+
+MemoryBudget::Stats MemoryBudget::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+
+    Stats stats;
+    stats.budgetBytes = budgetBytes;
+    stats.usedBytes = usedBytes;
+    stats.numEntries = (int) entries.size();
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+
+    for (auto const& entry : entries)
+        stats.bytesByCategory[(size_t) entry.category] += (juce::int64) entry.bytes;
+
+    return stats;
+}
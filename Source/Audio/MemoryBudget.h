@@ -0,0 +1,76 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+
+// Budget di memoria unico per tutti i dati audio tenuti in RAM (campioni decodificati, teste
+// per i lanci...). Ogni dato registrato è tenuto vivo dal budget; quando si supera il limite
+// vengono sfrattati i dati usati meno di recente che nessuno sta usando, e chi li possedeva
+// torna a leggere dal disco. Thread-safe, ma mai da chiamare dall'audio thread.
+class MemoryBudget
+{
+public:
+    enum class Category { decodedSample, launchHead, numCategories };
+
+    struct Stats
+    {
+        juce::int64 budgetBytes = 0;
+        juce::int64 usedBytes = 0;
+        juce::int64 bytesByCategory[(size_t) Category::numCategories] {};
+        int numEntries = 0;
+        juce::int64 hits = 0;
+        juce::int64 misses = 0;
+        juce::int64 evictions = 0;
+
+        double getHitRate() const { return hits + misses > 0 ? hits / (double) (hits + misses) : 0.0; }
+    };
+
+    explicit MemoryBudget(int budgetMegabytes = 1024);
+
+    void setBudgetMegabytes(int megabytes);
+
+    // Registra un dato. Un dato "in uso" (qualcun altro ne tiene un shared_ptr) non viene mai
+    // sfrattato; tryEvict, se presente, può rifiutare lo sfratto (es. dato in riproduzione).
+    // Un dato opzionale che non entra nel budget nemmeno dopo gli sfratti non viene registrato
+    // (restituisce false); uno obbligatorio viene registrato comunque, sforando il budget.
+    bool insert(const juce::String& key, Category category, std::shared_ptr<const void> data, size_t bytes,
+                bool optional, std::function<bool()> tryEvict = nullptr);
+
+    // Restituisce il dato e lo segna come usato di recente (conta come hit o miss)
+    template <typename Type>
+    std::shared_ptr<const Type> find(const juce::String& key)
+    {
+        return std::static_pointer_cast<const Type>(findEntry(key));
+    }
+
+    void remove(const juce::String& key);
+    int getNumEntries(Category category) const;
+    Stats getStats() const;
+
+private:
+    struct Entry
+    {
+        juce::String key;
+        Category category;
+        std::shared_ptr<const void> data;
+        size_t bytes = 0;
+        std::function<bool()> tryEvict;
+    };
+
+    std::shared_ptr<const void> findEntry(const juce::String& key);
+    // Da chiamare con il lock acquisito
+    void evictUntilFits(size_t incomingBytes);
+    void erase(std::list<Entry>::iterator entry);
+
+    mutable juce::CriticalSection lock;
+    std::list<Entry> entries; // Dal più recente al meno recente
+    std::map<juce::String, std::list<Entry>::iterator> index;
+    juce::int64 budgetBytes = 0;
+    juce::int64 usedBytes = 0;
+    juce::int64 hits = 0, misses = 0, evictions = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MemoryBudget)
+};
@@ -0,0 +1,311 @@
+#include "MultitrackRecorder.h"
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    // FileOutputStream che riserva spazio su disco in anticipo (a blocchi), così il writer
+    // non paga l'allocazione dei blocchi del filesystem durante la registrazione.
+    // Lo spazio è riservato senza cambiare la dimensione del file: niente dati spuri in coda.
+    class PreallocatedFileOutputStream : public juce::OutputStream
+    {
+    public:
+        PreallocatedFileOutputStream(const juce::File& fileToWrite, juce::int64 bytesPerChunk)
+            : stream(fileToWrite), chunkBytes(bytesPerChunk)
+        {
+            if (stream.openedOk())
+            {
+                stream.setPosition(0);
+                stream.truncate();
+            }
+
+           #if JUCE_LINUX || JUCE_MAC
+            fileDescriptor = ::open(fileToWrite.getFullPathName().toRawUTF8(), O_WRONLY);
+           #endif
+            reserve(chunkBytes);
+        }
+
+        ~PreallocatedFileOutputStream() override
+        {
+            stream.flush();
+           #if JUCE_LINUX || JUCE_MAC
+            if (fileDescriptor >= 0)
+                ::close(fileDescriptor);
+           #endif
+        }
+
+        bool openedOk() const { return stream.openedOk(); }
+
+        void flush() override { stream.flush(); }
+        bool setPosition(juce::int64 newPosition) override { return stream.setPosition(newPosition); }
+        juce::int64 getPosition() override { return stream.getPosition(); }
+
+        bool write(const void* dataToWrite, size_t numberOfBytes) override
+        {
+            const auto endPosition = stream.getPosition() + (juce::int64) numberOfBytes;
+            if (endPosition > reservedBytes)
+                reserve(endPosition + chunkBytes);
+
+            return stream.write(dataToWrite, numberOfBytes);
+        }
+
+    private:
+        void reserve(juce::int64 totalBytes)
+        {
+           #if JUCE_LINUX
+            if (fileDescriptor >= 0)
+                ::fallocate(fileDescriptor, FALLOC_FL_KEEP_SIZE, 0, (off_t) totalBytes);
+           #elif JUCE_MAC
+            if (fileDescriptor >= 0)
+            {
+                fstore_t store { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t) (totalBytes - reservedBytes), 0 };
+                if (::fcntl(fileDescriptor, F_PREALLOCATE, &store) == -1)
+                {
+                    store.fst_flags = F_ALLOCATEALL;
+                    ::fcntl(fileDescriptor, F_PREALLOCATE, &store);
+                }
+            }
+           #endif
+            // Se la preallocazione non è supportata la scrittura procede comunque normalmente
+            reservedBytes = totalBytes;
+        }
+
+        juce::FileOutputStream stream;
+        const juce::int64 chunkBytes;
+        juce::int64 reservedBytes = 0;
+        int fileDescriptor = -1;
+    };
+}
+
+//==============================================================================
+class MultitrackRecorder::WriterThread : public juce::Thread
+{
+public:
+    explicit WriterThread(MultitrackRecorder& recorder)
+        : juce::Thread("Recording Writer"), owner(recorder)
+    {
+    }
+
+    void run() override { owner.runWriter(*this); }
+
+private:
+    MultitrackRecorder& owner;
+};
+
+//==============================================================================
+MultitrackRecorder::MultitrackRecorder()
+    : outputDirectory(juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                          .getChildFile("AudioWorkstation")
+                          .getChildFile("Recordings")),
+      writerThread(std::make_unique<WriterThread>(*this))
+{
+}
+
+MultitrackRecorder::~MultitrackRecorder()
+{
+    stop();
+    writerThread->stopThread(2000);
+}
+
+void MultitrackRecorder::setTrackArmed(int trackId, bool armed, int firstInputChannel, int numChannels)
+{
+    // Le tracce armate vengono lette solo da start(): durante una registrazione non cambiano gli stream attivi
+    if (armed)
+        armedTracks[trackId] = { juce::jmax(0, firstInputChannel), juce::jlimit(1, 2, numChannels) };
+    else
+        armedTracks.erase(trackId);
+}
+
+bool MultitrackRecorder::isTrackArmed(int trackId) const
+{
+    return armedTracks.find(trackId) != armedTracks.end();
+}
+
+bool MultitrackRecorder::start(double sampleRate, int numInputChannelsAvailable)
+{
+    if (isRecording() || armedTracks.empty() || sampleRate <= 0.0)
+        return false;
+
+    if (!outputDirectory.createDirectory())
+    {
+        juce::Logger::writeToLog("MultitrackRecorder Error: Cannot create " + outputDirectory.getFullPathName());
+        return false;
+    }
+
+    auto newSession = std::make_unique<Session>();
+
+    for (auto const& [trackId, input] : armedTracks)
+    {
+        if (input.firstChannel + input.numChannels > numInputChannelsAvailable)
+        {
+            juce::Logger::writeToLog("MultitrackRecorder: Input " + juce::String(input.firstChannel + 1)
+                                     + " not available for track " + juce::String(trackId));
+            continue;
+        }
+
+        if (auto stream = createStream(trackId, input, sampleRate))
+            newSession->streams.push_back(std::move(stream));
+    }
+
+    if (newSession->streams.empty())
+        return false;
+
+    if (!writerThread->isThreadRunning())
+        writerThread->startThread(juce::Thread::Priority::high);
+
+    {
+        const juce::ScopedLock sl(writerLock);
+        session = std::move(newSession);
+    }
+    activeSession.store(session.get());
+
+    juce::Logger::writeToLog("MultitrackRecorder: Recording started on " + juce::String((int) session->streams.size()) + " tracks");
+    return true;
+}
+
+std::vector<MultitrackRecorder::Take> MultitrackRecorder::stop()
+{
+    std::vector<Take> takes;
+
+    if (session == nullptr)
+        return takes;
+
+    // Stacca la sessione dall'audio thread e aspetta che esca da captureInputs
+    activeSession.store(nullptr);
+    while (audioThreadInside.load())
+        juce::Thread::yield();
+
+    const juce::ScopedLock sl(writerLock);
+
+    for (auto& stream : session->streams)
+    {
+        // Scrive i campioni rimasti nel FIFO; distruggere il writer completa l'header e chiude il file
+        drainStream(*stream);
+        stream->writer.reset();
+        takes.push_back({ stream->trackId, stream->file });
+    }
+
+    session.reset();
+    juce::Logger::writeToLog("MultitrackRecorder: Recording stopped, " + juce::String((int) takes.size()) + " takes written");
+    return takes;
+}
+
+void MultitrackRecorder::captureInputs(const juce::AudioBuffer<float>& deviceBuffer, int startSample, int numSamples)
+{
+    audioThreadInside.store(true);
+
+    if (auto* current = activeSession.load())
+    {
+        for (auto& stream : current->streams)
+        {
+            if (stream->firstChannel + stream->numChannels > deviceBuffer.getNumChannels())
+            {
+                droppedSamples.fetch_add(numSamples, std::memory_order_relaxed);
+                continue;
+            }
+
+            // Solo copie nel ring preallocato: nessun lock, nessuna allocazione, nessuna notifica.
+            // Se il writer è rimasto indietro si scrive ciò che entra e il resto si conta come perso.
+            int start1, size1, start2, size2;
+            stream->fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+            for (int c = 0; c < stream->numChannels; ++c)
+            {
+                const int deviceChannel = stream->firstChannel + c;
+                if (size1 > 0)
+                    stream->ring.copyFrom(c, start1, deviceBuffer, deviceChannel, startSample, size1);
+                if (size2 > 0)
+                    stream->ring.copyFrom(c, start2, deviceBuffer, deviceChannel, startSample + size1, size2);
+            }
+
+            stream->fifo.finishedWrite(size1 + size2);
+
+            if (size1 + size2 < numSamples)
+                droppedSamples.fetch_add(numSamples - (size1 + size2), std::memory_order_relaxed);
+        }
+    }
+
+    audioThreadInside.store(false);
+}
+
+void MultitrackRecorder::runWriter(juce::Thread& thread)
+{
+    while (!thread.threadShouldExit())
+    {
+        {
+            const juce::ScopedLock sl(writerLock);
+            if (session != nullptr)
+                for (auto& stream : session->streams)
+                    drainStream(*stream);
+        }
+
+        // Polling: i FIFO coprono fifoSeconds, molto più dell'intervallo di controllo
+        thread.wait(writerPollMs);
+    }
+}
+
+void MultitrackRecorder::drainStream(RecordingStream& stream)
+{
+    if (stream.writer == nullptr)
+        return;
+
+    int start1, size1, start2, size2;
+    stream.fifo.prepareToRead(stream.fifo.getNumReady(), start1, size1, start2, size2);
+
+    if (size1 > 0)
+        stream.writer->writeFromAudioSampleBuffer(stream.ring, start1, size1);
+    if (size2 > 0)
+        stream.writer->writeFromAudioSampleBuffer(stream.ring, start2, size2);
+
+    stream.fifo.finishedRead(size1 + size2);
+}
+
+std::unique_ptr<MultitrackRecorder::RecordingStream> MultitrackRecorder::createStream(int trackId,
+                                                                                     const ArmedInput& input,
+                                                                                     double sampleRate)
+{
+    constexpr int bitsPerSample = 24;
+
+    std::unique_ptr<juce::AudioFormat> format;
+    if (fileFormat == FileFormat::flac)
+        format = std::make_unique<juce::FlacAudioFormat>();
+    else
+        format = std::make_unique<juce::WavAudioFormat>();
+
+    // FIFO e ring si allocano qui, sul message thread, prima che l'audio thread veda lo stream
+    auto stream = std::make_unique<RecordingStream>(input.numChannels, (int) (sampleRate * fifoSeconds));
+    stream->trackId = trackId;
+    stream->firstChannel = input.firstChannel;
+    stream->file = outputDirectory.getNonexistentChildFile("Track" + juce::String(trackId) + "_Take",
+                                                           format->getFileExtensions()[0]);
+
+    // Riserva un minuto di audio alla volta
+    const auto bytesPerMinute = (juce::int64) (sampleRate * 60.0) * input.numChannels * (bitsPerSample / 8);
+    auto outputStream = std::make_unique<PreallocatedFileOutputStream>(stream->file, bytesPerMinute);
+
+    if (!outputStream->openedOk())
+    {
+        juce::Logger::writeToLog("MultitrackRecorder Error: Cannot open " + stream->file.getFullPathName());
+        return nullptr;
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(outputStream.get(),
+                                                                            sampleRate,
+                                                                            (unsigned int) input.numChannels,
+                                                                            bitsPerSample,
+                                                                            {},
+                                                                            0));
+    if (writer == nullptr)
+    {
+        juce::Logger::writeToLog("MultitrackRecorder Error: Cannot create writer for " + stream->file.getFullPathName());
+        return nullptr;
+    }
+
+    outputStream.release(); // Ora appartiene al writer
+
+    stream->writer = std::move(writer);
+    return stream;
+}
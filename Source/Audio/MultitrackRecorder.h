@@ -0,0 +1,101 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <map>
+#include <vector>
+
+// Registrazione multitraccia: l'audio thread copia gli ingressi delle tracce armate in FIFO
+// lock-free preallocati (uno per traccia), mentre un thread dedicato li svuota a intervalli
+// regolari su file WAV/FLAC preallocati. L'audio thread non sveglia mai il writer.
+class MultitrackRecorder
+{
+public:
+    enum class FileFormat { wav, flac };
+
+    // Take completata, restituita da stop()
+    struct Take
+    {
+        int trackId = 0;
+        juce::File file;
+    };
+
+    MultitrackRecorder();
+    ~MultitrackRecorder();
+
+    // --- Configurazione (message thread) ---
+    void setOutputDirectory(const juce::File& directory) { outputDirectory = directory; }
+    juce::File getOutputDirectory() const { return outputDirectory; }
+    void setFileFormat(FileFormat format) { fileFormat = format; }
+
+    // Arma/disarma una traccia sugli ingressi [firstInputChannel, firstInputChannel + numChannels)
+    void setTrackArmed(int trackId, bool armed, int firstInputChannel, int numChannels = 1);
+    bool isTrackArmed(int trackId) const;
+    void removeTrack(int trackId) { armedTracks.erase(trackId); }
+
+    // --- Controllo (message thread) ---
+    bool start(double sampleRate, int numInputChannelsAvailable);
+    std::vector<Take> stop();
+    bool isRecording() const { return activeSession.load() != nullptr; }
+
+    // --- Audio thread ---
+    // Va chiamato a ogni callback, prima che il buffer venga sovrascritto dall'uscita
+    void captureInputs(const juce::AudioBuffer<float>& deviceBuffer, int startSample, int numSamples);
+
+    // Campioni persi perché il FIFO di una traccia era pieno (dovrebbe restare sempre 0)
+    juce::int64 getDroppedSamples() const { return droppedSamples.load(std::memory_order_relaxed); }
+
+    // Secondi di audio bufferizzati per ogni traccia tra audio thread e disco
+    static constexpr double fifoSeconds = 2.0;
+    // Intervallo con cui il writer controlla i FIFO
+    static constexpr int writerPollMs = 10;
+
+private:
+    struct ArmedInput
+    {
+        int firstChannel = 0;
+        int numChannels = 1;
+    };
+
+    // Un FIFO singolo produttore (audio thread) / singolo consumatore (writer) per traccia
+    struct RecordingStream
+    {
+        RecordingStream(int numChannelsToRecord, int capacitySamples)
+            : numChannels(numChannelsToRecord), fifo(capacitySamples), ring(numChannelsToRecord, capacitySamples)
+        {
+        }
+
+        int trackId = 0;
+        int firstChannel = 0;
+        const int numChannels;
+        juce::File file;
+        juce::AbstractFifo fifo;
+        juce::AudioBuffer<float> ring;
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+    };
+
+    struct Session
+    {
+        std::vector<std::unique_ptr<RecordingStream>> streams;
+    };
+
+    class WriterThread;
+
+    std::unique_ptr<RecordingStream> createStream(int trackId, const ArmedInput& input, double sampleRate);
+    void runWriter(juce::Thread& thread);
+    // Scrive su disco tutto ciò che è pronto nel FIFO (solo thread del writer o stop())
+    static void drainStream(RecordingStream& stream);
+
+    juce::File outputDirectory;
+    FileFormat fileFormat = FileFormat::wav;
+    std::map<int, ArmedInput> armedTracks;
+
+    std::unique_ptr<juce::Thread> writerThread;
+    juce::CriticalSection writerLock;            // Tra message thread e writer, mai preso dall'audio thread
+    std::unique_ptr<Session> session;            // Posseduta dal message thread, protetta da writerLock
+    std::atomic<Session*> activeSession { nullptr }; // Vista dall'audio thread
+    std::atomic<bool> audioThreadInside { false };
+    std::atomic<juce::int64> droppedSamples { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MultitrackRecorder)
+};
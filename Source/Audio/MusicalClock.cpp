@@ -0,0 +1,46 @@
+#include "MusicalClock.h"
+
+namespace
+{
+    // Tolleranza sugli errori di arrotondamento dell'accumulo dei battiti
+    constexpr double boundaryEpsilon = 1.0e-9;
+}
+
+void MusicalClock::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    beginBlock();
+}
+
+void MusicalClock::reset()
+{
+    beatPosition = 0.0;
+    publishedBeatPosition.store(0.0, std::memory_order_relaxed);
+}
+
+void MusicalClock::beginBlock()
+{
+    samplesPerBeat = sampleRate * 60.0 / tempo.load(std::memory_order_relaxed);
+    blockBeatsPerBar = beatsPerBar.load(std::memory_order_relaxed);
+}
+
+void MusicalClock::advance(int numSamples)
+{
+    beatPosition += numSamples / samplesPerBeat;
+    publishedBeatPosition.store(beatPosition, std::memory_order_relaxed);
+}
+
+double MusicalClock::getNextBoundary(Quantization quantization) const
+{
+    if (quantization == Quantization::none)
+        return beatPosition;
+
+    const double unit = quantization == Quantization::bar ? (double) blockBeatsPerBar : 1.0;
+    return std::ceil(beatPosition / unit - boundaryEpsilon) * unit;
+}
+
+juce::int64 MusicalClock::getSampleOffsetOf(double beat) const
+{
+    // Il primo campione che si trova sul confine o lo supera
+    return (juce::int64) std::ceil((beat - beatPosition) * samplesPerBeat - boundaryEpsilon);
+}
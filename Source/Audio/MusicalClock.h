@@ -0,0 +1,47 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Orologio musicale del transport, avanzato dall'audio thread: converte i campioni del
+// dispositivo in battiti e battute secondo il tempo corrente. Il tempo può cambiare da
+// qualsiasi thread e vale dal blocco successivo; le posizioni sono in battiti, così un
+// evento quantizzato resta sul suo confine anche se il tempo cambia prima di arrivarci.
+class MusicalClock
+{
+public:
+    enum class Quantization { none, beat, bar };
+
+    void prepare(double newSampleRate);
+    void setTempo(double beatsPerMinute) { tempo.store(juce::jlimit(20.0, 999.0, beatsPerMinute)); }
+    void setBeatsPerBar(int newBeatsPerBar) { beatsPerBar.store(juce::jlimit(1, 32, newBeatsPerBar)); }
+    double getTempo() const { return tempo.load(); }
+    int getBeatsPerBar() const { return beatsPerBar.load(); }
+
+    // --- Audio thread ---
+    // Riporta l'orologio all'inizio (battuta 1, battito 1) all'avvio del transport
+    void reset();
+    // Fissa il tempo per il blocco corrente; va chiamato prima di ogni blocco
+    void beginBlock();
+    void advance(int numSamples);
+    double getBeatPosition() const { return beatPosition; }
+    // Primo confine di quantizzazione a partire dalla posizione corrente (incluso, se ci si è sopra)
+    double getNextBoundary(Quantization quantization) const;
+    // Campione del blocco corrente (dall'inizio del blocco) in cui cade il battito indicato; <= 0 = già passato
+    juce::int64 getSampleOffsetOf(double beat) const;
+
+    // --- Qualsiasi thread (per la UI) ---
+    double getPublishedBeatPosition() const { return publishedBeatPosition.load(std::memory_order_relaxed); }
+
+private:
+    double sampleRate = 44100.0;
+    std::atomic<double> tempo { 120.0 };
+    std::atomic<int> beatsPerBar { 4 };
+
+    // Stato dell'audio thread
+    double beatPosition = 0.0;
+    double samplesPerBeat = 22050.0;
+    int blockBeatsPerBar = 4;
+
+    std::atomic<double> publishedBeatPosition { 0.0 };
+};
@@ -0,0 +1,303 @@
+#include "OfflineRenderer.h"
+#include <optional>
+
+//==============================================================================
+// Traccia di clip: la catena dei reader della riproduzione, letta in modo sincrono
+class OfflineRenderer::ClipTrack : public TrackNode
+{
+public:
+    ClipTrack(std::unique_ptr<ClipTrackSource> clips, float faderGain, float faderPan)
+        : source(std::move(clips)), gain(faderGain), pan(faderPan)
+    {
+    }
+
+    bool render(juce::AudioBuffer<float>& buffer, int numSamples, juce::int64&) override
+    {
+        juce::AudioSourceChannelInfo info(&buffer, 0, numSamples);
+        source->getNextAudioBlock(info);
+        return true;
+    }
+
+    float getGain() const override { return gain; }
+    float getPan() const override { return pan; }
+
+private:
+    const std::unique_ptr<ClipTrackSource> source;
+    const float gain, pan;
+};
+
+// Traccia MIDI: uno strumento proprio, con gli eventi raccolti blocco per blocco come sull'audio thread
+class OfflineRenderer::SamplerTrack : public TrackNode
+{
+public:
+    SamplerTrack(std::unique_ptr<SamplerInstrument> instrumentToPlay,
+                 std::shared_ptr<const std::vector<TimedMidiEvent>> sequence, float faderGain, float faderPan)
+        : instrument(std::move(instrumentToPlay)), events(std::move(sequence)), gain(faderGain), pan(faderPan)
+    {
+        midi.ensureSize(32768);
+    }
+
+    // Rendering anticipato con un secondo strumento, costruito come fa l'engine
+    void prerenderWith(std::shared_ptr<SamplerInstrument> workerInstrument, double sampleRate)
+    {
+        auto workerMidi = std::make_shared<juce::MidiBuffer>();
+        workerMidi->ensureSize(32768);
+
+        prerendered = std::make_unique<PrerenderedTrack>(
+            [workerInstrument, workerMidi, sequence = events](juce::AudioBuffer<float>& buffer, double blockStart, int numSamples)
+            {
+                SamplerInstrument::collectEvents(*sequence, *workerMidi, blockStart, 1.0, numSamples);
+                workerInstrument->render(buffer, *workerMidi, 0, numSamples);
+            },
+            sampleRate);
+    }
+
+    bool render(juce::AudioBuffer<float>& buffer, int numSamples, juce::int64&) override
+    {
+        const auto blockStart = position;
+        position += numSamples;
+
+        if (prerendered != nullptr)
+        {
+            // Come sull'audio thread: dal vivo finché il ring non copre il blocco, poi solo il ring
+            prerendered->begin(blockStart, (double) blockStart, 1.0);
+            prerendered->renderAhead();
+            if (prerendered->read(buffer, blockStart, numSamples))
+                return true;
+        }
+
+        SamplerInstrument::collectEvents(*events, midi, (double) blockStart, 1.0, numSamples);
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            buffer.clear(ch, 0, numSamples);
+
+        instrument->render(buffer, midi, 0, numSamples);
+        return true;
+    }
+
+    float getGain() const override { return gain; }
+    float getPan() const override { return pan; }
+
+private:
+    const std::unique_ptr<SamplerInstrument> instrument;
+    const std::shared_ptr<const std::vector<TimedMidiEvent>> events;
+    const float gain, pan;
+    juce::MidiBuffer midi;
+    juce::int64 position = 0;
+    std::unique_ptr<PrerenderedTrack> prerendered;
+};
+
+//==============================================================================
+OfflineRenderer::OfflineRenderer(juce::AudioFormatManager& formatManager, const SessionState& session,
+                                 double renderSampleRate, const Settings& settings)
+    : sampleRate(renderSampleRate > 0.0 ? renderSampleRate : 44100.0),
+      blockSize(settings.deterministic ? deterministicBlockSize : juce::jmax(64, settings.blockSize)),
+      masterBusEnabled(settings.onlyTrackId == 0),
+      flushDenormals(settings.deterministic),
+      // Uno stem pre-fader è la traccia com'è: nessun bus da attraversare
+      routing(settings.routing != nullptr && settings.applyTrackGain ? settings.routing->detachedCopy() : RoutingGraph())
+{
+    createTracks(formatManager, session, settings);
+    createReverbs(formatManager, settings);
+
+    if (masterBusEnabled)
+    {
+        masterBus.setGain(settings.masterGain);
+        masterBus.setLimiterEnabled(settings.limiterEnabled);
+        masterBus.setCeilingDb(settings.ceilingDb);
+        masterBus.prepare(sampleRate, blockSize);
+    }
+
+    // Le tracce senza un nodo (escluse, vuote) restano nel grafo: i loro passi tacciono
+    for (auto const& [trackId, track] : tracks)
+        routing.addTrack(trackId);
+
+    plan = routing.compile(blockSize, masterBusEnabled ? masterBus.getLatencySamples() : 0);
+    plan->serviceReverbTails = true;
+    connectPlan(settings);
+
+    // L'ultimo campione attraversa ancora tutta la risposta dei riverberi
+    int longestTail = 0;
+    for (auto const& [busId, reverb] : reverbs)
+        longestTail = juce::jmax(longestTail, reverb->getImpulseLength());
+    if (length > 0)
+        length += longestTail;
+
+    // Pre-roll delle compensazioni e del lookahead: il primo campione in uscita è l'inizio della timeline
+    juce::AudioBuffer<float> preRoll(2, blockSize);
+    for (int remaining = plan->mixLatency + (masterBusEnabled ? masterBus.getLatencySamples() : 0); remaining > 0;)
+    {
+        const int count = juce::jmin(remaining, blockSize);
+        processBlock(preRoll, count);
+        remaining -= count;
+    }
+}
+
+void OfflineRenderer::createTracks(juce::AudioFormatManager& formatManager, const SessionState& session, const Settings& settings)
+{
+    // Mute e solo come in riproduzione, tracce MIDI comprese: le escluse non vengono nemmeno aperte
+    bool anySoloed = false;
+    session.tracks.forEach([&anySoloed](int, const TrackState& track) { anySoloed = anySoloed || track.soloed; });
+    for (auto const& [trackId, midi] : settings.midiTracks)
+        anySoloed = anySoloed || midi.soloed;
+
+    auto isIncluded = [&](int trackId, bool muted, bool soloed)
+    {
+        return settings.onlyTrackId != 0 ? trackId == settings.onlyTrackId : !muted && (!anySoloed || soloed);
+    };
+
+    auto panFor = [&settings](int trackId)
+    {
+        auto pan = settings.trackPan.find(trackId);
+        return settings.applyTrackGain && pan != settings.trackPan.end() ? pan->second : 0.0f;
+    };
+
+    session.tracks.forEach([&](int trackId, const TrackState& state)
+    {
+        if (!isIncluded(trackId, state.muted, state.soloed) || state.clips.isEmpty())
+            return;
+
+        auto source = std::make_unique<ClipTrackSource>(formatManager, sampleRate);
+        source->setDeferIndexUpdates(true);
+        state.clips.forEach([&](int, const Clip& clip)
+        {
+            if (source->addClip(clip) < 0)
+                juce::Logger::writeToLog("OfflineRenderer: Cannot open " + clip.file.getFullPathName()
+                                         + " on track " + juce::String(trackId));
+        });
+        source->setDeferIndexUpdates(false);
+        source->setLooping(state.looping);
+        source->prepareToPlay(blockSize, sampleRate);
+
+        length = juce::jmax(length, source->getTotalLength());
+        tracks[trackId] = std::make_shared<ClipTrack>(std::move(source), settings.applyTrackGain ? state.gain : 1.0f, panFor(trackId));
+    });
+
+    for (auto const& [trackId, midi] : settings.midiTracks)
+    {
+        // Con dei clip la traccia suona come traccia audio, come in riproduzione
+        const auto* audio = session.getTrack(trackId);
+        if ((audio != nullptr && !audio->clips.isEmpty()) || !isIncluded(trackId, midi.muted, midi.soloed)
+            || midi.events == nullptr || midi.events->empty() || midi.zones.empty())
+            continue;
+
+        if (settings.sampleCache == nullptr)
+        {
+            juce::Logger::writeToLog("OfflineRenderer Error: No sample cache for MIDI track " + juce::String(trackId));
+            continue;
+        }
+
+        auto instrument = std::make_unique<SamplerInstrument>();
+        if (!instrument->setZones(midi.zones, *settings.sampleCache))
+            juce::Logger::writeToLog("OfflineRenderer: Missing samples on MIDI track " + juce::String(trackId));
+        instrument->prepare(sampleRate, blockSize);
+
+        // L'ultima nota si chiude con il rilascio dell'inviluppo
+        const auto releaseSamples = (juce::int64) std::ceil(SamplerInstrument::releaseSeconds * sampleRate);
+        length = juce::jmax(length, midi.events->back().time + releaseSamples);
+
+        auto track = std::make_shared<SamplerTrack>(std::move(instrument), midi.events,
+                                                    settings.applyTrackGain ? midi.gain : 1.0f, panFor(trackId));
+
+        if (settings.anticipativeRendering)
+        {
+            auto workerInstrument = std::make_shared<SamplerInstrument>();
+            workerInstrument->setZones(midi.zones, *settings.sampleCache);
+            workerInstrument->prepare(sampleRate, PrerenderedTrack::renderBlockFrames);
+            track->prerenderWith(std::move(workerInstrument), sampleRate);
+        }
+
+        tracks[trackId] = std::move(track);
+    }
+}
+
+void OfflineRenderer::createReverbs(juce::AudioFormatManager& formatManager, const Settings& settings)
+{
+    for (auto const& [busId, reverb] : settings.busReverbs)
+    {
+        // Solo i bus del grafo copiato: uno stem pre-fader non ne ha
+        if (routing.getBusChannel(busId) == nullptr)
+            continue;
+
+        juce::AudioBuffer<float> impulse;
+        if (!ConvolutionReverb::loadImpulseResponse(formatManager, reverb.impulseResponse, sampleRate, impulse))
+        {
+            juce::Logger::writeToLog("OfflineRenderer Error: Cannot load impulse response "
+                                     + reverb.impulseResponse.getFullPathName() + " for bus " + juce::String(busId));
+            continue;
+        }
+
+        auto convolution = std::make_unique<ConvolutionReverb>(impulse);
+        convolution->setLevels(reverb.wetLevel, reverb.dryLevel);
+        reverbs[busId] = std::move(convolution);
+    }
+}
+
+void OfflineRenderer::connectPlan(const Settings& settings)
+{
+    auto curveFor = [&settings](AutomatedParameter parameter, int id) -> std::shared_ptr<const AutomationCurve>
+    {
+        auto it = settings.automation.find({ parameter, id });
+        return it != settings.automation.end() ? it->second : nullptr;
+    };
+
+    for (auto& step : plan->steps)
+    {
+        if (step.isBus)
+        {
+            auto reverb = reverbs.find(step.id);
+            step.reverb = reverb != reverbs.end() ? reverb->second.get() : nullptr;
+            step.busAutomation.setCurve(curveFor(AutomatedParameter::busGain, step.id));
+            continue;
+        }
+
+        auto track = tracks.find(step.id);
+        if (track == tracks.end())
+            continue;
+
+        step.track = track->second;
+        if (settings.applyTrackGain)
+        {
+            step.trackAutomation.volume.setCurve(curveFor(AutomatedParameter::trackVolume, step.id));
+            step.trackAutomation.pan.setCurve(curveFor(AutomatedParameter::trackPan, step.id));
+        }
+    }
+
+    if (masterBusEnabled)
+    {
+        plan->masterGainAutomation.setCurve(curveFor(AutomatedParameter::masterGain, 0));
+        plan->masterCeilingAutomation.setCurve(curveFor(AutomatedParameter::masterCeiling, 0));
+    }
+}
+
+int OfflineRenderer::renderNextBlock(juce::AudioBuffer<float>& output, int numSamples)
+{
+    const int count = (int) juce::jmin<juce::int64>(juce::jmin(numSamples, blockSize), length - outputPosition);
+    if (count <= 0)
+        return 0;
+
+    processBlock(output, count);
+    outputPosition += count;
+    return count;
+}
+
+void OfflineRenderer::processBlock(juce::AudioBuffer<float>& output, int numSamples)
+{
+    // Lo stato della FPU è quello del thread chiamante: in modalità deterministica è fissato qui
+    std::optional<juce::ScopedNoDenormals> noDenormals;
+    if (flushDenormals)
+        noDenormals.emplace();
+
+    for (int ch = 0; ch < output.getNumChannels(); ++ch)
+        output.clear(ch, 0, numSamples);
+
+    // Il mix arriva al bus master in ritardo delle compensazioni, e l'automazione del master lo
+    // segue. La timeline è avanti delle latenze: l'ultimo tratto (silenzioso) svuota ritardi e lookahead.
+    const auto automation = masterBusEnabled ? plan->renderMasterAutomation((double) (mixPosition - plan->mixLatency), 1.0, numSamples)
+                                             : MasterBus::ParameterBuffers();
+    plan->process(output, 0, numSamples, (double) mixPosition, 1.0);
+    mixPosition += numSamples;
+
+    if (masterBusEnabled)
+        masterBus.process(output, 0, numSamples, automation);
+}
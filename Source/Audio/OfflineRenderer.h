@@ -0,0 +1,122 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Automation.h"
+#include "ClipTrackSource.h"
+#include "ConvolutionReverb.h"
+#include "MasterBus.h"
+#include "RoutingGraph.h"
+#include "SampleCache.h"
+#include "SamplerInstrument.h"
+#include "TrackPrerenderer.h"
+#include "../Session/SessionState.h"
+
+// Rendering offline di una sessione, più veloce del tempo reale e senza il dispositivo audio.
+// Costruisce una propria catena di clip per ogni traccia (reader compresi), propri strumenti e
+// riverberi, e compila un proprio piano dall'instradamento: il mix percorre lo stesso
+// ProcessingPlan della riproduzione (bus, mandate, compensazioni, automazione), quindi più
+// renderer possono lavorare in parallelo su thread diversi senza toccare l'engine.
+class OfflineRenderer
+{
+public:
+    // Riverbero a convoluzione inserito su un bus
+    struct BusReverb
+    {
+        juce::File impulseResponse;
+        float wetLevel = 1.0f;
+        float dryLevel = 0.0f;
+    };
+
+    // Traccia MIDI: non fa parte della SessionState, il suo stato arriva dall'engine
+    struct MidiTrack
+    {
+        std::vector<SamplerInstrument::Zone> zones;
+        std::shared_ptr<const std::vector<TimedMidiEvent>> events; // Ordinati per tempo
+        float gain = 1.0f;
+        bool muted = false;
+        bool soloed = false;
+    };
+
+    struct Settings
+    {
+        float masterGain = 1.0f;
+        bool limiterEnabled = true;
+        float ceilingDb = -1.0f;
+        int blockSize = 4096;
+
+        // Stem: solo questa traccia (mute e solo ignorati), senza bus master; 0 = mix completo.
+        // Dopo il fader attraversa i bus su cui è instradata, prima del fader esce com'è.
+        int onlyTrackId = 0;
+        bool applyTrackGain = true; // false = stem pre-fader
+
+        // Automazione e pan come in riproduzione (curve in campioni della timeline)
+        AutomationMap automation;
+        std::map<int, float> trackPan;
+
+        // Instradamento della riproduzione (bus, mandate, uscite dirette, latenze). nullptr = ogni
+        // traccia direttamente sul bus master. Il renderer ne compila una copia staccata.
+        std::shared_ptr<const RoutingGraph> routing;
+        std::map<int, BusReverb> busReverbs;
+
+        // Tracce MIDI, rese con uno strumento proprio dai campioni di sampleCache
+        std::map<int, MidiTrack> midiTracks;
+        SampleCache* sampleCache = nullptr; // Deve sopravvivere al renderer
+        // Tracce MIDI rese in anticipo come nell'engine (PrerenderedTrack, strumento proprio del
+        // "worker"), con il passaggio dallo strumento dal vivo al ring: il risultato non cambia
+        bool anticipativeRendering = false;
+
+        // Modalità deterministica (test di regressione): blocchi fissi di deterministicBlockSize
+        // campioni e denormali azzerati. Il piano è percorso sempre nello stesso ordine su un solo
+        // thread, e ogni stem ha il suo renderer: la stessa sessione dà gli stessi bit a ogni esecuzione.
+        bool deterministic = false;
+    };
+
+    static constexpr int deterministicBlockSize = 512;
+
+    OfflineRenderer(juce::AudioFormatManager& formatManager, const SessionState& session,
+                    double sampleRate, const Settings& settings);
+
+    double getSampleRate() const { return sampleRate; }
+    // Durata del mix: fino alla fine dell'ultimo clip o dell'ultima nota (le tracce in loop
+    // ripartono fino a lì), più la coda dei riverberi
+    juce::int64 getLengthInSamples() const { return length; }
+    juce::int64 getPosition() const { return outputPosition; }
+    bool isFinished() const { return outputPosition >= length; }
+    // Allunga il rendering con silenzio (o loop) fino a newLength, es. per allineare gli stem
+    void extendTo(juce::int64 newLength) { length = juce::jmax(length, newLength); }
+
+    // Rende al massimo numSamples campioni stereo all'inizio di output; restituisce i campioni
+    // scritti (0 a fine mix). Compensazioni dei percorsi e latenza del bus master sono già recuperate.
+    int renderNextBlock(juce::AudioBuffer<float>& output, int numSamples);
+
+private:
+    class ClipTrack;
+    class SamplerTrack;
+
+    // Nodi delle tracce incluse (stem: una sola) e riverberi, da collegare ai passi del piano
+    void createTracks(juce::AudioFormatManager& formatManager, const SessionState& session, const Settings& settings);
+    void createReverbs(juce::AudioFormatManager& formatManager, const Settings& settings);
+    void connectPlan(const Settings& settings);
+    // Piano, automazione e bus master di numSamples campioni (al massimo blockSize)
+    void processBlock(juce::AudioBuffer<float>& output, int numSamples);
+
+    const double sampleRate;
+    const int blockSize;
+    const bool masterBusEnabled;
+    const bool flushDenormals;
+
+    RoutingGraph routing;
+    std::map<int, std::shared_ptr<TrackNode>> tracks;
+    std::map<int, std::unique_ptr<ConvolutionReverb>> reverbs; // Devono sopravvivere al piano
+    std::unique_ptr<ProcessingPlan> plan;
+    MasterBus masterBus;
+
+    juce::int64 mixPosition = 0;               // Posizione della timeline del prossimo campione mixato
+    juce::int64 length = 0;
+    juce::int64 outputPosition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineRenderer)
+};
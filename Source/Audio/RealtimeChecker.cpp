@@ -0,0 +1,59 @@
+#include "RealtimeChecker.h"
+
+#if AUDIOWORKSTATION_RT_CHECKS
+
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+
+namespace
+{
+    // Solo tipi banali: l'accesso non deve allocare né passare dagli inizializzatori TLS
+    thread_local int realtimeDepth = 0;
+    thread_local bool reporting = false;
+
+    std::atomic<int> numViolations { 0 };
+}
+
+void RealtimeChecker::enter()   { ++realtimeDepth; }
+void RealtimeChecker::leave()   { --realtimeDepth; }
+
+int RealtimeChecker::getNumViolations() { return numViolations.load(); }
+
+// Chiamata dalle funzioni intercettate (RealtimeCheckerHooks.cpp) a ogni chiamata, su ogni thread
+extern "C" void audioWorkstationRealtimeCheck(const char* function)
+{
+    if (realtimeDepth == 0 || reporting)
+        return;
+
+    // Da qui in poi il thread può allocare e bloccare: la segnalazione stessa non viene controllata
+    reporting = true;
+    numViolations.fetch_add(1);
+
+    static std::mutex seenLock;
+    static std::unordered_set<size_t> seenTraces;
+
+    const auto trace = juce::SystemStats::getStackBacktrace();
+    bool isNew = false;
+    {
+        const std::lock_guard<std::mutex> lock(seenLock);
+        isNew = seenTraces.insert(std::hash<std::string>()(trace.toStdString())).second;
+    }
+
+    if (isNew)
+        juce::Logger::writeToLog("RealtimeChecker Error: " + juce::String(function) + " on a real-time thread\n" + trace);
+
+    static const bool abortOnViolation = std::getenv("AUDIOWORKSTATION_RT_ABORT") != nullptr;
+    if (abortOnViolation)
+        std::abort();
+
+    reporting = false;
+}
+
+#else
+
+int RealtimeChecker::getNumViolations() { return 0; }
+void RealtimeChecker::enter()   {}
+void RealtimeChecker::leave()   {}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef AUDIOWORKSTATION_RT_CHECKS
+ #define AUDIOWORKSTATION_RT_CHECKS 0
+#endif
+
+// Verifica del tempo reale per le build di debug/CI (opzione CMake AUDIOWORKSTATION_RT_CHECKS).
+// Mentre un thread è dentro una ScopedRealtimeSection, allocazioni, lock di mutex, attese e
+// I/O su file vengono intercettati e segnalati con lo stack trace (una volta per punto di
+// chiamata). Con la variabile d'ambiente AUDIOWORKSTATION_RT_ABORT il primo errore termina il
+// processo, così una regressione fa fallire la CI invece di diventare un glitch.
+// Nelle build normali le sezioni sono vuote e non costano nulla.
+class RealtimeChecker
+{
+public:
+    static constexpr bool enabled = AUDIOWORKSTATION_RT_CHECKS != 0;
+
+    // Il thread corrente esegue codice a tempo reale finché l'oggetto vive (annidabile)
+    class ScopedRealtimeSection
+    {
+    public:
+        ScopedRealtimeSection()  { if constexpr (enabled) enter(); }
+        ~ScopedRealtimeSection() { if constexpr (enabled) leave(); }
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+    };
+
+    // Violazioni rilevate dall'avvio (anche quelle già segnalate per lo stesso punto)
+    static int getNumViolations();
+
+private:
+    static void enter();
+    static void leave();
+};
@@ -0,0 +1,223 @@
+// Funzioni di sistema intercettate per il RealtimeChecker (solo Linux/glibc).
+// Niente JuceHeader né unistd.h/stdlib.h qui: le definizioni sostituiscono quelle della libc e
+// non devono scontrarsi con le dichiarazioni (o i wrapper inline di _FORTIFY_SOURCE) degli header.
+#include <cstddef>
+
+#if AUDIOWORKSTATION_RT_CHECKS && defined(__linux__) && defined(__GLIBC__)
+
+#include <cstdarg>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <time.h>
+
+struct _IO_FILE; // FILE della glibc, senza includere stdio.h
+
+extern "C"
+{
+    void audioWorkstationRealtimeCheck(const char* function); // RealtimeChecker.cpp
+
+    // Allocatore della glibc senza passare da dlsym (che a sua volta alloca)
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void __libc_free(void*);
+}
+
+namespace
+{
+    // Risolte alla prima chiamata; una corsa tra thread scrive due volte lo stesso valore
+    template <typename Function>
+    Function next(Function& cached, const char* name)
+    {
+        if (cached == nullptr)
+            cached = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+        return cached;
+    }
+
+    // Le condition variable hanno due versioni sui sistemi a 64 bit: dlsym restituirebbe quella
+    // di compatibilità (GLIBC_2.2.5), incompatibile con le variabili inizializzate dal programma
+    template <typename Function>
+    Function nextCondition(Function& cached, const char* name)
+    {
+        if (cached == nullptr)
+            cached = reinterpret_cast<Function>(dlvsym(RTLD_NEXT, name, "GLIBC_2.3.2"));
+        return next(cached, name); // Architetture con una sola versione
+    }
+
+    void* (*realAlignedAlloc)(size_t, size_t) = nullptr;
+    int (*realPosixMemalign)(void**, size_t, size_t) = nullptr;
+    int (*realMutexLock)(pthread_mutex_t*) = nullptr;
+    int (*realMutexTrylock)(pthread_mutex_t*) = nullptr;
+    int (*realCondWait)(pthread_cond_t*, pthread_mutex_t*) = nullptr;
+    int (*realCondTimedwait)(pthread_cond_t*, pthread_mutex_t*, const timespec*) = nullptr;
+    int (*realCondClockwait)(pthread_cond_t*, pthread_mutex_t*, clockid_t, const timespec*) = nullptr;
+    int (*realSemWait)(sem_t*) = nullptr;
+    int (*realSemTimedwait)(sem_t*, const timespec*) = nullptr;
+    int (*realNanosleep)(const timespec*, timespec*) = nullptr;
+    int (*realUsleep)(unsigned int) = nullptr;
+    ssize_t (*realRead)(int, void*, size_t) = nullptr;
+    ssize_t (*realWrite)(int, const void*, size_t) = nullptr;
+    int (*realOpen)(const char*, int, ...) = nullptr;
+    int (*realOpen64)(const char*, int, ...) = nullptr;
+    int (*realOpenat)(int, const char*, int, ...) = nullptr;
+    _IO_FILE* (*realFopen)(const char*, const char*) = nullptr;
+    _IO_FILE* (*realFopen64)(const char*, const char*) = nullptr;
+}
+
+extern "C"
+{
+    // --- Allocazioni ---
+    void* malloc(size_t size)
+    {
+        audioWorkstationRealtimeCheck("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        audioWorkstationRealtimeCheck("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        audioWorkstationRealtimeCheck("realloc");
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            audioWorkstationRealtimeCheck("free");
+        __libc_free(pointer);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        audioWorkstationRealtimeCheck("aligned_alloc");
+        return next(realAlignedAlloc, "aligned_alloc")(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size) noexcept
+    {
+        audioWorkstationRealtimeCheck("posix_memalign");
+        return next(realPosixMemalign, "posix_memalign")(result, alignment, size);
+    }
+
+    // --- Lock e attese ---
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        audioWorkstationRealtimeCheck("pthread_mutex_lock");
+        return next(realMutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    // Anche un trylock riuscito è un segnale: il codice a tempo reale non deve dipendere da un mutex
+    int pthread_mutex_trylock(pthread_mutex_t* mutex) noexcept
+    {
+        audioWorkstationRealtimeCheck("pthread_mutex_trylock");
+        return next(realMutexTrylock, "pthread_mutex_trylock")(mutex);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        audioWorkstationRealtimeCheck("pthread_cond_wait");
+        return nextCondition(realCondWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* timeout)
+    {
+        audioWorkstationRealtimeCheck("pthread_cond_timedwait");
+        return nextCondition(realCondTimedwait, "pthread_cond_timedwait")(condition, mutex, timeout);
+    }
+
+    int pthread_cond_clockwait(pthread_cond_t* condition, pthread_mutex_t* mutex, clockid_t clock, const timespec* timeout)
+    {
+        audioWorkstationRealtimeCheck("pthread_cond_clockwait");
+        return next(realCondClockwait, "pthread_cond_clockwait")(condition, mutex, clock, timeout);
+    }
+
+    int sem_wait(sem_t* semaphore)
+    {
+        audioWorkstationRealtimeCheck("sem_wait");
+        return next(realSemWait, "sem_wait")(semaphore);
+    }
+
+    int sem_timedwait(sem_t* semaphore, const timespec* timeout)
+    {
+        audioWorkstationRealtimeCheck("sem_timedwait");
+        return next(realSemTimedwait, "sem_timedwait")(semaphore, timeout);
+    }
+
+    int nanosleep(const timespec* requested, timespec* remaining)
+    {
+        audioWorkstationRealtimeCheck("nanosleep");
+        return next(realNanosleep, "nanosleep")(requested, remaining);
+    }
+
+    int usleep(unsigned int microseconds)
+    {
+        audioWorkstationRealtimeCheck("usleep");
+        return next(realUsleep, "usleep")(microseconds);
+    }
+
+    // --- I/O (file, pipe, logging su stderr) ---
+    ssize_t read(int fd, void* buffer, size_t numBytes)
+    {
+        audioWorkstationRealtimeCheck("read");
+        return next(realRead, "read")(fd, buffer, numBytes);
+    }
+
+    ssize_t write(int fd, const void* buffer, size_t numBytes)
+    {
+        audioWorkstationRealtimeCheck("write");
+        return next(realWrite, "write")(fd, buffer, numBytes);
+    }
+
+    // Il mode si legge sempre: senza O_CREAT/O_TMPFILE il valore non conta, e leggerlo è innocuo
+    // con le convenzioni di chiamata di Linux (come fanno i sanitizer)
+    int open(const char* path, int flags, ...)
+    {
+        audioWorkstationRealtimeCheck("open");
+        va_list args;
+        va_start(args, flags);
+        const auto mode = (mode_t) va_arg(args, int);
+        va_end(args);
+        return next(realOpen, "open")(path, flags, mode);
+    }
+
+    int open64(const char* path, int flags, ...)
+    {
+        audioWorkstationRealtimeCheck("open64");
+        va_list args;
+        va_start(args, flags);
+        const auto mode = (mode_t) va_arg(args, int);
+        va_end(args);
+        return next(realOpen64, "open64")(path, flags, mode);
+    }
+
+    int openat(int directory, const char* path, int flags, ...)
+    {
+        audioWorkstationRealtimeCheck("openat");
+        va_list args;
+        va_start(args, flags);
+        const auto mode = (mode_t) va_arg(args, int);
+        va_end(args);
+        return next(realOpenat, "openat")(directory, path, flags, mode);
+    }
+
+    _IO_FILE* fopen(const char* path, const char* mode)
+    {
+        audioWorkstationRealtimeCheck("fopen");
+        return next(realFopen, "fopen")(path, mode);
+    }
+
+    _IO_FILE* fopen64(const char* path, const char* mode)
+    {
+        audioWorkstationRealtimeCheck("fopen64");
+        return next(realFopen64, "fopen64")(path, mode);
+    }
+}
+
+#endif
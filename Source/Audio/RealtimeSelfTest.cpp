@@ -0,0 +1,251 @@
+#include "RealtimeSelfTest.h"
+#include "AudioEngine.h"
+#include "RealtimeChecker.h"
+
+namespace
+{
+    template <typename SampleAt>
+    bool writeSource(const juce::File& file, int numChannels, int numFrames, SampleAt sampleAt)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numFrames);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numFrames; ++i)
+                buffer.setSample(ch, i, sampleAt(ch, i));
+
+        file.deleteFile();
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        if (!stream->openedOk())
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), RealtimeSelfTest::sampleRate,
+                                                                            (unsigned int) numChannels, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Ora appartiene al writer
+        return writer->writeFromAudioSampleBuffer(buffer, 0, numFrames);
+    }
+
+    // Il dispositivo: blocchi di blockSize campioni a intervalli regolari, come un callback vero.
+    // Come un dispositivo vero consegna gli ingressi nello stesso buffer che poi diventa l'uscita.
+    class SimulatedDevice : public juce::Thread
+    {
+    public:
+        explicit SimulatedDevice(juce::AudioSource& sourceToDrive)
+            : juce::Thread("Simulated audio device"), source(sourceToDrive)
+        {
+        }
+
+        void run() override
+        {
+            juce::AudioBuffer<float> buffer(2, RealtimeSelfTest::blockSize);
+            juce::int64 inputPosition = 0;
+            while (!threadShouldExit())
+            {
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    for (int i = 0; i < buffer.getNumSamples(); ++i)
+                        buffer.setSample(ch, i, (float) std::sin((double) (inputPosition + i) * (0.03 + 0.01 * ch)) * 0.25f);
+                inputPosition += buffer.getNumSamples();
+
+                source.getNextAudioBlock({ &buffer, 0, buffer.getNumSamples() });
+                numBlocks.fetch_add(1);
+                wait(2);
+            }
+        }
+
+        std::atomic<int> numBlocks { 0 };
+
+    private:
+        juce::AudioSource& source;
+    };
+
+    juce::MidiMessageSequence makeSequence(int transpose)
+    {
+        juce::MidiMessageSequence sequence;
+        for (int i = 0; i < 64; ++i)
+        {
+            const int note = 48 + transpose + (i * 5) % 24;
+            sequence.addEvent(juce::MidiMessage::noteOn(1, note, 0.8f), i * 0.125);
+            sequence.addEvent(juce::MidiMessage::noteOff(1, note), i * 0.125 + 0.2);
+        }
+        sequence.updateMatchedPairs();
+        return sequence;
+    }
+
+    struct TakeCounter : public AudioEngine::Listener
+    {
+        void takeRecorded(const juce::File&, int) override { ++numTakes; }
+        int numTakes = 0;
+    };
+
+    std::shared_ptr<const AutomationCurve> makeRamp(float from, float to, juce::int64 length)
+    {
+        return std::make_shared<const AutomationCurve>(std::vector<AutomationCurve::Breakpoint> {
+            { 0, from, AutomationCurve::Shape::exponential }, { length, to } });
+    }
+}
+
+bool RealtimeSelfTest::run(juce::String& report)
+{
+    if (!RealtimeChecker::enabled)
+    {
+        report << "Real-time checks are not compiled in: configure with -DAUDIOWORKSTATION_RT_CHECKS=ON\n";
+        return false;
+    }
+
+    const auto sources = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioWorkstation Realtime Check");
+    const auto loopFile = sources.getChildFile("loop.wav");
+    const auto noteFile = sources.getChildFile("note.wav");
+    const auto impulseFile = sources.getChildFile("impulse.wav");
+
+    juce::Random random(7);
+    const bool written = sources.createDirectory()
+        && writeSource(loopFile, 2, 96000, [](int ch, int i) { return (float) ((i * (ch + 1)) % 200 - 100) / 400.0f; })
+        && writeSource(noteFile, 1, 24000, [](int, int i) { return (float) std::sin(i * 0.0575) * 0.5f; })
+        && writeSource(impulseFile, 2, 48000, [&random](int, int i)
+           {
+               return (random.nextFloat() * 2.0f - 1.0f) * std::exp(-(float) i / 8000.0f);
+           });
+
+    if (!written)
+    {
+        report << "Cannot write the source files in " << sources.getFullPathName() << "\n";
+        return false;
+    }
+
+    const int violationsBefore = RealtimeChecker::getNumViolations();
+    int blocks = 0;
+    juce::int64 droppedRecordingSamples = 0;
+    bool recordingFailed = false;
+    float meteringLoad = 0.0f;
+    {
+        AudioEngine engine;
+        engine.shutdownAudio(); // Il callback lo chiama solo il dispositivo simulato
+        engine.prepareToPlay(blockSize, sampleRate);
+
+        // Tracce 1 e 2 audio (la 2 lanciata), 3 e 4 MIDI, la 5 va e viene; un bus aux con riverbero
+        Clip loop;
+        loop.file = loopFile;
+        const int loopClip = engine.addClip(1, loop);
+        engine.setTrackLooping(1, true);
+        engine.addClip(2, loop);
+        engine.setTrackLooping(2, true);
+
+        const std::vector<SamplerInstrument::Zone> zones { { noteFile, 60, 0, 127 } };
+        engine.setAnticipativeRendering(true);
+        for (int trackId : { 3, 4 })
+        {
+            engine.setMidiTrackInstrument(trackId, zones);
+            engine.setMidiTrackSequence(trackId, makeSequence(trackId));
+        }
+        engine.setTrackLive(4, true);
+
+        const int reverbBus = engine.addBus("Reverb");
+        engine.setBusConvolution(reverbBus, impulseFile, 1.0f, 0.0f);
+        engine.setSend(RoutingGraph::NodeRef::track(1), reverbBus, 0.5f, false);
+        engine.setSend(RoutingGraph::NodeRef::track(3), reverbBus, 0.3f, true);
+        engine.setProcessingLatency(RoutingGraph::NodeRef::bus(reverbBus), 128);
+
+        // Tracce 6 e 7 armate sui due ingressi del dispositivo simulato
+        TakeCounter takes;
+        engine.addListener(&takes);
+        engine.setRecordingDirectory(sources.getChildFile("Takes"));
+        engine.setTrackRecordArmed(6, true, 0);
+        engine.setTrackRecordArmed(7, true, 1);
+        int recordings = 0;
+
+        SimulatedDevice device(engine);
+        device.startThread(juce::Thread::Priority::highest);
+        engine.play();
+
+        for (int edit = 0; edit < numEdits; ++edit)
+        {
+            const bool odd = (edit / 10) % 2 != 0;
+
+            switch (edit % 10)
+            {
+                case 0: engine.setTrackMuted(2, odd); break;
+                case 1: engine.setSend(RoutingGraph::NodeRef::track(1), reverbBus, 0.1f * (float) (edit % 7), odd); break;
+                case 2: engine.setAutomation(AutomatedParameter::trackVolume, 1, makeRamp(0.2f, 1.0f, 48000 + edit)); break;
+                case 3: odd ? engine.stopTrack(2, AudioEngine::Quantization::beat) : engine.launchTrack(2, AudioEngine::Quantization::beat); break;
+                case 4: engine.setProcessingLatency(RoutingGraph::NodeRef::track(1), (edit * 37) % 512); break;
+                case 5: engine.setMidiTrackSequence(3, makeSequence(edit % 12)); break;
+                case 6:
+                {
+                    Clip moved = loop;
+                    moved.id = loopClip;
+                    moved.timelineStart = (edit * 101) % 4800;
+                    engine.updateClip(1, moved);
+                    break;
+                }
+                case 7: engine.setTrackSoloed(4, odd); break;
+                case 8:
+                    engine.setAutomation(AutomatedParameter::busGain, reverbBus, odd ? makeRamp(1.0f, 0.5f, 96000) : nullptr);
+                    engine.setAutomation(AutomatedParameter::masterGain, 0, odd ? nullptr : makeRamp(0.5f, 1.0f, 24000));
+                    break;
+                case 9: engine.setTrackLive(3, odd); break;
+            }
+
+            if (edit % 50 == 49)
+                engine.setBusConvolution(reverbBus, impulseFile, 0.5f, 0.5f);
+
+            if (edit % 60 == 59)
+            {
+                engine.removeTrackAudio(5);
+                engine.addClip(5, loop);
+                engine.setAnalyzerSource(odd ? 5 : 0);
+            }
+
+            if (edit % 100 == 10)
+                recordings += engine.startRecording(2) ? 1 : 0;
+            else if (edit % 100 == 70)
+                engine.stopRecording();
+
+            if (edit % 75 == 74)
+            {
+                engine.stop();
+                juce::Thread::sleep(20);
+                engine.play();
+            }
+
+            juce::Thread::sleep(5);
+        }
+
+        engine.stopRecording();
+        engine.stop();
+        juce::Thread::sleep(20);
+        device.stopThread(1000);
+        blocks = device.numBlocks.load();
+        engine.removeListener(&takes);
+
+        droppedRecordingSamples = engine.getDroppedRecordingSamples();
+        recordingFailed = recordings == 0 || takes.numTakes != recordings * 2;
+        report << recordings << " recordings on 2 armed tracks: " << takes.numTakes << " takes, "
+               << droppedRecordingSamples << " dropped input samples\n";
+
+        meteringLoad = engine.getMeteringLoad();
+        report << "Metering load: " << juce::String(meteringLoad * 100.0f, 2) << "% of the callback budget (limit "
+               << juce::String(maxMeteringLoad * 100.0f, 0) << "%)\n";
+
+        report << "Streaming underruns: " << engine.getStreamingUnderruns()
+               << ", prerender underruns: " << engine.getPrerenderUnderruns()
+               << ", convolution underruns: " << engine.getConvolutionUnderruns() << "\n";
+    }
+
+    sources.deleteRecursively();
+
+    const int violations = RealtimeChecker::getNumViolations() - violationsBefore;
+    report << blocks << " callbacks of " << blockSize << " samples during " << numEdits << " session edits: "
+           << violations << " real-time violations\n";
+
+    if (blocks == 0)
+        report << "The simulated device never ran\n";
+    if (recordingFailed || droppedRecordingSamples > 0)
+        report << "Recording the armed inputs failed or lost samples\n";
+    if (meteringLoad > maxMeteringLoad)
+        report << "Metering exceeded its share of the callback budget\n";
+
+    return blocks > 0 && violations == 0 && !recordingFailed && droppedRecordingSamples == 0
+        && meteringLoad <= maxMeteringLoad;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Prova del callback dell'engine con i controlli del tempo reale attivi (build con
+// AUDIOWORKSTATION_RT_CHECKS, target CMake check-realtime). Un thread fa la parte del
+// dispositivo e chiama getNextAudioBlock su un AudioEngine senza dispositivo aperto, mentre il
+// message thread modifica la sessione come farebbe l'utente: clip e loop, lanci quantizzati,
+// tracce MIDI dal vivo e rese in anticipo, bus con riverbero, mandate pre/post fader,
+// compensazione della latenza, automazione, mute/solo, play/stop, registrazione delle tracce
+// armate dagli ingressi del dispositivo simulato.
+// Non serve una scheda audio: la prova gira anche su una macchina di CI.
+class RealtimeSelfTest
+{
+public:
+    // false se il callback ha violato il tempo reale, non ha girato, se il metering ha superato il
+    // suo budget, o se i controlli non sono compilati
+    static bool run(juce::String& report);
+
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int blockSize = 256;
+    static constexpr int numEdits = 300;
+    static constexpr float maxMeteringLoad = 0.05f; // Frazione del budget del callback per meter e loudness
+};
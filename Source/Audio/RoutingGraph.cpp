@@ -0,0 +1,589 @@
+#include "RoutingGraph.h"
+#include <set>
+#include "ConvolutionReverb.h"
+
+CompensationDelay::CompensationDelay(int delaySamples, int maxBlockSize)
+    : delay(delaySamples)
+{
+    prepare(maxBlockSize);
+}
+
+void CompensationDelay::prepare(int maxBlockSize)
+{
+    if (output.getNumSamples() >= maxBlockSize)
+        return;
+
+    ring.setSize(LevelMeter::maxChannels, delay + maxBlockSize);
+    ring.clear();
+    output.setSize(LevelMeter::maxChannels, maxBlockSize);
+    writePosition = 0;
+}
+
+const juce::AudioBuffer<float>& CompensationDelay::process(const juce::AudioBuffer<float>& input, float gain, int numSamples)
+{
+    const int size = ring.getNumSamples();
+    const int channels = juce::jmin(input.getNumChannels(), ring.getNumChannels());
+    const int readPosition = (writePosition + size - delay) % size;
+
+    // Prima la scrittura: con un ritardo più corto del blocco la lettura include campioni appena scritti
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        const int first = juce::jmin(numSamples, size - writePosition);
+        ring.copyFrom(ch, writePosition, input, ch, 0, first);
+        ring.applyGain(ch, writePosition, first, gain);
+        if (first < numSamples)
+        {
+            ring.copyFrom(ch, 0, input, ch, first, numSamples - first);
+            ring.applyGain(ch, 0, numSamples - first, gain);
+        }
+
+        const int firstRead = juce::jmin(numSamples, size - readPosition);
+        output.copyFrom(ch, 0, ring, ch, readPosition, firstRead);
+        if (firstRead < numSamples)
+            output.copyFrom(ch, firstRead, ring, ch, 0, numSamples - firstRead);
+    }
+
+    writePosition = (writePosition + numSamples) % size;
+    return output;
+}
+
+//==============================================================================
+juce::int64 ProcessingPlan::process(juce::AudioBuffer<float>& output, int startSample, int numSamples,
+                                    double timelinePosition, double timelinePerSample)
+{
+    juce::int64 meteringTicks = 0;
+
+    // Il piano è in ordine topologico: ogni bus trova già sommati tutti i suoi ingressi
+    for (auto& step : steps)
+    {
+        for (int slot : step.slotsToClear)
+            slots[(size_t) slot].clear(0, numSamples);
+
+        auto& buffer = slots[(size_t) step.slot];
+        const auto* postFader = &buffer;
+        float fader = 0.0f;
+
+        // Il segnale al fader è in ritardo della latenza accumulata fin qui: l'automazione lo segue
+        const double faderPosition = timelinePosition - step.latency * timelinePerSample;
+
+        if (step.isBus)
+        {
+            // Insert del bus: meter, fader e mandate vedono il segnale riverberato
+            if (step.reverb != nullptr)
+            {
+                if (serviceReverbTails)
+                    step.reverb->processOffline(buffer, numSamples);
+                else
+                    step.reverb->process(buffer, numSamples);
+            }
+
+            const auto meterStart = juce::Time::getHighResolutionTicks();
+            step.bus->meter.process(buffer, 0, numSamples);
+            meteringTicks += juce::Time::getHighResolutionTicks() - meterStart;
+
+            fader = step.bus->muted.load(std::memory_order_relaxed) ? 0.0f : step.bus->gain.load(std::memory_order_relaxed);
+
+            if (fader != 0.0f && step.busAutomation.isActive())
+            {
+                step.busAutomation.render(automationValues.getWritePointer(leftGainChannel), faderPosition, timelinePerSample, numSamples);
+                automationValues.copyFrom(rightGainChannel, 0, automationValues, leftGainChannel, 0, numSamples);
+                postFader = &applyFaderGains(buffer, numSamples);
+                fader = 1.0f;
+            }
+        }
+        else
+        {
+            if (step.track != nullptr && step.track->render(buffer, numSamples, meteringTicks))
+            {
+                fader = step.track->getGain();
+                const float pan = step.track->getPan();
+
+                // Volume e pan per campione: le uscite dopo il fader leggono il segnale già scalato
+                if (step.trackAutomation.isPerSample(pan))
+                {
+                    step.trackAutomation.renderGains(fader, pan, faderPosition, timelinePerSample,
+                                                    automationValues.getWritePointer(leftGainChannel),
+                                                    automationValues.getWritePointer(rightGainChannel),
+                                                    automationValues.getWritePointer(scratchChannel), numSamples);
+                    postFader = &applyFaderGains(buffer, numSamples);
+                    fader = 1.0f;
+                }
+            }
+            else if (!step.hasDelays)
+            {
+                continue; // Silenziata o ferma: nessun contributo, neanche alle mandate
+            }
+            else
+            {
+                // Le linee di compensazione devono continuare a scorrere, svuotandosi nel silenzio
+                buffer.clear(0, numSamples);
+            }
+        }
+
+        for (auto const& target : step.targets)
+        {
+            const bool preFader = target.sendLevel != nullptr && target.preFader;
+            float gain = target.sendLevel == nullptr
+                             ? fader
+                             : target.sendLevel->load(std::memory_order_relaxed) * (preFader ? 1.0f : fader);
+            if (gain == 0.0f && target.delay == nullptr)
+                continue;
+
+            const auto* signal = preFader ? &buffer : postFader;
+            if (target.delay != nullptr)
+            {
+                signal = &target.delay->process(*signal, gain, numSamples);
+                gain = 1.0f;
+            }
+
+            if (target.slot >= 0)
+            {
+                auto& destination = slots[(size_t) target.slot];
+                for (int ch = 0; ch < destination.getNumChannels(); ++ch)
+                    destination.addFrom(ch, 0, *signal, ch, 0, numSamples, gain);
+            }
+            else
+            {
+                addToOutput(output, target.outputChannel, startSample, *signal, numSamples, gain);
+            }
+        }
+    }
+
+    return meteringTicks;
+}
+
+MasterBus::ParameterBuffers ProcessingPlan::renderMasterAutomation(double masterPosition, double timelinePerSample, int numSamples)
+{
+    MasterBus::ParameterBuffers automation;
+
+    if (masterGainAutomation.isActive())
+    {
+        masterGainAutomation.render(automationValues.getWritePointer(masterGainChannel), masterPosition, timelinePerSample, numSamples);
+        automation.gain = automationValues.getReadPointer(masterGainChannel);
+    }
+
+    if (masterCeilingAutomation.isActive())
+    {
+        masterCeilingAutomation.render(automationValues.getWritePointer(masterCeilingChannel), masterPosition, timelinePerSample, numSamples);
+        automation.ceilingGain = automationValues.getReadPointer(masterCeilingChannel);
+    }
+
+    return automation;
+}
+
+const juce::AudioBuffer<float>& ProcessingPlan::applyFaderGains(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    for (int ch = 0; ch < faderOutput.getNumChannels(); ++ch)
+        juce::FloatVectorOperations::multiply(faderOutput.getWritePointer(ch), buffer.getReadPointer(ch),
+                                              automationValues.getReadPointer(ch == 0 ? leftGainChannel : rightGainChannel), numSamples);
+    return faderOutput;
+}
+
+void ProcessingPlan::addToOutput(juce::AudioBuffer<float>& output, int firstChannel, int startSample,
+                                 const juce::AudioBuffer<float>& source, int numSamples, float gain)
+{
+    // Una coppia di uscite che il dispositivo (o il file) non ha ricade sul mix principale
+    if (firstChannel + 1 >= output.getNumChannels())
+        firstChannel = 0;
+
+    const int channels = juce::jmin(source.getNumChannels(), output.getNumChannels() - firstChannel);
+    for (int ch = 0; ch < channels; ++ch)
+        output.addFrom(firstChannel + ch, startSample, source, ch, 0, numSamples, gain);
+}
+
+//==============================================================================
+void RoutingGraph::addTrack(int trackId)
+{
+    tracks.emplace(trackId, Routing());
+}
+
+void RoutingGraph::removeTrack(int trackId)
+{
+    tracks.erase(trackId);
+}
+
+int RoutingGraph::addBus(const juce::String& name)
+{
+    const int busId = nextBusId++;
+    auto& bus = buses[busId];
+    bus.name = name;
+    bus.channel = std::make_shared<BusChannel>();
+    return busId;
+}
+
+void RoutingGraph::removeBus(int busId)
+{
+    if (buses.erase(busId) == 0)
+        return;
+
+    auto detach = [busId](Routing& routing)
+    {
+        if (routing.destination == busId)
+            routing.destination = master;
+
+        routing.sends.erase(std::remove_if(routing.sends.begin(), routing.sends.end(),
+                                           [busId](const Send& send) { return send.busId == busId; }),
+                            routing.sends.end());
+    };
+
+    for (auto& [id, routing] : tracks)
+        detach(routing);
+    for (auto& [id, bus] : buses)
+        detach(bus.routing);
+}
+
+std::vector<int> RoutingGraph::getBusIds() const
+{
+    std::vector<int> ids;
+    for (auto const& [id, bus] : buses)
+        ids.push_back(id);
+    return ids;
+}
+
+juce::String RoutingGraph::getBusName(int busId) const
+{
+    auto it = buses.find(busId);
+    return it != buses.end() ? it->second.name : juce::String();
+}
+
+std::shared_ptr<BusChannel> RoutingGraph::getBusChannel(int busId) const
+{
+    auto it = buses.find(busId);
+    return it != buses.end() ? it->second.channel : nullptr;
+}
+
+bool RoutingGraph::setDestination(NodeRef node, int busId)
+{
+    auto* routing = findRouting(node);
+    if (routing == nullptr || (busId != master && (buses.count(busId) == 0 || reaches(busId, node))))
+    {
+        juce::Logger::writeToLog("RoutingGraph Error: Invalid destination " + juce::String(busId));
+        return false;
+    }
+
+    routing->destination = busId;
+    return true;
+}
+
+bool RoutingGraph::setSend(NodeRef node, int busId, float level, bool preFader)
+{
+    auto* routing = findRouting(node);
+    if (routing == nullptr || buses.count(busId) == 0 || reaches(busId, node))
+    {
+        juce::Logger::writeToLog("RoutingGraph Error: Invalid send to bus " + juce::String(busId));
+        return false;
+    }
+
+    for (auto& send : routing->sends)
+    {
+        if (send.busId == busId)
+        {
+            send.level->store(level);
+            send.preFader = preFader;
+            return true;
+        }
+    }
+
+    routing->sends.push_back({ busId, preFader, std::make_shared<SendLevel>(level) });
+    return true;
+}
+
+void RoutingGraph::removeSend(NodeRef node, int busId)
+{
+    if (auto* routing = findRouting(node))
+        routing->sends.erase(std::remove_if(routing->sends.begin(), routing->sends.end(),
+                                            [busId](const Send& send) { return send.busId == busId; }),
+                             routing->sends.end());
+}
+
+bool RoutingGraph::setBusOutputChannel(int busId, int firstOutputChannel)
+{
+    auto it = buses.find(busId);
+    if (it == buses.end())
+        return false;
+
+    it->second.outputChannel = juce::jmax(-1, firstOutputChannel);
+    return true;
+}
+
+bool RoutingGraph::setLatency(NodeRef node, int latencySamples)
+{
+    auto* routing = findRouting(node);
+    if (routing == nullptr)
+        return false;
+
+    routing->latency = juce::jmax(0, latencySamples);
+    return true;
+}
+
+int RoutingGraph::getLatency(NodeRef node) const
+{
+    const auto* routing = findRouting(node);
+    return routing != nullptr ? routing->latency : 0;
+}
+
+std::shared_ptr<CompensationDelay> RoutingGraph::getDelay(const EdgeKey& edge, int delaySamples, int maxBlockSize,
+                                                          std::map<EdgeKey, std::shared_ptr<CompensationDelay>>& used)
+{
+    if (delaySamples <= 0)
+        return nullptr;
+
+    // Stesso ritardo sullo stesso arco: il piano nuovo continua dalla linea di quello in esecuzione.
+    // L'audio thread può starla usando: si riusa solo se è già abbastanza grande, mai ridimensionata.
+    auto it = delays.find(edge);
+    auto delay = it != delays.end() && it->second->getDelay() == delaySamples && it->second->getMaxBlockSize() >= maxBlockSize
+                     ? it->second
+                     : std::make_shared<CompensationDelay>(delaySamples, maxBlockSize);
+
+    used[edge] = delay;
+    return delay;
+}
+
+RoutingGraph::Routing* RoutingGraph::findRouting(NodeRef node)
+{
+    return const_cast<Routing*>(static_cast<const RoutingGraph&>(*this).findRouting(node));
+}
+
+const RoutingGraph::Routing* RoutingGraph::findRouting(NodeRef node) const
+{
+    if (node.isBus)
+    {
+        auto it = buses.find(node.id);
+        return it != buses.end() ? &it->second.routing : nullptr;
+    }
+
+    auto it = tracks.find(node.id);
+    return it != tracks.end() ? &it->second : nullptr;
+}
+
+std::vector<int> RoutingGraph::getTargetBuses(NodeRef node) const
+{
+    // La destinazione conta come arco anche quando il bus esce direttamente sul dispositivo:
+    // tornare a seguirla non può mai chiudere un ciclo
+    std::vector<int> targets;
+    if (const auto* routing = findRouting(node))
+    {
+        if (routing->destination != master)
+            targets.push_back(routing->destination);
+        for (auto const& send : routing->sends)
+            targets.push_back(send.busId);
+    }
+    return targets;
+}
+
+bool RoutingGraph::reaches(int busId, NodeRef node) const
+{
+    // Le tracce non hanno ingressi: solo un bus può chiudere un ciclo
+    if (!node.isBus)
+        return false;
+
+    std::vector<int> pending { busId };
+    std::set<int> visited;
+
+    while (!pending.empty())
+    {
+        const int current = pending.back();
+        pending.pop_back();
+
+        if (current == node.id)
+            return true;
+
+        if (visited.insert(current).second)
+            for (int next : getTargetBuses(NodeRef::bus(current)))
+                pending.push_back(next);
+    }
+
+    return false;
+}
+
+std::unique_ptr<ProcessingPlan> RoutingGraph::compile(int maxBlockSize, int masterLatency)
+{
+    // --- Ordine topologico (Kahn): tracce prima dei bus, poi per ID, così il piano è deterministico ---
+    std::map<NodeRef, int> inDegree;
+    for (auto const& [id, routing] : tracks)
+        inDegree[NodeRef::track(id)];
+    for (auto const& [id, bus] : buses)
+        inDegree[NodeRef::bus(id)];
+
+    for (auto const& [node, degree] : inDegree)
+        for (int target : getTargetBuses(node))
+            ++inDegree[NodeRef::bus(target)];
+
+    std::set<NodeRef> ready;
+    for (auto const& [node, degree] : inDegree)
+        if (degree == 0)
+            ready.insert(node);
+
+    std::vector<NodeRef> order;
+    while (!ready.empty())
+    {
+        const auto node = *ready.begin();
+        ready.erase(ready.begin());
+        order.push_back(node);
+
+        for (int target : getTargetBuses(node))
+        {
+            const auto targetNode = NodeRef::bus(target);
+            if (--inDegree[targetNode] == 0)
+                ready.insert(targetNode);
+        }
+    }
+
+    jassert(order.size() == inDegree.size()); // Le modifiche rifiutano i cicli
+
+    // --- Latenze: ogni bus riceve al ritmo del suo ingresso più lento ---
+    std::map<NodeRef, int> arrival, departure;
+    int mixArrival = 0;
+
+    for (auto const& node : order)
+    {
+        const auto* routing = findRouting(node);
+        const int latency = arrival[node] + routing->latency;
+        departure[node] = latency;
+
+        // Le uscite dirette (canale > 0) si allineano al mix quando mixArrival è completo
+        const int outputChannel = node.isBus ? buses.at(node.id).outputChannel : -1;
+        if (outputChannel < 0 && routing->destination != master)
+            arrival[NodeRef::bus(routing->destination)] = juce::jmax(arrival[NodeRef::bus(routing->destination)], latency);
+        else if (outputChannel <= 0)
+            mixArrival = juce::jmax(mixArrival, latency);
+
+        for (auto const& send : routing->sends)
+            arrival[NodeRef::bus(send.busId)] = juce::jmax(arrival[NodeRef::bus(send.busId)], latency);
+    }
+
+    // Le uscite dirette saltano il bus master: ne recuperano anche la latenza
+    const int directArrival = mixArrival + masterLatency;
+    std::map<EdgeKey, std::shared_ptr<CompensationDelay>> usedDelays;
+
+    // --- Slot: ogni nodo vive dal primo contributo ricevuto fino al proprio passo ---
+    auto plan = std::make_unique<ProcessingPlan>();
+    std::vector<int> freeSlots;
+    std::map<int, int> busSlots;
+    int numSlots = 0;
+
+    auto acquire = [&]
+    {
+        if (freeSlots.empty())
+            return numSlots++;
+
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    };
+
+    for (auto const& node : order)
+    {
+        ProcessingPlan::Step step;
+        step.isBus = node.isBus;
+        step.id = node.id;
+        step.latency = departure[node];
+
+        auto busSlotFor = [&](int busId)
+        {
+            auto it = busSlots.find(busId);
+            if (it != busSlots.end())
+                return it->second;
+
+            // Primo contributo verso il bus: lo slot (forse usato da un nodo già concluso) va azzerato
+            const int slot = acquire();
+            busSlots[busId] = slot;
+            step.slotsToClear.push_back(slot);
+            return slot;
+        };
+
+        const auto* routing = findRouting(node);
+        const int latency = departure[node];
+        ProcessingPlan::Target mainOutput;
+        int mainArrival = mixArrival;
+
+        if (node.isBus)
+        {
+            const auto& bus = buses.at(node.id);
+            step.bus = bus.channel;
+            step.slot = busSlotFor(node.id); // Un bus senza ingressi riceve uno slot di silenzio
+
+            if (bus.outputChannel >= 0)
+            {
+                mainOutput.outputChannel = bus.outputChannel;
+                mainArrival = bus.outputChannel > 0 ? directArrival : mixArrival;
+            }
+            else if (routing->destination != master)
+            {
+                mainOutput.slot = busSlotFor(routing->destination);
+                mainArrival = arrival[NodeRef::bus(routing->destination)];
+            }
+        }
+        else
+        {
+            step.slot = acquire(); // La traccia lo riscrive per intero
+            if (routing->destination != master)
+            {
+                mainOutput.slot = busSlotFor(routing->destination);
+                mainArrival = arrival[NodeRef::bus(routing->destination)];
+            }
+        }
+
+        const bool toOutput = mainOutput.slot < 0;
+        mainOutput.delay = getDelay({ node, toOutput ? mainOutput.outputChannel : routing->destination, toOutput, false },
+                                    mainArrival - latency, maxBlockSize, usedDelays);
+        step.targets.push_back(mainOutput);
+
+        for (auto const& send : routing->sends)
+        {
+            ProcessingPlan::Target target;
+            target.slot = busSlotFor(send.busId);
+            target.sendLevel = send.level;
+            target.preFader = send.preFader;
+            target.delay = getDelay({ node, send.busId, false, true },
+                                    arrival[NodeRef::bus(send.busId)] - latency, maxBlockSize, usedDelays);
+            step.targets.push_back(target);
+        }
+
+        step.hasDelays = std::any_of(step.targets.begin(), step.targets.end(),
+                                     [](const ProcessingPlan::Target& target) { return target.delay != nullptr; });
+
+        freeSlots.push_back(step.slot);
+        plan->steps.push_back(std::move(step));
+    }
+
+    delays = std::move(usedDelays);
+
+    plan->mixLatency = mixArrival;
+    plan->maxBlockSize = juce::jmax(1, maxBlockSize);
+    plan->slots.resize((size_t) numSlots);
+    for (auto& slot : plan->slots)
+        slot.setSize(LevelMeter::maxChannels, plan->maxBlockSize, false, false, true);
+    plan->automationValues.setSize(ProcessingPlan::numAutomationChannels, plan->maxBlockSize);
+    plan->faderOutput.setSize(LevelMeter::maxChannels, plan->maxBlockSize);
+    return plan;
+}
+
+RoutingGraph RoutingGraph::detachedCopy() const
+{
+    RoutingGraph copy;
+    copy.tracks = tracks;
+    copy.buses = buses;
+    copy.nextBusId = nextBusId;
+
+    auto detachSends = [](Routing& routing)
+    {
+        for (auto& send : routing.sends)
+            send.level = std::make_shared<SendLevel>(send.level->load());
+    };
+
+    for (auto& [id, routing] : copy.tracks)
+        detachSends(routing);
+
+    for (auto& [id, bus] : copy.buses)
+    {
+        detachSends(bus.routing);
+
+        auto channel = std::make_shared<BusChannel>();
+        channel->gain.store(bus.channel->gain.load());
+        channel->muted.store(bus.channel->muted.load());
+        bus.channel = std::move(channel);
+    }
+
+    return copy;
+}
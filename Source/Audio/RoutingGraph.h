@@ -0,0 +1,241 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "Automation.h"
+#include "LevelMeter.h"
+#include "MasterBus.h"
+
+class ConvolutionReverb;
+
+// Stato di canale di un bus: condiviso tra il grafo, il piano in esecuzione e la UI
+struct BusChannel
+{
+    LevelMeter meter;
+    std::atomic<float> gain { 1.0f };
+    std::atomic<bool> muted { false };
+};
+
+// Sorgente di una traccia nel piano, fornita da chi lo compila. Un piano nuovo condivide le
+// sorgenti con quello che sostituisce; vengono distrutte solo fuori dall'audio thread.
+class TrackNode
+{
+public:
+    virtual ~TrackNode() = default;
+
+    // Audio thread: rende numSamples campioni nel buffer, prima del fader. false se la traccia
+    // non suona in questo blocco (silenziata, ferma in attesa di un lancio, senza strumento...).
+    virtual bool render(juce::AudioBuffer<float>& buffer, int numSamples, juce::int64& meteringTicks) = 0;
+
+    // Valori statici del fader; l'automazione è nel passo del piano
+    virtual float getGain() const = 0;
+    virtual float getPan() const = 0;
+
+    // Audio thread: il transport si è fermato (es. note da rilasciare)
+    virtual void stopped() {}
+};
+
+// Livello di una mandata: si cambia senza ricompilare il piano
+using SendLevel = std::atomic<float>;
+
+// Ritardo di compensazione su un arco del grafo: allinea un percorso con meno latenza agli
+// altri che arrivano nella stessa destinazione. Preallocato; il guadagno si applica in ingresso.
+class CompensationDelay
+{
+public:
+    CompensationDelay(int delaySamples, int maxBlockSize);
+
+    int getDelay() const { return delay; }
+    int getMaxBlockSize() const { return output.getNumSamples(); }
+    // Fuori dall'audio thread: rialloca solo se il blocco massimo cresce
+    void prepare(int maxBlockSize);
+
+    // Audio thread: scrive input * gain e restituisce i numSamples campioni ritardati
+    const juce::AudioBuffer<float>& process(const juce::AudioBuffer<float>& input, float gain, int numSamples);
+
+private:
+    const int delay;
+    juce::AudioBuffer<float> ring, output;
+    int writePosition = 0;
+};
+
+// Piano di esecuzione compilato da RoutingGraph. L'audio thread lo percorre in ordine:
+// ogni passo rende una traccia (o trova la somma degli ingressi di un bus) nel proprio slot
+// e lo somma nelle destinazioni. Gli slot sono allocati alla compilazione e riusati tra nodi
+// che non sono mai vivi contemporaneamente. Un piano pubblicato non viene più modificato:
+// un cambio di dispositivo ne compila uno nuovo. L'export ne compila uno proprio e lo
+// percorre allo stesso modo (vedi OfflineRenderer).
+struct ProcessingPlan
+{
+    struct Target
+    {
+        int slot = -1;            // Bus di destinazione (somma nel suo slot)
+        int outputChannel = 0;    // Se slot < 0: prima uscita stereo del dispositivo (0 = mix principale)
+        std::shared_ptr<const SendLevel> sendLevel; // nullptr = uscita del nodo (dopo il fader)
+        bool preFader = false;
+        std::shared_ptr<CompensationDelay> delay;   // nullptr = percorso già allineato
+    };
+
+    struct Step
+    {
+        bool isBus = false;
+        int id = 0;                     // ID della traccia o del bus
+        int slot = 0;
+        std::vector<int> slotsToClear;  // Slot dei bus che iniziano a ricevere da questo passo
+        std::vector<Target> targets;
+        std::shared_ptr<BusChannel> bus;
+        bool hasDelays = false;         // Almeno una destinazione passa da una compensazione
+        int latency = 0;                // Ritardo del segnale al fader rispetto alla timeline (per l'automazione)
+
+        // Completati da chi compila prima della pubblicazione, poi letti solo dall'audio thread
+        std::shared_ptr<TrackNode> track;     // nullptr = traccia senza audio
+        AutomatedFader trackAutomation;
+        AutomationLane busAutomation;         // Guadagno del bus
+        ConvolutionReverb* reverb = nullptr;  // Insert del bus, distrutto solo dopo il piano che lo usa
+    };
+
+    std::vector<Step> steps;
+    std::vector<juce::AudioBuffer<float>> slots;
+    int maxBlockSize = 0;   // Campioni per passo: blocchi più lunghi vanno divisi
+    AutomationLane masterGainAutomation, masterCeilingAutomation;
+
+    // Latenza del percorso più lento fino all'ingresso del bus master (esclusa quella del bus)
+    int mixLatency = 0;
+
+    // Rendering offline: i riverberi calcolano la coda nel passo invece che sui worker
+    bool serviceReverbTails = false;
+
+    // Percorre il piano su numSamples campioni (al massimo maxBlockSize) e somma le uscite in
+    // output da startSample. timelinePosition è quella del primo campione, in campioni della
+    // timeline: l'automazione di ogni fader la segue. Restituisce i tick spesi nel metering dei bus.
+    juce::int64 process(juce::AudioBuffer<float>& output, int startSample, int numSamples,
+                        double timelinePosition, double timelinePerSample);
+
+    // Guadagno e soffitto automatizzati del bus master; masterPosition è la posizione del mix
+    // che arriva al bus (la timeline meno mixLatency)
+    MasterBus::ParameterBuffers renderMasterAutomation(double masterPosition, double timelinePerSample, int numSamples);
+
+    // Valori per campione dell'automazione e segnale dopo un fader automatizzato o con pan,
+    // allocati dalla compilazione (un canale per uso)
+    enum AutomationChannel { leftGainChannel, rightGainChannel, scratchChannel, masterGainChannel,
+                             masterCeilingChannel, numAutomationChannels };
+    juce::AudioBuffer<float> automationValues;
+    juce::AudioBuffer<float> faderOutput;
+
+private:
+    // Moltiplica il segnale per i guadagni sinistro e destro in automationValues
+    const juce::AudioBuffer<float>& applyFaderGains(const juce::AudioBuffer<float>& buffer, int numSamples);
+    static void addToOutput(juce::AudioBuffer<float>& output, int firstChannel, int startSample,
+                            const juce::AudioBuffer<float>& source, int numSamples, float gain);
+};
+
+// Instradamento di tracce e bus (di gruppo o aux): ogni nodo ha un'uscita principale verso un
+// bus o il master, più mandate pre/post fader verso altri bus. Le modifiche che creerebbero un
+// ciclo vengono rifiutate. Solo message thread; l'audio thread vede solo i piani compilati.
+class RoutingGraph
+{
+public:
+    static constexpr int master = 0; // Destinazione: mix principale, attraverso il bus master
+
+    struct NodeRef
+    {
+        bool isBus = false;
+        int id = 0;
+
+        static NodeRef track(int trackId) { return { false, trackId }; }
+        static NodeRef bus(int busId)     { return { true, busId }; }
+
+        bool operator<(const NodeRef& other) const  { return isBus != other.isBus ? !isBus : id < other.id; }
+        bool operator==(const NodeRef& other) const { return isBus == other.isBus && id == other.id; }
+    };
+
+    void addTrack(int trackId);
+    void removeTrack(int trackId);
+
+    int addBus(const juce::String& name);
+    // I nodi che uscivano sul bus tornano al master, le mandate verso il bus spariscono
+    void removeBus(int busId);
+    std::vector<int> getBusIds() const;
+    juce::String getBusName(int busId) const;
+    std::shared_ptr<BusChannel> getBusChannel(int busId) const;
+
+    bool setDestination(NodeRef node, int busId);
+    // Aggiunge la mandata o ne aggiorna livello e punto di prelievo
+    bool setSend(NodeRef node, int busId, float level, bool preFader);
+    void removeSend(NodeRef node, int busId);
+    // Uscita diretta del bus su una coppia di canali del dispositivo (-1 = segue la destinazione)
+    bool setBusOutputChannel(int busId, int firstOutputChannel);
+
+    // Latenza dichiarata dall'elaborazione del nodo (lookahead, fase lineare...), in campioni
+    bool setLatency(NodeRef node, int latencySamples);
+    int getLatency(NodeRef node) const;
+
+    // Compensa le latenze dei percorsi: tutto arriva allineato al mix principale, e le uscite
+    // dirette anche alla latenza del bus master (masterLatency) che esse saltano. I ritardi
+    // invariati dalla compilazione precedente sono condivisi con il nuovo piano e non perdono
+    // il loro contenuto: cambiare una catena tocca solo i percorsi che attraversano quella.
+    // Tutte le allocazioni del piano avvengono qui.
+    std::unique_ptr<ProcessingPlan> compile(int maxBlockSize, int masterLatency);
+
+    // Copia con canali dei bus e livelli delle mandate propri (valori attuali) e nessun
+    // ritardo condiviso: i suoi piani non toccano lo stato di quelli dell'engine
+    RoutingGraph detachedCopy() const;
+
+private:
+    struct Send
+    {
+        int busId = 0;
+        bool preFader = false;
+        std::shared_ptr<SendLevel> level;
+    };
+
+    struct Routing
+    {
+        int destination = master;
+        std::vector<Send> sends;
+        int latency = 0;
+    };
+
+    // Arco del grafo che porta un ritardo: nodo sorgente, bus (o uscita) di arrivo, mandata o no
+    struct EdgeKey
+    {
+        NodeRef source;
+        int target = 0;
+        bool toOutput = false;
+        bool isSend = false;
+
+        bool operator<(const EdgeKey& other) const
+        {
+            if (!(source == other.source))
+                return source < other.source;
+            return std::tie(target, toOutput, isSend) < std::tie(other.target, other.toOutput, other.isSend);
+        }
+    };
+
+    std::shared_ptr<CompensationDelay> getDelay(const EdgeKey& edge, int delaySamples, int maxBlockSize,
+                                                std::map<EdgeKey, std::shared_ptr<CompensationDelay>>& used);
+
+    struct Bus
+    {
+        juce::String name;
+        Routing routing;
+        int outputChannel = -1;
+        std::shared_ptr<BusChannel> channel;
+    };
+
+    Routing* findRouting(NodeRef node);
+    const Routing* findRouting(NodeRef node) const;
+    std::vector<int> getTargetBuses(NodeRef node) const;
+    // Vero se busId raggiunge node: collegare node -> busId chiuderebbe un ciclo
+    bool reaches(int busId, NodeRef node) const;
+
+    std::map<int, Routing> tracks;
+    std::map<int, Bus> buses;
+    int nextBusId = 1;
+
+    // Ritardi dell'ultimo piano compilato, riusati quando il valore non cambia
+    std::map<EdgeKey, std::shared_ptr<CompensationDelay>> delays;
+};
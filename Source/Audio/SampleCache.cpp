@@ -0,0 +1,66 @@
+#include "SampleCache.h"
+#include "Tracer.h"
+
+SampleCache::SampleCache(juce::AudioFormatManager& formatManager, MemoryBudget& memoryBudget)
+    : formats(formatManager), budget(memoryBudget)
+{
+}
+
+size_t SampleCache::Sample::getSizeInBytes() const
+{
+    if (compressed != nullptr)
+        return compressed->getSizeInBytes();
+
+    return (size_t) data.getNumChannels() * (size_t) data.getNumSamples() * sizeof(float);
+}
+
+std::shared_ptr<const SampleCache::Sample> SampleCache::getOrLoad(const juce::File& file)
+{
+    // I due formati sono voci distinte: cambiare formato non riusa copie nell'altro
+    const bool compress = storageFormat.load() == StorageFormat::compressed;
+    const auto key = (compress ? "sample-compressed/" : "sample/") + file.getFullPathName();
+
+    if (auto existing = budget.find<Sample>(key))
+    {
+        Tracer::instant("Sample cache hit");
+        return existing;
+    }
+
+    Tracer::instant("Sample cache miss");
+    AW_TRACE_SCOPE("Sample decode");
+
+    // Due richieste simultanee dello stesso file producono al massimo una copia in più:
+    // l'ultima registrata sostituisce l'altra nel budget, chi ha la prima continua a usarla
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->lengthInSamples > std::numeric_limits<int>::max())
+    {
+        juce::Logger::writeToLog("AudioEngine Error: Cannot load sample: " + file.getFullPathName());
+        return nullptr;
+    }
+
+    auto sample = std::make_shared<Sample>();
+    sample->file = file;
+    sample->sampleRate = reader->sampleRate;
+
+    if (compress)
+    {
+        sample->compressed = CompressedAudioBuffer::fromReader(*reader, 2);
+        if (sample->compressed == nullptr)
+            juce::Logger::writeToLog("SampleCache: " + file.getFileName() + " is not integer PCM, kept as float");
+    }
+
+    if (sample->compressed == nullptr)
+    {
+        sample->data.setSize((int) juce::jmin(2u, reader->numChannels), (int) reader->lengthInSamples);
+        reader->read(&sample->data, 0, (int) reader->lengthInSamples, 0, true, sample->data.getNumChannels() > 1);
+    }
+
+    // Obbligatorio: lo strumento non può suonare dal disco, al limite il budget viene sforato
+    budget.insert(key, MemoryBudget::Category::decodedSample, sample, sample->getSizeInBytes(), false);
+    return sample;
+}
+
+int SampleCache::getNumLoadedSamples() const
+{
+    return budget.getNumEntries(MemoryBudget::Category::decodedSample);
+}
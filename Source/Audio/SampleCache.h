@@ -0,0 +1,47 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include "CompressedAudioBuffer.h"
+#include "MemoryBudget.h"
+
+// Campioni decodificati interamente in memoria, condivisi tra tutti gli strumenti che usano
+// lo stesso file. I campioni restano nel budget di memoria anche quando nessuno strumento li
+// usa più, finché non servono spazio per altri dati.
+class SampleCache
+{
+public:
+    struct Sample
+    {
+        juce::File file;
+        juce::AudioBuffer<float> data;                               // Vuoto se compressed è presente
+        std::unique_ptr<const CompressedAudioBuffer> compressed;
+        double sampleRate = 44100.0;
+
+        int getNumFrames() const { return compressed != nullptr ? compressed->getNumFrames() : data.getNumSamples(); }
+        int getNumChannels() const { return compressed != nullptr ? compressed->getNumChannels() : data.getNumChannels(); }
+        size_t getSizeInBytes() const;
+    };
+
+    // float32: decodifica completa, lettura diretta. compressed: compressione senza perdite
+    // a blocchi, decodificati dalle voci durante la riproduzione (molti più campioni nel budget)
+    enum class StorageFormat { float32, compressed };
+
+    SampleCache(juce::AudioFormatManager& formatManager, MemoryBudget& memoryBudget);
+
+    // Vale per i campioni caricati da qui in poi
+    void setStorageFormat(StorageFormat format) { storageFormat.store(format); }
+    StorageFormat getStorageFormat() const { return storageFormat.load(); }
+
+    // Decodifica il file se non è già in memoria (da chiamare fuori dall'audio thread)
+    std::shared_ptr<const Sample> getOrLoad(const juce::File& file);
+
+    int getNumLoadedSamples() const;
+
+private:
+    juce::AudioFormatManager& formats;
+    MemoryBudget& budget;
+    std::atomic<StorageFormat> storageFormat { StorageFormat::float32 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleCache)
+};
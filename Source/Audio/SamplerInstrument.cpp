@@ -0,0 +1,430 @@
+#include "SamplerInstrument.h"
+
+namespace
+{
+    constexpr int stealFadeSamples = 64;
+
+    // Lettura dei frame di un campione, in float o compresso (blocchi decodificati al passaggio)
+    class SampleReader
+    {
+    public:
+        SampleReader() { decoder.prepare(2); }
+
+        void setSample(const SampleCache::Sample* newSample)
+        {
+            sample = newSample;
+            decoder.setSource(sample != nullptr ? sample->compressed.get() : nullptr);
+            rightChannel = sample != nullptr && sample->getNumChannels() > 1 ? 1 : 0;
+            length = sample != nullptr ? sample->getNumFrames() : 0;
+        }
+
+        int getLength() const { return length; }
+
+        // Interpolazione lineare tra index e index + 1 (channel 0 = sinistro, 1 = destro)
+        float interpolate(int channel, int index, float frac)
+        {
+            const int sourceChannel = channel == 0 ? 0 : rightChannel;
+            const float a = read(sourceChannel, index);
+            const float b = read(sourceChannel, index + 1);
+            return a + frac * (b - a);
+        }
+
+    private:
+        float read(int channel, int frame)
+        {
+            return sample->compressed != nullptr ? decoder.getSample(channel, frame)
+                                                 : sample->data.getSample(channel, frame);
+        }
+
+        const SampleCache::Sample* sample = nullptr;
+        CompressedAudioBuffer::Reader decoder;
+        int rightChannel = 0;
+        int length = 0;
+    };
+}
+
+//==============================================================================
+class SamplerInstrument::Sound
+{
+public:
+    Sound(std::shared_ptr<const SampleCache::Sample> sampleToPlay, const Zone& zone)
+        : sample(std::move(sampleToPlay)), rootNote(zone.rootNote), lowNote(zone.lowNote), highNote(zone.highNote)
+    {
+    }
+
+    bool appliesToNote(int midiNoteNumber) const { return midiNoteNumber >= lowNote && midiNoteNumber <= highNote; }
+
+    const std::shared_ptr<const SampleCache::Sample> sample; // Condiviso con la SampleCache
+    const int rootNote, lowNote, highNote;
+};
+
+//==============================================================================
+class SamplerInstrument::Voice
+{
+public:
+    // Stato della nota, gestito da SamplerInstrument come farebbe juce::Synthesiser
+    int note = -1;          // -1: voce libera (la dissolvenza di una voce rubata può ancora suonare)
+    int channel = 0;
+    juce::uint32 noteOnTime = 0;
+    bool keyDown = false;
+
+    bool isActive() const { return note >= 0; }
+    bool wasStartedBefore(const Voice& other) const { return noteOnTime < other.noteOnTime; }
+
+    Voice()
+    {
+        envelopeParameters.attack = 0.001f;
+        envelopeParameters.decay = 0.0f;
+        envelopeParameters.sustain = 1.0f;
+        envelopeParameters.release = releaseSeconds;
+    }
+
+    void setSampleRate(double newRate)
+    {
+        sampleRate = newRate;
+        if (newRate > 0.0)
+            envelope.setSampleRate(newRate);
+        envelope.setParameters(envelopeParameters);
+    }
+
+    void startNote(int midiNoteNumber, float velocity, const Sound& sound)
+    {
+        playing = &sound;
+        const auto& sample = *playing->sample;
+        reader.setSample(&sample);
+
+        position = 0.0;
+        increment = std::pow(2.0, (midiNoteNumber - playing->rootNote) / 12.0) * sample.sampleRate / sampleRate;
+        gain = velocity;
+
+        envelope.reset();
+        envelope.noteOn();
+    }
+
+    void stopNote(bool allowTailOff)
+    {
+        if (allowTailOff)
+        {
+            envelope.noteOff();
+            return;
+        }
+
+        // Voce rubata o note off immediato: la nota in corso sfuma su un breve tratto
+        if (playing != nullptr)
+        {
+            // Il lettore passa alla dissolvenza con i blocchi già decodificati: nessuna allocazione
+            std::swap(reader, fadeReader);
+            fade = { playing, position, increment, gain * envelope.getNextSample(), stealFadeSamples };
+        }
+
+        playing = nullptr;
+        note = -1;
+    }
+
+    void renderNextBlock(juce::AudioBuffer<float>& output, int startSample, int numSamples)
+    {
+        if (fade.remaining > 0)
+            renderFade(output, startSample, numSamples);
+
+        if (playing == nullptr)
+            return;
+
+        const int length = reader.getLength();
+        const int outputChannels = juce::jmin(2, output.getNumChannels());
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const int index = (int) position;
+            if (index + 1 >= length || !envelope.isActive())
+            {
+                playing = nullptr;
+                note = -1;
+                break;
+            }
+
+            const float frac = (float) (position - index);
+            const float amplitude = gain * envelope.getNextSample();
+            output.addSample(0, startSample + i, reader.interpolate(0, index, frac) * amplitude);
+            if (outputChannels > 1)
+                output.addSample(1, startSample + i, reader.interpolate(1, index, frac) * amplitude);
+
+            position += increment;
+        }
+    }
+
+private:
+    struct Fade
+    {
+        const Sound* sound = nullptr;
+        double position = 0.0;
+        double increment = 0.0;
+        float gain = 0.0f;
+        int remaining = 0;
+    };
+
+    void renderFade(juce::AudioBuffer<float>& output, int startSample, int numSamples)
+    {
+        const int outputChannels = juce::jmin(2, output.getNumChannels());
+        const int count = juce::jmin(numSamples, fade.remaining);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int index = (int) fade.position;
+            if (index + 1 >= fadeReader.getLength())
+            {
+                fade.remaining = 0;
+                return;
+            }
+
+            const float amplitude = fade.gain * (float) (fade.remaining - i) / (float) stealFadeSamples;
+            const float frac = (float) (fade.position - index);
+            output.addSample(0, startSample + i, fadeReader.interpolate(0, index, frac) * amplitude);
+            if (outputChannels > 1)
+                output.addSample(1, startSample + i, fadeReader.interpolate(1, index, frac) * amplitude);
+
+            fade.position += fade.increment;
+        }
+
+        fade.remaining -= count;
+    }
+
+    const Sound* playing = nullptr;
+    double sampleRate = 44100.0;
+    double position = 0.0;
+    double increment = 1.0;
+    float gain = 0.0f;
+
+    juce::ADSR envelope;
+    juce::ADSR::Parameters envelopeParameters;
+    Fade fade;
+    SampleReader reader, fadeReader;
+};
+
+//==============================================================================
+SamplerInstrument::SamplerInstrument(int numVoices)
+{
+    for (int i = 0; i < juce::jmax(1, numVoices); ++i)
+        voices.push_back(std::make_unique<Voice>());
+
+    // Il furto di voce ordina i candidati qui dentro: niente allocazioni durante il rendering
+    stealCandidates.reserve(voices.size());
+}
+
+SamplerInstrument::~SamplerInstrument() = default;
+
+bool SamplerInstrument::setZones(const std::vector<Zone>& zones, SampleCache& cache)
+{
+    // Lo strumento non è ancora collegato al motore: nessun altro thread lo sta suonando
+    for (auto& voice : voices)
+        voice->stopNote(false);
+    sounds.clear();
+
+    bool allLoaded = true;
+    for (auto const& zone : zones)
+    {
+        if (auto sample = cache.getOrLoad(zone.file))
+            sounds.push_back(std::make_unique<Sound>(std::move(sample), zone));
+        else
+            allLoaded = false;
+    }
+
+    return allLoaded;
+}
+
+void SamplerInstrument::prepare(double sampleRate, int)
+{
+    for (auto& voice : voices)
+        voice->setSampleRate(sampleRate);
+}
+
+void SamplerInstrument::render(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midi, int startSample, int numSamples)
+{
+    // Nessun lock: lo strumento lo suona un solo thread (l'audio thread, o il worker che ha uno
+    // strumento proprio). Il blocco si divide esattamente sul campione di ogni evento.
+    const int endSample = startSample + numSamples;
+    int position = startSample;
+    auto it = midi.findNextSamplePosition(startSample);
+
+    for (; it != midi.end(); ++it)
+    {
+        const auto metadata = *it;
+        if (metadata.samplePosition >= endSample)
+            break;
+
+        if (metadata.samplePosition > position)
+        {
+            renderVoices(buffer, position, metadata.samplePosition - position);
+            position = metadata.samplePosition;
+        }
+
+        handleMidiEvent(metadata.getMessage());
+    }
+
+    if (endSample > position)
+        renderVoices(buffer, position, endSample - position);
+
+    // Eventi oltre la fine del blocco: valgono subito, come in juce::Synthesiser
+    for (; it != midi.end(); ++it)
+        handleMidiEvent((*it).getMessage());
+}
+
+void SamplerInstrument::allNotesOff()
+{
+    for (auto& voice : voices)
+        voice->stopNote(false);
+
+    std::fill(std::begin(sustainPedalDown), std::end(sustainPedalDown), false);
+}
+
+void SamplerInstrument::renderVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    for (auto& voice : voices)
+        voice->renderNextBlock(buffer, startSample, numSamples);
+}
+
+void SamplerInstrument::handleMidiEvent(const juce::MidiMessage& message)
+{
+    const int channel = message.getChannel();
+
+    if (message.isNoteOn())
+        noteOn(channel, message.getNoteNumber(), message.getFloatVelocity());
+    else if (message.isNoteOff())
+        noteOff(channel, message.getNoteNumber());
+    else if (message.isAllNotesOff() || message.isAllSoundOff())
+    {
+        for (auto& voice : voices)
+            if (voice->channel == channel)
+                voice->stopNote(true);
+    }
+    else if (message.isSustainPedalOn() && channel >= 1 && channel <= 16)
+        sustainPedalDown[channel - 1] = true;
+    else if (message.isSustainPedalOff() && channel >= 1 && channel <= 16)
+    {
+        sustainPedalDown[channel - 1] = false;
+        for (auto& voice : voices)
+            if (voice->isActive() && voice->channel == channel && !voice->keyDown)
+                voice->stopNote(true);
+    }
+}
+
+void SamplerInstrument::noteOn(int channel, int note, float velocity)
+{
+    for (auto& sound : sounds)
+    {
+        if (!sound->appliesToNote(note))
+            continue;
+
+        // La stessa nota ancora in coda (es. tenuta dal pedale) si rilascia prima di ripartire
+        for (auto& voice : voices)
+            if (voice->note == note && voice->channel == channel)
+                voice->stopNote(true);
+
+        Voice* freeVoice = nullptr;
+        for (auto& voice : voices)
+        {
+            if (!voice->isActive())
+            {
+                freeVoice = voice.get();
+                break;
+            }
+        }
+
+        startVoice(freeVoice != nullptr ? *freeVoice : findVoiceToSteal(note), *sound, channel, note, velocity);
+    }
+}
+
+void SamplerInstrument::noteOff(int channel, int note)
+{
+    const bool sustained = channel >= 1 && channel <= 16 && sustainPedalDown[channel - 1];
+
+    for (auto& voice : voices)
+    {
+        if (voice->note != note || voice->channel != channel)
+            continue;
+
+        voice->keyDown = false;
+        if (!sustained)
+            voice->stopNote(true);
+    }
+}
+
+void SamplerInstrument::startVoice(Voice& voice, const Sound& sound, int channel, int note, float velocity)
+{
+    // Una voce rubata sfuma la nota precedente
+    if (voice.isActive())
+        voice.stopNote(false);
+
+    voice.note = note;
+    voice.channel = channel;
+    voice.noteOnTime = ++lastNoteOnCounter;
+    voice.keyDown = true;
+    voice.startNote(note, velocity, sound);
+}
+
+SamplerInstrument::Voice& SamplerInstrument::findVoiceToSteal(int note)
+{
+    // Stesse regole di juce::Synthesiser: prima le note più vecchie, proteggendo la più bassa e la
+    // più alta finché sono tenute. Qui tutte le voci sono attive.
+    stealCandidates.clear();
+    Voice* low = nullptr;
+    Voice* top = nullptr;
+
+    auto isReleased = [this](const Voice& voice)
+    {
+        const bool sustained = voice.channel >= 1 && voice.channel <= 16 && sustainPedalDown[voice.channel - 1];
+        return voice.isActive() && !voice.keyDown && !sustained;
+    };
+
+    for (auto& voice : voices)
+    {
+        stealCandidates.push_back(voice.get());
+
+        if (!isReleased(*voice))
+        {
+            if (low == nullptr || voice->note < low->note)
+                low = voice.get();
+            if (top == nullptr || voice->note > top->note)
+                top = voice.get();
+        }
+    }
+
+    std::sort(stealCandidates.begin(), stealCandidates.end(),
+              [](const Voice* a, const Voice* b) { return a->wasStartedBefore(*b); });
+
+    // Con una sola nota protetta si protegge solo quella
+    if (top == low)
+        top = nullptr;
+
+    for (auto* voice : stealCandidates)
+        if (voice->note == note)
+            return *voice;
+
+    for (auto* voice : stealCandidates)
+        if (voice != low && voice != top && isReleased(*voice))
+            return *voice;
+
+    for (auto* voice : stealCandidates)
+        if (voice != low && voice != top && !voice->keyDown)
+            return *voice;
+
+    for (auto* voice : stealCandidates)
+        if (voice != low && voice != top)
+            return *voice;
+
+    return top != nullptr ? *top : *low;
+}
+
+void SamplerInstrument::collectEvents(const std::vector<TimedMidiEvent>& events, juce::MidiBuffer& midi,
+                                      double blockStart, double timelinePerSample, int numSamples)
+{
+    // Ricerca binaria: nessuno stato da riallineare dopo un seek
+    const auto firstTime = (juce::int64) std::ceil(blockStart);
+    const auto endTime = (juce::int64) std::ceil(blockStart + numSamples * timelinePerSample);
+
+    midi.clear();
+    auto it = std::lower_bound(events.begin(), events.end(), firstTime,
+                               [](const TimedMidiEvent& e, juce::int64 time) { return e.time < time; });
+
+    for (; it != events.end() && it->time < endTime; ++it)
+        midi.addEvent(it->message, juce::jlimit(0, numSamples - 1, (int) ((it->time - blockStart) / timelinePerSample)));
+}
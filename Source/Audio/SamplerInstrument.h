@@ -0,0 +1,73 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "SampleCache.h"
+
+// Evento MIDI posizionato sulla timeline
+struct TimedMidiEvent
+{
+    juce::int64 time; // Campioni della timeline
+    juce::MidiMessage message;
+};
+
+// Campionatore multi-sample.
+// Le voci sono allocate tutte nel costruttore: durante il rendering non si alloca nulla e,
+// quando le voci finiscono, il furto segue le regole deterministiche di juce::Synthesiser
+// (nota più vecchia, proteggendo la più alta e la più bassa). Una voce rubata sfuma in pochi
+// campioni invece di interrompersi di colpo. Le voci non passano da juce::Synthesiser, che
+// prende il suo lock a ogni blocco: l'audio thread non ne prende nessuno.
+class SamplerInstrument
+{
+public:
+    // Zona di tastiera: il campione suona a altezza originale su rootNote
+    struct Zone
+    {
+        juce::File file;
+        int rootNote = 60;
+        int lowNote = 0;
+        int highNote = 127;
+    };
+
+    static constexpr int defaultNumVoices = 64;
+    static constexpr float releaseSeconds = 0.05f; // Coda di una nota dopo il note off
+
+    explicit SamplerInstrument(int numVoices = defaultNumVoices);
+    ~SamplerInstrument();
+
+    // Message thread, prima di collegare lo strumento al motore
+    bool setZones(const std::vector<Zone>& zones, SampleCache& cache);
+
+    void prepare(double sampleRate, int maximumBlockSize);
+
+    // --- Audio thread ---
+    // Gli eventi sono posizionati al campione esatto all'interno del blocco
+    void render(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midi, int startSample, int numSamples);
+    void allNotesOff();
+
+    // Eventi della sequenza (ordinata per tempo) che cadono nel blocco, ognuno al suo campione
+    // (blockStart in campioni della timeline). Non alloca se midi ha già lo spazio.
+    static void collectEvents(const std::vector<TimedMidiEvent>& events, juce::MidiBuffer& midi,
+                              double blockStart, double timelinePerSample, int numSamples);
+
+    int getNumVoices() const { return (int) voices.size(); }
+
+private:
+    class Sound;
+    class Voice;
+
+    void renderVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+    void handleMidiEvent(const juce::MidiMessage& message);
+    void noteOn(int channel, int note, float velocity);
+    void noteOff(int channel, int note);
+    void startVoice(Voice& voice, const Sound& sound, int channel, int note, float velocity);
+    Voice& findVoiceToSteal(int note);
+
+    std::vector<std::unique_ptr<Voice>> voices;
+    std::vector<std::unique_ptr<Sound>> sounds; // Cambiano solo prima di collegare lo strumento
+    std::vector<Voice*> stealCandidates;
+    juce::uint32 lastNoteOnCounter = 0;
+    bool sustainPedalDown[16] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplerInstrument)
+};
@@ -0,0 +1,108 @@
+#include "SpectrumAnalyzer.h"
+
+namespace
+{
+    constexpr float minimumDb = -100.0f;
+    constexpr float minimumFrequency = 20.0f;
+
+    // Mappa di colori per lo spettrogramma: nero -> viola -> giallo chiaro
+    juce::uint32 levelToPixel(float proportion)
+    {
+        const auto colour = proportion < 0.5f
+            ? juce::Colour(0xff10101b).interpolatedWith(juce::Colour(0xffB84EE6), proportion * 2.0f)
+            : juce::Colour(0xffB84EE6).interpolatedWith(juce::Colour(0xffFFE6A0), (proportion - 0.5f) * 2.0f);
+        return colour.getARGB();
+    }
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(AudioTap& tapToRead)
+    : juce::Thread("Spectrum Analyzer"),
+      tap(tapToRead),
+      history((size_t) fftSize, 0.0f),
+      fftData((size_t) fftSize * 2, 0.0f),
+      incoming((size_t) hopSize, 0.0f),
+      columnPixels((size_t) spectrogramColumns * spectrogramHeight, levelToPixel(0.0f))
+{
+    for (auto& level : binLevels)
+        level.store(minimumDb);
+
+    startThread(juce::Thread::Priority::low);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    stopThread(1000);
+}
+
+float SpectrumAnalyzer::rowToFrequency(int row, double sampleRate)
+{
+    const double nyquist = sampleRate * 0.5;
+    return (float) (minimumFrequency * std::pow(nyquist / minimumFrequency, row / (double) (spectrogramHeight - 1)));
+}
+
+void SpectrumAnalyzer::run()
+{
+    while (!threadShouldExit())
+    {
+        if (resetRequested.exchange(false))
+        {
+            tap.discardAll();
+            std::fill(history.begin(), history.end(), 0.0f);
+            samplesSinceLastFrame = 0;
+        }
+
+        // Un frame ogni hopSize campioni nuovi; se la presa è vuota si dorme fino al prossimo giro
+        const int wanted = hopSize - samplesSinceLastFrame;
+        const int pulled = tap.pull(incoming.data(), wanted);
+
+        if (pulled > 0)
+        {
+            std::move(history.begin() + pulled, history.end(), history.begin());
+            std::copy(incoming.begin(), incoming.begin() + pulled, history.end() - pulled);
+            samplesSinceLastFrame += pulled;
+        }
+
+        if (samplesSinceLastFrame >= hopSize)
+        {
+            samplesSinceLastFrame = 0;
+            analyseFrame();
+        }
+        else if (pulled < wanted)
+        {
+            wait(10);
+        }
+    }
+}
+
+void SpectrumAnalyzer::analyseFrame()
+{
+    std::copy(history.begin(), history.end(), fftData.begin());
+    window.multiplyWithWindowingTable(fftData.data(), (size_t) fftSize);
+    fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+    // Normalizzazione: una sinusoide a fondo scala (finestra di Hann, guadagno 0.5) vale 0 dB
+    const float scale = 4.0f / (float) fftSize;
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        const float db = juce::Decibels::gainToDecibels(fftData[(size_t) bin] * scale, minimumDb);
+
+        // Discesa morbida per la curva dello spettro, salita immediata
+        const float previous = binLevels[(size_t) bin].load(std::memory_order_relaxed);
+        binLevels[(size_t) bin].store(juce::jmax(db, previous - 1.5f), std::memory_order_relaxed);
+        fftData[(size_t) bin] = db;
+    }
+
+    // Nuova colonna dello spettrogramma, in frequenza logaritmica
+    const auto column = columnsProduced.load(std::memory_order_relaxed);
+    auto* pixels = columnPixels.data() + (size_t) (column % spectrogramColumns) * spectrogramHeight;
+    const double binWidth = sampleRate.load() / fftSize;
+
+    for (int row = 0; row < spectrogramHeight; ++row)
+    {
+        const int bin = juce::jlimit(1, numBins - 1, (int) (rowToFrequency(row, sampleRate.load()) / binWidth));
+        const float proportion = juce::jlimit(0.0f, 1.0f, (fftData[(size_t) bin] - minimumDb) / -minimumDb);
+        pixels[row] = levelToPixel(proportion);
+    }
+
+    columnsProduced.store(column + 1, std::memory_order_release);
+}
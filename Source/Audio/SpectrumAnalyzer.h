@@ -0,0 +1,70 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <vector>
+#include "AudioTap.h"
+
+// Analizzatore di spettro su un thread dedicato: legge da una AudioTap, calcola FFT
+// finestrate (Hann, sovrapposizione del 75%) e pubblica lo spettro corrente e le colonne
+// dello spettrogramma. L'audio thread non esegue FFT e non prende lock.
+class SpectrumAnalyzer : private juce::Thread
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 4;
+    static constexpr int numBins = fftSize / 2;
+
+    // Righe (in frequenza logaritmica) e colonne della memoria circolare dello spettrogramma
+    static constexpr int spectrogramHeight = 256;
+    static constexpr int spectrogramColumns = 1024;
+
+    explicit SpectrumAnalyzer(AudioTap& tapToRead);
+    ~SpectrumAnalyzer() override;
+
+    void setSampleRate(double newSampleRate) { sampleRate.store(newSampleRate > 0.0 ? newSampleRate : 44100.0); }
+    double getSampleRate() const { return sampleRate.load(); }
+
+    // Scarta i dati in coda (es. quando cambia la sorgente della presa)
+    void reset() { resetRequested.store(true); }
+
+    // --- Lettura (qualsiasi thread) ---
+    // Livello in dB di un bin dello spettro più recente
+    float getBinLevelDb(int bin) const { return binLevels[(size_t) juce::jlimit(0, numBins - 1, bin)].load(std::memory_order_relaxed); }
+
+    // Colonne prodotte finora; la colonna n occupa lo slot n % spectrogramColumns
+    juce::int64 getNumColumnsProduced() const { return columnsProduced.load(std::memory_order_acquire); }
+    // Pixel (ARGB) di uno slot, dal basso (20 Hz) verso l'alto (Nyquist)
+    const juce::uint32* getColumnPixels(juce::int64 column) const
+    {
+        return columnPixels.data() + (size_t) (column % spectrogramColumns) * spectrogramHeight;
+    }
+
+    // Frequenza associata a una riga dello spettrogramma (scala logaritmica)
+    static float rowToFrequency(int row, double sampleRate);
+
+private:
+    void run() override;
+    void analyseFrame();
+
+    AudioTap& tap;
+    std::atomic<double> sampleRate { 44100.0 };
+    std::atomic<bool> resetRequested { false };
+
+    juce::dsp::FFT fft { fftOrder };
+    juce::dsp::WindowingFunction<float> window { (size_t) fftSize, juce::dsp::WindowingFunction<float>::hann, false };
+
+    // Stato del thread di analisi
+    std::vector<float> history;     // Ultimi fftSize campioni
+    std::vector<float> fftData;     // 2 * fftSize, richiesto da performFrequencyOnlyForwardTransform
+    std::vector<float> incoming;
+    int samplesSinceLastFrame = 0;
+
+    std::array<std::atomic<float>, numBins> binLevels;
+    std::vector<juce::uint32> columnPixels;
+    std::atomic<juce::int64> columnsProduced { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumAnalyzer)
+};
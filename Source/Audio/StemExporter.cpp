@@ -0,0 +1,238 @@
+#include "StemExporter.h"
+#include "Tracer.h"
+
+namespace
+{
+    // Accumula i byte di un writer e li scarica sul file a blocchi di diskBatchBytes, sotto il
+    // lock condiviso: il disco vede poche scritture grandi e sequenziali invece di tante piccole.
+    class BatchedOutputStream : public juce::OutputStream
+    {
+    public:
+        BatchedOutputStream(const juce::File& file, juce::CriticalSection& sharedDiskLock)
+            : stream(file), diskLock(sharedDiskLock)
+        {
+            if (stream.openedOk())
+            {
+                stream.setPosition(0);
+                stream.truncate();
+            }
+            pending.ensureSize((size_t) StemExporter::diskBatchBytes);
+        }
+
+        ~BatchedOutputStream() override { flushBatch(); }
+
+        bool openedOk() const { return stream.openedOk(); }
+
+        void flush() override { flushBatch(); }
+        juce::int64 getPosition() override { return stream.getPosition() + (juce::int64) pending.getSize(); }
+
+        bool setPosition(juce::int64 newPosition) override
+        {
+            // Riscrittura dell'header a fine file: prima si scarica quanto accumulato
+            return flushBatch() && stream.setPosition(newPosition);
+        }
+
+        bool write(const void* data, size_t numBytes) override
+        {
+            pending.append(data, numBytes);
+            return pending.getSize() < (size_t) StemExporter::diskBatchBytes || flushBatch();
+        }
+
+    private:
+        bool flushBatch()
+        {
+            if (pending.getSize() == 0)
+                return true;
+
+            const juce::ScopedLock lock(diskLock);
+            const bool ok = stream.write(pending.getData(), pending.getSize());
+            stream.flush();
+            pending.setSize(0);
+            return ok;
+        }
+
+        juce::FileOutputStream stream;
+        juce::CriticalSection& diskLock;
+        juce::MemoryBlock pending;
+    };
+}
+
+//==============================================================================
+// Rendering e codifica di una traccia. Il renderer viene costruito dal thread chiamante
+// (apre i file), il job gira su un thread del pool.
+class StemExporter::StemJob : public juce::ThreadPoolJob
+{
+public:
+    StemJob(int id, std::unique_ptr<OfflineRenderer> rendererToUse, const juce::File& destination, int depth)
+        : juce::ThreadPoolJob("Stem " + juce::String(id)),
+          trackId(id), renderer(std::move(rendererToUse)), output(destination), bitDepth(depth)
+    {
+    }
+
+    bool open(juce::AudioFormat& format, int quality, juce::CriticalSection& diskLock)
+    {
+        auto stream = std::make_unique<BatchedOutputStream>(output.getFile(), diskLock);
+        if (!stream->openedOk())
+            return false;
+
+        writer.reset(format.createWriterFor(stream.get(), renderer->getSampleRate(), 2, bitDepth, {}, quality));
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // Ora appartiene al writer
+        return true;
+    }
+
+    JobStatus runJob() override
+    {
+        juce::AudioBuffer<float> block(2, blockSize);
+        const double length = (double) juce::jmax<juce::int64>(1, renderer->getLengthInSamples());
+
+        while (!renderer->isFinished())
+        {
+            if (shouldExit())
+                return jobHasFinished;
+
+            AW_TRACE_SCOPE("Stem block");
+            const int rendered = renderer->renderNextBlock(block, blockSize);
+            if (bitDepth < 32)
+                dither.process(block, 0, rendered, bitDepth, false);
+
+            if (!writer->writeFromAudioSampleBuffer(block, 0, rendered))
+            {
+                juce::Logger::writeToLog("StemExporter Error: Write failed for track " + juce::String(trackId));
+                return jobHasFinished;
+            }
+
+            progress.store(renderer->getPosition() / length, std::memory_order_relaxed);
+        }
+
+        writer.reset(); // Completa l'header e scarica l'ultimo blocco
+        succeeded.store(true);
+        return jobHasFinished;
+    }
+
+    // Tutti gli stem arrivano alla durata della sessione, anche se la traccia finisce prima
+    void extendTo(juce::int64 length) { renderer->extendTo(length); }
+    bool commit() { return output.overwriteTargetFileWithTemporary(); }
+
+    const int trackId;
+    std::atomic<double> progress { 0.0 };
+    std::atomic<bool> succeeded { false };
+
+private:
+    static constexpr int blockSize = 4096;
+
+    std::unique_ptr<OfflineRenderer> renderer;
+    juce::TemporaryFile output;
+    const int bitDepth;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    TpdfDither dither;
+};
+
+//==============================================================================
+juce::String StemExporter::getStemFileName(int trackId, const TrackState& track)
+{
+    juce::String name = "Track " + juce::String(trackId);
+    if (const auto* clip = track.getFirstClip())
+        name << " - " << clip->file.getFileNameWithoutExtension();
+    return juce::File::createLegalFileName(name);
+}
+
+juce::String StemExporter::getMidiStemFileName(int trackId)
+{
+    return juce::File::createLegalFileName("Track " + juce::String(trackId) + " - MIDI");
+}
+
+bool StemExporter::run(const SessionState& session, double sampleRate, const Options& options, ProgressCallback progress)
+{
+    auto* format = ExportPipeline::findFormat(formats, options.format);
+    if (format == nullptr || !options.directory.createDirectory())
+    {
+        juce::Logger::writeToLog("StemExporter Error: Cannot export to " + options.directory.getFullPathName());
+        return false;
+    }
+
+    const int bitDepth = options.format == ExportPipeline::Format::oggVorbis ? 32 : options.bitDepth;
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    // Un renderer per traccia (ognuno con i propri reader: i job non condividono stato)
+    juce::OwnedArray<StemJob> jobs;
+    juce::int64 sessionLength = 0;
+    bool ok = true;
+
+    auto addStem = [&](int trackId, const juce::String& fileName)
+    {
+        auto settings = options.render;
+        settings.onlyTrackId = trackId;
+        settings.applyTrackGain = options.postFader;
+
+        auto renderer = std::make_unique<OfflineRenderer>(formats, session, sampleRate, settings);
+        sessionLength = juce::jmax(sessionLength, renderer->getLengthInSamples());
+
+        const auto file = options.directory.getChildFile(fileName + ExportPipeline::getFileExtension(options.format));
+        auto* job = jobs.add(new StemJob(trackId, std::move(renderer), file, bitDepth));
+        if (!job->open(*format, options.oggQuality, diskLock))
+        {
+            juce::Logger::writeToLog("StemExporter Error: Cannot write " + file.getFullPathName());
+            ok = false;
+        }
+    };
+
+    session.tracks.forEach([&](int trackId, const TrackState& track)
+    {
+        if (ok && !track.clips.isEmpty())
+            addStem(trackId, getStemFileName(trackId, track));
+    });
+
+    // Una traccia con dei clip suona come traccia audio: il suo stem c'è già
+    for (auto const& [trackId, midi] : options.render.midiTracks)
+    {
+        const auto* audio = session.getTrack(trackId);
+        if (ok && (audio == nullptr || audio->clips.isEmpty()) && midi.events != nullptr && !midi.events->empty())
+            addStem(trackId, getMidiStemFileName(trackId));
+    }
+
+    if (!ok || jobs.isEmpty())
+        return false;
+
+    for (auto* job : jobs)
+        job->extendTo(sessionLength);
+
+    const int numThreads = options.numThreads > 0 ? options.numThreads : juce::SystemStats::getNumCpus();
+    juce::ThreadPool pool(juce::jmin(numThreads, jobs.size()));
+    for (auto* job : jobs)
+        pool.addJob(job, false);
+
+    std::map<int, double> stemProgress;
+    bool cancelled = false;
+    while (pool.getNumJobs() > 0)
+    {
+        for (auto* job : jobs)
+            stemProgress[job->trackId] = job->progress.load(std::memory_order_relaxed);
+
+        if (progress != nullptr && !progress(stemProgress))
+        {
+            cancelled = true;
+            break;
+        }
+
+        juce::Thread::sleep(50);
+    }
+
+    // Annullamento: i job si fermano al blocco successivo e i file temporanei vengono rimossi
+    pool.removeAllJobs(true, 10000);
+
+    int written = 0;
+    for (auto* job : jobs)
+    {
+        if (!cancelled && job->succeeded.load() && job->commit())
+            ++written;
+        else
+            ok = false;
+    }
+
+    juce::Logger::writeToLog("StemExporter: " + juce::String(written) + " of " + juce::String(jobs.size())
+                             + " stems written in " + juce::String((juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 2) + " s");
+    return ok;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <map>
+#include "ExportPipeline.h"
+#include "OfflineRenderer.h"
+
+// Export degli stem: ogni traccia (audio o MIDI) viene resa e codificata come job indipendente
+// su un ThreadPool grande quanto i core disponibili. Dopo il fader uno stem attraversa anche i
+// bus su cui la traccia è instradata (mandate e riverberi compresi), ma non il bus master. Tutti gli
+// stem hanno la durata della sessione, così si allineano dal primo campione. Le scritture su
+// disco passano da un unico lock e avvengono a blocchi grandi, per non alternare decine di
+// piccole scritture tra i file.
+class StemExporter
+{
+public:
+    struct Options
+    {
+        juce::File directory;
+        ExportPipeline::Format format = ExportPipeline::Format::wav;
+        int bitDepth = 24;
+        int oggQuality = 6;
+        bool postFader = true;   // Applica il volume della traccia (automazione e pan compresi) e i bus
+        // Stato da riprodurre oltre alla sessione (AudioEngine::getExportSettings): instradamento,
+        // automazione, pan e tracce MIDI. Traccia e fader li decide ogni stem.
+        OfflineRenderer::Settings render;
+        int numThreads = 0;      // 0 = un thread per core
+    };
+
+    // Avanzamento 0..1 per ID di traccia; restituire false annulla l'export
+    using ProgressCallback = std::function<bool(const std::map<int, double>&)>;
+
+    explicit StemExporter(juce::AudioFormatManager& formatManager) : formats(formatManager) {}
+
+    // Blocca fino alla fine; i file già completati restano anche se un altro stem fallisce
+    bool run(const SessionState& session, double sampleRate, const Options& options, ProgressCallback progress = nullptr);
+
+    static juce::String getStemFileName(int trackId, const TrackState& track);
+    static juce::String getMidiStemFileName(int trackId);
+
+    // Dimensione dei blocchi scritti su disco da ogni stem
+    static constexpr int diskBatchBytes = 4 * 1024 * 1024;
+
+private:
+    class StemJob;
+
+    juce::AudioFormatManager& formats;
+    juce::CriticalSection diskLock; // Una sola scrittura su disco alla volta
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemExporter)
+};
@@ -0,0 +1,261 @@
+#include "Tracer.h"
+
+#include <cstdio>
+
+std::atomic<bool> Tracer::enabled { false };
+
+//==============================================================================
+class Tracer::Writer : public juce::Thread
+{
+public:
+    Writer(Tracer& owner, std::unique_ptr<juce::FileOutputStream> output)
+        : juce::Thread("Trace Writer"), stream(std::move(output)), tracer(owner)
+    {
+    }
+
+    ~Writer() override
+    {
+        stopThread(2000);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            tracer.drain(*stream, false);
+            wait(50);
+        }
+    }
+
+    std::unique_ptr<juce::FileOutputStream> stream;
+
+private:
+    Tracer& tracer;
+};
+
+//==============================================================================
+Tracer::ThreadBuffer::ThreadBuffer()
+    : events((size_t) eventsPerThread)
+{
+}
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::Tracer()
+{
+   #if JUCE_LINUX || JUCE_MAC
+    // Le prime chiavi usano lo spazio già riservato nel thread: pthread_setspecific non alloca
+    threadExitKeyCreated = pthread_key_create(&threadExitKey, &Tracer::releaseThreadBuffer) == 0;
+   #endif
+}
+
+Tracer::~Tracer()
+{
+    stop();
+
+   #if JUCE_LINUX || JUCE_MAC
+    // I thread che terminano dopo non devono toccare buffer ormai distrutti
+    if (threadExitKeyCreated)
+        pthread_key_delete(threadExitKey);
+   #endif
+}
+
+bool Tracer::start(const juce::File& outputFile)
+{
+    stop();
+
+    auto stream = std::make_unique<juce::FileOutputStream>(outputFile);
+    if (!stream->openedOk())
+    {
+        juce::Logger::writeToLog("Tracer Error: Cannot write " + outputFile.getFullPathName());
+        return false;
+    }
+
+    stream->setPosition(0);
+    stream->truncate();
+    *stream << "{\"traceEvents\":[\n";
+
+    // Eventi rimasti nei ring da una registrazione precedente
+    juce::MemoryOutputStream discarded;
+    drain(discarded, true);
+
+    // Tutta la memoria dei thread si alloca qui, sul message thread
+    for (auto& buffer : threads)
+        if (buffer == nullptr)
+            buffer = std::make_unique<ThreadBuffer>();
+
+    file = outputFile;
+    firstEvent = true;
+    startTicks = juce::Time::getHighResolutionTicks();
+
+    writer = std::make_unique<Writer>(*this, std::move(stream));
+    writer->startThread();
+    enabled.store(true);
+
+    juce::Logger::writeToLog("Tracer: Recording to " + file.getFullPathName());
+    return true;
+}
+
+void Tracer::stop()
+{
+    if (writer == nullptr)
+        return;
+
+    enabled.store(false);
+    writer->stopThread(2000);
+
+    auto& stream = *writer->stream;
+    drain(stream, false);
+    stream << "\n]}\n";
+    stream.flush();
+    writer.reset();
+
+    juce::Logger::writeToLog("Tracer: Trace written to " + file.getFullPathName());
+}
+
+void Tracer::record(const char* name, char phase, juce::int64 value) noexcept
+{
+    auto* threadBuffer = getThreadBuffer();
+    if (threadBuffer == nullptr)
+    {
+        unassignedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& buffer = *threadBuffer;
+    int start1, size1, start2, size2;
+    buffer.fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.events[(size_t) start1] = { name, juce::Time::getHighResolutionTicks(), value, phase };
+    buffer.fifo.finishedWrite(1);
+}
+
+Tracer::ThreadBuffer* Tracer::getThreadBuffer() noexcept
+{
+    // Puntatore semplice: un thread_local con distruttore allocherebbe alla prima chiamata
+    thread_local ThreadBuffer* current = nullptr;
+    if (current == nullptr)
+        current = claimThreadBuffer();
+    return current;
+}
+
+Tracer::ThreadBuffer* Tracer::claimThreadBuffer() noexcept
+{
+    // I buffer esistono da quando start() ha acceso il tracing
+    if (!enabled.load(std::memory_order_acquire))
+        return nullptr;
+
+    for (auto& slot : threads)
+    {
+        auto* buffer = slot.get();
+        int expected = ThreadBuffer::free;
+        if (buffer == nullptr || !buffer->state.compare_exchange_strong(expected, ThreadBuffer::active))
+            continue;
+
+        // Prima traccia del thread: nessun lock e nessuna allocazione, anche sull'audio thread
+        buffer->threadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+
+        if (auto* thread = juce::Thread::getCurrentThread())
+            thread->getThreadName().copyToUTF8(buffer->threadName, sizeof(buffer->threadName));
+        else if (juce::MessageManager::getInstanceWithoutCreating() != nullptr
+                 && juce::MessageManager::getInstanceWithoutCreating()->isThisTheMessageThread())
+            std::snprintf(buffer->threadName, sizeof(buffer->threadName), "Message Thread");
+        else
+            std::snprintf(buffer->threadName, sizeof(buffer->threadName), "Thread %d", buffer->threadId); // Es. la callback del dispositivo
+
+       #if JUCE_LINUX || JUCE_MAC
+        if (threadExitKeyCreated)
+            pthread_setspecific(threadExitKey, buffer);
+       #endif
+        return buffer;
+    }
+
+    return nullptr;
+}
+
+void Tracer::releaseThreadBuffer(void* buffer)
+{
+    // Il thread è terminato: il writer scrive gli ultimi eventi e poi libera il buffer
+    static_cast<ThreadBuffer*>(buffer)->state.store(ThreadBuffer::retiring, std::memory_order_release);
+}
+
+void Tracer::drain(juce::OutputStream& out, bool discard)
+{
+    const double microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    auto beginEvent = [&]
+    {
+        out << (firstEvent ? "" : ",\n");
+        firstEvent = false;
+    };
+
+    for (auto& slot : threads)
+    {
+        auto* buffer = slot.get();
+        if (buffer == nullptr)
+            continue;
+
+        // Letto prima degli eventi: un buffer in ritiro contiene già tutti quelli del suo thread
+        const bool retiring = buffer->state.load(std::memory_order_acquire) == ThreadBuffer::retiring;
+
+        int start1, size1, start2, size2;
+        buffer->fifo.prepareToRead(buffer->fifo.getNumReady(), start1, size1, start2, size2);
+
+        if (!discard)
+        {
+            if (size1 > 0 || size2 > 0)
+            {
+                // Il nome del thread precede i suoi eventi (duplicati innocui se ripetuto)
+                beginEvent();
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                    << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            }
+
+            auto write = [&](int start, int size)
+            {
+                for (int i = start; i < start + size; ++i)
+                {
+                    const auto& event = buffer->events[(size_t) i];
+                    beginEvent();
+                    out << "{\"name\":\"" << event.name << "\",\"ph\":\"" << juce::String::charToString(event.phase)
+                        << "\",\"ts\":" << juce::String((double) (event.ticks - startTicks) * microsecondsPerTick, 3)
+                        << ",\"pid\":1,\"tid\":" << buffer->threadId;
+
+                    if (event.phase == 'i')
+                        out << ",\"s\":\"t\"";
+                    else if (event.phase == 'C')
+                        out << ",\"args\":{\"value\":" << event.value << "}";
+
+                    out << "}";
+                }
+            };
+
+            write(start1, size1);
+            write(start2, size2);
+
+            if (const int dropped = buffer->dropped.exchange(0))
+                juce::Logger::writeToLog("Tracer: " + juce::String(dropped) + " events dropped on " + juce::String(buffer->threadName));
+        }
+
+        buffer->fifo.finishedRead(size1 + size2);
+
+        if (retiring)
+        {
+            buffer->dropped.store(0, std::memory_order_relaxed);
+            buffer->state.store(ThreadBuffer::free, std::memory_order_release);
+        }
+    }
+
+    if (const int unassigned = unassignedEvents.exchange(0))
+        if (!discard)
+            juce::Logger::writeToLog("Tracer: " + juce::String(unassigned) + " events dropped on threads without a trace buffer");
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <pthread.h>
+#endif
+
+// Tracing a basso costo per vedere su un'unica timeline callback audio, letture da disco,
+// caricamenti, cache e repaint. Ogni thread scrive eventi binari di dimensione fissa nel
+// proprio ring lock-free; un thread in background li scrive nel formato JSON di Chrome
+// (apribile con chrome://tracing o ui.perfetto.dev). Con il tracing spento un punto di
+// traccia costa una lettura atomica e un salto.
+class Tracer
+{
+public:
+    static Tracer& getInstance();
+
+    // --- Message thread ---
+    bool start(const juce::File& outputFile);
+    void stop();
+    bool isRecording() const { return writer != nullptr; }
+    juce::File getOutputFile() const { return file; }
+
+    static bool isEnabled() noexcept { return enabled.load(std::memory_order_relaxed); }
+
+    // --- Qualsiasi thread ---
+    // name deve vivere per tutto il programma (una stringa letterale): si registra solo il puntatore
+    static void instant(const char* name) noexcept             { if (isEnabled()) getInstance().record(name, 'i', 0); }
+    static void counter(const char* name, juce::int64 value) noexcept { if (isEnabled()) getInstance().record(name, 'C', value); }
+
+    // Intervallo tra costruzione e distruzione (o per l'intero scope)
+    class Scope
+    {
+    public:
+        explicit Scope(const char* scopeName) noexcept : name(scopeName), active(isEnabled())
+        {
+            if (active)
+                getInstance().record(name, 'B', 0);
+        }
+
+        ~Scope()
+        {
+            if (active)
+                getInstance().record(name, 'E', 0);
+        }
+
+    private:
+        const char* const name;
+        const bool active;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+    // Eventi per thread: oltre, gli eventi vengono contati come persi finché il writer non svuota
+    static constexpr int eventsPerThread = 16384;
+    // Buffer preparati da start(). Un thread che traccia per la prima volta ne prende uno libero
+    // senza lock né allocazioni (anche l'audio thread); quando il thread termina il buffer, una
+    // volta svuotato, torna disponibile (Linux e macOS). Con tutti i buffer occupati gli eventi
+    // vanno persi.
+    static constexpr int maxThreads = 32;
+
+private:
+    struct Event
+    {
+        const char* name;
+        juce::int64 ticks;
+        juce::int64 value;
+        char phase; // 'B', 'E', 'i', 'C' come nel formato di Chrome
+    };
+
+    struct ThreadBuffer
+    {
+        ThreadBuffer();
+
+        enum State { free, active, retiring }; // retiring: thread terminato, eventi ancora da scrivere
+        std::atomic<int> state { free };
+
+        // Scritti dal thread proprietario prima del primo evento
+        int threadId = 0;
+        char threadName[64] = {};
+
+        std::vector<Event> events;
+        juce::AbstractFifo fifo { eventsPerThread };
+        std::atomic<int> dropped { 0 };
+    };
+
+    class Writer;
+
+    Tracer();
+    ~Tracer();
+
+    void record(const char* name, char phase, juce::int64 value) noexcept;
+    // nullptr se tutti i buffer sono occupati
+    ThreadBuffer* getThreadBuffer() noexcept;
+    ThreadBuffer* claimThreadBuffer() noexcept;
+    static void releaseThreadBuffer(void* buffer);
+    // Thread del writer: svuota i ring nel file
+    void drain(juce::OutputStream& out, bool discard);
+
+    static std::atomic<bool> enabled;
+
+    std::unique_ptr<ThreadBuffer> threads[maxThreads]; // Allocati da start(), mai liberati: i thread tengono un puntatore
+    std::atomic<int> nextThreadId { 1 };
+    std::atomic<int> unassignedEvents { 0 }; // Eventi di thread rimasti senza buffer
+   #if JUCE_LINUX || JUCE_MAC
+    pthread_key_t threadExitKey {}; // Il suo distruttore restituisce il buffer quando il thread termina
+    bool threadExitKeyCreated = false;
+   #endif
+    std::unique_ptr<Writer> writer;
+    juce::File file;
+    juce::int64 startTicks = 0;
+    bool firstEvent = true;
+};
+
+// Punto di traccia per lo scope corrente
+#define AW_TRACE_SCOPE(name) const Tracer::Scope JUCE_JOIN_MACRO(traceScope_, __LINE__) (name)
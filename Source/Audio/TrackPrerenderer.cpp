@@ -0,0 +1,296 @@
+#include "TrackPrerenderer.h"
+#include "Tracer.h"
+
+//==============================================================================
+PrerenderedTrack::PrerenderedTrack(RenderFunction renderFunction, double rate, int numChannels)
+    : render(std::move(renderFunction)),
+      sampleRate(rate > 0.0 ? rate : 44100.0),
+      ring(numChannels, capacityFrames),
+      scratch(numChannels, renderBlockFrames)
+{
+    ring.clear();
+}
+
+PrerenderedTrack::~PrerenderedTrack()
+{
+    // Va rimossa dal TrackPrerenderer prima della distruzione
+    jassert(!registered.load());
+}
+
+void PrerenderedTrack::begin(juce::int64 position, double timelinePosition, double timelinePerSample)
+{
+    if (hasStarted())
+        return;
+
+    const auto start = position + leadFrames;
+    timelineRatio = timelinePerSample;
+    timelineAtStart = timelinePosition + leadFrames * timelinePerSample;
+    readPosition.store(start, std::memory_order_relaxed);
+    startPosition.store(start, std::memory_order_release);
+}
+
+bool PrerenderedTrack::read(juce::AudioBuffer<float>& buffer, juce::int64 position, int numSamples)
+{
+    const auto start = startPosition.load(std::memory_order_relaxed);
+    const bool available = start >= 0 && position >= start && numSamples <= capacityFrames
+                           && position + numSamples <= writtenEnd.load(std::memory_order_acquire);
+
+    if (available)
+    {
+        const int ringStart = (int) (position % capacityFrames);
+        const int firstPart = juce::jmin(numSamples, capacityFrames - ringStart);
+        const int channels = juce::jmin(buffer.getNumChannels(), ring.getNumChannels());
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            buffer.copyFrom(ch, 0, ring, ch, ringStart, firstPart);
+            if (numSamples > firstPart)
+                buffer.copyFrom(ch, firstPart, ring, ch, 0, numSamples - firstPart);
+        }
+
+        for (int ch = channels; ch < buffer.getNumChannels(); ++ch)
+            buffer.clear(ch, 0, numSamples);
+    }
+
+    skip(position, numSamples);
+    return available;
+}
+
+void PrerenderedTrack::skip(juce::int64 position, int numSamples)
+{
+    // Prima della partenza resta fermo su startPosition: lo spazio è già tutto del worker
+    if (position + numSamples > readPosition.load(std::memory_order_relaxed))
+        readPosition.store(position + numSamples, std::memory_order_release);
+}
+
+void PrerenderedTrack::renderAhead()
+{
+    jassert(!registered.load());
+
+    while (wantsService())
+        service();
+}
+
+int PrerenderedTrack::getBufferedFrames() const
+{
+    return (int) juce::jmax<juce::int64>(0, writtenEnd.load(std::memory_order_acquire) - readPosition.load(std::memory_order_acquire));
+}
+
+double PrerenderedTrack::getSecondsUntilDry() const
+{
+    if (!hasStarted())
+        return std::numeric_limits<double>::max();
+
+    return preRolled ? getBufferedFrames() / sampleRate : 0.0;
+}
+
+bool PrerenderedTrack::wantsService() const
+{
+    if (!hasStarted())
+        return false;
+
+    return !preRolled || readPosition.load(std::memory_order_acquire) + capacityFrames - renderPosition >= renderBlockFrames;
+}
+
+double PrerenderedTrack::getTimelinePositionOf(juce::int64 position) const
+{
+    return timelineAtStart + (double) (position - startPosition.load(std::memory_order_relaxed)) * timelineRatio;
+}
+
+void PrerenderedTrack::service()
+{
+    const auto start = startPosition.load(std::memory_order_acquire);
+    if (start < 0)
+        return;
+
+    AW_TRACE_SCOPE("Prerender block");
+
+    if (!preRolled)
+    {
+        // Il tratto prima della partenza viene reso e scartato (mai prima dell'inizio della timeline)
+        const auto preRollFrames = juce::jmin((juce::int64) (preRollSeconds * sampleRate),
+                                              (juce::int64) (timelineAtStart / juce::jmax(1.0e-9, timelineRatio)));
+
+        for (auto position = start - preRollFrames; position < start;)
+        {
+            const int count = (int) juce::jmin<juce::int64>(renderBlockFrames, start - position);
+            scratch.clear(0, count);
+            render(scratch, getTimelinePositionOf(position), count);
+            position += count;
+        }
+
+        renderPosition = start;
+        preRolled = true;
+    }
+
+    // Se il worker è rimasto indietro, i blocchi già superati vengono resi lo stesso (e mai
+    // letti): lo stato dello strumento deve restare continuo
+    const auto consumed = readPosition.load(std::memory_order_acquire);
+    const int toRender = (int) juce::jmin<juce::int64>(renderBlockFrames, consumed + capacityFrames - renderPosition);
+    if (toRender <= 0)
+        return;
+
+    scratch.clear(0, toRender);
+    render(scratch, getTimelinePositionOf(renderPosition), toRender);
+
+    const int ringStart = (int) (renderPosition % capacityFrames);
+    const int firstPart = juce::jmin(toRender, capacityFrames - ringStart);
+    for (int ch = 0; ch < ring.getNumChannels(); ++ch)
+    {
+        ring.copyFrom(ch, ringStart, scratch, ch, 0, firstPart);
+        if (toRender > firstPart)
+            ring.copyFrom(ch, 0, scratch, ch, firstPart, toRender - firstPart);
+    }
+
+    renderPosition += toRender;
+    writtenEnd.store(renderPosition, std::memory_order_release);
+}
+
+//==============================================================================
+class TrackPrerenderer::Worker : public juce::Thread
+{
+public:
+    Worker(TrackPrerenderer& prerenderer, int index)
+        : juce::Thread("Prerender " + juce::String(index + 1)), owner(prerenderer)
+    {
+    }
+
+    void run() override { owner.runWorker(*this); }
+
+private:
+    TrackPrerenderer& owner;
+};
+
+TrackPrerenderer::TrackPrerenderer()
+{
+    startWorkers();
+}
+
+TrackPrerenderer::~TrackPrerenderer()
+{
+    stopWorkers();
+    jassert(tracks.isEmpty());
+}
+
+void TrackPrerenderer::setWorkerOptions(const WorkerOptions& options)
+{
+    stopWorkers();
+    workerOptions = options;
+    startWorkers();
+
+    juce::Logger::writeToLog("TrackPrerenderer: " + juce::String(workers.size()) + " workers"
+                             + (options.affinityMask != 0 ? ", affinity mask 0x" + juce::String::toHexString((int) options.affinityMask)
+                                                          : juce::String()));
+}
+
+void TrackPrerenderer::startWorkers()
+{
+    for (int i = 0; i < juce::jmax(1, workerOptions.numThreads); ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i));
+        if (workerOptions.affinityMask != 0)
+            worker->setAffinityMask(workerOptions.affinityMask);
+        worker->startThread(workerOptions.priority);
+    }
+}
+
+void TrackPrerenderer::stopWorkers()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto* worker : workers)
+    {
+        workAvailable.signal();
+        worker->stopThread(2000);
+    }
+
+    workers.clear();
+}
+
+void TrackPrerenderer::addTrack(PrerenderedTrack* track)
+{
+    jassert(track != nullptr);
+    {
+        const juce::ScopedLock sl(lock);
+        tracks.addIfNotAlreadyThere(track);
+        track->registered = true;
+    }
+    workAvailable.signal();
+}
+
+void TrackPrerenderer::removeTrack(PrerenderedTrack* track)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        tracks.removeFirstMatchingValue(track);
+        track->registered = false;
+    }
+
+    // Un worker potrebbe starla rendendo: aspettiamo che finisca il blocco
+    while (track->serviceInProgress.load(std::memory_order_acquire))
+        juce::Thread::sleep(1);
+}
+
+int TrackPrerenderer::getNumTracks() const
+{
+    const juce::ScopedLock sl(lock);
+    return tracks.size();
+}
+
+int TrackPrerenderer::getTotalUnderruns() const
+{
+    const juce::ScopedLock sl(lock);
+    int total = 0;
+    for (auto* track : tracks)
+        total += track->getUnderrunCount();
+    return total;
+}
+
+PrerenderedTrack* TrackPrerenderer::claimMostUrgentTrack(int& waitMs)
+{
+    const juce::ScopedLock sl(lock);
+
+    PrerenderedTrack* mostUrgent = nullptr;
+    double mostUrgentDeadline = std::numeric_limits<double>::max();
+    double nearestDeadline = 0.04;
+
+    for (auto* track : tracks)
+    {
+        if (track->serviceInProgress.load(std::memory_order_acquire))
+            continue;
+
+        const double deadline = track->getSecondsUntilDry();
+        nearestDeadline = juce::jmin(nearestDeadline, deadline);
+
+        if (deadline < mostUrgentDeadline && track->wantsService())
+        {
+            mostUrgent = track;
+            mostUrgentDeadline = deadline;
+        }
+    }
+
+    if (mostUrgent != nullptr)
+        mostUrgent->serviceInProgress.store(true, std::memory_order_release);
+
+    // Le tracce non ancora partite vengono viste al giro successivo (al più qualche ms)
+    waitMs = juce::jlimit(1, 10, (int) (nearestDeadline * 1000.0 / 4.0));
+    return mostUrgent;
+}
+
+void TrackPrerenderer::runWorker(juce::Thread& thread)
+{
+    while (!thread.threadShouldExit())
+    {
+        int waitMs = 10;
+
+        if (auto* track = claimMostUrgentTrack(waitMs))
+        {
+            track->service();
+            track->serviceInProgress.store(false, std::memory_order_release);
+            continue;
+        }
+
+        workAvailable.wait(waitMs);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+
+class TrackPrerenderer;
+
+// Traccia resa in anticipo dai worker del TrackPrerenderer su un ring lock-free (singolo
+// produttore, singolo consumatore). Le posizioni sono in campioni del dispositivo: al primo
+// blocco in cui la vede, l'audio thread fissa la partenza leadFrames più avanti, e finché il
+// ring non copre il blocco corrente la traccia continua a essere resa dal vivo.
+class PrerenderedTrack
+{
+public:
+    // Worker: rende numSamples nel buffer (già azzerato) a partire da timelinePosition.
+    // La funzione e lo stato che cattura appartengono al worker: l'audio thread non li tocca.
+    using RenderFunction = std::function<void(juce::AudioBuffer<float>& buffer, double timelinePosition, int numSamples)>;
+
+    PrerenderedTrack(RenderFunction renderFunction, double sampleRate, int numChannels = 2);
+    ~PrerenderedTrack();
+
+    // --- Audio thread ---
+    bool hasStarted() const { return startPosition.load(std::memory_order_relaxed) >= 0; }
+    // Fissa la partenza una sola volta; timelinePerSample converte i campioni del dispositivo in quelli della timeline
+    void begin(juce::int64 position, double timelinePosition, double timelinePerSample);
+    // Copia [position, position + numSamples) se il ring lo contiene; in ogni caso libera lo spazio precedente
+    bool read(juce::AudioBuffer<float>& buffer, juce::int64 position, int numSamples);
+    // Traccia silenziata: nessuna copia, lo spazio viene liberato lo stesso
+    void skip(juce::int64 position, int numSamples);
+    void reportUnderrun() { underruns.fetch_add(1, std::memory_order_relaxed); }
+
+    // Rendering offline, con la traccia non registrata presso un TrackPrerenderer: il lavoro
+    // dei worker viene fatto qui, finché il ring è pieno
+    void renderAhead();
+
+    // --- Statistiche (qualsiasi thread) ---
+    int getBufferedFrames() const;
+    int getUnderrunCount() const { return underruns.load(std::memory_order_relaxed); }
+
+    // Frame del ring, margine di partenza e blocco di rendering dei worker
+    static constexpr int capacityFrames = 32768;
+    static constexpr int leadFrames = 8192;
+    static constexpr int renderBlockFrames = 4096;
+    // Prima della partenza il worker rende (e scarta) questo tratto: le note già iniziate suonano
+    static constexpr double preRollSeconds = 4.0;
+
+private:
+    friend class TrackPrerenderer;
+
+    // --- Chiamati solo dal TrackPrerenderer, un worker alla volta ---
+    double getSecondsUntilDry() const;
+    bool wantsService() const;
+    void service();
+    double getTimelinePositionOf(juce::int64 position) const;
+
+    RenderFunction render;
+    const double sampleRate;
+    juce::AudioBuffer<float> ring, scratch;
+
+    // Partenza pubblicata dall'audio thread (-1 = non ancora fissata); la conversione verso
+    // la timeline è scritta prima della release su startPosition
+    std::atomic<juce::int64> startPosition { -1 };
+    double timelineAtStart = 0.0;
+    double timelineRatio = 1.0;
+
+    // Fine dei dati validi nel ring (worker) e posizione già consumata (audio thread)
+    std::atomic<juce::int64> writtenEnd { 0 };
+    std::atomic<juce::int64> readPosition { 0 };
+
+    // Solo worker
+    juce::int64 renderPosition = 0;
+    bool preRolled = false;
+
+    std::atomic<int> underruns { 0 };
+    std::atomic<bool> serviceInProgress { false };
+    std::atomic<bool> registered { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PrerenderedTrack)
+};
+
+// Pool di worker che rendono in anticipo, a blocchi grandi, le tracce che nessuno sta
+// suonando o modificando. Come il DiskStreamer, i worker servono sempre la traccia più
+// vicina a svuotarsi; numero, priorità e affinità dei thread sono configurabili.
+class TrackPrerenderer
+{
+public:
+    struct WorkerOptions
+    {
+        int numThreads = 2;
+        juce::Thread::Priority priority = juce::Thread::Priority::high;
+        juce::uint32 affinityMask = 0; // Bit per core; 0 = nessun vincolo
+    };
+
+    TrackPrerenderer();
+    ~TrackPrerenderer();
+
+    // Message thread: ferma e ricrea i worker (le tracce registrate restano)
+    void setWorkerOptions(const WorkerOptions& options);
+    WorkerOptions getWorkerOptions() const { return workerOptions; }
+
+    void addTrack(PrerenderedTrack* track);
+    // Rimuove la traccia e attende che nessun worker la stia rendendo
+    void removeTrack(PrerenderedTrack* track);
+
+    int getNumTracks() const;
+    int getTotalUnderruns() const;
+
+private:
+    class Worker;
+
+    void startWorkers();
+    void stopWorkers();
+    PrerenderedTrack* claimMostUrgentTrack(int& waitMs);
+    void runWorker(juce::Thread& thread);
+
+    WorkerOptions workerOptions;
+    mutable juce::CriticalSection lock; // Protegge solo la lista, mai preso dall'audio thread
+    juce::Array<PrerenderedTrack*> tracks;
+    juce::WaitableEvent workAvailable;
+    juce::OwnedArray<juce::Thread> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TrackPrerenderer)
+};
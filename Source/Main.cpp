@@ -1,5 +1,9 @@
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "Audio/ConvolutionReverb.h"
+#include "Audio/GoldenRender.h"
+#include "Audio/RealtimeSelfTest.h"
+#include <iostream>
 
 #define JUCE_APPLICATION_NAME_STRING "AudioWorkstation"
 #define JUCE_APPLICATION_VERSION_STRING "1.0.0"
@@ -15,6 +19,44 @@ public:
 
     void initialise(const juce::String& commandLine) override
     {
+        // Misura il costo del riverbero a convoluzione senza aprire la finestra
+        if (commandLine.contains("--benchmark-convolution"))
+        {
+            std::cout << ConvolutionReverb::runBenchmark() << std::endl;
+            quit();
+            return;
+        }
+
+        // Callback dell'engine sotto i controlli del tempo reale (build con AUDIOWORKSTATION_RT_CHECKS)
+        if (commandLine.contains("--check-realtime"))
+        {
+            juce::String report;
+            const bool passed = RealtimeSelfTest::run(report);
+            std::cout << report << std::flush;
+            setApplicationReturnValue(passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // Regressione del rendering: --record-golden / --verify-golden [cartella], predefinita ./Golden
+        const auto arguments = juce::StringArray::fromTokens(commandLine, true);
+        const bool recordGolden = arguments.contains("--record-golden");
+        if (recordGolden || arguments.contains("--verify-golden"))
+        {
+            const int option = arguments.indexOf(recordGolden ? "--record-golden" : "--verify-golden");
+            const auto path = arguments[option + 1].unquoted();
+            const auto directory = path.isNotEmpty() && !path.startsWith("--")
+                                       ? juce::File::getCurrentWorkingDirectory().getChildFile(path)
+                                       : juce::File::getCurrentWorkingDirectory().getChildFile("Golden");
+
+            juce::String report;
+            const bool passed = recordGolden ? GoldenRender::record(directory, report) : GoldenRender::verify(directory, report);
+            std::cout << report << std::flush;
+            setApplicationReturnValue(passed ? 0 : 1);
+            quit();
+            return;
+        }
+
         mainWindow.reset(new MainWindow(getApplicationName()));
     }
 
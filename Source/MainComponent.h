@@ -6,22 +6,33 @@
 #include "UI/TrackComponent.h"
 #include "UI/SidebarComponent.h"
 #include "UI/TransportPanel.h"
+#include "UI/SpectrumDisplay.h"
+#include "UI/ExportProgressWindow.h"
+#include "Session/SessionHistory.h"
+#include "Session/SessionJournal.h"
 
 class MainComponent : public juce::Component,
                       public juce::FileDragAndDropTarget,
                       public AudioEngine::Listener,
                       public TrackComponent::Listener,
-                      public SidebarComponent::Listener
+                      public SidebarComponent::Listener,
+                      public SessionHistory::Listener
 {
 public:
-    MainComponent() : transportPanel(audioEngine)
+    MainComponent() : transportPanel(audioEngine), spectrumDisplay(audioEngine)
     {
         lookAndFeel = std::make_unique<ModernLookAndFeel>();
         juce::LookAndFeel::setDefaultLookAndFeel(lookAndFeel.get());
         audioEngine.addListener(this);
+        history.addListener(this);
         sidebar.addListener(this);
         addAndMakeVisible(sidebar);
         addAndMakeVisible(transportPanel);
+        spectrumDisplay.onMasterSelected = [this] {
+            for (auto* track : tracks)
+                track->setSelected(false);
+        };
+        addAndMakeVisible(spectrumDisplay);
         tracksViewport.setViewedComponent(&tracksContainer, false);
         tracksViewport.setScrollBarsShown(true, true);
         addAndMakeVisible(tracksViewport);
@@ -30,12 +41,22 @@ public:
         addTrackButton.setColour(juce::TextButton::buttonColourId, juce::Colour(0x20FFFFFF));
         addTrackButton.onClick = [this] { addNewTrack(); };
         addAndMakeVisible(addTrackButton);
+        setWantsKeyboardFocus(true);
         setSize(1600, 900);
+
+        // Ripresa dall'autosalvataggio (istantanea + journal); da qui ogni edit finisce nel journal
+        SessionState recovered;
+        if (SessionJournal::recover(SessionJournal::getDefaultDirectory(), recovered))
+            history.restore(recovered);
+        journal.start(history.getCurrent());
+        history.addListener(&journal);
     }
 
     ~MainComponent() override
     {
         audioEngine.removeListener(this);
+        history.removeListener(this);
+        history.removeListener(&journal);
         sidebar.removeListener(this);
         juce::LookAndFeel::setDefaultLookAndFeel(nullptr);
     }
@@ -59,6 +80,7 @@ public:
         transportPanel.setBounds(mainArea.removeFromTop(70));
         auto addTrackButtonArea = mainArea.removeFromBottom(60);
         addTrackButton.setBounds(addTrackButtonArea.withSizeKeepingCentre(180, 40));
+        spectrumDisplay.setBounds(mainArea.removeFromBottom(140).reduced(10, 0));
         tracksViewport.setBounds(mainArea.reduced(10));
         updateTracksLayout();
     }
@@ -81,51 +103,77 @@ public:
         // CORREZIONE: Specifica Point<int> per risolvere ambiguità
         auto tracksContainerPos = tracksContainer.getLocalPoint(this, juce::Point<int>(x, y));
 
-        TrackComponent* targetTrack = nullptr;
+        int targetTrackId = 0;
         for (auto* track : tracks)
         {
             if (track->getBoundsInParent().contains(tracksContainerPos))
             {
-                targetTrack = track;
+                targetTrackId = track->getTrackNumber();
                 break;
             }
         }
 
-        if (targetTrack == nullptr)
+        if (files.isEmpty())
+            return;
+
+        juce::File file(files[0]);
+        if (!file.existsAsFile() || !isInterestedInFileDrag({file.getFullPathName()}))
         {
-             juce::Logger::writeToLog("File dropped outside a track, creating a new one.");
-             targetTrack = addNewTrack();
-             if (targetTrack)
-                 tracksViewport.setViewPosition(0, targetTrack->getY());
+            juce::Logger::writeToLog("Dropped file is not a valid audio file or doesn't exist.");
+            return;
         }
 
-        if (targetTrack != nullptr && !files.isEmpty())
+        if (targetTrackId == 0)
         {
-            juce::File file(files[0]);
-            if (file.existsAsFile() && isInterestedInFileDrag({file.getFullPathName()}))
-            {
-                juce::Logger::writeToLog("Loading dropped file '" + file.getFileName() + "' into track " + juce::String(targetTrack->getTrackNumber()));
-                targetTrack->loadFile(file);
-                audioEngine.loadFile(file, targetTrack->getTrackNumber());
-            }
-            else {
-                 juce::Logger::writeToLog("Dropped file is not a valid audio file or doesn't exist.");
-            }
+            // Nuova traccia e caricamento del file sono un unico passo di undo
+            juce::Logger::writeToLog("File dropped outside a track, creating a new one.");
+            targetTrackId = history.getCurrent().nextTrackId;
         }
+
+        juce::Logger::writeToLog("Loading dropped file '" + file.getFileName() + "' into track " + juce::String(targetTrackId));
+        history.perform(withFileLoaded(history.getCurrent(), targetTrackId, file), "Load File");
+
+        if (auto* track = findTrack(targetTrackId))
+            tracksViewport.setViewPosition(0, track->getY());
     }
 
     // --- Callback da AudioEngine::Listener ---
     void fileLoaded(const juce::File& file, int trackId) override
     {
         juce::Logger::writeToLog("MainComponent notified: File loaded for track " + juce::String(trackId));
+
+        // Le take registrate vengono caricate dall'engine: aggiorna la traccia corrispondente
+        for (auto* track : tracks)
+            if (track->getTrackNumber() == trackId && track->getAudioFile() != file)
+                track->loadFile(file);
     }
 
     void bpmChanged(int newBpm) override {
         juce::Logger::writeToLog("MainComponent notified: BPM changed to " + juce::String(newBpm));
+
+        // Le modifiche dal transport entrano nella sessione; quelle prodotte da undo/redo sono già allineate
+        if (history.getCurrent().bpm != newBpm)
+        {
+            auto state = history.getCurrent();
+            state.bpm = newBpm;
+            history.perform(state, "Change BPM");
+        }
     }
 
     void keyChanged(const juce::String& newKey) override {
          juce::Logger::writeToLog("MainComponent notified: Key changed to " + newKey);
+
+         if (history.getCurrent().key != newKey)
+         {
+             auto state = history.getCurrent();
+             state.key = newKey;
+             history.perform(state, "Change Key");
+         }
+    }
+
+    void takeRecorded(const juce::File& file, int trackId) override
+    {
+        history.perform(withFileLoaded(history.getCurrent(), trackId, file), "Record");
     }
 
 
@@ -137,23 +185,83 @@ public:
         int trackIdToRemove = trackToRemove->getTrackNumber();
         juce::Logger::writeToLog("MainComponent: Requesting removal of track ID " + juce::String(trackIdToRemove));
 
-        audioEngine.removeTrackAudio(trackIdToRemove);
+        // Il componente e l'audio vengono rimossi da sessionChanged; l'undo li ricrea
+        history.perform(history.getCurrent().withoutTrack(trackIdToRemove), "Delete Track");
+    }
+
+    void trackMuteToggled(TrackComponent* track, bool muted) override
+    {
+        editTrack(track->getTrackNumber(), muted ? "Mute" : "Unmute", [muted](TrackState& t) { t.muted = muted; });
+    }
+
+    void trackSoloToggled(TrackComponent* track, bool soloed) override
+    {
+        editTrack(track->getTrackNumber(), soloed ? "Solo" : "Unsolo", [soloed](TrackState& t) { t.soloed = soloed; });
+    }
 
-        int trackIndex = tracks.indexOf(trackToRemove);
-        if (trackIndex >= 0)
+    void trackGainChanged(TrackComponent* track, float gain) override
+    {
+        editTrack(track->getTrackNumber(), "Change Volume", [gain](TrackState& t) { t.gain = gain; });
+    }
+
+    void trackSelected(TrackComponent* track) override
+    {
+        // L'analizzatore segue la traccia selezionata; un click sull'analizzatore torna al master
+        audioEngine.setAnalyzerSource(track->getTrackNumber());
+        for (auto* t : tracks)
+            t->setSelected(t == track);
+        spectrumDisplay.repaint();
+    }
+
+    // --- Callback da SessionHistory::Listener ---
+    void sessionChanged(const SessionState& before, const SessionState& after) override
+    {
+        // Il motore riceve solo le differenze, poi la UI si allinea allo stesso diff
+        audioEngine.applySessionChange(before, after);
+
+        struct TrackVisitor
         {
-             juce::Logger::writeToLog("MainComponent: Found track at index " + juce::String(trackIndex) + ". Removing from UI and list.");
-             tracksContainer.removeChildComponent(tracks[trackIndex]);
-             tracks.remove(trackIndex, true); // true = delete the object
-             updateTracksLayout();
-             juce::Logger::writeToLog("MainComponent: Track removal complete.");
+            MainComponent& owner;
+            void added(int trackId, const TrackState& state)             { owner.createTrackComponent(trackId)->showState(state); }
+            void removed(int trackId, const TrackState&)                 { owner.deleteTrackComponent(trackId); }
+            void changed(int trackId, const TrackState&, const TrackState& state)
+            {
+                if (auto* track = owner.findTrack(trackId))
+                    track->showState(state);
+            }
+        } visitor { *this };
+
+        PersistentMap<int, TrackState>::diff(before.tracks, after.tracks, visitor);
+        updateTracksLayout();
+    }
+
+    bool keyPressed(const juce::KeyPress& key) override
+    {
+        const auto mods = key.getModifiers();
+        const auto keyCode = juce::CharacterFunctions::toUpperCase((juce::juce_wchar) key.getKeyCode());
+
+        if (mods.isCommandDown() && keyCode == 'Z')
+            return mods.isShiftDown() ? history.redo() : history.undo();
+
+        if (mods.isCommandDown() && keyCode == 'Y')
+            return history.redo();
+
+        if (mods.isCommandDown() && keyCode == 'E')
+        {
+            if (mods.isShiftDown())
+                exportStems();
+            else
+                exportMix();
+            return true;
         }
-        else
+
+        if (mods.isCommandDown() && keyCode == 'T')
         {
-             juce::Logger::writeToLog("MainComponent Error: Track to remove not found in the list!");
-             if (trackToRemove->getParentComponent() == &tracksContainer)
-                 tracksContainer.removeChildComponent(trackToRemove);
+            toggleTracing();
+            return true;
         }
+
+        return false;
     }
 
     // --- Callback da SidebarComponent::Listener ---
@@ -166,21 +274,167 @@ public:
 private:
     TrackComponent* addNewTrack()
     {
-        static int nextTrackId = 1;
-        const int newTrackId = nextTrackId++;
+        const int newTrackId = history.getCurrent().nextTrackId;
 
         juce::Logger::writeToLog("MainComponent: Adding new track with ID " + juce::String(newTrackId));
+        history.perform(history.getCurrent().withTrack(newTrackId, TrackState()), "Add Track");
 
-        auto* track = new TrackComponent(newTrackId, audioEngine);
+        auto* track = findTrack(newTrackId);
+        if (track != nullptr)
+            tracksViewport.setViewPosition(0, tracksContainer.getHeight() - track->getHeight() - 10);
+
+        return track;
+    }
+
+    // Registrazione di una traccia di profiling (chrome://tracing o ui.perfetto.dev)
+    void toggleTracing()
+    {
+        auto& tracer = Tracer::getInstance();
+        if (tracer.isRecording())
+        {
+            tracer.stop();
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::InfoIcon, "Trace saved",
+                                                   tracer.getOutputFile().getFullPathName());
+            return;
+        }
+
+        const auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                              .getNonexistentChildFile("AudioWorkstation Trace " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S"), ".json");
+        tracer.start(file);
+    }
+
+    // Export del mix in WAV, FLAC, Ogg Vorbis e una versione normalizzata, con un solo rendering
+    void exportMix()
+    {
+        exportChooser = std::make_unique<juce::FileChooser>("Export Mix",
+            juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("Mix.wav"), "*.wav");
+
+        exportChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles,
+                                   [this](const juce::FileChooser& chooser)
+        {
+            const auto file = chooser.getResult();
+            if (file == juce::File())
+                return;
+
+            using Format = ExportPipeline::Format;
+            std::vector<ExportPipeline::Target> targets(4);
+            targets[0].file = file.withFileExtension("wav");
+            targets[1].file = file.withFileExtension("flac");
+            targets[1].format = Format::flac;
+            targets[2].file = file.withFileExtension("ogg");
+            targets[2].format = Format::oggVorbis;
+            targets[3].file = file.getSiblingFile(file.getFileNameWithoutExtension() + " (normalized).wav");
+            targets[3].bitDepth = 16;
+            targets[3].normaliseLoudness = true;
+
+            // Sessione e stato dell'engine si fotografano qui, sul message thread
+            auto session = history.getCurrent();
+            auto settings = audioEngine.getExportSettings();
+            (new ExportProgressWindow("Exporting mix...", [this, session, settings, targets](ExportProgressWindow& window)
+            {
+                return audioEngine.exportMix(session, settings, targets, [&window](double progress)
+                {
+                    window.setProgress(progress);
+                    return !window.threadShouldExit();
+                });
+            }))->launchThread();
+        });
+    }
+
+    // Uno stem per traccia nella cartella scelta, con l'avanzamento di ognuno
+    void exportStems()
+    {
+        exportChooser = std::make_unique<juce::FileChooser>("Export Stems",
+            juce::File::getSpecialLocation(juce::File::userDocumentsDirectory));
+
+        exportChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                                   [this](const juce::FileChooser& chooser)
+        {
+            StemExporter::Options options;
+            options.directory = chooser.getResult();
+            if (options.directory == juce::File())
+                return;
+
+            auto session = history.getCurrent();
+            options.render = audioEngine.getExportSettings();
+            (new ExportProgressWindow("Exporting stems...", [this, session, options](ExportProgressWindow& window)
+            {
+                return audioEngine.exportStems(session, options, [&window](const std::map<int, double>& stems)
+                {
+                    double total = 0.0;
+                    juce::StringArray lines;
+                    for (auto const& [trackId, progress] : stems)
+                    {
+                        total += progress;
+                        lines.add("Track " + juce::String(trackId) + ": " + juce::String(juce::roundToInt(progress * 100.0)) + "%");
+                    }
+
+                    window.setProgress(stems.empty() ? 0.0 : total / (double) stems.size());
+                    window.setStatusMessage(lines.joinIntoString("   "));
+                    return !window.threadShouldExit();
+                });
+            }))->launchThread();
+        });
+    }
+
+    // Il file diventa l'unico clip della traccia, in loop (creando la traccia se non esiste)
+    static SessionState withFileLoaded(const SessionState& state, int trackId, const juce::File& file)
+    {
+        TrackState track = state.getTrack(trackId) != nullptr ? *state.getTrack(trackId) : TrackState();
+        track.clips = PersistentMap<int, Clip>();
+        track.looping = true;
+
+        Clip clip;
+        clip.file = file;
+        return state.withTrack(trackId, track).withNewClip(trackId, clip);
+    }
+
+    template <typename Edit>
+    void editTrack(int trackId, const juce::String& description, Edit&& edit)
+    {
+        const auto* current = history.getCurrent().getTrack(trackId);
+        if (current == nullptr)
+            return;
+
+        TrackState track = *current;
+        edit(track);
+        if (!(track == *current))
+            history.perform(history.getCurrent().withTrack(trackId, track), description);
+    }
+
+    TrackComponent* findTrack(int trackId) const
+    {
+        for (auto* track : tracks)
+            if (track->getTrackNumber() == trackId)
+                return track;
+        return nullptr;
+    }
+
+    TrackComponent* createTrackComponent(int trackId)
+    {
+        auto* track = new TrackComponent(trackId, audioEngine);
         track->addListener(this);
-        tracks.add(track);
-        tracksContainer.addAndMakeVisible(track);
-        updateTracksLayout();
-        tracksViewport.setViewPosition(0, tracksContainer.getHeight() - track->getHeight() - 10);
 
+        // Le tracce restano in ordine di ID anche quando l'undo ne ripristina una in mezzo
+        int index = 0;
+        while (index < tracks.size() && tracks[index]->getTrackNumber() < trackId)
+            ++index;
+
+        tracks.insert(index, track);
+        tracksContainer.addAndMakeVisible(track);
         return track;
     }
 
+    void deleteTrackComponent(int trackId)
+    {
+        if (auto* track = findTrack(trackId))
+        {
+            tracksContainer.removeChildComponent(track);
+            tracks.removeObject(track, true); // true = delete the object
+            juce::Logger::writeToLog("MainComponent: Track " + juce::String(trackId) + " removed from UI.");
+        }
+    }
+
     void updateTracksLayout()
     {
         const int trackHeight = 140;
@@ -206,11 +460,15 @@ private:
 
     SidebarComponent sidebar;
     TransportPanel transportPanel;
+    SpectrumDisplay spectrumDisplay;
     juce::Viewport tracksViewport;
     juce::Component tracksContainer;
     juce::TextButton addTrackButton;
 
     juce::OwnedArray<TrackComponent> tracks;
+    SessionHistory history;
+    SessionJournal journal;
+    std::unique_ptr<juce::FileChooser> exportChooser;
 
     int sidebarWidth = 220;
 
@@ -0,0 +1,152 @@
+#include "ClipEdits.h"
+
+namespace
+{
+    // Clip della sessione, purché sia ancora quello risolto dal motore (stesso file)
+    const Clip* findClip(const SessionState& state, int trackId, int clipId)
+    {
+        const auto* track = state.getTrack(trackId);
+        return track != nullptr ? track->clips.find(clipId) : nullptr;
+    }
+
+    bool matchesSession(const SessionState& state, int trackId, const ResolvedClip& source)
+    {
+        const auto* clip = findClip(state, trackId, source.clip.id);
+        return clip != nullptr && clip->file == source.clip.file;
+    }
+
+    // Il tratto letto resta dentro il file (un campione di tolleranza per l'arrotondamento di sourceOffset)
+    bool fitsSource(const ResolvedClip& source, const Clip& clip)
+    {
+        return clip.length > 0 && clip.timelineStart >= 0 && clip.sourceOffset >= 0
+            && (double) clip.sourceOffset + (double) clip.length * source.sourceRatio <= (double) source.sourceLength + 1.0;
+    }
+
+    juce::int64 toSourceSamples(const ResolvedClip& source, juce::int64 timelineSamples)
+    {
+        return (juce::int64) std::llround((double) timelineSamples * source.sourceRatio);
+    }
+
+    void limitFades(Clip& clip)
+    {
+        clip.fadeInLength = juce::jlimit<juce::int64>(0, clip.length, clip.fadeInLength);
+        clip.fadeOutLength = juce::jlimit<juce::int64>(0, clip.length, clip.fadeOutLength);
+    }
+
+    SessionState withClip(const SessionState& state, int trackId, const Clip& clip)
+    {
+        return state.withTrack(trackId, state.getTrack(trackId)->withClip(clip));
+    }
+
+    template <typename Edit>
+    SessionState editClip(const SessionState& state, int trackId, int clipId, Edit&& edit)
+    {
+        const auto* current = findClip(state, trackId, clipId);
+        if (current == nullptr)
+            return state;
+
+        Clip clip = *current;
+        edit(clip);
+        return clip == *current ? state : withClip(state, trackId, clip);
+    }
+}
+
+//==============================================================================
+SessionState ClipEdits::trimStart(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 newStart)
+{
+    if (!matchesSession(state, trackId, source))
+        return state;
+
+    Clip clip = source.clip;
+    const auto delta = newStart - clip.timelineStart;
+    clip.timelineStart = newStart;
+    clip.length -= delta;
+
+    // Il contenuto resta fermo: in avanti l'inizio del clip è l'inizio del tratto nel file,
+    // al contrario ne è la fine (e sourceOffset non cambia)
+    if (!clip.reversed)
+        clip.sourceOffset += toSourceSamples(source, delta);
+
+    if (delta == 0 || !fitsSource(source, clip))
+        return state;
+
+    limitFades(clip);
+    return withClip(state, trackId, clip);
+}
+
+SessionState ClipEdits::trimEnd(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 newEnd)
+{
+    if (!matchesSession(state, trackId, source))
+        return state;
+
+    Clip clip = source.clip;
+    const auto delta = newEnd - clip.getTimelineEnd();
+    clip.length += delta;
+
+    if (clip.reversed)
+        clip.sourceOffset -= toSourceSamples(source, delta);
+
+    if (delta == 0 || !fitsSource(source, clip))
+        return state;
+
+    limitFades(clip);
+    return withClip(state, trackId, clip);
+}
+
+SessionState ClipEdits::split(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 position)
+{
+    const auto& clip = source.clip;
+    const auto leftLength = position - clip.timelineStart;
+    if (!matchesSession(state, trackId, source) || leftLength <= 0 || leftLength >= clip.length)
+        return state;
+
+    Clip left = clip;
+    left.length = leftLength;
+    left.fadeOutLength = 0;
+
+    Clip right = clip;
+    right.timelineStart = position;
+    right.length = clip.length - leftLength;
+    right.fadeInLength = 0;
+
+    // Al contrario la parte sinistra suona la fine del tratto nel file
+    if (clip.reversed)
+        left.sourceOffset += toSourceSamples(source, right.length);
+    else
+        right.sourceOffset += toSourceSamples(source, leftLength);
+
+    limitFades(left);
+    limitFades(right);
+    return withClip(state, trackId, left).withNewClip(trackId, right);
+}
+
+SessionState ClipEdits::setFades(const SessionState& state, int trackId, int clipId, juce::int64 fadeIn, juce::int64 fadeOut)
+{
+    return editClip(state, trackId, clipId, [=](Clip& clip)
+    {
+        clip.fadeInLength = juce::jmax<juce::int64>(0, fadeIn);
+        clip.fadeOutLength = juce::jmax<juce::int64>(0, fadeOut);
+    });
+}
+
+SessionState ClipEdits::setGain(const SessionState& state, int trackId, int clipId, float gain)
+{
+    return editClip(state, trackId, clipId, [=](Clip& clip) { clip.gain = juce::jmax(0.0f, gain); });
+}
+
+SessionState ClipEdits::reverse(const SessionState& state, int trackId, int clipId)
+{
+    return editClip(state, trackId, clipId, [](Clip& clip) { clip.reversed = !clip.reversed; });
+}
+
+SessionState ClipEdits::duplicate(const SessionState& state, int trackId, int clipId,
+                                  int destinationTrackId, juce::int64 timelineStart)
+{
+    const auto* clip = findClip(state, trackId, clipId);
+    if (clip == nullptr || timelineStart < 0)
+        return state;
+
+    Clip copy = *clip;
+    copy.timelineStart = timelineStart;
+    return state.withNewClip(destinationTrackId, copy);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SessionState.h"
+
+// Edit non distruttivi dei clip. Un clip è solo un riferimento a un tratto di un file che non
+// cambia mai: tagliare, dividere, aggiungere fade o guadagno, rovesciare e duplicare producono
+// una nuova istantanea della sessione con clip diversi, senza copiare campioni (un duplicato
+// costa un nodo della mappa persistente). Solo AudioEngine::bakeClip, chiamato esplicitamente,
+// scrive campioni nuovi.
+//
+// Ogni funzione restituisce la sessione invariata se l'edit non è possibile. Tagli e divisioni
+// vogliono il clip risolto dal motore (AudioEngine::getResolvedClip): durata effettiva e misure
+// del file servono per spostare sourceOffset e per non uscire dal file.
+namespace ClipEdits
+{
+    // Sposta l'inizio del clip (il contenuto resta fermo sulla timeline); può anche allungarlo
+    SessionState trimStart(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 newStart);
+    // Sposta la fine del clip, accorciandolo o allungandolo fin dove arriva il file
+    SessionState trimEnd(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 newEnd);
+    // Divide il clip in position: la parte destra diventa un clip nuovo sullo stesso file
+    SessionState split(const SessionState& state, int trackId, const ResolvedClip& source, juce::int64 position);
+
+    // Durate dei fade in campioni della timeline (limitate dal motore alla durata del clip)
+    SessionState setFades(const SessionState& state, int trackId, int clipId, juce::int64 fadeIn, juce::int64 fadeOut);
+    SessionState setGain(const SessionState& state, int trackId, int clipId, float gain);
+    // Inverte il verso di lettura; i fade restano agli estremi del clip sulla timeline
+    SessionState reverse(const SessionState& state, int trackId, int clipId);
+    // Copia del clip che inizia a timelineStart, sulla stessa traccia o su un'altra
+    SessionState duplicate(const SessionState& state, int trackId, int clipId,
+                           int destinationTrackId, juce::int64 timelineStart);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+
+// Mappa ordinata immutabile con condivisione strutturale (treap persistente).
+// Ogni modifica restituisce una nuova mappa copiando solo il cammino dalla radice al nodo
+// toccato (O(log n) nodi): versioni diverse condividono tutto il resto.
+// La priorità di ogni nodo dipende solo dalla chiave, quindi la forma dell'albero è unica
+// per un dato insieme di chiavi: il diff tra due versioni salta i sottoalberi condivisi e
+// costa O(d log n), con d elementi cambiati.
+template <typename Key, typename Value>
+class PersistentMap
+{
+public:
+    PersistentMap() = default;
+
+    const Value* find(const Key& key) const
+    {
+        for (auto* node = root.get(); node != nullptr;)
+        {
+            if (key < node->key)       node = node->left.get();
+            else if (node->key < key)  node = node->right.get();
+            else                       return &node->value;
+        }
+        return nullptr;
+    }
+
+    bool contains(const Key& key) const { return find(key) != nullptr; }
+    int size() const { return sizeOf(root); }
+    bool isEmpty() const { return root == nullptr; }
+
+    // Stessa radice = stesso contenuto, senza visitare nulla
+    bool isSameAs(const PersistentMap& other) const { return root == other.root; }
+
+    PersistentMap set(const Key& key, Value value) const
+    {
+        return PersistentMap(insert(root, key, std::move(value), priorityOf(key)));
+    }
+
+    PersistentMap erase(const Key& key) const
+    {
+        return PersistentMap(remove(root, key));
+    }
+
+    // Visita in ordine di chiave
+    template <typename Function>
+    void forEach(Function&& function) const
+    {
+        visit(root, function);
+    }
+
+    // Confronta due versioni chiamando visitor.added(key, value), visitor.removed(key, value)
+    // e visitor.changed(key, before, after). Value deve avere operator==.
+    template <typename Visitor>
+    static void diff(const PersistentMap& before, const PersistentMap& after, Visitor& visitor)
+    {
+        diffNodes(before.root, after.root, visitor);
+    }
+
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node
+    {
+        Key key;
+        Value value;
+        juce::uint32 priority;
+        NodePtr left, right;
+        int size;
+    };
+
+    explicit PersistentMap(NodePtr newRoot) : root(std::move(newRoot)) {}
+
+    static juce::uint32 priorityOf(const Key& key)
+    {
+        // Finalizzatore di MurmurHash3: priorità pseudo-casuali ma deterministiche
+        auto h = (juce::uint32) std::hash<Key>()(key);
+        h ^= h >> 16; h *= 0x85ebca6bu;
+        h ^= h >> 13; h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Ordine totale tra le priorità (a parità di hash decide la chiave)
+    static bool isAbove(const Node& a, const Node& b)
+    {
+        return a.priority > b.priority || (a.priority == b.priority && a.key < b.key);
+    }
+
+    static bool isAbove(juce::uint32 priority, const Key& key, const Node& node)
+    {
+        return priority > node.priority || (priority == node.priority && key < node.key);
+    }
+
+    static int sizeOf(const NodePtr& node) { return node != nullptr ? node->size : 0; }
+
+    static NodePtr makeNode(const Key& key, Value value, juce::uint32 priority, NodePtr left, NodePtr right)
+    {
+        const int size = 1 + sizeOf(left) + sizeOf(right);
+        return std::make_shared<const Node>(Node { key, std::move(value), priority, std::move(left), std::move(right), size });
+    }
+
+    static NodePtr withChildren(const Node& node, NodePtr left, NodePtr right)
+    {
+        return makeNode(node.key, node.value, node.priority, std::move(left), std::move(right));
+    }
+
+    // Divide in (< key, > key); key non è presente
+    static std::pair<NodePtr, NodePtr> split(const NodePtr& node, const Key& key)
+    {
+        if (node == nullptr)
+            return {};
+
+        if (node->key < key)
+        {
+            auto [left, right] = split(node->right, key);
+            return { withChildren(*node, node->left, std::move(left)), std::move(right) };
+        }
+
+        auto [left, right] = split(node->left, key);
+        return { std::move(left), withChildren(*node, std::move(right), node->right) };
+    }
+
+    // Unisce due alberi con tutte le chiavi di a minori di quelle di b
+    static NodePtr merge(const NodePtr& a, const NodePtr& b)
+    {
+        if (a == nullptr) return b;
+        if (b == nullptr) return a;
+
+        if (isAbove(*a, *b))
+            return withChildren(*a, a->left, merge(a->right, b));
+
+        return withChildren(*b, merge(a, b->left), b->right);
+    }
+
+    static NodePtr insert(const NodePtr& node, const Key& key, Value value, juce::uint32 priority)
+    {
+        if (node == nullptr)
+            return makeNode(key, std::move(value), priority, nullptr, nullptr);
+
+        if (!(key < node->key) && !(node->key < key))
+            return makeNode(key, std::move(value), priority, node->left, node->right);
+
+        // Una chiave già presente sta sotto i nodi di priorità maggiore, quindi qui è sicuramente nuova
+        if (isAbove(priority, key, *node))
+        {
+            auto [left, right] = split(node, key);
+            return makeNode(key, std::move(value), priority, std::move(left), std::move(right));
+        }
+
+        if (key < node->key)
+            return withChildren(*node, insert(node->left, key, std::move(value), priority), node->right);
+
+        return withChildren(*node, node->left, insert(node->right, key, std::move(value), priority));
+    }
+
+    static NodePtr remove(const NodePtr& node, const Key& key)
+    {
+        if (node == nullptr)
+            return node;
+
+        if (key < node->key)
+        {
+            auto left = remove(node->left, key);
+            return left == node->left ? node : withChildren(*node, std::move(left), node->right);
+        }
+
+        if (node->key < key)
+        {
+            auto right = remove(node->right, key);
+            return right == node->right ? node : withChildren(*node, node->left, std::move(right));
+        }
+
+        return merge(node->left, node->right);
+    }
+
+    template <typename Function>
+    static void visit(const NodePtr& node, Function&& function)
+    {
+        if (node == nullptr)
+            return;
+
+        visit(node->left, function);
+        function(node->key, node->value);
+        visit(node->right, function);
+    }
+
+    template <typename Visitor>
+    static void diffNodes(const NodePtr& before, const NodePtr& after, Visitor& visitor)
+    {
+        if (before == after)
+            return; // Sottoalbero condiviso: nessuna differenza
+
+        if (before == nullptr)
+        {
+            visit(after, [&](const Key& key, const Value& value) { visitor.added(key, value); });
+            return;
+        }
+
+        if (after == nullptr)
+        {
+            visit(before, [&](const Key& key, const Value& value) { visitor.removed(key, value); });
+            return;
+        }
+
+        if (!(before->key < after->key) && !(after->key < before->key))
+        {
+            if (!(before->value == after->value))
+                visitor.changed(before->key, before->value, after->value);
+
+            diffNodes(before->left, after->left, visitor);
+            diffNodes(before->right, after->right, visitor);
+            return;
+        }
+
+        // La radice è la chiave di priorità massima: se le radici differiscono, quella più
+        // in alto non può esistere nell'altra versione
+        if (isAbove(*before, *after))
+        {
+            visitor.removed(before->key, before->value);
+            diffNodes(merge(before->left, before->right), after, visitor);
+        }
+        else
+        {
+            visitor.added(after->key, after->value);
+            diffNodes(before, merge(after->left, after->right), visitor);
+        }
+    }
+
+    NodePtr root;
+};
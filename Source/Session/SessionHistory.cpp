@@ -0,0 +1,57 @@
+#include "SessionHistory.h"
+
+SessionHistory::SessionHistory(int maxUndoSteps)
+    : maxSteps(juce::jmax(1, maxUndoSteps))
+{
+}
+
+void SessionHistory::perform(SessionState newState, const juce::String& description)
+{
+    undoStack.push_back({ current, description });
+    if ((int) undoStack.size() > maxSteps)
+        undoStack.pop_front();
+
+    redoStack.clear();
+    moveTo(std::move(newState));
+}
+
+void SessionHistory::restore(SessionState state)
+{
+    undoStack.clear();
+    redoStack.clear();
+    moveTo(std::move(state));
+}
+
+bool SessionHistory::undo()
+{
+    if (undoStack.empty())
+        return false;
+
+    auto step = std::move(undoStack.back());
+    undoStack.pop_back();
+    redoStack.push_back({ current, step.description });
+
+    juce::Logger::writeToLog("Session: Undo " + step.description);
+    moveTo(std::move(step.state));
+    return true;
+}
+
+bool SessionHistory::redo()
+{
+    if (redoStack.empty())
+        return false;
+
+    auto step = std::move(redoStack.back());
+    redoStack.pop_back();
+    undoStack.push_back({ current, step.description });
+
+    juce::Logger::writeToLog("Session: Redo " + step.description);
+    moveTo(std::move(step.state));
+    return true;
+}
+
+void SessionHistory::moveTo(SessionState newState)
+{
+    const auto before = std::exchange(current, std::move(newState));
+    listeners.call(&Listener::sessionChanged, before, current);
+}
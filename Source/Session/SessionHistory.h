@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include "SessionState.h"
+
+// Cronologia di undo/redo: ogni voce è un'istantanea completa della sessione, ma grazie alla
+// condivisione strutturale occupa solo i nodi cambiati dall'edit. Undo e redo scambiano la
+// radice corrente e notificano il diff ai listener (motore audio e UI).
+class SessionHistory
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+        // La sessione è passata da before ad after (edit, undo o redo)
+        virtual void sessionChanged(const SessionState& before, const SessionState& after) = 0;
+    };
+
+    explicit SessionHistory(int maxUndoSteps = 1000);
+
+    const SessionState& getCurrent() const { return current; }
+
+    // Registra un nuovo stato come passo annullabile (la cronologia di redo viene scartata)
+    void perform(SessionState newState, const juce::String& description);
+
+    // Sostituisce la sessione senza un passo di undo (es. ripristino all'avvio); svuota la cronologia
+    void restore(SessionState state);
+
+    bool undo();
+    bool redo();
+    bool canUndo() const { return !undoStack.empty(); }
+    bool canRedo() const { return !redoStack.empty(); }
+    juce::String getUndoDescription() const { return canUndo() ? undoStack.back().description : juce::String(); }
+    juce::String getRedoDescription() const { return canRedo() ? redoStack.back().description : juce::String(); }
+
+    void addListener(Listener* listener) { listeners.add(listener); }
+    void removeListener(Listener* listener) { listeners.remove(listener); }
+
+private:
+    struct Step
+    {
+        SessionState state;
+        juce::String description;
+    };
+
+    void moveTo(SessionState newState);
+
+    const int maxSteps;
+    SessionState current;
+    std::deque<Step> undoStack;
+    std::deque<Step> redoStack;
+
+    juce::ListenerList<Listener> listeners;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionHistory)
+};
@@ -0,0 +1,438 @@
+#include "SessionJournal.h"
+
+namespace
+{
+    // Checksum dei record (FNV-1a a 32 bit): un record scritto a metà da un crash non viene applicato
+    juce::uint32 checksum(const void* data, size_t numBytes)
+    {
+        juce::uint32 value = 2166136261u;
+        auto* bytes = static_cast<const juce::uint8*>(data);
+        for (size_t i = 0; i < numBytes; ++i)
+            value = (value ^ bytes[i]) * 16777619u;
+        return value;
+    }
+
+    //==========================================================================
+    juce::var clipToVar(const Clip& clip)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("id", clip.id);
+        object->setProperty("file", clip.file.getFullPathName());
+        object->setProperty("timelineStart", clip.timelineStart);
+        object->setProperty("sourceOffset", clip.sourceOffset);
+        object->setProperty("length", clip.length);
+        object->setProperty("fadeIn", clip.fadeInLength);
+        object->setProperty("fadeOut", clip.fadeOutLength);
+        object->setProperty("gain", clip.gain);
+        object->setProperty("reversed", clip.reversed);
+        return juce::var(object);
+    }
+
+    Clip clipFromVar(const juce::var& value)
+    {
+        Clip clip;
+        clip.id = value["id"];
+        clip.file = juce::File(value["file"].toString());
+        clip.timelineStart = value["timelineStart"];
+        clip.sourceOffset = value["sourceOffset"];
+        clip.length = value["length"];
+        clip.fadeInLength = value["fadeIn"];
+        clip.fadeOutLength = value["fadeOut"];
+        clip.gain = value["gain"];
+        clip.reversed = value["reversed"]; // Assente nei journal precedenti: false
+        return clip;
+    }
+
+    void setTrackProperties(juce::DynamicObject& object, const TrackState& track)
+    {
+        object.setProperty("looping", track.looping);
+        object.setProperty("gain", track.gain);
+        object.setProperty("muted", track.muted);
+        object.setProperty("soloed", track.soloed);
+    }
+
+    void readTrackProperties(const juce::var& value, TrackState& track)
+    {
+        track.looping = value["looping"];
+        track.gain = value["gain"];
+        track.muted = value["muted"];
+        track.soloed = value["soloed"];
+    }
+
+    bool hasSameTrackProperties(const TrackState& a, const TrackState& b)
+    {
+        return a.looping == b.looping && a.gain == b.gain && a.muted == b.muted && a.soloed == b.soloed;
+    }
+
+    void setSessionProperties(juce::DynamicObject& object, const SessionState& session)
+    {
+        object.setProperty("bpm", session.bpm);
+        object.setProperty("key", session.key);
+        object.setProperty("nextTrackId", session.nextTrackId);
+        object.setProperty("nextClipId", session.nextClipId);
+    }
+
+    void readSessionProperties(const juce::var& value, SessionState& session)
+    {
+        session.bpm = value["bpm"];
+        session.key = value["key"].toString();
+        session.nextTrackId = value["nextTrackId"];
+        session.nextClipId = value["nextClipId"];
+    }
+
+    bool hasSameSessionProperties(const SessionState& a, const SessionState& b)
+    {
+        return a.bpm == b.bpm && a.key == b.key && a.nextTrackId == b.nextTrackId && a.nextClipId == b.nextClipId;
+    }
+
+    juce::var sessionToVar(const SessionState& session)
+    {
+        auto* object = new juce::DynamicObject();
+        setSessionProperties(*object, session);
+
+        juce::Array<juce::var> tracks;
+        session.tracks.forEach([&tracks](int trackId, const TrackState& track)
+        {
+            auto* trackObject = new juce::DynamicObject();
+            trackObject->setProperty("id", trackId);
+            setTrackProperties(*trackObject, track);
+
+            juce::Array<juce::var> clips;
+            track.clips.forEach([&clips](int, const Clip& clip) { clips.add(clipToVar(clip)); });
+            trackObject->setProperty("clips", clips);
+            tracks.add(juce::var(trackObject));
+        });
+
+        object->setProperty("tracks", tracks);
+        return juce::var(object);
+    }
+
+    SessionState sessionFromVar(const juce::var& value)
+    {
+        SessionState session;
+        if (auto* tracks = value["tracks"].getArray())
+        {
+            for (auto const& trackValue : *tracks)
+            {
+                TrackState track;
+                readTrackProperties(trackValue, track);
+                if (auto* clips = trackValue["clips"].getArray())
+                    for (auto const& clipValue : *clips)
+                        track = track.withClip(clipFromVar(clipValue));
+
+                session = session.withTrack(trackValue["id"], std::move(track));
+            }
+        }
+
+        readSessionProperties(value, session);
+        return session;
+    }
+
+    //==========================================================================
+    // Record del journal: ognuno descrive un solo cambiamento, applicabile in ordine
+    juce::var makeRecord(const char* op)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("op", op);
+        return juce::var(object);
+    }
+
+    void applyRecord(SessionState& session, const juce::var& record)
+    {
+        const auto op = record["op"].toString();
+        const int trackId = record["track"];
+        const auto* existing = session.getTrack(trackId);
+        auto track = existing != nullptr ? *existing : TrackState();
+
+        if (op == "session")
+        {
+            readSessionProperties(record, session);
+        }
+        else if (op == "track")
+        {
+            readTrackProperties(record, track);
+            session = session.withTrack(trackId, std::move(track));
+        }
+        else if (op == "removeTrack")
+        {
+            session = session.withoutTrack(trackId);
+        }
+        else if (op == "clip")
+        {
+            session = session.withTrack(trackId, track.withClip(clipFromVar(record["clip"])));
+        }
+        else if (op == "removeClip")
+        {
+            session = session.withTrack(trackId, track.withoutClip(record["clip"]));
+        }
+    }
+}
+
+//==============================================================================
+SessionJournal::SessionJournal(const juce::File& journalDirectory)
+    : juce::Thread("Session Journal"), directory(journalDirectory)
+{
+}
+
+SessionJournal::~SessionJournal()
+{
+    signalThreadShouldExit();
+    editsAvailable.signal();
+    stopThread(10000);
+}
+
+juce::File SessionJournal::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+               .getChildFile("AudioWorkstation").getChildFile("Autosave");
+}
+
+bool SessionJournal::recover(const juce::File& directory, SessionState& state)
+{
+    const auto snapshotFile = getSnapshotFile(directory);
+    if (!snapshotFile.existsAsFile())
+        return false;
+
+    const auto snapshot = juce::JSON::parse(snapshotFile);
+    if (!snapshot.isObject())
+    {
+        juce::Logger::writeToLog("SessionJournal Error: Unreadable snapshot " + snapshotFile.getFullPathName());
+        return false;
+    }
+
+    state = sessionFromVar(snapshot["session"]);
+
+    int applied = 0;
+    juce::FileInputStream journalStream(getJournalFile(directory, (juce::int64) snapshot["generation"]));
+    if (journalStream.openedOk())
+    {
+        juce::MemoryBlock payload;
+        while (journalStream.getNumBytesRemaining() >= 8)
+        {
+            const int size = journalStream.readInt();
+            const auto expected = (juce::uint32) journalStream.readInt();
+            if (size <= 0 || size > journalStream.getNumBytesRemaining())
+                break;
+
+            payload.setSize((size_t) size);
+            journalStream.read(payload.getData(), size);
+            if (checksum(payload.getData(), payload.getSize()) != expected)
+                break;
+
+            applyRecord(state, juce::JSON::parse(payload.toString()));
+            ++applied;
+        }
+    }
+
+    juce::Logger::writeToLog("SessionJournal: Recovered " + juce::String(state.tracks.size()) + " tracks ("
+                             + juce::String(applied) + " journal records after the snapshot)");
+    return true;
+}
+
+void SessionJournal::start(const SessionState& initialState)
+{
+    {
+        const juce::ScopedLock lock(queueLock);
+        queue.push_back({ initialState, initialState, true });
+    }
+
+    startThread(juce::Thread::Priority::low);
+    editsAvailable.signal();
+}
+
+void SessionJournal::sessionChanged(const SessionState& before, const SessionState& after)
+{
+    {
+        const juce::ScopedLock lock(queueLock);
+        queue.push_back({ before, after, false });
+    }
+    editsAvailable.signal();
+}
+
+int SessionJournal::getNumPendingEdits() const
+{
+    const juce::ScopedLock lock(queueLock);
+    return (int) queue.size();
+}
+
+void SessionJournal::run()
+{
+    while (!threadShouldExit())
+    {
+        editsAvailable.wait(1000);
+        writePendingEdits();
+    }
+
+    // Uscita: gli ultimi edit e un'istantanea completa (il prossimo avvio non deve rileggere il journal)
+    writePendingEdits();
+    if (started)
+        compact(lastWritten);
+}
+
+void SessionJournal::writePendingEdits()
+{
+    std::deque<Edit> edits;
+    {
+        const juce::ScopedLock lock(queueLock);
+        std::swap(edits, queue);
+    }
+
+    if (edits.empty())
+        return;
+
+    for (auto const& edit : edits)
+    {
+        if (edit.snapshot)
+        {
+            started = compact(edit.after) || started;
+        }
+        else if (started)
+        {
+            appendRecords(edit.before, edit.after);
+        }
+
+        lastWritten = edit.after;
+    }
+
+    // Un solo flush (con fsync) per gruppo di edit
+    if (journal != nullptr)
+        journal->flush();
+
+    if (recordsInJournal >= compactAfterRecords)
+        compact(lastWritten);
+}
+
+void SessionJournal::appendRecords(const SessionState& before, const SessionState& after)
+{
+    if (journal == nullptr)
+        return;
+
+    if (!hasSameSessionProperties(before, after))
+    {
+        auto record = makeRecord("session");
+        setSessionProperties(*record.getDynamicObject(), after);
+        writeRecord(record);
+    }
+
+    // Il diff salta i sottoalberi condivisi: si visitano solo tracce e clip cambiati
+    struct ClipVisitor
+    {
+        SessionJournal& owner;
+        int trackId;
+
+        void added(int, const Clip& clip)               { write(clip); }
+        void changed(int, const Clip&, const Clip& clip) { write(clip); }
+        void removed(int clipId, const Clip&)
+        {
+            auto record = makeRecord("removeClip");
+            record.getDynamicObject()->setProperty("track", trackId);
+            record.getDynamicObject()->setProperty("clip", clipId);
+            owner.writeRecord(record);
+        }
+
+        void write(const Clip& clip)
+        {
+            auto record = makeRecord("clip");
+            record.getDynamicObject()->setProperty("track", trackId);
+            record.getDynamicObject()->setProperty("clip", clipToVar(clip));
+            owner.writeRecord(record);
+        }
+    };
+
+    struct TrackVisitor
+    {
+        SessionJournal& owner;
+
+        void added(int trackId, const TrackState& track)
+        {
+            writeTrack(trackId, track);
+            ClipVisitor clips { owner, trackId };
+            PersistentMap<int, Clip>::diff({}, track.clips, clips);
+        }
+
+        void removed(int trackId, const TrackState&)
+        {
+            auto record = makeRecord("removeTrack");
+            record.getDynamicObject()->setProperty("track", trackId);
+            owner.writeRecord(record);
+        }
+
+        void changed(int trackId, const TrackState& previous, const TrackState& track)
+        {
+            if (!hasSameTrackProperties(previous, track))
+                writeTrack(trackId, track);
+
+            ClipVisitor clips { owner, trackId };
+            PersistentMap<int, Clip>::diff(previous.clips, track.clips, clips);
+        }
+
+        void writeTrack(int trackId, const TrackState& track)
+        {
+            auto record = makeRecord("track");
+            record.getDynamicObject()->setProperty("track", trackId);
+            setTrackProperties(*record.getDynamicObject(), track);
+            owner.writeRecord(record);
+        }
+    } visitor { *this };
+
+    PersistentMap<int, TrackState>::diff(before.tracks, after.tracks, visitor);
+}
+
+void SessionJournal::writeRecord(const juce::var& record)
+{
+    const auto text = juce::JSON::toString(record, true);
+    const auto* utf8 = text.toRawUTF8();
+    const auto size = text.getNumBytesAsUTF8();
+
+    // [dimensione][checksum][JSON]: alla rilettura un record incompleto o corrotto si riconosce
+    journal->writeInt((int) size);
+    journal->writeInt((int) checksum(utf8, size));
+    journal->write(utf8, size);
+    ++recordsInJournal;
+}
+
+bool SessionJournal::compact(const SessionState& state)
+{
+    if (!directory.createDirectory())
+    {
+        juce::Logger::writeToLog("SessionJournal Error: Cannot create " + directory.getFullPathName());
+        return false;
+    }
+
+    const auto newGeneration = juce::jmax(generation + 1, juce::Time::currentTimeMillis());
+
+    auto* object = new juce::DynamicObject();
+    object->setProperty("generation", newGeneration);
+    object->setProperty("session", sessionToVar(state));
+
+    // L'istantanea sostituisce la precedente con un rename: un crash lascia l'una o l'altra, mai metà
+    juce::TemporaryFile temporary(getSnapshotFile(directory));
+    {
+        juce::FileOutputStream stream(temporary.getFile());
+        if (!stream.openedOk() || !stream.writeText(juce::JSON::toString(juce::var(object)), false, false, nullptr))
+        {
+            juce::Logger::writeToLog("SessionJournal Error: Cannot write snapshot in " + directory.getFullPathName());
+            return false;
+        }
+        stream.flush();
+    }
+
+    if (!temporary.overwriteTargetFileWithTemporary())
+        return false;
+
+    // Da qui vale la nuova generazione: i journal precedenti non servono più
+    journal.reset();
+    for (auto const& file : directory.findChildFiles(juce::File::findFiles, false, "journal-*.bin"))
+        file.deleteFile();
+
+    generation = newGeneration;
+    recordsInJournal = 0;
+    journal = std::make_unique<juce::FileOutputStream>(getJournalFile(directory, generation));
+    if (!journal->openedOk())
+    {
+        juce::Logger::writeToLog("SessionJournal Error: Cannot open journal in " + directory.getFullPathName());
+        journal.reset();
+    }
+
+    return true;
+}
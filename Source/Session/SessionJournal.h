@@ -0,0 +1,72 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include "SessionHistory.h"
+
+// Autosalvataggio a prova di crash: ogni cambio di sessione diventa qualche piccolo record in
+// coda a un journal (solo append), scritto e sincronizzato su disco da un thread in background.
+// Il message thread accoda soltanto la coppia prima/dopo (due istantanee, copiarle costa come
+// copiare pochi puntatori); il diff e la scrittura avvengono sul writer, quindi il costo
+// dipende dalla dimensione dell'edit e non della sessione. Periodicamente l'intera sessione
+// viene scritta in un'istantanea e il journal ricomincia da zero.
+class SessionJournal : public SessionHistory::Listener,
+                       private juce::Thread
+{
+public:
+    explicit SessionJournal(const juce::File& directory = getDefaultDirectory());
+    // Scrive gli edit in coda e un'istantanea finale
+    ~SessionJournal() override;
+
+    static juce::File getDefaultDirectory();
+
+    // Ultima istantanea più i record validi del journal (un record troncato da un crash chiude
+    // la lettura). false se non c'è niente da recuperare.
+    static bool recover(const juce::File& directory, SessionState& state);
+
+    // Message thread, una volta sola: lo stato di partenza diventa la prima istantanea
+    void start(const SessionState& initialState);
+
+    // --- SessionHistory::Listener ---
+    void sessionChanged(const SessionState& before, const SessionState& after) override;
+
+    int getNumPendingEdits() const;
+
+    // Record oltre i quali il journal viene compattato in una nuova istantanea
+    static constexpr int compactAfterRecords = 1000;
+
+private:
+    struct Edit
+    {
+        SessionState before, after;
+        bool snapshot = false; // Solo l'istantanea di after, senza record
+    };
+
+    void run() override;
+    void writePendingEdits();
+    void appendRecords(const SessionState& before, const SessionState& after);
+    void writeRecord(const juce::var& record);
+    // Nuova istantanea e nuovo journal vuoto; il journal precedente viene eliminato
+    bool compact(const SessionState& state);
+
+    static juce::File getSnapshotFile(const juce::File& directory) { return directory.getChildFile("session.json"); }
+    static juce::File getJournalFile(const juce::File& directory, juce::int64 generation)
+    {
+        return directory.getChildFile("journal-" + juce::String(generation) + ".bin");
+    }
+
+    const juce::File directory;
+
+    mutable juce::CriticalSection queueLock;
+    std::deque<Edit> queue;
+    juce::WaitableEvent editsAvailable;
+
+    // Solo writer thread
+    std::unique_ptr<juce::FileOutputStream> journal;
+    juce::int64 generation = 0; // Cresce anche tra un avvio e l'altro: un journal vecchio non combacia mai
+    int recordsInJournal = 0;
+    SessionState lastWritten;
+    bool started = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionJournal)
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PersistentMap.h"
+#include "../Audio/ClipTrackSource.h"
+
+// Stato di una traccia nella sessione. È un valore: le modifiche producono una copia,
+// che condivide con l'originale la mappa dei clip non toccata.
+struct TrackState
+{
+    PersistentMap<int, Clip> clips;
+    bool looping = false;  // Tracce create trascinando un file: il clip si ripete come prima
+    float gain = 0.8f;
+    bool muted = false;
+    bool soloed = false;
+
+    TrackState withClip(const Clip& clip) const        { auto t = *this; t.clips = clips.set(clip.id, clip); return t; }
+    TrackState withoutClip(int clipId) const           { auto t = *this; t.clips = clips.erase(clipId); return t; }
+
+    // Primo clip della traccia (quello che la UI mostra come file della traccia)
+    const Clip* getFirstClip() const
+    {
+        const Clip* first = nullptr;
+        clips.forEach([&first](int, const Clip& clip)
+        {
+            if (first == nullptr || clip.timelineStart < first->timelineStart)
+                first = &clip;
+        });
+        return first;
+    }
+
+    bool operator==(const TrackState& other) const
+    {
+        return clips.isSameAs(other.clips) && looping == other.looping && gain == other.gain
+            && muted == other.muted && soloed == other.soloed;
+    }
+};
+
+// Istantanea immutabile dell'intera sessione. Copiarla costa come copiare pochi puntatori:
+// la cronologia di undo conserva solo i nodi effettivamente cambiati tra una versione e l'altra.
+struct SessionState
+{
+    PersistentMap<int, TrackState> tracks;
+    int bpm = 120;
+    juce::String key = "C Minor";
+    int nextTrackId = 1;
+    int nextClipId = 1;
+
+    const TrackState* getTrack(int trackId) const { return tracks.find(trackId); }
+
+    SessionState withTrack(int trackId, TrackState track) const
+    {
+        auto s = *this;
+        s.tracks = tracks.set(trackId, std::move(track));
+        s.nextTrackId = juce::jmax(nextTrackId, trackId + 1);
+        return s;
+    }
+
+    SessionState withoutTrack(int trackId) const { auto s = *this; s.tracks = tracks.erase(trackId); return s; }
+
+    // Aggiunge un clip assegnandogli un ID univoco nella sessione
+    SessionState withNewClip(int trackId, Clip clip) const
+    {
+        auto s = *this;
+        clip.id = s.nextClipId++;
+        const auto* track = getTrack(trackId);
+        s.tracks = tracks.set(trackId, (track != nullptr ? *track : TrackState()).withClip(clip));
+        s.nextTrackId = juce::jmax(nextTrackId, trackId + 1);
+        return s;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+
+// Finestra di avanzamento per gli export: il lavoro gira su un thread in background e la
+// finestra si elimina da sola alla fine. Il task aggiorna avanzamento e messaggio e
+// restituisce false in caso di errore.
+class ExportProgressWindow : public juce::ThreadWithProgressWindow
+{
+public:
+    using Task = std::function<bool(ExportProgressWindow&)>;
+
+    ExportProgressWindow(const juce::String& title, Task taskToRun)
+        : juce::ThreadWithProgressWindow(title, true, true), task(std::move(taskToRun))
+    {
+    }
+
+    void run() override
+    {
+        succeeded = task(*this);
+    }
+
+    void threadComplete(bool userPressedCancel) override
+    {
+        if (!succeeded && !userPressedCancel)
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Export failed",
+                                                   "The export could not be completed. Check the log for details.");
+        delete this;
+    }
+
+private:
+    Task task;
+    bool succeeded = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ExportProgressWindow)
+};
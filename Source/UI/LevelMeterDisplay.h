@@ -0,0 +1,63 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Audio/LevelMeter.h"
+
+// Disegno dei meter di livello condiviso tra tracce e transport.
+// Legge solo gli atomici pubblicati dall'audio thread.
+namespace LevelMeterDisplay
+{
+    // Mappa un guadagno lineare su 0..1 (scala in dB da -60 a 0)
+    inline float gainToProportion(float gain)
+    {
+        const float db = juce::Decibels::gainToDecibels(gain, -60.0f);
+        return juce::jlimit(0.0f, 1.0f, (db + 60.0f) / 60.0f);
+    }
+
+    // Due barre verticali affiancate: RMS piena, picco come linea
+    inline void drawStereoMeter(juce::Graphics& g, juce::Rectangle<float> bounds,
+                                const LevelMeter& meter, juce::Colour colour)
+    {
+        const float barWidth = (bounds.getWidth() - 2.0f) / 2.0f;
+
+        for (int ch = 0; ch < LevelMeter::maxChannels; ++ch)
+        {
+            auto bar = bounds.withWidth(barWidth).withX(bounds.getX() + ch * (barWidth + 2.0f));
+
+            g.setColour(juce::Colour(0x20FFFFFF));
+            g.fillRoundedRectangle(bar, 1.5f);
+
+            const float rms = gainToProportion(meter.getRms(ch));
+            const float peak = meter.getPeak(ch);
+            const float peakY = bar.getBottom() - bar.getHeight() * gainToProportion(peak);
+
+            g.setColour(colour.withAlpha(0.8f));
+            g.fillRoundedRectangle(bar.withTop(bar.getBottom() - bar.getHeight() * rms), 1.5f);
+
+            g.setColour(peak >= 1.0f ? juce::Colour(0xFFE64E4E) : juce::Colours::white);
+            g.fillRect(bar.withTop(peakY).withHeight(1.5f));
+        }
+    }
+
+    // Due barre orizzontali sovrapposte (canale sinistro sopra, destro sotto)
+    inline void drawHorizontalStereoMeter(juce::Graphics& g, juce::Rectangle<float> bounds,
+                                          const LevelMeter& meter, juce::Colour colour)
+    {
+        const float barHeight = (bounds.getHeight() - 1.0f) / 2.0f;
+
+        for (int ch = 0; ch < LevelMeter::maxChannels; ++ch)
+        {
+            auto bar = bounds.withHeight(barHeight).withY(bounds.getY() + ch * (barHeight + 1.0f));
+
+            g.setColour(juce::Colour(0x20FFFFFF));
+            g.fillRect(bar);
+
+            const float peak = meter.getPeak(ch);
+            g.setColour(colour.withAlpha(0.8f));
+            g.fillRect(bar.withWidth(bar.getWidth() * gainToProportion(meter.getRms(ch))));
+
+            g.setColour(peak >= 1.0f ? juce::Colour(0xFFE64E4E) : juce::Colours::white);
+            g.fillRect(bar.withX(bar.getX() + bar.getWidth() * gainToProportion(peak) - 1.5f).withWidth(1.5f));
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Audio/AudioEngine.h"
+
+// Spettro e spettrogramma del segnale scelto nell'engine (master o una traccia).
+// Lo spettrogramma è un'immagine circolare: a ogni frame si copiano e si ridisegnano
+// solo le colonne nuove, con un cursore che scorre sopra quelle più vecchie.
+class SpectrumDisplay : public juce::Component,
+                        private juce::Timer
+{
+public:
+    explicit SpectrumDisplay(AudioEngine& engine)
+        : audioEngine(engine),
+          analyzer(engine.getSpectrumAnalyzer()),
+          spectrogram(juce::Image::ARGB, imageWidth, SpectrumAnalyzer::spectrogramHeight, true)
+    {
+        spectrogram.clear(spectrogram.getBounds(), juce::Colour(0xff10101b));
+        columnsDrawn = analyzer.getNumColumnsProduced();
+        setMouseCursor(juce::MouseCursor::PointingHandCursor);
+        startTimerHz(30);
+    }
+
+    ~SpectrumDisplay() override
+    {
+        stopTimer();
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        AW_TRACE_SCOPE("Spectrum repaint");
+        g.setColour(juce::Colour(0xff252537).withAlpha(0.5f));
+        g.fillRoundedRectangle(getLocalBounds().toFloat(), 10.0f);
+
+        // Spettrogramma: l'immagine viene scalata sull'area, il repaint è limitato alle colonne nuove
+        g.setImageResamplingQuality(juce::Graphics::lowResamplingQuality);
+        g.drawImage(spectrogram, spectrogramBounds.toFloat());
+
+        const float cursorX = columnToX(writeColumn);
+        g.setColour(juce::Colours::white.withAlpha(0.6f));
+        g.fillRect(juce::Rectangle<float>(cursorX, (float) spectrogramBounds.getY(), 1.0f, (float) spectrogramBounds.getHeight()));
+
+        drawSpectrum(g, spectrumBounds.toFloat());
+
+        g.setColour(juce::Colours::lightgrey);
+        g.setFont(juce::Font(14.0f).withStyle(juce::Font::bold));
+        const int source = audioEngine.getAnalyzerSource();
+        g.drawText(source == 0 ? "Master" : "Track " + juce::String(source),
+                   spectrumBounds.reduced(8, 4), juce::Justification::topLeft);
+    }
+
+    void resized() override
+    {
+        auto bounds = getLocalBounds().reduced(10);
+        spectrumBounds = bounds.removeFromLeft(bounds.getWidth() / 3);
+        bounds.removeFromLeft(10);
+        spectrogramBounds = bounds;
+    }
+
+    // Un click riporta l'analisi sull'uscita master
+    void mouseDown(const juce::MouseEvent&) override
+    {
+        audioEngine.setAnalyzerSource(0);
+        repaint();
+        if (onMasterSelected)
+            onMasterSelected();
+    }
+
+    std::function<void()> onMasterSelected;
+
+private:
+    static constexpr int imageWidth = 512;
+
+    void timerCallback() override
+    {
+        const auto produced = analyzer.getNumColumnsProduced();
+
+        // Se la UI resta indietro di un giro intero le colonne perse non servono più
+        if (produced - columnsDrawn > imageWidth)
+            columnsDrawn = produced - imageWidth;
+
+        const int firstColumn = writeColumn;
+        int columnsAdded = 0;
+
+        {
+            juce::Image::BitmapData pixels(spectrogram, juce::Image::BitmapData::writeOnly);
+            const int height = SpectrumAnalyzer::spectrogramHeight;
+
+            for (; columnsDrawn < produced; ++columnsDrawn, ++columnsAdded)
+            {
+                const auto* column = analyzer.getColumnPixels(columnsDrawn);
+                for (int row = 0; row < height; ++row)
+                    pixels.setPixelColour(writeColumn, height - 1 - row, juce::Colour(column[row]));
+
+                writeColumn = (writeColumn + 1) % imageWidth;
+            }
+        }
+
+        // Solo le colonne appena scritte (più il cursore) e la curva dello spettro
+        if (columnsAdded > 0)
+        {
+            repaintColumns(firstColumn, columnsAdded + 1);
+            repaint(spectrumBounds);
+        }
+    }
+
+    void repaintColumns(int first, int count)
+    {
+        const int end = first + count;
+        const int x1 = (int) std::floor(columnToX(first)) - 1;
+        const int x2 = (int) std::ceil(columnToX(juce::jmin(end, imageWidth))) + 1;
+        repaint(x1, spectrogramBounds.getY(), x2 - x1, spectrogramBounds.getHeight());
+
+        if (end > imageWidth)
+            repaintColumns(0, end - imageWidth);
+    }
+
+    float columnToX(int column) const
+    {
+        return (float) spectrogramBounds.getX() + (float) spectrogramBounds.getWidth() * (float) column / (float) imageWidth;
+    }
+
+    void drawSpectrum(juce::Graphics& g, juce::Rectangle<float> area) const
+    {
+        g.setColour(juce::Colour(0x20FFFFFF));
+        g.fillRect(area);
+
+        const double sampleRate = analyzer.getSampleRate();
+        const double binWidth = sampleRate / SpectrumAnalyzer::fftSize;
+        const int points = juce::jmax(2, (int) area.getWidth());
+
+        juce::Path curve;
+        for (int i = 0; i < points; ++i)
+        {
+            // Asse delle frequenze logaritmico, come lo spettrogramma
+            const int row = i * (SpectrumAnalyzer::spectrogramHeight - 1) / (points - 1);
+            const int bin = (int) (SpectrumAnalyzer::rowToFrequency(row, sampleRate) / binWidth);
+            const float db = analyzer.getBinLevelDb(bin);
+            const float y = area.getBottom() - area.getHeight() * juce::jlimit(0.0f, 1.0f, (db + 100.0f) / 100.0f);
+
+            if (i == 0)
+                curve.startNewSubPath(area.getX(), y);
+            else
+                curve.lineTo(area.getX() + (float) i, y);
+        }
+
+        g.setColour(juce::Colour(0xFFB84EE6));
+        g.strokePath(curve, juce::PathStrokeType(1.5f));
+    }
+
+    AudioEngine& audioEngine;
+    const SpectrumAnalyzer& analyzer;
+
+    juce::Image spectrogram;
+    juce::int64 columnsDrawn = 0;
+    int writeColumn = 0;
+
+    juce::Rectangle<int> spectrumBounds;
+    juce::Rectangle<int> spectrogramBounds;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumDisplay)
+};
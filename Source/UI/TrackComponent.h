@@ -3,6 +3,8 @@
 #include <JuceHeader.h>
 #include <vector> // Necessario per std::vector o juce::PathStrokeType::DashLengths
 #include "../Audio/AudioEngine.h"
+#include "../Session/SessionState.h"
+#include "LevelMeterDisplay.h"
 
 class TrackComponent : public juce::Component,
                        public juce::Timer
@@ -38,6 +40,8 @@ public:
         volumeLabel.setColour(juce::Label::textColourId, juce::Colours::lightgrey);
         addAndMakeVisible(volumeLabel);
 
+        configureButton(launchButton, juce::String(L"\u25B6"));
+        configureButton(recordArmButton, "R");
         configureButton(muteButton, "M");
         configureButton(soloButton, "S");
         // Ripristino testo originale se preferito
@@ -45,6 +49,31 @@ public:
         configureButton(deleteButton, "X");
 
         deleteButton.onClick = [this] { notifyRemoval(); };
+        recordArmButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour(0xFFE64E4E));
+        // Mute, solo e volume passano dalla sessione, così sono annullabili
+        muteButton.onClick = [this] {
+            listeners.call(&Listener::trackMuteToggled, this, muteButton.getToggleState());
+        };
+        soloButton.onClick = [this] {
+            listeners.call(&Listener::trackSoloToggled, this, soloButton.getToggleState());
+        };
+        // Durante il trascinamento il volume cambia subito; il passo di undo si registra al rilascio
+        volumeSlider.onValueChange = [this] {
+            audioEngine.setTrackGain(trackNumber, (float) volumeSlider.getValue());
+        };
+        volumeSlider.onDragEnd = [this] {
+            listeners.call(&Listener::trackGainChanged, this, (float) volumeSlider.getValue());
+        };
+        // Lancio e stop cadono sulla prossima battuta
+        launchButton.onClick = [this] {
+            if (audioEngine.isTrackLaunched(trackNumber))
+                audioEngine.stopTrack(trackNumber);
+            else
+                audioEngine.launchTrack(trackNumber);
+        };
+        recordArmButton.onClick = [this] {
+            audioEngine.setTrackRecordArmed(trackNumber, recordArmButton.getToggleState());
+        };
 
         startTimerHz(30);
         setMouseCursor(juce::MouseCursor::PointingHandCursor);
@@ -58,10 +87,17 @@ public:
     // --- Paint con UI originale e fix Dash ---
     void paint(juce::Graphics& g) override
     {
+        AW_TRACE_SCOPE("Track repaint");
         // Sfondo base della traccia
         g.setColour(juce::Colour(0xff252537).withAlpha(0.5f)); // Ripristino sfondo originale
         g.fillRoundedRectangle(getLocalBounds().toFloat(), 10.0f);
 
+        if (selected)
+        {
+            g.setColour(trackColour.withAlpha(0.7f));
+            g.drawRoundedRectangle(getLocalBounds().toFloat().reduced(1.0f), 10.0f, 2.0f);
+        }
+
         if (audioFile.existsAsFile())
         {
              // --- Area di progresso originale ---
@@ -94,6 +130,10 @@ public:
             g.setColour(juce::Colours::black);
             g.setFont(juce::Font(24.0f).withStyle(juce::Font::bold));
             g.drawText(juce::String(trackNumber), circleBounds, juce::Justification::centred);
+
+            // --- Meter di livello della traccia ---
+            if (meter != nullptr)
+                LevelMeterDisplay::drawStereoMeter(g, meterBounds.toFloat(), *meter, trackColour);
         }
         else
         {
@@ -127,6 +167,10 @@ public:
     {
         auto bounds = getLocalBounds().reduced(10);
 
+        // Meter di livello sul bordo destro
+        meterBounds = bounds.removeFromRight(12);
+        bounds.removeFromRight(5);
+
         // Area cerchio (spazio vuoto a sinistra)
         bounds.removeFromLeft(80);
 
@@ -147,7 +191,7 @@ public:
             volumeSlider.setBounds(volumeArea.withHeight(30).withY(bounds.getCentreY() - 15));
 
             // Pulsanti a destra
-            auto buttonArea = controlsArea.removeFromRight(200); // Stima larghezza area bottoni
+            auto buttonArea = controlsArea.removeFromRight(240); // Stima larghezza area bottoni
             int buttonWidth = 40;
             int buttonHeight = 30;
             int buttonY = bounds.getCentreY() - buttonHeight / 2;
@@ -157,6 +201,8 @@ public:
             eqButton.setBounds(buttonArea.removeFromRight(buttonWidth).reduced(buttonSpacing).withHeight(buttonHeight).withY(buttonY));
             soloButton.setBounds(buttonArea.removeFromRight(buttonWidth).reduced(buttonSpacing).withHeight(buttonHeight).withY(buttonY));
             muteButton.setBounds(buttonArea.removeFromRight(buttonWidth).reduced(buttonSpacing).withHeight(buttonHeight).withY(buttonY));
+            recordArmButton.setBounds(buttonArea.removeFromRight(buttonWidth).reduced(buttonSpacing).withHeight(buttonHeight).withY(buttonY));
+            launchButton.setBounds(buttonArea.removeFromRight(buttonWidth).reduced(buttonSpacing).withHeight(buttonHeight).withY(buttonY));
 
             // Rendi visibili i controlli se necessario (basato su isMouseOver)
             bool showControls = isMouseOver || true; // Modifica qui se vuoi controlli solo on hover
@@ -166,6 +212,8 @@ public:
             eqButton.setVisible(showControls);
             soloButton.setVisible(showControls);
             muteButton.setVisible(showControls);
+            recordArmButton.setVisible(showControls);
+            launchButton.setVisible(showControls);
         }
         /* else { // Opzionale: nascondi i controlli
              volumeLabel.setVisible(false);
@@ -192,12 +240,36 @@ public:
         // repaint(); // Potrebbe servire anche repaint se resized non basta
     }
 
+    // Un click sulla traccia la seleziona (es. come sorgente dell'analizzatore di spettro)
+    void mouseDown(const juce::MouseEvent&) override
+    {
+        listeners.call(&Listener::trackSelected, this);
+    }
+
+    void setSelected(bool shouldBeSelected)
+    {
+        if (selected != shouldBeSelected)
+        {
+            selected = shouldBeSelected;
+            repaint();
+        }
+    }
+
     void timerCallback() override
     {
+        launchButton.setToggleState(audioEngine.isTrackLaunched(trackNumber), juce::dontSendNotification);
+
+        // Il canale nasce con il primo audio della traccia e cambia se la traccia viene ricreata
+        meter = audioEngine.getTrackMeter(trackNumber);
+
         if (audioFile.existsAsFile())
         {
             repaint(); // Aggiorna la barra di progresso
         }
+        else if (meter != nullptr)
+        {
+            repaint(meterBounds); // Anche una traccia senza file (MIDI, registrata) ha il suo livello
+        }
     }
 
     bool loadFile(const juce::File& file)
@@ -232,6 +304,32 @@ public:
         return false;
     }
 
+    void clearFile()
+    {
+        audioFile = juce::File();
+        fileNameLabel.setText("No file loaded", juce::dontSendNotification);
+        fileInfoLabel.setText("", juce::dontSendNotification);
+        repaint();
+    }
+
+    // Allinea i controlli allo stato della sessione (dopo un edit, un undo o un redo)
+    void showState(const TrackState& state)
+    {
+        muteButton.setToggleState(state.muted, juce::dontSendNotification);
+        soloButton.setToggleState(state.soloed, juce::dontSendNotification);
+        volumeSlider.setValue(state.gain, juce::dontSendNotification);
+
+        if (const auto* clip = state.getFirstClip())
+        {
+            if (clip->file != audioFile)
+                loadFile(clip->file);
+        }
+        else if (audioFile != juce::File())
+        {
+            clearFile();
+        }
+    }
+
     juce::File getAudioFile() const { return audioFile; }
     int getTrackNumber() const { return trackNumber; }
 
@@ -240,6 +338,10 @@ public:
     public:
         virtual ~Listener() = default;
         virtual void trackRemovalRequested(TrackComponent* track) = 0;
+        virtual void trackMuteToggled(TrackComponent* track, bool muted) = 0;
+        virtual void trackSoloToggled(TrackComponent* track, bool soloed) = 0;
+        virtual void trackGainChanged(TrackComponent* track, float gain) = 0;
+        virtual void trackSelected(TrackComponent* track) = 0;
     };
     void addListener(Listener* listener) { listeners.add(listener); }
     void removeListener(Listener* listener) { listeners.remove(listener); }
@@ -255,7 +357,7 @@ private:
         button.setColour(juce::TextButton::buttonOnColourId, trackColour);             // Colore originale
         button.setColour(juce::TextButton::textColourOffId, juce::Colours::lightgrey);
         button.setColour(juce::TextButton::textColourOnId, juce::Colours::black);
-        button.setClickingTogglesState(text == "M" || text == "S");
+        button.setClickingTogglesState(text == "M" || text == "S" || text == "R");
         // Rimosso setConnectedEdges se non faceva parte dell'originale
         // button.setConnectedEdges(juce::Button::ConnectedEdgeFlags::ConnectedOnLeft | juce::Button::ConnectedEdgeFlags::ConnectedOnRight);
         addAndMakeVisible(button);
@@ -287,11 +389,16 @@ private:
     juce::File audioFile;
     juce::Colour trackColour;
     bool isMouseOver;
+    bool selected = false;
+    std::shared_ptr<const LevelMeter> meter;
+    juce::Rectangle<int> meterBounds;
 
     juce::Label fileNameLabel;
     juce::Label fileInfoLabel;
     juce::Slider volumeSlider;
     juce::Label volumeLabel;
+    juce::TextButton launchButton;
+    juce::TextButton recordArmButton;
     juce::TextButton muteButton;
     juce::TextButton soloButton;
     juce::TextButton eqButton;
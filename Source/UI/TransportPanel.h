@@ -2,8 +2,9 @@
 
 #include <JuceHeader.h>
 #include "../Audio/AudioEngine.h"
+#include "LevelMeterDisplay.h"
 
-class TransportPanel : public juce::Component, public AudioEngine::Listener
+class TransportPanel : public juce::Component, public AudioEngine::Listener, private juce::Timer
 {
 public:
     TransportPanel(AudioEngine& engine) : audioEngine(engine)
@@ -78,6 +79,23 @@ public:
                 audioEngine.play();
             }
             updatePlayButtonIcon(audioEngine.isPlaying());
+            updateRecordButton();
+        };
+
+        recordButton.setButtonText(juce::String(L"\u25CF"));
+        recordButton.setColour(juce::TextButton::buttonColourId, juce::Colour(0x30FFFFFF));
+        recordButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour(0xffE64E4E));
+        recordButton.setColour(juce::TextButton::textColourOffId, juce::Colour(0xffE64E4E));
+        recordButton.setClickingTogglesState(false);
+        addAndMakeVisible(recordButton);
+
+        recordButton.onClick = [this] {
+            if (audioEngine.isRecording())
+                audioEngine.stopRecording();
+            else
+                audioEngine.startRecording();
+            updateRecordButton();
+            updatePlayButtonIcon(audioEngine.isPlaying());
         };
 
         volumeSlider.setSliderStyle(juce::Slider::LinearHorizontal);
@@ -86,6 +104,10 @@ public:
         volumeSlider.setValue(0.8);
         volumeSlider.setColour(juce::Slider::trackColourId, juce::Colour(0xff4EE6B8));
         volumeSlider.setColour(juce::Slider::thumbColourId, juce::Colours::white);
+        volumeSlider.onValueChange = [this] {
+            audioEngine.setMasterGain((float) volumeSlider.getValue());
+        };
+        audioEngine.setMasterGain((float) volumeSlider.getValue());
         addAndMakeVisible(volumeSlider);
 
         // CORREZIONE: Sintassi Font moderna e stile 'plain'
@@ -95,16 +117,33 @@ public:
         volumeLabel.setJustificationType(juce::Justification::centredTop);
         addAndMakeVisible(volumeLabel);
 
+        loudnessLabel.setFont(juce::Font("Poppins", 11.0f, juce::Font::plain));
+        loudnessLabel.setColour(juce::Label::textColourId, juce::Colours::lightgrey);
+        loudnessLabel.setJustificationType(juce::Justification::centred);
+        loudnessLabel.setTooltip("Loudness EBU R128: short-term / integrated (doppio click per azzerare)");
+        loudnessLabel.addMouseListener(this, false);
+        addAndMakeVisible(loudnessLabel);
+
+        // Posizione musicale (battuta.battito), la stessa griglia usata per i lanci quantizzati
+        positionLabel.setFont(juce::Font("Poppins", 16.0f, juce::Font::plain));
+        positionLabel.setColour(juce::Label::textColourId, juce::Colours::lightgrey);
+        positionLabel.setColour(juce::Label::backgroundColourId, juce::Colour(0x20FFFFFF));
+        positionLabel.setJustificationType(juce::Justification::centred);
+        addAndMakeVisible(positionLabel);
+
         saveButton.setButtonText("SAVE");
         saveButton.setColour(juce::TextButton::buttonColourId, juce::Colour(0xff4EE6B8));
         saveButton.setColour(juce::TextButton::textColourOffId, juce::Colour(0xff161626));
         // CORREZIONE: Rimuovi setCornerRadius
         // saveButton.setCornerRadius(5.f);
         addAndMakeVisible(saveButton);
+
+        startTimerHz(30);
     }
 
      ~TransportPanel() override
      {
+         stopTimer();
          audioEngine.removeListener(this);
      }
 
@@ -113,6 +152,15 @@ public:
         g.fillAll(juce::Colour(0xff1C1C2E));
         g.setColour(juce::Colours::black.withAlpha(0.3f));
         g.drawLine(0.0f, (float)getHeight() - 1.0f, (float)getWidth(), (float)getHeight() - 1.0f, 1.0f);
+
+        LevelMeterDisplay::drawHorizontalStereoMeter(g, masterMeterBounds.toFloat(),
+                                                     audioEngine.getMasterMeter(), juce::Colour(0xff4EE6B8));
+    }
+
+    void mouseDoubleClick(const juce::MouseEvent& event) override
+    {
+        if (event.eventComponent == &loudnessLabel)
+            audioEngine.resetIntegratedLoudness();
     }
 
     void resized() override
@@ -137,14 +185,23 @@ public:
         bounds.removeFromLeft(spacing + 10);
 
         playButton.setBounds(bounds.removeFromLeft(40).withSizeKeepingCentre(40, 40));
-        bounds.removeFromLeft(spacing + 10);
+        bounds.removeFromLeft(smallSpacing * 2);
+        recordButton.setBounds(bounds.removeFromLeft(40).withSizeKeepingCentre(40, 40));
+        bounds.removeFromLeft(spacing);
+
+        positionLabel.setBounds(bounds.removeFromLeft(70).withSizeKeepingCentre(70, 30));
+        bounds.removeFromLeft(spacing);
 
         saveButton.setBounds(bounds.removeFromRight(100));
         bounds.removeFromRight(spacing);
 
+        loudnessLabel.setBounds(bounds.removeFromRight(120));
+        bounds.removeFromRight(smallSpacing);
+
         auto volumeArea = bounds;
         volumeLabel.setBounds(volumeArea.removeFromBottom(15));
         volumeArea.removeFromBottom(smallSpacing);
+        masterMeterBounds = volumeArea.removeFromBottom(7);
         volumeSlider.setBounds(volumeArea);
     }
 
@@ -165,7 +222,30 @@ public:
         playButton.setToggleState(engineIsPlaying, juce::dontSendNotification);
     }
 
+    void updateRecordButton()
+    {
+        recordButton.setToggleState(audioEngine.isRecording(), juce::dontSendNotification);
+    }
+
 private:
+    void timerCallback() override
+    {
+        auto formatLufs = [](float lufs) {
+            return std::isfinite(lufs) ? juce::String(lufs, 1) : juce::String("-inf");
+        };
+
+        const auto& loudness = audioEngine.getMasterLoudness();
+        loudnessLabel.setText("ST " + formatLufs(loudness.getShortTermLufs())
+                                  + "  INT " + formatLufs(loudness.getIntegratedLufs()) + " LUFS",
+                              juce::dontSendNotification);
+        repaint(masterMeterBounds);
+
+        const int beatsPerBar = audioEngine.getBeatsPerBar();
+        const auto beat = (juce::int64) audioEngine.getBeatPosition();
+        positionLabel.setText(juce::String(beat / beatsPerBar + 1) + "." + juce::String(beat % beatsPerBar + 1),
+                              juce::dontSendNotification);
+    }
+
     AudioEngine& audioEngine;
 
     juce::Label projectNameLabel;
@@ -174,8 +254,12 @@ private:
     juce::Label keyEditor;
     juce::Label keyLabel;
     juce::TextButton playButton;
+    juce::TextButton recordButton;
     juce::Slider volumeSlider;
     juce::Label volumeLabel;
+    juce::Label loudnessLabel;
+    juce::Label positionLabel;
+    juce::Rectangle<int> masterMeterBounds;
     juce::TextButton saveButton;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TransportPanel)